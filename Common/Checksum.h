@@ -0,0 +1,11 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// CRC-32 (IEEE), used to detect torn or corrupt records in journal files.
+// Pass the previous result as crc to checksum data in pieces.
+uint32_t Crc32(const void* data, size_t size, uint32_t crc = 0);
+
+// 64-bit xxHash (XXH64). Not cryptographic; for content hashes where a
+// collision only costs a missed difference with negligible probability.
+uint64_t Hash64(const void* data, size_t size, uint64_t seed = 0);
@@ -0,0 +1,353 @@
+#include "CommandGraph.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include "Trace.h"
+
+bool CommandGraphResult::Succeeded() const
+{
+    return std::all_of(nodes.begin(), nodes.end(),
+                       [](const CommandNodeResult& node) { return node.state == CommandNodeResult::SUCCEEDED; });
+}
+
+// Dependencies, piped inputs and dependents as node indices, plus an order
+// in which every node comes after what it depends on
+struct CommandEdges
+{
+    std::vector<std::vector<size_t>> dependencies;
+    std::vector<std::vector<size_t>> inputs;
+    std::vector<std::vector<size_t>> dependents;
+    std::vector<size_t> order;
+};
+
+static bool ResolveEdges(const std::vector<CommandNode>& nodes, CommandEdges& edges, std::string& error)
+{
+    std::unordered_map<std::string, size_t> indexOf;
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        if (nodes[i].name.empty())
+        {
+            error = "Command #" + std::to_string(i + 1) + " has no name";
+            return false;
+        }
+        if (!indexOf.emplace(nodes[i].name, i).second)
+        {
+            error = "Command name '" + nodes[i].name + "' is used twice";
+            return false;
+        }
+    }
+
+    edges.dependencies.assign(nodes.size(), {});
+    edges.inputs.assign(nodes.size(), {});
+    edges.dependents.assign(nodes.size(), {});
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        auto resolve = [&](const std::string& name, size_t& index)
+        {
+            auto found = indexOf.find(name);
+            if (found == indexOf.end())
+            {
+                error = "'" + nodes[i].name + "' depends on unknown command '" + name + "'";
+                return false;
+            }
+            index = found->second;
+            return true;
+        };
+        std::vector<size_t>& dependencies = edges.dependencies[i];
+        for (const std::string& name : nodes[i].inputFrom)
+        {
+            size_t index;
+            if (!resolve(name, index))
+            {
+                return false;
+            }
+            edges.inputs[i].push_back(index);
+            dependencies.push_back(index);
+        }
+        for (const std::string& name : nodes[i].dependsOn)
+        {
+            size_t index;
+            if (!resolve(name, index))
+            {
+                return false;
+            }
+            dependencies.push_back(index);
+        }
+        std::sort(dependencies.begin(), dependencies.end());
+        dependencies.erase(std::unique(dependencies.begin(), dependencies.end()), dependencies.end());
+        for (size_t dependency : dependencies)
+        {
+            edges.dependents[dependency].push_back(i);
+        }
+    }
+
+    // Kahn's algorithm; whatever it cannot reach is on or behind a cycle
+    std::vector<size_t> waiting(nodes.size());
+    edges.order.clear();
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        waiting[i] = edges.dependencies[i].size();
+        if (waiting[i] == 0)
+        {
+            edges.order.push_back(i);
+        }
+    }
+    for (size_t at = 0; at < edges.order.size(); ++at)
+    {
+        for (size_t dependent : edges.dependents[edges.order[at]])
+        {
+            if (--waiting[dependent] == 0)
+            {
+                edges.order.push_back(dependent);
+            }
+        }
+    }
+    if (edges.order.size() != nodes.size())
+    {
+        // Follow unresolved dependencies until one repeats: that one is on the cycle
+        size_t node = 0;
+        while (waiting[node] == 0)
+        {
+            ++node;
+        }
+        std::vector<bool> seen(nodes.size(), false);
+        while (!seen[node])
+        {
+            seen[node] = true;
+            for (size_t dependency : edges.dependencies[node])
+            {
+                if (waiting[dependency] != 0)
+                {
+                    node = dependency;
+                    break;
+                }
+            }
+        }
+        error = "Commands depend on each other in a cycle through '" + nodes[node].name + "'";
+        return false;
+    }
+    return true;
+}
+
+// Shared by the workers; everything is guarded by mutex
+struct GraphRun
+{
+    const std::vector<CommandNode>& nodes;
+    const CommandEdges& edges;
+    CommandGraphResult& result;
+    std::chrono::steady_clock::time_point start;
+    int totalTimeout;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<size_t> ready;
+    std::vector<size_t> waiting; // Dependencies that have not succeeded yet
+    std::vector<bool> settled;
+    size_t settledCount = 0;
+
+    GraphRun(const std::vector<CommandNode>& nodes, const CommandEdges& edges, CommandGraphResult& result, int totalTimeout)
+        : nodes(nodes), edges(edges), result(result), start(std::chrono::steady_clock::now()), totalTimeout(totalTimeout),
+          waiting(nodes.size()), settled(nodes.size(), false)
+    {
+        for (size_t i = 0; i < nodes.size(); ++i)
+        {
+            waiting[i] = edges.dependencies[i].size();
+            if (waiting[i] == 0)
+            {
+                ready.push_back(i);
+            }
+        }
+    }
+
+    double Now() const
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Releases the dependents of a node that succeeded, or cancels every node
+    // downstream of one that did not
+    void Settle(size_t node)
+    {
+        settled[node] = true;
+        ++settledCount;
+        if (result.nodes[node].state == CommandNodeResult::SUCCEEDED)
+        {
+            for (size_t dependent : edges.dependents[node])
+            {
+                if (--waiting[dependent] == 0)
+                {
+                    ready.push_back(dependent);
+                }
+            }
+        }
+        else
+        {
+            std::vector<size_t> pending(edges.dependents[node]);
+            while (!pending.empty())
+            {
+                size_t dependent = pending.back();
+                pending.pop_back();
+                if (settled[dependent])
+                {
+                    continue;
+                }
+                settled[dependent] = true;
+                ++settledCount;
+                result.nodes[dependent].state = CommandNodeResult::CANCELLED;
+                pending.insert(pending.end(), edges.dependents[dependent].begin(), edges.dependents[dependent].end());
+            }
+        }
+        changed.notify_all();
+    }
+
+    void Work()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            changed.wait(lock, [this] { return !ready.empty() || settledCount == nodes.size(); });
+            if (ready.empty())
+            {
+                return;
+            }
+            size_t node = ready.front();
+            ready.pop_front();
+            CommandNodeResult& nodeResult = result.nodes[node];
+
+            // The per-command timeout, cut short by the batch deadline
+            int timeout = nodes[node].timeout;
+            if (totalTimeout >= 0)
+            {
+                int remaining = totalTimeout - static_cast<int>(Now());
+                if (remaining <= 0)
+                {
+                    nodeResult.state = CommandNodeResult::CANCELLED;
+                    Settle(node);
+                    continue;
+                }
+                timeout = timeout < 0 ? remaining : (std::min)(timeout, remaining);
+            }
+            std::string input;
+            for (size_t from : edges.inputs[node])
+            {
+                input += result.nodes[from].result.output;
+            }
+
+            lock.unlock();
+            double startMs = Now();
+            CommandResult commandResult = RunCommand(nodes[node].command, input, timeout);
+            double endMs = Now();
+            lock.lock();
+
+            nodeResult.result = std::move(commandResult);
+            nodeResult.startMs = startMs;
+            nodeResult.endMs = endMs;
+            nodeResult.state = nodeResult.result.Succeeded() ? CommandNodeResult::SUCCEEDED
+                             : nodeResult.result.status == CommandResult::TIMED_OUT ? CommandNodeResult::TIMED_OUT
+                             : CommandNodeResult::FAILED;
+            Settle(node);
+        }
+    }
+};
+
+bool RunCommandGraph(const std::vector<CommandNode>& nodes, const CommandGraphOptions& options,
+                     CommandGraphResult& result, std::string& error)
+{
+    LY_TRACE_FUNCTION("process");
+    result = CommandGraphResult();
+    CommandEdges edges;
+    if (!ResolveEdges(nodes, edges, error))
+    {
+        return false;
+    }
+    result.nodes.assign(nodes.size(), CommandNodeResult());
+
+    GraphRun run(nodes, edges, result, options.totalTimeout);
+
+    size_t workerCount = (std::min)(nodes.size(), static_cast<size_t>((std::max)(options.maxParallel, 1)));
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < workerCount; ++i)
+    {
+        workers.emplace_back([&run, i]
+        {
+            if (Trace::Enabled())
+            {
+                Trace::SetThreadName("Command worker " + std::to_string(i + 1));
+            }
+            run.Work();
+        });
+    }
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+    result.elapsedMs = run.Now();
+
+    // Longest chain by run time, walked in dependency order
+    std::vector<double> chainMs(nodes.size(), 0);
+    std::vector<size_t> previous(nodes.size(), nodes.size());
+    size_t last = nodes.size();
+    for (size_t node : edges.order)
+    {
+        const CommandNodeResult& nodeResult = result.nodes[node];
+        double ms = nodeResult.endMs - nodeResult.startMs;
+        result.commandMs += ms;
+        for (size_t dependency : edges.dependencies[node])
+        {
+            if (previous[node] == nodes.size() || chainMs[dependency] > chainMs[previous[node]])
+            {
+                previous[node] = dependency;
+            }
+        }
+        chainMs[node] = ms + (previous[node] != nodes.size() ? chainMs[previous[node]] : 0);
+        if (last == nodes.size() || chainMs[node] > chainMs[last])
+        {
+            last = node;
+        }
+    }
+    for (size_t node = last; node != nodes.size(); node = previous[node])
+    {
+        result.criticalPath.push_back(nodes[node].name);
+    }
+    std::reverse(result.criticalPath.begin(), result.criticalPath.end());
+    result.criticalPathMs = last != nodes.size() ? chainMs[last] : 0;
+    return true;
+}
+
+std::string FormatCommandGraphResult(const std::vector<CommandNode>& nodes, const CommandGraphResult& result)
+{
+    static const char* const STATES[] = { "succeeded", "failed", "timed out", "cancelled" };
+    std::ostringstream text;
+    for (size_t i = 0; i < nodes.size() && i < result.nodes.size(); ++i)
+    {
+        const CommandNodeResult& node = result.nodes[i];
+        text << ">> [" << nodes[i].name << "] " << STATES[node.state];
+        if (node.state == CommandNodeResult::FAILED && node.result.status == CommandResult::EXITED)
+        {
+            text << " with exit code " << node.result.exitCode;
+        }
+        if (node.state != CommandNodeResult::CANCELLED)
+        {
+            text << " after " << static_cast<long long>(node.endMs - node.startMs) << " ms";
+        }
+        text << ": " << nodes[i].command << "\n";
+        if (node.state != CommandNodeResult::CANCELLED)
+        {
+            text << node.result.output << "\n";
+        }
+    }
+    text << ">> " << static_cast<long long>(result.elapsedMs) << " ms in all, critical path "
+         << static_cast<long long>(result.criticalPathMs) << " ms";
+    for (size_t i = 0; i < result.criticalPath.size(); ++i)
+    {
+        text << (i == 0 ? " (" : " -> ") << result.criticalPath[i];
+    }
+    text << (result.criticalPath.empty() ? "" : ")") << ", " << static_cast<long long>(result.commandMs)
+         << " ms of commands\n";
+    return text.str();
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "CommandRunner.h"
+
+// Commands that depend on each other, run with RunCommand as soon as what
+// they depend on has succeeded, several at a time. The batch takes about as
+// long as its slowest chain of dependencies instead of the sum of them all.
+
+struct CommandNode
+{
+    std::string name; // Unique; what dependsOn and inputFrom refer to
+    std::string command;
+    std::vector<std::string> dependsOn;
+    std::vector<std::string> inputFrom; // Outputs piped to stdin in this order; dependencies too
+    int timeout = -1;                   // Milliseconds, negative for none
+};
+
+struct CommandGraphOptions
+{
+    int maxParallel = 4;
+    int totalTimeout = -1; // One deadline for the whole batch, as in RunMultipleCommands
+};
+
+struct CommandNodeResult
+{
+    enum State
+    {
+        SUCCEEDED,
+        FAILED,    // Could not start, or exited with a code other than 0
+        TIMED_OUT, // Its own timeout or the batch deadline
+        CANCELLED, // Not run: something it depends on did not succeed, or the deadline had passed
+    };
+
+    State state = CANCELLED;
+    CommandResult result;
+    double startMs = 0; // From the start of the batch
+    double endMs = 0;
+};
+
+struct CommandGraphResult
+{
+    std::vector<CommandNodeResult> nodes; // In the order of the nodes given
+    double elapsedMs = 0;
+    double commandMs = 0;                   // Sum of every run, what running them in order would cost
+    double criticalPathMs = 0;              // Slowest chain of dependencies, by how long each run took
+    std::vector<std::string> criticalPath;  // Its nodes, first to last
+
+    bool Succeeded() const;
+};
+
+// False with the reason in error when a name is empty or repeated, a
+// dependency is unknown or the dependencies form a cycle; nothing runs then.
+// A node that fails or times out cancels everything downstream of it;
+// independent nodes carry on.
+bool RunCommandGraph(const std::vector<CommandNode>& nodes, const CommandGraphOptions& options,
+                     CommandGraphResult& result, std::string& error);
+
+// One line per node in the style of RunMultipleCommands, then the timings
+std::string FormatCommandGraphResult(const std::vector<CommandNode>& nodes, const CommandGraphResult& result);
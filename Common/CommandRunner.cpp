@@ -0,0 +1,612 @@
+#include "CommandRunner.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include "Json.h"
+#include "Metrics.h"
+#include "Trace.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+#endif
+
+// Exported with Metrics::PrometheusText; durations in nanoseconds
+struct CommandMetrics
+{
+    Metrics::Counter& runs = Metrics::GetCounter("command_runs_total", "", "Commands started");
+    Metrics::Counter& errors = Metrics::GetCounter("command_errors_total", "", "Commands that could not be started");
+    Metrics::Counter& timeouts = Metrics::GetCounter("command_timeouts_total", "", "Commands killed at their timeout");
+    Metrics::Histogram& spawn = Metrics::GetHistogram("command_spawn_duration_seconds", "", "Time spent starting the process", 1e-9);
+    Metrics::Histogram& run = Metrics::GetHistogram("command_run_duration_seconds", "", "Time from start until exit or timeout", 1e-9);
+    Metrics::Histogram& output = Metrics::GetHistogram("command_output_bytes", "", "Output captured per command");
+};
+
+static uint64_t NanosecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+#ifdef _WIN32
+static std::string EscapeCommandForPowerShell(const std::string& raw)
+{
+    std::ostringstream oss;
+    for (char ch : raw)
+    {
+        if (ch == '"') oss << '\\';  // Escape quote for cmd line
+        oss << ch;
+    }
+    return oss.str();
+}
+
+// Pipe ends are inheritable only while this is held, so a process started by
+// another thread cannot pick up ours and keep them open after we finish
+static std::mutex g_spawnMutex;
+
+// Large enough that a command writing fast does not stall between our polls
+static const DWORD OUTPUT_PIPE_SIZE = 1 << 20;
+
+CommandResult RunCommand(const std::string& command, const std::string& input, int timeout,
+                         const std::function<void(std::string_view)>& onOutput)
+{
+    LY_TRACE_FUNCTION("process");
+    static CommandMetrics metrics;
+    CommandResult result;
+    HANDLE hRead = NULL, hWrite = NULL;
+    HANDLE hErrorRead = NULL, hErrorWrite = NULL;
+    HANDLE hInputRead = NULL, hInputWrite = NULL;
+
+    if (!CreatePipe(&hRead, &hWrite, NULL, OUTPUT_PIPE_SIZE))
+    {
+        metrics.errors.Add();
+        result.output = "ERROR: Cannot create pipe.";
+        return result;
+    }
+    if ((onOutput && !CreatePipe(&hErrorRead, &hErrorWrite, NULL, 0)) ||
+        (!input.empty() && !CreatePipe(&hInputRead, &hInputWrite, NULL, 0)))
+    {
+        metrics.errors.Add();
+        CloseHandle(hRead);
+        CloseHandle(hWrite);
+        if (hErrorRead)
+        {
+            CloseHandle(hErrorRead);
+            CloseHandle(hErrorWrite);
+        }
+        result.output = "ERROR: Cannot create pipe.";
+        return result;
+    }
+
+    std::string escapedCommand = EscapeCommandForPowerShell(command);
+    std::string cmdLineStr = "powershell.exe -NoProfile -ExecutionPolicy Bypass -Command \"" + escapedCommand + "\"";
+
+    std::vector<char> cmdLine(cmdLineStr.begin(), cmdLineStr.end());
+    cmdLine.push_back('\0'); // Ensure null-termination
+
+    STARTUPINFOA si = {};
+    si.cb = sizeof(si);
+    si.dwFlags = STARTF_USESTDHANDLES;
+    si.hStdOutput = hWrite;
+    si.hStdError = hErrorWrite ? hErrorWrite : hWrite;
+    si.hStdInput = hInputRead;
+
+    // The job plays the part of the POSIX process group: a timeout kills the
+    // whole tree, not just PowerShell. The command starts suspended so nothing
+    // it starts can get out before it is in the job.
+    HANDLE hJob = CreateJobObjectA(NULL, NULL);
+
+    PROCESS_INFORMATION pi = {};
+    auto start = std::chrono::steady_clock::now();
+    BOOL success;
+    {
+        std::lock_guard<std::mutex> lock(g_spawnMutex);
+        SetHandleInformation(hWrite, HANDLE_FLAG_INHERIT, HANDLE_FLAG_INHERIT);
+        if (hErrorWrite)
+            SetHandleInformation(hErrorWrite, HANDLE_FLAG_INHERIT, HANDLE_FLAG_INHERIT);
+        if (hInputRead)
+            SetHandleInformation(hInputRead, HANDLE_FLAG_INHERIT, HANDLE_FLAG_INHERIT);
+        success = CreateProcessA(NULL, cmdLine.data(), NULL, NULL, TRUE, CREATE_NO_WINDOW | CREATE_SUSPENDED, NULL, NULL,
+                                 &si, &pi);
+        CloseHandle(hWrite);
+        if (hErrorWrite)
+            CloseHandle(hErrorWrite);
+        if (hInputRead)
+            CloseHandle(hInputRead);
+    }
+
+    if (success)
+    {
+        if (hJob && !AssignProcessToJobObject(hJob, pi.hProcess))
+        {
+            CloseHandle(hJob); // Falls back to ending PowerShell alone
+            hJob = NULL;
+        }
+        ResumeThread(pi.hThread);
+    }
+
+    metrics.spawn.Record(NanosecondsSince(start));
+
+    if (!success)
+    {
+        metrics.errors.Add();
+        if (hJob)
+            CloseHandle(hJob);
+        CloseHandle(hRead);
+        if (hErrorRead)
+            CloseHandle(hErrorRead);
+        if (hInputWrite)
+            CloseHandle(hInputWrite);
+        result.output = "ERROR: Cannot create process.";
+        return result;
+    }
+    metrics.runs.Add();
+
+    // Fed from its own thread so a command that writes before it reads cannot deadlock us
+    std::thread feeder;
+    std::atomic<bool> fed{ false };
+    if (hInputWrite)
+    {
+        feeder = std::thread([hInputWrite, &input, &fed]
+        {
+            DWORD written = 0;
+            for (size_t at = 0; at < input.size(); at += written)
+            {
+                DWORD chunk = static_cast<DWORD>((std::min)(input.size() - at, size_t(1) << 20));
+                if (!WriteFile(hInputWrite, input.data() + at, chunk, &written, NULL))
+                    break; // The command exited without reading it all
+            }
+            CloseHandle(hInputWrite);
+            fed = true;
+        });
+    }
+    // Something outside the job may still hold stdin open after the command
+    // is gone; break the feeder out of WriteFile, again if it was between two
+    // writes, so joining it cannot hang
+    auto stopFeeder = [&]
+    {
+        while (feeder.joinable() && !fed)
+        {
+            CancelSynchronousIo(feeder.native_handle());
+            Sleep(1);
+        }
+        if (feeder.joinable())
+            feeder.join();
+    };
+
+    std::string& output = result.output;
+    std::vector<char> buffer(1 << 16);
+    size_t outputSize = 0;
+    auto deliver = [&](HANDLE pipe, DWORD bytes)
+    {
+        outputSize += bytes;
+        if (pipe == hRead && onOutput)
+            onOutput(std::string_view(buffer.data(), bytes));
+        else
+            output.append(buffer.data(), bytes);
+    };
+    // Reads whatever the pipe holds now; false if it held nothing
+    auto drain = [&](HANDLE pipe)
+    {
+        bool readSome = false;
+        DWORD bytesAvailable = 0, bytesRead = 0;
+        while (pipe && PeekNamedPipe(pipe, NULL, 0, NULL, &bytesAvailable, NULL) && bytesAvailable > 0 &&
+               ReadFile(pipe, buffer.data(), static_cast<DWORD>(buffer.size()), &bytesRead, NULL) && bytesRead > 0)
+        {
+            deliver(pipe, bytesRead);
+            readSome = true;
+        }
+        return readSome;
+    };
+    const DWORD sleepStep = 10;
+
+    while (true)
+    {
+        bool readSome = drain(hRead);
+        readSome |= drain(hErrorRead);
+
+        DWORD waitResult = WaitForSingleObject(pi.hProcess, 0);
+        if (waitResult == WAIT_OBJECT_0)
+            break;
+
+        if (timeout >= 0 && NanosecondsSince(start) >= static_cast<uint64_t>(timeout) * 1000000)
+        {
+            if (hJob)
+                TerminateJobObject(hJob, 1);
+            else
+                TerminateProcess(pi.hProcess, 1);
+            stopFeeder();
+            metrics.timeouts.Add();
+            metrics.run.Record(NanosecondsSince(start));
+            metrics.output.Record(outputSize);
+            CloseHandle(pi.hThread);
+            CloseHandle(pi.hProcess);
+            if (hJob)
+                CloseHandle(hJob);
+            CloseHandle(hRead);
+            if (hErrorRead)
+                CloseHandle(hErrorRead);
+            result.status = CommandResult::TIMED_OUT;
+            return result;
+        }
+
+        if (!readSome)
+            Sleep(sleepStep);
+    }
+
+    // Final flush
+    for (HANDLE pipe : { hRead, hErrorRead })
+    {
+        DWORD bytesRead = 0;
+        while (pipe && ReadFile(pipe, buffer.data(), static_cast<DWORD>(buffer.size()), &bytesRead, NULL) && bytesRead > 0)
+        {
+            deliver(pipe, bytesRead);
+        }
+    }
+    // The command exited, possibly without reading all of its input
+    stopFeeder();
+
+    DWORD exitCode = 0;
+    GetExitCodeProcess(pi.hProcess, &exitCode);
+    result.status = CommandResult::EXITED;
+    result.exitCode = static_cast<int>(exitCode);
+
+    metrics.run.Record(NanosecondsSince(start));
+    metrics.output.Record(outputSize);
+
+    CloseHandle(pi.hThread);
+    CloseHandle(pi.hProcess);
+    if (hJob)
+        CloseHandle(hJob);
+    CloseHandle(hRead);
+    if (hErrorRead)
+        CloseHandle(hErrorRead);
+
+    return result;
+}
+#else
+// Milliseconds left before the timeout, rounded up; -1 without a timeout
+static int RemainingMs(std::chrono::steady_clock::time_point start, int timeout)
+{
+    if (timeout < 0)
+    {
+        return -1;
+    }
+    auto left = start + std::chrono::milliseconds(timeout) - std::chrono::steady_clock::now();
+    auto ms = std::chrono::ceil<std::chrono::milliseconds>(left).count();
+    return ms > 0 ? static_cast<int>(ms) : 0;
+}
+
+// Both ends close on exec, so a command started by another thread cannot
+// inherit ours and hold the pipe open after its own command has finished
+static int OpenPipe(int ends[2])
+{
+#ifdef __linux__
+    return pipe2(ends, O_CLOEXEC);
+#else
+    if (pipe(ends) != 0)
+    {
+        return -1;
+    }
+    fcntl(ends[0], F_SETFD, FD_CLOEXEC);
+    fcntl(ends[1], F_SETFD, FD_CLOEXEC);
+    return 0;
+#endif
+}
+
+// write() without SIGPIPE: a command that exits before reading its input
+// must not take the whole process down with it
+static ssize_t WriteNoSignal(int fd, const char* data, size_t size)
+{
+    sigset_t pipeSignal, previous;
+    sigemptyset(&pipeSignal);
+    sigaddset(&pipeSignal, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipeSignal, &previous);
+    ssize_t written = write(fd, data, size);
+    int error = errno;
+    if (written < 0 && error == EPIPE)
+    {
+        timespec none = { 0, 0 };
+        sigtimedwait(&pipeSignal, nullptr, &none); // Take the signal raised for this thread
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+    errno = error;
+    return written;
+}
+
+// The shell gets its own process group so a timeout kills whatever it started too
+CommandResult RunCommand(const std::string& command, const std::string& input, int timeout,
+                         const std::function<void(std::string_view)>& onOutput)
+{
+    LY_TRACE_FUNCTION("process");
+    static CommandMetrics metrics;
+    CommandResult result;
+    int pipeEnds[2];
+    int errorEnds[2] = { -1, -1 };
+    int inputEnds[2] = { -1, -1 };
+    if (OpenPipe(pipeEnds) != 0)
+    {
+        metrics.errors.Add();
+        result.output = "ERROR: Cannot create pipe.";
+        return result;
+    }
+    if ((onOutput && OpenPipe(errorEnds) != 0) || (!input.empty() && OpenPipe(inputEnds) != 0))
+    {
+        metrics.errors.Add();
+        for (int fd : { pipeEnds[0], pipeEnds[1], errorEnds[0], errorEnds[1] })
+        {
+            if (fd != -1)
+            {
+                close(fd);
+            }
+        }
+        result.output = "ERROR: Cannot create pipe.";
+        return result;
+    }
+    int readEnd = pipeEnds[0], writeEnd = pipeEnds[1];
+    int errorEnd = errorEnds[0];
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (inputEnds[0] != -1)
+    {
+        posix_spawn_file_actions_adddup2(&actions, inputEnds[0], 0);
+    }
+    else
+    {
+        posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+    }
+    posix_spawn_file_actions_adddup2(&actions, writeEnd, 1);
+    posix_spawn_file_actions_adddup2(&actions, errorEnds[1] != -1 ? errorEnds[1] : writeEnd, 2);
+    posix_spawnattr_t attributes;
+    posix_spawnattr_init(&attributes);
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP);
+    posix_spawnattr_setpgroup(&attributes, 0);
+
+    const char* argv[] = { "/bin/sh", "-c", command.c_str(), nullptr };
+    pid_t pid = 0;
+    auto start = std::chrono::steady_clock::now();
+    int spawned = posix_spawn(&pid, "/bin/sh", &actions, &attributes, const_cast<char* const*>(argv), environ);
+
+    metrics.spawn.Record(NanosecondsSince(start));
+
+    posix_spawnattr_destroy(&attributes);
+    posix_spawn_file_actions_destroy(&actions);
+    close(writeEnd);
+    if (errorEnds[1] != -1)
+    {
+        close(errorEnds[1]);
+    }
+    int inputEnd = inputEnds[1];
+    if (inputEnds[0] != -1)
+    {
+        close(inputEnds[0]);
+        fcntl(inputEnd, F_SETFL, fcntl(inputEnd, F_GETFL) | O_NONBLOCK);
+    }
+
+    if (spawned != 0)
+    {
+        metrics.errors.Add();
+        close(readEnd);
+        if (errorEnd != -1)
+        {
+            close(errorEnd);
+        }
+        if (inputEnd != -1)
+        {
+            close(inputEnd);
+        }
+        result.output = "ERROR: Cannot create process.";
+        return result;
+    }
+    metrics.runs.Add();
+
+    // Output is read and input written as each becomes ready, so neither side
+    // waits on the other whatever the command does first
+    std::string& output = result.output;
+    std::vector<char> buffer(1 << 16);
+    size_t outputSize = 0;
+    size_t inputWritten = 0;
+    bool timedOut = false;
+    while (readEnd != -1 || errorEnd != -1)
+    {
+        int wait = RemainingMs(start, timeout);
+        if (wait == 0)
+        {
+            timedOut = true;
+            break;
+        }
+        // poll skips the entries whose descriptor is -1
+        pollfd ready[3] = { { readEnd, POLLIN, 0 }, { errorEnd, POLLIN, 0 }, { inputEnd, POLLOUT, 0 } };
+        int count = poll(ready, 3, wait);
+        if (count < 0 && errno != EINTR)
+        {
+            break;
+        }
+        if (count <= 0)
+        {
+            continue;
+        }
+        if (inputEnd != -1 && ready[2].revents != 0)
+        {
+            ssize_t bytes = WriteNoSignal(inputEnd, input.data() + inputWritten, input.size() - inputWritten);
+            if (bytes > 0)
+            {
+                inputWritten += static_cast<size_t>(bytes);
+            }
+            if (inputWritten == input.size() || (bytes < 0 && errno != EAGAIN && errno != EINTR))
+            {
+                close(inputEnd); // All of it, or the command stopped reading
+                inputEnd = -1;
+            }
+        }
+        for (int stream = 0; stream < 2; ++stream)
+        {
+            int& fd = stream == 0 ? readEnd : errorEnd;
+            if (fd == -1 || ready[stream].revents == 0)
+            {
+                continue;
+            }
+            ssize_t bytes = read(fd, buffer.data(), buffer.size());
+            if (bytes > 0)
+            {
+                outputSize += static_cast<size_t>(bytes);
+                if (stream == 0 && onOutput)
+                {
+                    onOutput(std::string_view(buffer.data(), static_cast<size_t>(bytes)));
+                }
+                else
+                {
+                    output.append(buffer.data(), static_cast<size_t>(bytes));
+                }
+            }
+            else if (bytes == 0 || errno != EINTR)
+            {
+                close(fd); // Every writer has closed the pipe
+                fd = -1;
+            }
+        }
+    }
+    for (int fd : { readEnd, errorEnd, inputEnd })
+    {
+        if (fd != -1)
+        {
+            close(fd);
+        }
+    }
+
+    // The command may outlive its output by a little
+    int status = 0;
+    pid_t exited = 0;
+    while (!timedOut && (exited = waitpid(pid, &status, WNOHANG)) == 0)
+    {
+        if (RemainingMs(start, timeout) == 0)
+        {
+            timedOut = true;
+        }
+        else
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    if (timedOut)
+    {
+        kill(-pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        metrics.timeouts.Add();
+        metrics.run.Record(NanosecondsSince(start));
+        metrics.output.Record(outputSize);
+        result.status = CommandResult::TIMED_OUT;
+        return result;
+    }
+
+    result.status = CommandResult::EXITED;
+    if (exited == pid)
+    {
+        result.exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    }
+    metrics.run.Record(NanosecondsSince(start));
+    metrics.output.Record(outputSize);
+    return result;
+}
+#endif
+
+CommandResult RunCommand(const std::string& command, const std::string& input, int timeout)
+{
+    return RunCommand(command, input, timeout, nullptr);
+}
+
+bool ExecuteJsonCommand(const std::string& command, int timeout, JsonHandler& handler, std::string& error)
+{
+    LY_TRACE_FUNCTION("process");
+#ifdef _WIN32
+    // ConvertTo-Json builds its whole text before writing it, so the
+    // streaming happens on our side of the pipe
+    std::string script = "[Console]::OutputEncoding = [Text.Encoding]::UTF8; & { " + command + " } | ConvertTo-Json -Compress";
+#else
+    const std::string& script = command;
+#endif
+    JsonParser parser(handler);
+    CommandResult result = RunCommand(script, std::string(), timeout, [&parser](std::string_view chunk) { parser.Feed(chunk); });
+    if (result.status == CommandResult::TIMED_OUT)
+    {
+        error = "TIMEOUT!";
+        return false;
+    }
+    if (result.status == CommandResult::START_FAILED)
+    {
+        error = result.output;
+        return false;
+    }
+    if (result.exitCode != 0)
+    {
+        error = "Exit code " + std::to_string(result.exitCode) + (result.output.empty() ? "" : ": " + result.output);
+        return false;
+    }
+    if (!parser.Finish())
+    {
+        error = parser.Error();
+        return false;
+    }
+    return true;
+}
+
+std::string ExecuteCommand(const std::string& command, int timeout)
+{
+    CommandResult result = RunCommand(command, std::string(), timeout);
+    if (result.status == CommandResult::TIMED_OUT)
+    {
+        return "TIMEOUT!";
+    }
+    return std::move(result.output);
+}
+
+std::string RunMultipleCommands(const std::vector<std::string>& commands, int timeoutPerCmd, int totalTimeout)
+{
+    auto startTime = std::chrono::steady_clock::now();
+    std::ostringstream combinedOutput;
+
+    for (size_t i = 0; i < commands.size(); ++i)
+    {
+        int elapsed = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - startTime).count());
+        if (totalTimeout >= 0 && elapsed >= totalTimeout)
+        {
+            combinedOutput << ">> [Command #" << (i + 1) << "] Skipped due to total timeout.\n";
+            break;
+        }
+
+        int remainingTotal = totalTimeout >= 0 ? (totalTimeout - elapsed) : -1;
+        if (remainingTotal <= 0 && totalTimeout >= 0)
+        {
+            combinedOutput << ">> [Command #" << (i + 1) << "] Skipped due to total timeout.\n";
+            break;
+        }
+
+        int effectiveTimeout = timeoutPerCmd;
+        if (timeoutPerCmd < 0 && remainingTotal >= 0)
+            effectiveTimeout = remainingTotal;
+        else if (timeoutPerCmd >= 0 && remainingTotal >= 0)
+            effectiveTimeout = (std::min)(timeoutPerCmd, remainingTotal);
+
+        const std::string& cmd = commands[i];
+        std::string result = ExecuteCommand(cmd, effectiveTimeout);
+
+        combinedOutput << ">> [Command #" << (i + 1) << "]: " << cmd << "\n" << result << "\n";
+    }
+
+    return combinedOutput.str();
+}
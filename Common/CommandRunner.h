@@ -0,0 +1,53 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class JsonHandler;
+
+// Runs one command through the platform shell, PowerShell on Windows and
+// /bin/sh elsewhere, and returns what it wrote to stdout and stderr.
+// timeout is in milliseconds, negative for none. Failures come back as text:
+// "ERROR: Cannot create pipe.", "ERROR: Cannot create process." or "TIMEOUT!".
+// Runs, failures, spawn and run times are recorded as command_* metrics.
+std::string ExecuteCommand(const std::string& command, int timeout);
+
+// How a command ended, for callers that need more than the text
+struct CommandResult
+{
+    enum Status
+    {
+        EXITED,
+        TIMED_OUT,   // Killed with whatever it had started
+        START_FAILED,
+    };
+
+    Status status = START_FAILED;
+    int exitCode = -1;  // When EXITED; 128 + the signal if one ended it
+    std::string output; // stdout and stderr, or the ERROR: text when START_FAILED
+
+    bool Succeeded() const { return status == EXITED && exitCode == 0; }
+};
+
+// ExecuteCommand with input written to the command's stdin, which is
+// otherwise empty. Safe to call from several threads at once.
+CommandResult RunCommand(const std::string& command, const std::string& input, int timeout);
+
+// Hands stdout to onOutput chunk by chunk as it is read instead of keeping
+// it; stderr goes to a pipe of its own and ends up in output, so error text
+// cannot land in the middle of what onOutput is parsing
+CommandResult RunCommand(const std::string& command, const std::string& input, int timeout,
+                         const std::function<void(std::string_view)>& onOutput);
+
+// For structured results. On Windows the objects the command produces are
+// piped through ConvertTo-Json -Compress, as UTF-8; elsewhere the command
+// must print JSON itself. The output is parsed as it is read and never held
+// whole. False with the reason in error when the command could not start,
+// timed out or exited with a code other than 0 (with its stderr), or when
+// the output is not valid JSON.
+bool ExecuteJsonCommand(const std::string& command, int timeout, JsonHandler& handler, std::string& error);
+
+// Runs the commands in order, each limited by timeoutPerCmd and all of them
+// by totalTimeout; the output is every command followed by its result
+std::string RunMultipleCommands(const std::vector<std::string>& commands, int timeoutPerCmd, int totalTimeout);
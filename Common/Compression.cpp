@@ -0,0 +1,157 @@
+#include "Compression.h"
+#include <cstring>
+
+static const size_t MIN_MATCH = 4;
+static const size_t LAST_LITERALS = 5; // The format ends every block with literals
+static const size_t MATCH_SEARCH_END = 12; // No match may start this close to the end
+static const size_t MAX_OFFSET = 65535;
+static const int HASH_BITS = 12;
+
+static inline uint32_t Read32(const uint8_t* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t HashOf(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Lengths of 15 and more continue in extra bytes of 255 and a remainder
+static void PutLength(std::string& out, size_t length)
+{
+    for (; length >= 255; length -= 255)
+    {
+        out += static_cast<char>(255);
+    }
+    out += static_cast<char>(length);
+}
+
+static void PutSequence(std::string& out, const uint8_t* literals, size_t literalCount, size_t offset, size_t matchLength)
+{
+    size_t matchCode = matchLength ? matchLength - MIN_MATCH : 0;
+    uint8_t token = static_cast<uint8_t>((literalCount < 15 ? literalCount : 15) << 4);
+    token |= static_cast<uint8_t>(matchCode < 15 ? matchCode : 15);
+    out += static_cast<char>(token);
+    if (literalCount >= 15)
+    {
+        PutLength(out, literalCount - 15);
+    }
+    out.append(reinterpret_cast<const char*>(literals), literalCount);
+    if (matchLength == 0)
+    {
+        return; // Last sequence: literals only
+    }
+    out += static_cast<char>(offset & 0xFF);
+    out += static_cast<char>(offset >> 8);
+    if (matchCode >= 15)
+    {
+        PutLength(out, matchCode - 15);
+    }
+}
+
+size_t LzCompress(const void* data, size_t size, std::string& out)
+{
+    const uint8_t* input = static_cast<const uint8_t*>(data);
+    size_t start = out.size();
+    size_t anchor = 0; // First byte not yet emitted
+
+    if (size > MATCH_SEARCH_END)
+    {
+        uint32_t table[1 << HASH_BITS] = {}; // Position + 1 of the last sequence with this hash
+        size_t matchLimit = size - LAST_LITERALS;
+        size_t position = 0;
+        while (position + MATCH_SEARCH_END <= size)
+        {
+            uint32_t sequence = Read32(input + position);
+            uint32_t hash = HashOf(sequence);
+            size_t candidate = table[hash];
+            table[hash] = static_cast<uint32_t>(position + 1);
+            if (candidate == 0 || position - (candidate - 1) > MAX_OFFSET || Read32(input + candidate - 1) != sequence)
+            {
+                ++position;
+                continue;
+            }
+
+            size_t match = candidate - 1;
+            size_t length = MIN_MATCH;
+            while (position + length < matchLimit && input[match + length] == input[position + length])
+            {
+                ++length;
+            }
+            PutSequence(out, input + anchor, position - anchor, position - match, length);
+            position += length;
+            anchor = position;
+        }
+    }
+    PutSequence(out, input + anchor, size - anchor, 0, 0);
+    return out.size() - start;
+}
+
+bool LzDecompress(const void* data, size_t size, void* out, size_t rawSize)
+{
+    const uint8_t* in = static_cast<const uint8_t*>(data);
+    const uint8_t* inEnd = in + size;
+    uint8_t* output = static_cast<uint8_t*>(out);
+    size_t written = 0;
+
+    auto readLength = [&](size_t length, bool& ok)
+    {
+        if (length != 15)
+        {
+            return length;
+        }
+        uint8_t byte;
+        do
+        {
+            if (in == inEnd)
+            {
+                ok = false;
+                return length;
+            }
+            byte = *in++;
+            length += byte;
+        } while (byte == 255);
+        return length;
+    };
+
+    while (in < inEnd)
+    {
+        uint8_t token = *in++;
+        bool ok = true;
+        size_t literals = readLength(token >> 4, ok);
+        if (!ok || literals > static_cast<size_t>(inEnd - in) || literals > rawSize - written)
+        {
+            return false;
+        }
+        memcpy(output + written, in, literals);
+        in += literals;
+        written += literals;
+        if (in == inEnd)
+        {
+            break; // Last sequence
+        }
+
+        if (inEnd - in < 2)
+        {
+            return false;
+        }
+        size_t offset = in[0] | (in[1] << 8);
+        in += 2;
+        size_t length = readLength(token & 15, ok) + MIN_MATCH;
+        if (!ok || offset == 0 || offset > written || length > rawSize - written)
+        {
+            return false;
+        }
+        // Byte by byte: the source may overlap what is being written
+        const uint8_t* from = output + written - offset;
+        for (size_t i = 0; i < length; ++i)
+        {
+            output[written + i] = from[i];
+        }
+        written += length;
+    }
+    return written == rawSize;
+}
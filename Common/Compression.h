@@ -0,0 +1,15 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Fast LZ77 block compression in the LZ4 block format: no entropy coding,
+// decompresses at memory speed. Meant for file blocks of a few KiB to a few
+// MiB that are compressed once and read many times.
+
+// Appends the compressed form of data to out and returns its size
+size_t LzCompress(const void* data, size_t size, std::string& out);
+
+// Fills exactly rawSize bytes of out; false if the input is malformed or
+// does not decode to exactly rawSize bytes
+bool LzDecompress(const void* data, size_t size, void* out, size_t rawSize);
@@ -0,0 +1,92 @@
+#include "Epoch.h"
+#include <thread>
+
+namespace
+{
+    constexpr size_t SLOT_COUNT = 256;
+
+    // One cache line per slot so guards on different threads do not share lines
+    struct alignas(64) Slot
+    {
+        std::atomic<uint64_t> epoch{0}; // 0 = free
+    };
+
+    std::atomic<uint64_t> g_epoch{1};
+    Slot g_slots[SLOT_COUNT];
+    std::atomic<uint32_t> g_nextStart{0};
+
+    size_t StartSlot()
+    {
+        thread_local size_t start = g_nextStart.fetch_add(1, std::memory_order_relaxed) % SLOT_COUNT;
+        return start;
+    }
+}
+
+namespace Epoch
+{
+    Guard::Guard()
+    {
+        // Announce before the caller loads any shared pointer
+        uint64_t epoch = g_epoch.load();
+        for (size_t i = StartSlot();; i = (i + 1) % SLOT_COUNT)
+        {
+            uint64_t expected = 0;
+            if (g_slots[i].epoch.compare_exchange_strong(expected, epoch))
+            {
+                m_slot = &g_slots[i].epoch;
+                return;
+            }
+            if ((i + 1) % SLOT_COUNT == StartSlot())
+            {
+                std::this_thread::yield(); // Every slot taken; wait for a guard to go away
+            }
+        }
+    }
+
+    Guard::~Guard()
+    {
+        if (m_slot)
+        {
+            m_slot->store(0, std::memory_order_release);
+        }
+    }
+
+    Guard::Guard(Guard&& other) noexcept : m_slot(other.m_slot)
+    {
+        other.m_slot = nullptr;
+    }
+
+    Guard& Guard::operator=(Guard&& other) noexcept
+    {
+        if (this != &other)
+        {
+            if (m_slot)
+            {
+                m_slot->store(0, std::memory_order_release);
+            }
+            m_slot = other.m_slot;
+            other.m_slot = nullptr;
+        }
+        return *this;
+    }
+
+    uint64_t Retire()
+    {
+        // Guards announced from now on carry a larger epoch and cannot see the object
+        return g_epoch.fetch_add(1);
+    }
+
+    uint64_t OldestActive()
+    {
+        uint64_t oldest = UINT64_MAX;
+        for (Slot& slot : g_slots)
+        {
+            uint64_t epoch = slot.epoch.load();
+            if (epoch != 0 && epoch < oldest)
+            {
+                oldest = epoch;
+            }
+        }
+        return oldest;
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Epoch-based reclamation for lock-free readers.
+// A reader holds a Guard while it follows pointers into a shared structure.
+// A writer that unlinks an object tags it with Retire() and frees it once
+// OldestActive() has moved past the tag: no guard taken before the unlink is
+// still alive by then. One process-wide domain; guards are not tied to a
+// thread and may nest.
+namespace Epoch
+{
+    class Guard
+    {
+    public:
+        Guard();
+        ~Guard();
+        Guard(Guard&& other) noexcept;
+        Guard& operator=(Guard&& other) noexcept;
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+    private:
+        std::atomic<uint64_t>* m_slot;
+    };
+
+    // Call after unlinking; the result is the tag for what was unlinked
+    uint64_t Retire();
+
+    // Objects tagged below this can be freed; UINT64_MAX when no guard is alive
+    uint64_t OldestActive();
+}
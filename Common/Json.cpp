@@ -0,0 +1,1058 @@
+#include "Json.h"
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include "Utf.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define JSON_X86
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// As in Utf.cpp: built for their instruction set, called only after the CPU check
+#if defined(__GNUC__) || defined(__clang__)
+#define JSON_TARGET(isa) __attribute__((target(isa)))
+#else
+#define JSON_TARGET(isa)
+#endif
+
+static const size_t BLOCK = 64;
+
+// One bit per byte of a 64-byte block
+struct BlockMasks
+{
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t op;      // { } [ ] : ,
+    uint64_t space;   // The four whitespace characters JSON allows
+    uint64_t control; // Below 0x20, which a string may not hold raw
+};
+
+enum ByteClass : uint8_t
+{
+    CLASS_QUOTE = 1,
+    CLASS_BACKSLASH = 2,
+    CLASS_OP = 4,
+    CLASS_SPACE = 8,
+    CLASS_CONTROL = 16,
+};
+
+static const struct ByteClasses
+{
+    uint8_t of[256] = {};
+
+    ByteClasses()
+    {
+        for (int c = 0; c < 0x20; ++c)
+        {
+            of[c] = CLASS_CONTROL;
+        }
+        of['"'] = CLASS_QUOTE;
+        of['\\'] = CLASS_BACKSLASH;
+        for (unsigned char c : {'{', '}', '[', ']', ':', ','})
+        {
+            of[c] = CLASS_OP;
+        }
+        for (unsigned char c : {' ', '\t', '\n', '\r'})
+        {
+            of[c] |= CLASS_SPACE;
+        }
+    }
+} CLASSES;
+
+static void ScalarClassify(const uint8_t* in, BlockMasks& masks)
+{
+    masks = BlockMasks();
+    for (size_t i = 0; i < BLOCK; ++i)
+    {
+        uint64_t c = CLASSES.of[in[i]];
+        masks.quote |= (c & 1) << i;
+        masks.backslash |= ((c >> 1) & 1) << i;
+        masks.op |= ((c >> 2) & 1) << i;
+        masks.space |= ((c >> 3) & 1) << i;
+        masks.control |= ((c >> 4) & 1) << i;
+    }
+}
+
+#if defined(JSON_X86)
+// '[' and ']' differ from '{' and '}' only in bit 0x20, so two compares find all four
+JSON_TARGET("sse4.1") static void Sse41Classify(const uint8_t* in, BlockMasks& masks)
+{
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+    const __m128i open = _mm_set1_epi8('{');
+    const __m128i close = _mm_set1_epi8('}');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i ret = _mm_set1_epi8('\r');
+    const __m128i lastControl = _mm_set1_epi8(0x1F);
+
+    masks = BlockMasks();
+    for (int part = 0; part < 4; ++part)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + part * 16));
+        __m128i folded = _mm_or_si128(x, caseBit);
+        __m128i op = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(folded, open), _mm_cmpeq_epi8(folded, close)),
+                                  _mm_or_si128(_mm_cmpeq_epi8(x, colon), _mm_cmpeq_epi8(x, comma)));
+        __m128i white = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, space), _mm_cmpeq_epi8(x, tab)),
+                                     _mm_or_si128(_mm_cmpeq_epi8(x, newline), _mm_cmpeq_epi8(x, ret)));
+        __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(x, lastControl), x);
+        int shift = part * 16;
+        masks.quote |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, quote)))) << shift;
+        masks.backslash |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, backslash)))) << shift;
+        masks.op |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(op))) << shift;
+        masks.space |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(white))) << shift;
+        masks.control |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(control))) << shift;
+    }
+}
+
+JSON_TARGET("avx2") static void Avx2Classify(const uint8_t* in, BlockMasks& masks)
+{
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i caseBit = _mm256_set1_epi8(0x20);
+    const __m256i open = _mm256_set1_epi8('{');
+    const __m256i close = _mm256_set1_epi8('}');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i ret = _mm256_set1_epi8('\r');
+    const __m256i lastControl = _mm256_set1_epi8(0x1F);
+
+    masks = BlockMasks();
+    for (int part = 0; part < 2; ++part)
+    {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + part * 32));
+        __m256i folded = _mm256_or_si256(x, caseBit);
+        __m256i op = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(folded, open), _mm256_cmpeq_epi8(folded, close)),
+                                     _mm256_or_si256(_mm256_cmpeq_epi8(x, colon), _mm256_cmpeq_epi8(x, comma)));
+        __m256i white = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(x, space), _mm256_cmpeq_epi8(x, tab)),
+                                        _mm256_or_si256(_mm256_cmpeq_epi8(x, newline), _mm256_cmpeq_epi8(x, ret)));
+        __m256i control = _mm256_cmpeq_epi8(_mm256_min_epu8(x, lastControl), x);
+        int shift = part * 32;
+        masks.quote |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, quote)))) << shift;
+        masks.backslash |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, backslash)))) << shift;
+        masks.op |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(op))) << shift;
+        masks.space |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(white))) << shift;
+        masks.control |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(control))) << shift;
+    }
+}
+#endif
+
+// Indexed by TextKernel
+static void (*const CLASSIFY[])(const uint8_t* in, BlockMasks& masks) = {
+    ScalarClassify,
+#if defined(JSON_X86)
+    Sse41Classify,
+    Avx2Classify,
+#endif
+};
+
+static inline unsigned LowestBit(uint64_t bits)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return index;
+#else
+    return __builtin_ctzll(bits);
+#endif
+}
+
+static inline unsigned CountBits(uint64_t bits)
+{
+#ifdef _MSC_VER
+    // __popcnt64 would need a POPCNT check of its own for the scalar kernel
+    bits -= (bits >> 1) & 0x5555555555555555ull;
+    bits = (bits & 0x3333333333333333ull) + ((bits >> 2) & 0x3333333333333333ull);
+    bits = (bits + (bits >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+    return static_cast<unsigned>((bits * 0x0101010101010101ull) >> 56);
+#else
+    return __builtin_popcountll(bits);
+#endif
+}
+
+// The bytes that follow an escaping backslash. Each backslash either escapes
+// the next byte or is itself escaped; walking them one at a time is cheap
+// since they are rare, even in Windows paths next to the rest of the text.
+static inline uint64_t EscapedBytes(uint64_t backslash, uint64_t& carry)
+{
+    uint64_t escaped = carry;
+    backslash &= ~carry;
+    carry = 0;
+    while (backslash)
+    {
+        uint64_t bit = backslash & (0 - backslash);
+        uint64_t next = bit << 1;
+        carry = next == 0;
+        escaped |= next;
+        backslash &= ~(bit | next);
+    }
+    return escaped;
+}
+
+// Bit i is the xor of bits 0 to i: from each opening quote up to, not
+// including, its closing quote
+static inline uint64_t PrefixXor(uint64_t bits)
+{
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+static inline bool IsSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static inline bool IsDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// The JSON number grammar, which from_chars is looser than; integer holds the
+// value when there is no fraction or exponent and it fits
+static bool CheckNumber(std::string_view text, bool& isInteger, int64_t& integer)
+{
+    size_t i = 0;
+    size_t size = text.size();
+    bool negative = i < size && text[i] == '-';
+    i += negative;
+    if (i == size || !IsDigit(text[i]))
+    {
+        return false;
+    }
+    size_t digits = i;
+    uint64_t value = 0;
+    if (text[i] == '0')
+    {
+        ++i;
+    }
+    else
+    {
+        for (; i < size && IsDigit(text[i]); ++i)
+        {
+            value = value * 10 + (text[i] - '0');
+        }
+    }
+    isInteger = i - digits <= 18; // Cannot overflow
+    if (i < size && text[i] == '.')
+    {
+        size_t fraction = ++i;
+        while (i < size && IsDigit(text[i]))
+        {
+            ++i;
+        }
+        if (i == fraction)
+        {
+            return false;
+        }
+        isInteger = false;
+    }
+    if (i < size && (text[i] == 'e' || text[i] == 'E'))
+    {
+        ++i;
+        if (i < size && (text[i] == '+' || text[i] == '-'))
+        {
+            ++i;
+        }
+        size_t exponent = i;
+        while (i < size && IsDigit(text[i]))
+        {
+            ++i;
+        }
+        if (i == exponent)
+        {
+            return false;
+        }
+        isInteger = false;
+    }
+    integer = negative ? -static_cast<int64_t>(value) : static_cast<int64_t>(value);
+    return i == size;
+}
+
+static int HexDigit(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// The code unit of the \uXXXX at text, or -1
+static long ReadHex4(const char* text, const char* end)
+{
+    if (end - text < 4)
+    {
+        return -1;
+    }
+    long value = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        int digit = HexDigit(text[i]);
+        if (digit < 0)
+        {
+            return -1;
+        }
+        value = value * 16 + digit;
+    }
+    return value;
+}
+
+static void AppendUtf8(std::string& out, uint32_t codePoint)
+{
+    if (codePoint < 0x80)
+    {
+        out += static_cast<char>(codePoint);
+    }
+    else if (codePoint < 0x800)
+    {
+        out += static_cast<char>(0xC0 | (codePoint >> 6));
+        out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+    else if (codePoint < 0x10000)
+    {
+        out += static_cast<char>(0xE0 | (codePoint >> 12));
+        out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+    else
+    {
+        out += static_cast<char>(0xF0 | (codePoint >> 18));
+        out += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+}
+
+JsonParser::JsonParser(JsonHandler& handler) : m_handler(handler)
+{
+}
+
+void JsonParser::Reset()
+{
+    m_buffer.clear();
+    m_scanned = 0;
+    m_indices.clear();
+    m_next = 0;
+    m_dropped = 0;
+    m_end = 0;
+    m_finished = false;
+    m_inString = 0;
+    m_escaped = 0;
+    m_inScalar = 0;
+    m_badControl = UINT64_MAX;
+    m_stack.clear();
+    m_expect = Expect::Value;
+    m_values = 0;
+    m_error.clear();
+}
+
+bool JsonParser::Feed(std::string_view data)
+{
+    if (Failed() || m_finished)
+    {
+        return !Failed();
+    }
+    m_buffer.append(data.data(), data.size());
+    Scan(m_buffer.size() - (m_buffer.size() - m_scanned) % BLOCK);
+    bool ok = Parse();
+    Compact();
+    return ok;
+}
+
+bool JsonParser::Finish()
+{
+    if (Failed() || m_finished)
+    {
+        return !Failed();
+    }
+    m_finished = true;
+    m_end = m_buffer.size();
+    m_buffer.append((BLOCK - (m_buffer.size() - m_scanned) % BLOCK) % BLOCK, ' ');
+    Scan(m_buffer.size());
+    if (!Parse())
+    {
+        return false;
+    }
+    if (m_next < m_indices.size())
+    {
+        return Fail(m_indices[m_next], "unterminated string");
+    }
+    if (!m_stack.empty() || m_expect != Expect::Value)
+    {
+        return Fail(m_end, "unexpected end of input");
+    }
+    return true;
+}
+
+// Stage one: appends the position of every structural character, every
+// unescaped quote and every first byte of a number or literal that lies
+// outside strings, one 64-byte block at a time
+void JsonParser::Scan(size_t end)
+{
+    void (*classify)(const uint8_t*, BlockMasks&) = CLASSIFY[static_cast<int>(ActiveTextKernel())];
+    const uint8_t* text = reinterpret_cast<const uint8_t*>(m_buffer.data());
+    for (; m_scanned + BLOCK <= end; m_scanned += BLOCK)
+    {
+        BlockMasks masks;
+        classify(text + m_scanned, masks);
+
+        uint64_t quotes = masks.quote & ~EscapedBytes(masks.backslash, m_escaped);
+        uint64_t inString = PrefixXor(quotes) ^ m_inString;
+        m_inString = static_cast<uint64_t>(static_cast<int64_t>(inString) >> 63);
+
+        uint64_t scalar = ~(masks.op | masks.space | quotes | inString);
+        uint64_t scalarStarts = scalar & ~((scalar << 1) | m_inScalar);
+        m_inScalar = scalar >> 63;
+
+        uint64_t control = masks.control & inString;
+        if (control && m_badControl == UINT64_MAX)
+        {
+            m_badControl = m_scanned + LowestBit(control);
+        }
+
+        // Sized up front so the loop stores without a capacity check
+        uint64_t tokens = (masks.op & ~inString) | quotes | scalarStarts;
+        size_t count = m_indices.size();
+        m_indices.resize(count + CountBits(tokens));
+        uint32_t* out = m_indices.data() + count;
+        while (tokens)
+        {
+            *out++ = static_cast<uint32_t>(m_scanned + LowestBit(tokens));
+            tokens &= tokens - 1;
+        }
+    }
+}
+
+// Stage two: walks the positions with the container stack, stopping at the
+// first token whose end has not been scanned yet
+bool JsonParser::Parse()
+{
+    const char* text = m_buffer.data();
+    while (m_next < m_indices.size())
+    {
+        size_t at = m_indices[m_next];
+        char c = text[at];
+        switch (m_expect)
+        {
+            case Expect::Colon:
+                if (c != ':')
+                {
+                    return Fail(at, "expected ':'");
+                }
+                m_expect = Expect::Value;
+                ++m_next;
+                continue;
+
+            case Expect::CommaOrEnd:
+            {
+                bool inObject = m_stack.back() == '{';
+                if (c == ',')
+                {
+                    m_expect = inObject ? Expect::Key : Expect::Value;
+                    ++m_next;
+                    continue;
+                }
+                if (c != (inObject ? '}' : ']'))
+                {
+                    return Fail(at, inObject ? "expected ',' or '}'" : "expected ',' or ']'");
+                }
+                if (!Close(at))
+                {
+                    return false;
+                }
+                continue;
+            }
+
+            case Expect::FirstKey:
+                if (c == '}')
+                {
+                    if (!Close(at))
+                    {
+                        return false;
+                    }
+                    continue;
+                }
+                [[fallthrough]];
+            case Expect::Key:
+            {
+                if (c != '"')
+                {
+                    return Fail(at, "expected a string key");
+                }
+                if (m_next + 1 == m_indices.size())
+                {
+                    return true; // Its closing quote has not come yet
+                }
+                std::string_view key;
+                if (!DecodeString(at + 1, m_indices[m_next + 1], key))
+                {
+                    return false;
+                }
+                if (!m_handler.Key(key))
+                {
+                    return Fail(at, nullptr);
+                }
+                m_next += 2;
+                m_expect = Expect::Colon;
+                continue;
+            }
+
+            case Expect::FirstElement:
+                if (c == ']')
+                {
+                    if (!Close(at))
+                    {
+                        return false;
+                    }
+                    continue;
+                }
+                [[fallthrough]];
+            case Expect::Value:
+                break;
+        }
+
+        switch (c)
+        {
+            case '{':
+            case '[':
+            {
+                if (m_stack.size() == MAX_DEPTH)
+                {
+                    return Fail(at, "nested too deeply");
+                }
+                m_stack.push_back(c);
+                ++m_next;
+                m_expect = c == '{' ? Expect::FirstKey : Expect::FirstElement;
+                if (!(c == '{' ? m_handler.StartObject() : m_handler.StartArray()))
+                {
+                    return Fail(at, nullptr);
+                }
+                break;
+            }
+            case '"':
+            {
+                if (m_next + 1 == m_indices.size())
+                {
+                    return true;
+                }
+                std::string_view value;
+                if (!DecodeString(at + 1, m_indices[m_next + 1], value))
+                {
+                    return false;
+                }
+                m_next += 2;
+                if (!ValueDone(m_handler.String(value), at))
+                {
+                    return false;
+                }
+                break;
+            }
+            case '}':
+            case ']':
+            case ':':
+            case ',':
+                return Fail(at, "expected a value");
+            default:
+            {
+                // Ends where the next token starts, or at the end of the input
+                size_t end;
+                if (m_next + 1 < m_indices.size())
+                {
+                    end = m_indices[m_next + 1];
+                }
+                else if (m_finished)
+                {
+                    end = m_end;
+                }
+                else
+                {
+                    return true;
+                }
+                while (end > at && IsSpace(text[end - 1]))
+                {
+                    --end;
+                }
+                ++m_next;
+                if (!ParseScalar(at, end))
+                {
+                    return false;
+                }
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+bool JsonParser::ParseScalar(size_t start, size_t end)
+{
+    std::string_view text(m_buffer.data() + start, end - start);
+    switch (text[0])
+    {
+        case 't':
+            if (text != "true")
+            {
+                return Fail(start, "invalid literal");
+            }
+            return ValueDone(m_handler.Bool(true), start);
+        case 'f':
+            if (text != "false")
+            {
+                return Fail(start, "invalid literal");
+            }
+            return ValueDone(m_handler.Bool(false), start);
+        case 'n':
+            if (text != "null")
+            {
+                return Fail(start, "invalid literal");
+            }
+            return ValueDone(m_handler.Null(), start);
+    }
+
+    bool isInteger = false;
+    int64_t integer = 0;
+    if (!CheckNumber(text, isInteger, integer))
+    {
+        return Fail(start, "invalid number");
+    }
+    double value = static_cast<double>(integer);
+    if (!isInteger && std::from_chars(text.data(), text.data() + text.size(), value).ec != std::errc())
+    {
+        // Past the range of a double, which JSON allows; strtod saturates to infinity or 0
+        value = strtod(std::string(text).c_str(), nullptr);
+    }
+    return ValueDone(m_handler.Number(value, text), start);
+}
+
+// The string between start and the closing quote at end, as a view of the
+// buffer when it has no escapes
+bool JsonParser::DecodeString(size_t start, size_t end, std::string_view& value)
+{
+    if (m_badControl < end)
+    {
+        return Fail(static_cast<size_t>(m_badControl), "control character in a string");
+    }
+    const char* text = m_buffer.data() + start;
+    const char* stop = m_buffer.data() + end;
+    const char* escape = static_cast<const char*>(memchr(text, '\\', end - start));
+    if (!escape)
+    {
+        value = std::string_view(text, end - start);
+    }
+    else
+    {
+        m_unescaped.assign(text, escape);
+        for (const char* p = escape; p < stop;)
+        {
+            if (*p != '\\')
+            {
+                const char* next = static_cast<const char*>(memchr(p, '\\', stop - p));
+                next = next ? next : stop;
+                m_unescaped.append(p, next);
+                p = next;
+                continue;
+            }
+            char kind = p[1]; // The first pass saw the escaped byte before the closing quote
+            p += 2;
+            switch (kind)
+            {
+                case '"': m_unescaped += '"'; break;
+                case '\\': m_unescaped += '\\'; break;
+                case '/': m_unescaped += '/'; break;
+                case 'b': m_unescaped += '\b'; break;
+                case 'f': m_unescaped += '\f'; break;
+                case 'n': m_unescaped += '\n'; break;
+                case 'r': m_unescaped += '\r'; break;
+                case 't': m_unescaped += '\t'; break;
+                case 'u':
+                {
+                    long unit = ReadHex4(p, stop);
+                    if (unit < 0)
+                    {
+                        return Fail(p - m_buffer.data() - 2, "invalid \\u escape");
+                    }
+                    p += 4;
+                    uint32_t codePoint = static_cast<uint32_t>(unit);
+                    if (unit >= 0xD800 && unit <= 0xDBFF && stop - p >= 6 && p[0] == '\\' && p[1] == 'u')
+                    {
+                        long low = ReadHex4(p + 2, stop);
+                        if (low >= 0xDC00 && low <= 0xDFFF)
+                        {
+                            codePoint = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+                            p += 6;
+                        }
+                    }
+                    if (codePoint >= 0xD800 && codePoint <= 0xDFFF)
+                    {
+                        codePoint = 0xFFFD; // A lone surrogate, as Narrow replaces them
+                    }
+                    AppendUtf8(m_unescaped, codePoint);
+                    break;
+                }
+                default:
+                    return Fail(p - m_buffer.data() - 2, "invalid escape");
+            }
+        }
+        value = m_unescaped;
+    }
+    if (!IsValidUtf8(value))
+    {
+        return Fail(start, "invalid UTF-8 in a string");
+    }
+    return true;
+}
+
+bool JsonParser::Close(size_t at)
+{
+    char open = m_stack.back();
+    m_stack.pop_back();
+    ++m_next;
+    return ValueDone(open == '{' ? m_handler.EndObject() : m_handler.EndArray(), at);
+}
+
+bool JsonParser::ValueDone(bool handled, size_t at)
+{
+    if (!handled)
+    {
+        return Fail(at, nullptr);
+    }
+    if (m_stack.empty())
+    {
+        ++m_values;
+        m_expect = Expect::Value;
+    }
+    else
+    {
+        m_expect = Expect::CommaOrEnd;
+    }
+    return true;
+}
+
+// A null reason means the handler asked to stop
+bool JsonParser::Fail(size_t offset, const char* reason)
+{
+    std::string at = std::to_string(m_dropped + offset);
+    m_error = reason ? "Invalid JSON at byte " + at + ": " + reason : "Stopped by the handler at byte " + at;
+    return false;
+}
+
+// Drops what has been parsed, so memory is bounded by the largest token
+// rather than by the stream
+void JsonParser::Compact()
+{
+    size_t keep = m_next < m_indices.size() ? m_indices[m_next] : m_scanned;
+    if (keep == 0)
+    {
+        return;
+    }
+    m_buffer.erase(0, keep);
+    m_scanned -= keep;
+    m_dropped += keep;
+    if (m_badControl != UINT64_MAX)
+    {
+        m_badControl -= keep;
+    }
+    m_indices.erase(m_indices.begin(), m_indices.begin() + m_next);
+    for (uint32_t& index : m_indices)
+    {
+        index -= static_cast<uint32_t>(keep);
+    }
+    m_next = 0;
+}
+
+JsonType JsonDocument::Value::Type() const
+{
+    return m_document ? m_document->m_tape[m_entry].type : JsonType::Missing;
+}
+
+std::string_view JsonDocument::Value::AsString(std::string_view fallback) const
+{
+    if (Type() != JsonType::String)
+    {
+        return fallback;
+    }
+    const Entry& entry = m_document->m_tape[m_entry];
+    return std::string_view(m_document->m_strings.data() + entry.payload, entry.length);
+}
+
+double JsonDocument::Value::AsNumber(double fallback) const
+{
+    if (Type() != JsonType::Number)
+    {
+        return fallback;
+    }
+    double value;
+    memcpy(&value, &m_document->m_tape[m_entry].payload, sizeof(value));
+    return value;
+}
+
+bool JsonDocument::Value::AsBool(bool fallback) const
+{
+    return Type() == JsonType::Bool ? m_document->m_tape[m_entry].payload != 0 : fallback;
+}
+
+size_t JsonDocument::Value::Size() const
+{
+    JsonType type = Type();
+    return type == JsonType::Array || type == JsonType::Object ? m_document->m_tape[m_entry].length : 0;
+}
+
+uint32_t JsonDocument::Value::Child(size_t index) const
+{
+    bool object = Type() == JsonType::Object;
+    uint32_t entry = m_entry + 1;
+    for (size_t i = 0; i < index; ++i)
+    {
+        entry = m_document->Next(object ? entry + 1 : entry);
+    }
+    return entry;
+}
+
+JsonDocument::Value JsonDocument::Value::At(size_t index) const
+{
+    if (index >= Size())
+    {
+        return Value();
+    }
+    uint32_t entry = Child(index);
+    return Value(m_document, Type() == JsonType::Object ? entry + 1 : entry);
+}
+
+std::string_view JsonDocument::Value::KeyAt(size_t index) const
+{
+    if (Type() != JsonType::Object || index >= Size())
+    {
+        return {};
+    }
+    return Value(m_document, Child(index)).AsString();
+}
+
+JsonDocument::Value JsonDocument::Value::operator[](std::string_view key) const
+{
+    if (Type() != JsonType::Object)
+    {
+        return Value();
+    }
+    uint32_t entry = m_entry + 1;
+    for (size_t i = 0, size = Size(); i < size; ++i)
+    {
+        if (Value(m_document, entry).AsString() == key)
+        {
+            return Value(m_document, entry + 1);
+        }
+        entry = m_document->Next(entry + 1);
+    }
+    return Value();
+}
+
+uint32_t JsonDocument::Next(uint32_t entry) const
+{
+    JsonType type = m_tape[entry].type;
+    return type == JsonType::Array || type == JsonType::Object ? static_cast<uint32_t>(m_tape[entry].payload) : entry + 1;
+}
+
+JsonDocument::Value JsonDocument::Root(size_t index) const
+{
+    if (index >= m_rootCount)
+    {
+        return Value();
+    }
+    uint32_t entry = 0;
+    for (size_t i = 0; i < index; ++i)
+    {
+        entry = Next(entry);
+    }
+    return Value(this, entry);
+}
+
+void JsonDocument::Clear()
+{
+    m_tape.clear();
+    m_strings.clear();
+    m_rootCount = 0;
+}
+
+JsonTapeBuilder::JsonTapeBuilder(JsonDocument& document) : m_document(document)
+{
+}
+
+// Counts the value in its array; object members are counted by their key
+void JsonTapeBuilder::Add(JsonType type, uint32_t length, uint64_t payload)
+{
+    if (!m_open.empty())
+    {
+        JsonDocument::Entry& parent = m_document.m_tape[m_open.back()];
+        parent.length += parent.type == JsonType::Array;
+    }
+    else if (type != JsonType::Array && type != JsonType::Object)
+    {
+        ++m_document.m_rootCount;
+    }
+    m_document.m_tape.push_back({type, length, payload});
+}
+
+bool JsonTapeBuilder::Open(JsonType type)
+{
+    uint32_t entry = static_cast<uint32_t>(m_document.m_tape.size());
+    Add(type, 0, 0);
+    m_open.push_back(entry);
+    return true;
+}
+
+bool JsonTapeBuilder::Close()
+{
+    m_document.m_tape[m_open.back()].payload = m_document.m_tape.size();
+    m_open.pop_back();
+    if (m_open.empty())
+    {
+        ++m_document.m_rootCount;
+    }
+    return true;
+}
+
+uint32_t JsonTapeBuilder::AddString(std::string_view text)
+{
+    uint32_t offset = static_cast<uint32_t>(m_document.m_strings.size());
+    m_document.m_strings.append(text.data(), text.size());
+    return offset;
+}
+
+bool JsonTapeBuilder::StartObject()
+{
+    return Open(JsonType::Object);
+}
+
+bool JsonTapeBuilder::Key(std::string_view key)
+{
+    ++m_document.m_tape[m_open.back()].length;
+    m_document.m_tape.push_back({JsonType::String, static_cast<uint32_t>(key.size()), AddString(key)});
+    return true;
+}
+
+bool JsonTapeBuilder::EndObject()
+{
+    return Close();
+}
+
+bool JsonTapeBuilder::StartArray()
+{
+    return Open(JsonType::Array);
+}
+
+bool JsonTapeBuilder::EndArray()
+{
+    return Close();
+}
+
+bool JsonTapeBuilder::String(std::string_view value)
+{
+    Add(JsonType::String, static_cast<uint32_t>(value.size()), AddString(value));
+    return true;
+}
+
+bool JsonTapeBuilder::Number(double value, std::string_view)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    Add(JsonType::Number, 0, bits);
+    return true;
+}
+
+bool JsonTapeBuilder::Bool(bool value)
+{
+    Add(JsonType::Bool, 0, value);
+    return true;
+}
+
+bool JsonTapeBuilder::Null()
+{
+    Add(JsonType::Null, 0, 0);
+    return true;
+}
+
+JsonRecordReader::JsonRecordReader(std::function<bool(const JsonDocument::Value&)> onRecord)
+    : m_onRecord(std::move(onRecord)), m_builder(m_record)
+{
+}
+
+bool JsonRecordReader::Forwarded(bool result)
+{
+    if (!result || m_builder.Depth() != 0)
+    {
+        return result;
+    }
+    ++m_records;
+    bool keepGoing = m_onRecord(m_record.Root());
+    m_record.Clear();
+    return keepGoing;
+}
+
+bool JsonRecordReader::StartObject()
+{
+    return m_builder.StartObject();
+}
+
+bool JsonRecordReader::Key(std::string_view key)
+{
+    return m_builder.Key(key);
+}
+
+bool JsonRecordReader::EndObject()
+{
+    return Forwarded(m_builder.EndObject());
+}
+
+bool JsonRecordReader::StartArray()
+{
+    if (!m_inArray && m_builder.Depth() == 0)
+    {
+        m_inArray = true;
+        return true;
+    }
+    return m_builder.StartArray();
+}
+
+bool JsonRecordReader::EndArray()
+{
+    if (m_inArray && m_builder.Depth() == 0)
+    {
+        m_inArray = false;
+        return true;
+    }
+    return Forwarded(m_builder.EndArray());
+}
+
+bool JsonRecordReader::String(std::string_view value)
+{
+    return Forwarded(m_builder.String(value));
+}
+
+bool JsonRecordReader::Number(double value, std::string_view text)
+{
+    return Forwarded(m_builder.Number(value, text));
+}
+
+bool JsonRecordReader::Bool(bool value)
+{
+    return Forwarded(m_builder.Bool(value));
+}
+
+bool JsonRecordReader::Null()
+{
+    return Forwarded(m_builder.Null());
+}
@@ -0,0 +1,227 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Streaming JSON parser for command output. Bytes are fed as they arrive and
+// events go to a handler as soon as each token is complete; only the token
+// still being received is kept between calls. A first pass finds every
+// structural character, quote and value start 64 bytes at a time with the
+// SSE4.1 or AVX2 kernel that Utf picked for the CPU (see ActiveTextKernel),
+// tracking escapes and strings across blocks; a second pass walks those
+// positions with an explicit stack. Input is one or more top-level values,
+// as in JSON lines; none at all is accepted too, since ConvertTo-Json
+// prints nothing for an empty pipeline.
+
+// Receives the document as it is parsed. Views are only valid during the
+// call. Returning false stops the parser, which then reports an error.
+class JsonHandler
+{
+public:
+    virtual ~JsonHandler() = default;
+
+    virtual bool StartObject() = 0;
+    virtual bool Key(std::string_view key) = 0;
+    virtual bool EndObject() = 0;
+    virtual bool StartArray() = 0;
+    virtual bool EndArray() = 0;
+    virtual bool String(std::string_view value) = 0;
+    virtual bool Number(double value, std::string_view text) = 0; // text keeps integers past 2^53 exact
+    virtual bool Bool(bool value) = 0;
+    virtual bool Null() = 0;
+};
+
+class JsonParser
+{
+public:
+    explicit JsonParser(JsonHandler& handler);
+
+    // False once the input is invalid or the handler stopped; later input is ignored
+    bool Feed(std::string_view data);
+
+    // Parses what is left; false if the input ends inside a value
+    bool Finish();
+
+    // Ready for a new stream, with the same handler
+    void Reset();
+
+    bool Failed() const { return !m_error.empty(); }
+    const std::string& Error() const { return m_error; } // "Invalid JSON at byte 12: expected ':'"
+    uint64_t ValueCount() const { return m_values; }     // Complete top-level values so far
+
+    static const size_t MAX_DEPTH = 1024;
+
+private:
+    enum class Expect : uint8_t
+    {
+        Value,
+        FirstElement, // A value or ']'
+        FirstKey,     // A key or '}'
+        Key,
+        Colon,
+        CommaOrEnd,
+    };
+
+    void Scan(size_t end);
+    bool Parse();
+    bool ParseScalar(size_t start, size_t end);
+    bool DecodeString(size_t start, size_t end, std::string_view& value);
+    bool Close(size_t at);
+    bool ValueDone(bool handled, size_t at);
+    bool Fail(size_t offset, const char* reason);
+    void Compact();
+
+    JsonHandler& m_handler;
+    std::string m_buffer;            // From the oldest byte still needed
+    size_t m_scanned = 0;            // Bytes of m_buffer the first pass has indexed
+    std::vector<uint32_t> m_indices; // Positions in m_buffer of tokens not parsed yet
+    size_t m_next = 0;               // First of m_indices not parsed yet
+    uint64_t m_dropped = 0;          // Bytes dropped from the front of the stream
+    size_t m_end = 0;                // Real end of the input in m_buffer once finished, before padding
+    bool m_finished = false;
+
+    // First-pass state carried from one block to the next
+    uint64_t m_inString = 0;  // All ones while inside a string
+    uint64_t m_escaped = 0;   // 1 if the next byte is escaped
+    uint64_t m_inScalar = 0;  // 1 if the last byte was part of a number or literal
+    uint64_t m_badControl = UINT64_MAX; // Offset in m_buffer of a raw control character in a string
+
+    std::vector<char> m_stack; // '{' or '[' per open container
+    Expect m_expect = Expect::Value;
+    uint64_t m_values = 0;
+    std::string m_unescaped;
+    std::string m_error;
+};
+
+enum class JsonType : uint8_t
+{
+    Missing, // What a lookup that found nothing returns
+    Null,
+    Bool,
+    Number,
+    String,
+    Array,
+    Object,
+};
+
+// A parsed document on a flat tape: one entry per value, with object keys as
+// string entries before their values, and containers pointing past their end
+// so a lookup skips whole subtrees
+class JsonDocument
+{
+public:
+    class Value
+    {
+    public:
+        Value() = default;
+
+        JsonType Type() const;
+        bool Exists() const { return Type() != JsonType::Missing; }
+        bool IsNull() const { return Type() == JsonType::Null; }
+
+        // The fallback when the value has another type
+        std::string_view AsString(std::string_view fallback = {}) const;
+        double AsNumber(double fallback = 0) const;
+        bool AsBool(bool fallback = false) const;
+
+        // Elements of an array or members of an object, 0 for anything else
+        size_t Size() const;
+        Value At(size_t index) const;
+        std::string_view KeyAt(size_t index) const; // Objects only
+        Value operator[](std::string_view key) const;
+
+    private:
+        friend class JsonDocument;
+        Value(const JsonDocument* document, uint32_t entry) : m_document(document), m_entry(entry)
+        {}
+        uint32_t Child(size_t index) const; // Tape index of a member's key or an element
+
+        const JsonDocument* m_document = nullptr;
+        uint32_t m_entry = 0;
+    };
+
+    // Top-level values in the order they came; Missing past the last
+    Value Root(size_t index = 0) const;
+    size_t RootCount() const { return m_rootCount; }
+    bool Empty() const { return m_tape.empty(); }
+    void Clear();
+
+private:
+    friend class JsonTapeBuilder;
+
+    struct Entry
+    {
+        JsonType type;
+        uint32_t length;  // Bytes of a string; elements or members of a container
+        uint64_t payload; // String offset, number bits, bool, or for a container the entry after its end
+    };
+
+    uint32_t Next(uint32_t entry) const; // The entry after this value and everything in it
+
+    std::vector<Entry> m_tape;
+    std::string m_strings;
+    size_t m_rootCount = 0;
+};
+
+// Appends every top-level value of the stream to a document as one of its roots
+class JsonTapeBuilder : public JsonHandler
+{
+public:
+    explicit JsonTapeBuilder(JsonDocument& document);
+
+    bool StartObject() override;
+    bool Key(std::string_view key) override;
+    bool EndObject() override;
+    bool StartArray() override;
+    bool EndArray() override;
+    bool String(std::string_view value) override;
+    bool Number(double value, std::string_view text) override;
+    bool Bool(bool value) override;
+    bool Null() override;
+
+    // Open containers, 0 between top-level values
+    size_t Depth() const { return m_open.size(); }
+
+private:
+    void Add(JsonType type, uint32_t length, uint64_t payload);
+    bool Open(JsonType type);
+    bool Close();
+    uint32_t AddString(std::string_view text);
+
+    JsonDocument& m_document;
+    std::vector<uint32_t> m_open; // Tape index of each open container
+};
+
+// Hands over each record as soon as it is complete and then forgets it, so a
+// huge result is never held whole. A record is an element of a top-level
+// array, or a top-level value that is not an array, which is what
+// ConvertTo-Json prints for one object. onRecord returns false to stop.
+class JsonRecordReader : public JsonHandler
+{
+public:
+    explicit JsonRecordReader(std::function<bool(const JsonDocument::Value&)> onRecord);
+
+    bool StartObject() override;
+    bool Key(std::string_view key) override;
+    bool EndObject() override;
+    bool StartArray() override;
+    bool EndArray() override;
+    bool String(std::string_view value) override;
+    bool Number(double value, std::string_view text) override;
+    bool Bool(bool value) override;
+    bool Null() override;
+
+    uint64_t Records() const { return m_records; }
+
+private:
+    bool Forwarded(bool result); // Hands over the record once the builder has all of it
+
+    std::function<bool(const JsonDocument::Value&)> m_onRecord;
+    JsonDocument m_record;
+    JsonTapeBuilder m_builder;
+    bool m_inArray = false; // Inside a top-level array, whose elements are the records
+    uint64_t m_records = 0;
+};
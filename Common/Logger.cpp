@@ -0,0 +1,482 @@
+#include "Logger.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace Log
+{
+    // Single-producer single-consumer byte ring: the owning thread pushes,
+    // the writer thread pops. Positions only grow; the mask wraps them.
+    class RingBuffer
+    {
+    public:
+        explicit RingBuffer(size_t capacity) : m_data(capacity), m_mask(capacity - 1)
+        {}
+
+        bool Push(const char* data, size_t size)
+        {
+            uint64_t head = m_head.load(std::memory_order_relaxed);
+            uint64_t tail = m_tail.load(std::memory_order_acquire);
+            if (m_data.size() - (head - tail) < size)
+            {
+                return false;
+            }
+            CopyIn(head, data, size);
+            m_head.store(head + size, std::memory_order_release);
+            return true;
+        }
+
+        bool Empty() const
+        {
+            return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_relaxed);
+        }
+
+        // Appends every complete record to out; returns false when empty
+        bool Pop(std::vector<char>& out)
+        {
+            uint64_t tail = m_tail.load(std::memory_order_relaxed);
+            uint64_t head = m_head.load(std::memory_order_acquire);
+            if (head == tail)
+            {
+                return false;
+            }
+            size_t begin = out.size();
+            out.resize(begin + static_cast<size_t>(head - tail));
+            CopyOut(tail, out.data() + begin, static_cast<size_t>(head - tail));
+            m_tail.store(head, std::memory_order_release);
+            return true;
+        }
+
+    private:
+        void CopyIn(uint64_t position, const char* data, size_t size)
+        {
+            size_t offset = static_cast<size_t>(position & m_mask);
+            size_t first = (std::min)(size, m_data.size() - offset);
+            memcpy(m_data.data() + offset, data, first);
+            memcpy(m_data.data(), data + first, size - first);
+        }
+
+        void CopyOut(uint64_t position, char* data, size_t size) const
+        {
+            size_t offset = static_cast<size_t>(position & m_mask);
+            size_t first = (std::min)(size, m_data.size() - offset);
+            memcpy(data, m_data.data() + offset, first);
+            memcpy(data + first, m_data.data(), size - first);
+        }
+
+        std::vector<char> m_data;
+        size_t m_mask;
+        alignas(64) std::atomic<uint64_t> m_head{0};
+        alignas(64) std::atomic<uint64_t> m_tail{0};
+    };
+
+    struct ThreadRing
+    {
+        explicit ThreadRing(uint32_t id) : ring(RING_CAPACITY), threadId(id)
+        {}
+
+        static constexpr size_t RING_CAPACITY = 256 * 1024;
+        RingBuffer ring;
+        uint32_t threadId;
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<bool> retired{false}; // Owning thread has exited
+    };
+
+    class Logger
+    {
+    public:
+        static Logger& Instance()
+        {
+            static Logger logger;
+            return logger;
+        }
+
+        std::shared_ptr<ThreadRing> Register()
+        {
+            std::lock_guard<std::mutex> lock(m_ringsMutex);
+            auto ring = std::make_shared<ThreadRing>(++m_nextThreadId);
+            m_rings.push_back(ring);
+            return ring;
+        }
+
+        uint64_t Now() const
+        {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - m_start).count());
+        }
+
+        void Flush()
+        {
+            std::unique_lock<std::mutex> lock(m_wakeMutex);
+            uint64_t ticket = ++m_flushRequested;
+            m_wake.notify_all();
+            m_flushed.wait(lock, [&] { return m_flushCompleted >= ticket || m_stop; });
+        }
+
+        bool SetOutputFile(const std::string& fileName)
+        {
+            FILE* file = nullptr;
+            if (!fileName.empty() && !(file = fopen(fileName.c_str(), "a")))
+            {
+                return false;
+            }
+            Flush();
+            std::lock_guard<std::mutex> lock(m_outputMutex);
+            if (m_file)
+            {
+                fclose(m_file);
+            }
+            m_file = file;
+            return true;
+        }
+
+        void SetAlertHandler(std::function<void(const std::string&)> handler)
+        {
+            std::lock_guard<std::mutex> lock(m_outputMutex);
+            m_alertHandler = std::move(handler);
+        }
+
+        Stats GetStats()
+        {
+            Stats stats{m_written.load(), 0};
+            std::lock_guard<std::mutex> lock(m_ringsMutex);
+            stats.dropped = m_droppedRetired;
+            for (const auto& ring : m_rings)
+            {
+                stats.dropped += ring->dropped.load(std::memory_order_relaxed);
+            }
+            return stats;
+        }
+
+    private:
+        Logger() : m_start(std::chrono::steady_clock::now())
+        {
+#ifdef _WIN32
+            m_alertHandler = [](const std::string& line) { OutputDebugStringA(line.c_str()); };
+#endif
+            m_writer = std::thread(&Logger::Run, this);
+        }
+
+        ~Logger()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_wakeMutex);
+                m_stop = true;
+            }
+            m_wake.notify_all();
+            m_writer.join();
+            Drain(); // Whatever was logged while stopping
+            if (m_file)
+            {
+                fclose(m_file);
+            }
+        }
+
+        void Run()
+        {
+            std::unique_lock<std::mutex> lock(m_wakeMutex);
+            while (!m_stop)
+            {
+                // Producers never signal, so poll; Flush() cuts the wait short
+                m_wake.wait_for(lock, std::chrono::milliseconds(10),
+                                [this] { return m_stop || m_flushRequested > m_flushCompleted; });
+                uint64_t ticket = m_flushRequested;
+                lock.unlock();
+                Drain();
+                lock.lock();
+                m_flushCompleted = ticket;
+                m_flushed.notify_all();
+            }
+        }
+
+        void Drain()
+        {
+            std::vector<std::shared_ptr<ThreadRing>> rings;
+            {
+                std::lock_guard<std::mutex> lock(m_ringsMutex);
+                rings = m_rings;
+            }
+
+            // Records of one thread are in order; merge threads by timestamp
+            m_batch.clear();
+            m_records.clear();
+            for (const auto& ring : rings)
+            {
+                size_t begin = m_batch.size();
+                ring->ring.Pop(m_batch);
+                for (size_t offset = begin; offset < m_batch.size();)
+                {
+                    RecordHeader header;
+                    memcpy(&header, m_batch.data() + offset, sizeof(header));
+                    m_records.push_back({header.timestamp, offset, ring->threadId});
+                    offset += header.size;
+                }
+            }
+            std::stable_sort(m_records.begin(), m_records.end(),
+                             [](const Pending& a, const Pending& b) { return a.timestamp < b.timestamp; });
+
+            std::lock_guard<std::mutex> lock(m_outputMutex);
+            for (const Pending& pending : m_records)
+            {
+                RecordHeader header;
+                memcpy(&header, m_batch.data() + pending.offset, sizeof(header));
+                m_line.clear();
+                FormatRecord(header, m_batch.data() + pending.offset + sizeof(header),
+                             header.size - sizeof(header), pending.threadId, m_line);
+
+                FILE* out = m_file ? m_file : (header.site->level >= LEVEL_ERROR ? stderr : stdout);
+                fwrite(m_line.data(), 1, m_line.size(), out);
+                if (header.site->level == LEVEL_ALERT && m_alertHandler)
+                {
+                    m_alertHandler(m_line);
+                }
+            }
+            m_written += m_records.size();
+            ReportDrops(rings);
+            fflush(m_file ? m_file : stdout);
+            fflush(stderr);
+
+            // Forget rings whose thread is gone once they are empty
+            std::lock_guard<std::mutex> ringsLock(m_ringsMutex);
+            m_rings.erase(std::remove_if(m_rings.begin(), m_rings.end(), [&](const std::shared_ptr<ThreadRing>& ring)
+            {
+                if (!ring->retired || !ring->ring.Empty())
+                {
+                    return false;
+                }
+                m_droppedRetired += ring->dropped;
+                return true;
+            }), m_rings.end());
+        }
+
+        void ReportDrops(const std::vector<std::shared_ptr<ThreadRing>>& rings)
+        {
+            uint64_t dropped = m_droppedRetired;
+            for (const auto& ring : rings)
+            {
+                dropped += ring->dropped.load(std::memory_order_relaxed);
+            }
+            if (dropped > m_droppedReported)
+            {
+                FILE* out = m_file ? m_file : stderr;
+                fprintf(out, "WARNING: %llu log record(s) dropped, ring buffer full\n",
+                        static_cast<unsigned long long>(dropped - m_droppedReported));
+                m_droppedReported = dropped;
+            }
+        }
+
+        template <class T>
+        static void AppendFormatted(std::string& out, const std::string& spec, T value)
+        {
+            char buffer[128];
+            int length = snprintf(buffer, sizeof(buffer), spec.c_str(), value);
+            if (length < 0)
+            {
+                return;
+            }
+            if (static_cast<size_t>(length) < sizeof(buffer))
+            {
+                out.append(buffer, length);
+                return;
+            }
+            size_t begin = out.size();
+            out.resize(begin + length + 1);
+            snprintf(&out[begin], length + 1, spec.c_str(), value);
+            out.resize(begin + length);
+        }
+
+        static void FormatRecord(const RecordHeader& header, const char* args, size_t argsSize,
+                                 uint32_t threadId, std::string& out)
+        {
+            static const char* const LEVEL_NAMES[] = { "DEBUG", "INFO", "WARNING", "ERROR", "ALERT", "FATAL" };
+            const Site& site = *header.site;
+
+            char prefix[64];
+            snprintf(prefix, sizeof(prefix), "+%.6f [T%u] %s: ", header.timestamp / 1e9, threadId, LEVEL_NAMES[site.level]);
+            out += prefix;
+            if (site.function)
+            {
+                out += site.function;
+                out += "::";
+                out += std::to_string(site.line);
+                if (site.level >= LEVEL_ERROR)
+                {
+                    out += " Error Code = ";
+                    out += std::to_string(header.errorCode);
+                }
+                out += ": ";
+            }
+
+            size_t position = 0;
+            std::string spec;
+            for (const char* p = site.format; *p; ++p)
+            {
+                if (*p != '%')
+                {
+                    out += *p;
+                    continue;
+                }
+                if (p[1] == '%')
+                {
+                    out += '%';
+                    ++p;
+                    continue;
+                }
+
+                // Keep flags, width and precision; the length modifier comes from the captured type
+                spec.assign(1, '%');
+                for (++p; *p && strchr("-+ #0123456789.", *p); ++p)
+                {
+                    spec += *p;
+                }
+                while (*p && strchr("hlzjtLI", *p))
+                {
+                    ++p;
+                }
+                char conversion = *p;
+                if (position >= argsSize)
+                {
+                    break; // Truncated record
+                }
+
+                ArgKind kind = static_cast<ArgKind>(args[position++]);
+                if (kind == ArgKind::String)
+                {
+                    uint16_t length;
+                    memcpy(&length, args + position, sizeof(length));
+                    position += sizeof(length);
+                    std::string text(args + position, length);
+                    position += length;
+                    AppendFormatted(out, spec + 's', text.c_str());
+                    continue;
+                }
+
+                uint64_t bits;
+                memcpy(&bits, args + position, sizeof(bits));
+                position += sizeof(bits);
+                if (kind == ArgKind::Float)
+                {
+                    double value;
+                    memcpy(&value, &bits, sizeof(value));
+                    AppendFormatted(out, spec + conversion, value);
+                }
+                else if (kind == ArgKind::Pointer)
+                {
+                    AppendFormatted(out, spec + 'p', reinterpret_cast<void*>(static_cast<uintptr_t>(bits)));
+                }
+                else if (conversion == 'c')
+                {
+                    AppendFormatted(out, spec + 'c', static_cast<int>(bits));
+                }
+                else if (conversion == 'd' || conversion == 'i')
+                {
+                    AppendFormatted(out, spec + "lld", static_cast<long long>(bits));
+                }
+                else
+                {
+                    AppendFormatted(out, spec + "ll" + conversion, static_cast<unsigned long long>(bits));
+                }
+            }
+            out += '\n';
+        }
+
+        struct Pending
+        {
+            uint64_t timestamp;
+            size_t offset;
+            uint32_t threadId;
+        };
+
+        std::chrono::steady_clock::time_point m_start;
+
+        std::mutex m_ringsMutex; // Guards registration, never taken on the logging path
+        std::vector<std::shared_ptr<ThreadRing>> m_rings;
+        uint32_t m_nextThreadId{0};
+        uint64_t m_droppedRetired{0};
+
+        std::thread m_writer;
+        std::mutex m_wakeMutex;
+        std::condition_variable m_wake;
+        std::condition_variable m_flushed;
+        uint64_t m_flushRequested{0};
+        uint64_t m_flushCompleted{0};
+        bool m_stop{false};
+
+        // Writer thread state
+        std::mutex m_outputMutex;
+        FILE* m_file{nullptr};
+        std::function<void(const std::string&)> m_alertHandler;
+        std::vector<char> m_batch;
+        std::vector<Pending> m_records;
+        std::string m_line;
+        std::atomic<uint64_t> m_written{0};
+        uint64_t m_droppedReported{0};
+    };
+
+    // Keeps the ring alive for the writer after its thread exits
+    struct ThreadRingOwner
+    {
+        std::shared_ptr<ThreadRing> ring = Logger::Instance().Register();
+        ~ThreadRingOwner()
+        {
+            ring->retired = true;
+        }
+    };
+
+    void Commit(const Site& site, int32_t errorCode, Encoder& encoder)
+    {
+        static thread_local ThreadRingOwner owner;
+        Logger& logger = Logger::Instance();
+
+        RecordHeader header{&site, logger.Now(), errorCode, static_cast<uint32_t>(encoder.used)};
+        memcpy(encoder.buffer, &header, sizeof(header));
+        if (!owner.ring->ring.Push(encoder.buffer, encoder.used))
+        {
+            owner.ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    int32_t LastErrorCode(Level level)
+    {
+        if (level < LEVEL_ERROR)
+        {
+            return 0;
+        }
+#ifdef _WIN32
+        return static_cast<int32_t>(GetLastError());
+#else
+        return errno;
+#endif
+    }
+
+    void Flush()
+    {
+        Logger::Instance().Flush();
+    }
+
+    bool SetOutputFile(const std::string& fileName)
+    {
+        return Logger::Instance().SetOutputFile(fileName);
+    }
+
+    void SetAlertHandler(std::function<void(const std::string&)> handler)
+    {
+        Logger::Instance().SetAlertHandler(std::move(handler));
+    }
+
+    Stats GetStats()
+    {
+        return Logger::Instance().GetStats();
+    }
+}
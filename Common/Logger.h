@@ -0,0 +1,265 @@
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Asynchronous logger behind the LY_* macros.
+// A call site copies its arguments in binary form into a ring buffer owned by
+// the calling thread; a background thread formats the records and writes them.
+// Format strings use printf syntax and are checked against the argument types
+// at compile time, so a mismatch is a build error instead of garbage output.
+
+// Records below this level are compiled out: 0 debug, 1 info, 2 warn, 3 error
+#ifndef LY_LOG_LEVEL
+#define LY_LOG_LEVEL 1
+#endif
+
+// Set to 0 to keep file names and function names out of the binary
+#ifndef LY_LOG_LOCATION
+#define LY_LOG_LOCATION 1
+#endif
+
+namespace Log
+{
+    enum Level : uint8_t
+    {
+        LEVEL_DEBUG,
+        LEVEL_INFO,
+        LEVEL_WARN,
+        LEVEL_ERROR,
+        LEVEL_ALERT, // Used to be a modal message box; goes to the alert handler
+        LEVEL_FATAL,
+    };
+
+    // Everything known at compile time about one call site
+    struct Site
+    {
+        Level level;
+        const char* format;
+        const char* file;
+        const char* function;
+        int line;
+    };
+
+    enum class ArgKind : uint8_t
+    {
+        Signed,
+        Unsigned,
+        Float,
+        String,
+        Pointer,
+        Invalid,
+    };
+
+    template <class T>
+    constexpr ArgKind KindOf()
+    {
+        if constexpr (std::is_same_v<T, bool>)
+            return ArgKind::Unsigned;
+        else if constexpr (std::is_integral_v<T>)
+            return std::is_signed_v<T> ? ArgKind::Signed : ArgKind::Unsigned;
+        else if constexpr (std::is_enum_v<T>)
+            return KindOf<std::underlying_type_t<T>>();
+        else if constexpr (std::is_floating_point_v<T>)
+            return ArgKind::Float;
+        else if constexpr (std::is_same_v<T, const char*> || std::is_same_v<T, char*> ||
+                           std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>)
+            return ArgKind::String;
+        else if constexpr (std::is_pointer_v<T>)
+            return ArgKind::Pointer;
+        else
+            return ArgKind::Invalid;
+    }
+
+    template <class... A>
+    struct TypeList
+    {};
+
+    // Only used inside decltype to get the decayed argument types of a call site
+    template <class... A>
+    TypeList<std::decay_t<A>...> TypesOf(A&&...);
+
+    constexpr bool Accepts(char conversion, ArgKind kind)
+    {
+        switch (conversion)
+        {
+            case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+                return kind == ArgKind::Signed || kind == ArgKind::Unsigned;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                return kind == ArgKind::Float;
+            case 's':
+                return kind == ArgKind::String;
+            case 'p':
+                return kind == ArgKind::Pointer;
+        }
+        return false;
+    }
+
+    // Length modifiers are accepted but ignored: the writer picks the right
+    // one from the captured type. '*' widths and %n are rejected.
+    template <class... A>
+    constexpr bool FormatMatches(TypeList<A...>, const char* format)
+    {
+        constexpr ArgKind kinds[] = { KindOf<A>()..., ArgKind::Invalid };
+        size_t next = 0;
+        for (const char* p = format; *p; ++p)
+        {
+            if (*p != '%')
+            {
+                continue;
+            }
+            ++p;
+            if (*p == '%')
+            {
+                continue;
+            }
+            while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0')
+            {
+                ++p;
+            }
+            while ((*p >= '0' && *p <= '9') || *p == '.')
+            {
+                ++p;
+            }
+            while (*p == 'h' || *p == 'l' || *p == 'z' || *p == 'j' || *p == 't' || *p == 'L' || *p == 'I')
+            {
+                ++p;
+            }
+            if (*p == '\0' || next >= sizeof...(A) || !Accepts(*p, kinds[next]))
+            {
+                return false;
+            }
+            ++next;
+        }
+        return next == sizeof...(A);
+    }
+
+    // Largest encoded record; longer strings are truncated
+    constexpr size_t MAX_RECORD_SIZE = 1024;
+
+    // Fixed part of every record, followed by the encoded arguments
+    struct RecordHeader
+    {
+        const Site* site;
+        uint64_t timestamp;
+        int32_t errorCode;
+        uint32_t size;
+    };
+
+    struct Encoder
+    {
+        char buffer[MAX_RECORD_SIZE];
+        size_t used = sizeof(RecordHeader);
+
+        template <class T>
+        void Put(ArgKind kind, const T& value)
+        {
+            if (used + 1 + sizeof(T) > MAX_RECORD_SIZE)
+            {
+                return;
+            }
+            buffer[used++] = static_cast<char>(kind);
+            memcpy(buffer + used, &value, sizeof(T));
+            used += sizeof(T);
+        }
+
+        void PutString(const char* text, size_t length)
+        {
+            if (used + 3 > MAX_RECORD_SIZE)
+            {
+                return;
+            }
+            size_t room = MAX_RECORD_SIZE - used - 3;
+            uint16_t stored = static_cast<uint16_t>(length < room ? length : room);
+            buffer[used++] = static_cast<char>(ArgKind::String);
+            memcpy(buffer + used, &stored, sizeof(stored));
+            memcpy(buffer + used + sizeof(stored), text, stored);
+            used += sizeof(stored) + stored;
+        }
+
+        // D is the decayed type, so string literals arrive as const char*
+        template <class D, class T>
+        void Append(const T& value)
+        {
+            constexpr ArgKind kind = KindOf<D>();
+            static_assert(kind != ArgKind::Invalid, "type cannot be logged");
+            if constexpr (kind == ArgKind::Signed)
+                Put(kind, static_cast<int64_t>(value));
+            else if constexpr (kind == ArgKind::Unsigned)
+                Put(kind, static_cast<uint64_t>(value));
+            else if constexpr (kind == ArgKind::Float)
+                Put(kind, static_cast<double>(value));
+            else if constexpr (kind == ArgKind::Pointer)
+                Put(kind, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(value)));
+            else if constexpr (std::is_pointer_v<D>)
+            {
+                const char* text = value;
+                text ? PutString(text, strlen(text)) : PutString("(null)", 6);
+            }
+            else
+                PutString(value.data(), value.size());
+        }
+    };
+
+    // Stamps the header and pushes the record into this thread's ring buffer.
+    // Never blocks: when the ring is full the record is dropped and counted.
+    void Commit(const Site& site, int32_t errorCode, Encoder& encoder);
+
+    template <class... A>
+    void Write(const Site& site, int32_t errorCode, const A&... args)
+    {
+        Encoder encoder;
+        (encoder.Append<std::decay_t<A>>(args), ...);
+        Commit(site, errorCode, encoder);
+    }
+
+    // GetLastError() on Windows, errno elsewhere; only read for error levels
+    int32_t LastErrorCode(Level level);
+
+    // Blocks until everything logged before the call has been written
+    void Flush();
+
+    // Writes to this file instead of stdout/stderr; empty restores the console
+    bool SetOutputFile(const std::string& fileName);
+
+    // Called on the writer thread with each formatted alert line
+    void SetAlertHandler(std::function<void(const std::string&)> handler);
+
+    struct Stats
+    {
+        uint64_t written;
+        uint64_t dropped;
+    };
+    Stats GetStats();
+}
+
+#if LY_LOG_LOCATION
+#define LY_LOG_SITE_LOCATION __FILE__, __FUNCTION__, __LINE__
+#else
+#define LY_LOG_SITE_LOCATION nullptr, nullptr, 0
+#endif
+
+#define LY_LOG(_level_, _msg_, ...) do {\
+static_assert(::Log::FormatMatches(decltype(::Log::TypesOf(__VA_ARGS__)){}, _msg_), "log format does not match its arguments");\
+if constexpr (_level_ >= LY_LOG_LEVEL) {\
+static const ::Log::Site __site = { _level_, _msg_, LY_LOG_SITE_LOCATION };\
+::Log::Write(__site, ::Log::LastErrorCode(_level_), ##__VA_ARGS__);\
+}\
+} while (0)
+
+#define LY_DBG(_msg_, ...) LY_LOG(::Log::LEVEL_DEBUG, _msg_, ##__VA_ARGS__)
+#define LY_INF(_msg_, ...) LY_LOG(::Log::LEVEL_INFO, _msg_, ##__VA_ARGS__)
+#define LY_WRN(_msg_, ...) LY_LOG(::Log::LEVEL_WARN, _msg_, ##__VA_ARGS__)
+#define LY_MSB(_msg_, ...) LY_LOG(::Log::LEVEL_ALERT, _msg_, ##__VA_ARGS__)
+
+#define LY_ERR(_msg_, ...) do {\
+LY_LOG(::Log::LEVEL_FATAL, _msg_, ##__VA_ARGS__);\
+::Log::Flush();\
+exit(1);\
+} while (0)
+
+#define LY_TEST(expr, msg, ...) if (!(expr)) LY_ERR(msg, ##__VA_ARGS__)
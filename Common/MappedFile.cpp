@@ -0,0 +1,178 @@
+#include "MappedFile.h"
+#include <cerrno>
+
+#ifdef _WIN32
+#include <windows.h>
+#include "Utf.h"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+{}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+#ifdef _WIN32
+
+FILE* OpenUtf8File(const std::string& fileName, const char* mode)
+{
+    return _wfopen(Widen(fileName).c_str(), Widen(mode).c_str());
+}
+
+int32_t MappedFile::Open(const std::string& fileName)
+{
+    Close();
+    HANDLE file = CreateFileW(Widen(fileName).c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return static_cast<int32_t>(GetLastError());
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
+    {
+        int32_t result = static_cast<int32_t>(GetLastError());
+        CloseHandle(file);
+        return result;
+    }
+
+    m_file = file;
+    m_size = static_cast<size_t>(size.QuadPart);
+    m_open = true;
+    if (m_size == 0)
+    {
+        return 0; // Nothing to map
+    }
+    m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_mapping)
+    {
+        m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    }
+    if (!m_data)
+    {
+        int32_t result = static_cast<int32_t>(GetLastError());
+        Close();
+        return result;
+    }
+    return 0;
+}
+
+FileStamp ReadFileStamp(const std::string& fileName)
+{
+    FileStamp stamp;
+    HANDLE file = CreateFileW(Widen(fileName).c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return stamp;
+    }
+    BY_HANDLE_FILE_INFORMATION info;
+    if (GetFileInformationByHandle(file, &info))
+    {
+        stamp.exists = true;
+        stamp.writeTime = (uint64_t(info.ftLastWriteTime.dwHighDateTime) << 32) | info.ftLastWriteTime.dwLowDateTime;
+        stamp.fileId = (uint64_t(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+        stamp.device = info.dwVolumeSerialNumber;
+        stamp.size = (uint64_t(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+    }
+    CloseHandle(file);
+    return stamp;
+}
+
+void MappedFile::Close()
+{
+    if (m_data)
+    {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping)
+    {
+        CloseHandle(m_mapping);
+    }
+    if (m_file)
+    {
+        CloseHandle(m_file);
+    }
+    m_data = nullptr;
+    m_mapping = nullptr;
+    m_file = nullptr;
+    m_size = 0;
+    m_open = false;
+}
+
+#else
+
+FILE* OpenUtf8File(const std::string& fileName, const char* mode)
+{
+    return fopen(fileName.c_str(), mode);
+}
+
+int32_t MappedFile::Open(const std::string& fileName)
+{
+    Close();
+    int fd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return errno;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        int32_t result = errno;
+        close(fd);
+        return result;
+    }
+
+    // The mapping keeps the file referenced; the descriptor is not needed
+    m_size = static_cast<size_t>(info.st_size);
+    if (m_size > 0)
+    {
+        void* data = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            int32_t result = errno;
+            close(fd);
+            m_size = 0;
+            return result;
+        }
+        m_data = static_cast<const uint8_t*>(data);
+    }
+    close(fd);
+    m_open = true;
+    return 0;
+}
+
+FileStamp ReadFileStamp(const std::string& fileName)
+{
+    FileStamp stamp;
+    struct stat info;
+    if (stat(fileName.c_str(), &info) == 0)
+    {
+        stamp.exists = true;
+        stamp.writeTime = uint64_t(info.st_mtim.tv_sec) * 1000000000u + uint64_t(info.st_mtim.tv_nsec);
+        stamp.fileId = info.st_ino;
+        stamp.device = info.st_dev;
+        stamp.size = static_cast<uint64_t>(info.st_size);
+    }
+    return stamp;
+}
+
+void MappedFile::Close()
+{
+    if (m_data)
+    {
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_open = false;
+}
+
+#endif
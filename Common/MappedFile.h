@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// What a file on disk currently is: rewriting it changes the write time or
+// size, replacing it by rename changes the file id even if the time is kept
+struct FileStamp
+{
+    bool exists = false;
+    uint64_t writeTime = 0; // FILETIME units on Windows, nanoseconds since the epoch elsewhere
+    uint64_t fileId = 0;    // NTFS file index or inode
+    uint64_t device = 0;    // Volume serial number or st_dev
+    uint64_t size = 0;
+
+    bool operator==(const FileStamp& o) const
+    {
+        return exists == o.exists && writeTime == o.writeTime && fileId == o.fileId && device == o.device &&
+               size == o.size;
+    }
+    bool operator!=(const FileStamp& o) const { return !(*this == o); }
+};
+
+// fopen for a UTF-8 file name; on Windows it goes through _wfopen so a name
+// outside the ANSI code page still opens
+FILE* OpenUtf8File(const std::string& fileName, const char* mode);
+
+// One metadata query, without reading the file; exists is false if it cannot be opened
+FileStamp ReadFileStamp(const std::string& fileName);
+
+// Read-only view of a whole file through the OS mapping (MapViewOfFile or
+// mmap). Pages are read on first touch, so opening costs the same whatever
+// the file size. The view stays valid until Close.
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Returns 0, or the GetLastError/errno code
+    int32_t Open(const std::string& fileName);
+    void Close();
+
+    bool IsOpen() const { return m_open; }
+    const uint8_t* Data() const { return m_data; } // Null for an empty file
+    size_t Size() const { return m_size; }
+
+private:
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    bool m_open = false;
+#ifdef _WIN32
+    void* m_file = nullptr;    // HANDLE
+    void* m_mapping = nullptr; // HANDLE
+#endif
+};
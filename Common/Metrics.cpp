@@ -0,0 +1,378 @@
+#include "Metrics.h"
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace Metrics
+{
+    size_t ThisShard()
+    {
+        static std::atomic<size_t> next{0};
+        static thread_local size_t shard = next.fetch_add(1, std::memory_order_relaxed) % SHARDS;
+        return shard;
+    }
+
+    uint64_t Counter::Value() const
+    {
+        uint64_t total = 0;
+        for (const Shard& shard : m_shards)
+        {
+            total += shard.value.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    static int HighestBit(uint64_t value)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanReverse64(&index, value);
+        return static_cast<int>(index);
+#else
+        return 63 - __builtin_clzll(value);
+#endif
+    }
+
+    // Below 16 every value has its own bucket; above, each power of two is
+    // split into 16 buckets by the 4 bits after the highest one
+    size_t Histogram::BucketOf(uint64_t value)
+    {
+        if (value < (1u << SUB_BITS))
+        {
+            return static_cast<size_t>(value);
+        }
+        int exponent = HighestBit(value);
+        if (exponent >= 44)
+        {
+            return OVERFLOW_BUCKET;
+        }
+        size_t group = static_cast<size_t>(exponent - SUB_BITS + 1);
+        size_t sub = static_cast<size_t>(value >> (exponent - SUB_BITS)) & ((1u << SUB_BITS) - 1);
+        return (group << SUB_BITS) + sub;
+    }
+
+    uint64_t Histogram::BucketMidpoint(size_t bucket)
+    {
+        if (bucket < (1u << SUB_BITS))
+        {
+            return bucket;
+        }
+        if (bucket >= OVERFLOW_BUCKET)
+        {
+            return HistogramSnapshot::OVERFLOWED;
+        }
+        size_t group = bucket >> SUB_BITS;
+        uint64_t sub = bucket & ((1u << SUB_BITS) - 1);
+        uint64_t lower = ((uint64_t(1) << SUB_BITS) + sub) << (group - 1);
+        return lower + ((uint64_t(1) << (group - 1)) >> 1);
+    }
+
+    HistogramSnapshot Histogram::Read() const
+    {
+        HistogramSnapshot snapshot;
+        snapshot.buckets.assign(BUCKETS, 0);
+        for (const Shard& shard : m_shards)
+        {
+            for (size_t i = 0; i < BUCKETS; ++i)
+            {
+                snapshot.buckets[i] += shard.buckets[i].load(std::memory_order_relaxed);
+            }
+            snapshot.sum += shard.sum.load(std::memory_order_relaxed);
+        }
+        for (uint64_t count : snapshot.buckets)
+        {
+            snapshot.count += count;
+        }
+        return snapshot;
+    }
+
+    uint64_t HistogramSnapshot::Quantile(double q) const
+    {
+        if (count == 0)
+        {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(q * count + 0.5);
+        rank = rank < 1 ? 1 : (rank > count ? count : rank);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < buckets.size(); ++i)
+        {
+            seen += buckets[i];
+            if (seen >= rank)
+            {
+                return Histogram::BucketMidpoint(i);
+            }
+        }
+        return Histogram::BucketMidpoint(buckets.size() - 1);
+    }
+
+    // Metrics are never removed, so references handed out stay valid
+    class Registry
+    {
+    public:
+        static Registry& Instance()
+        {
+            static Registry registry;
+            return registry;
+        }
+
+        Counter& GetCounter(const std::string& name, const std::string& labels, const std::string& help)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            Family<Counter>& family = m_counters[name];
+            family.help = help;
+            std::unique_ptr<Counter>& counter = family.metrics[labels];
+            if (!counter)
+            {
+                counter = std::make_unique<Counter>();
+            }
+            return *counter;
+        }
+
+        Histogram& GetHistogram(const std::string& name, const std::string& labels, const std::string& help, double scale)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            Family<Histogram>& family = m_histograms[name];
+            family.help = help;
+            std::unique_ptr<Histogram>& histogram = family.metrics[labels];
+            if (!histogram)
+            {
+                histogram = std::make_unique<Histogram>(scale);
+            }
+            return *histogram;
+        }
+
+        std::string PrometheusText()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::string out;
+            char line[512];
+            for (const auto& [name, family] : m_counters)
+            {
+                out += "# HELP " + name + " " + family.help + "\n# TYPE " + name + " counter\n";
+                for (const auto& [labels, counter] : family.metrics)
+                {
+                    snprintf(line, sizeof(line), "%s%s %llu\n", name.c_str(), Braced(labels, "").c_str(),
+                             static_cast<unsigned long long>(counter->Value()));
+                    out += line;
+                }
+            }
+            for (const auto& [name, family] : m_histograms)
+            {
+                out += "# HELP " + name + " " + family.help + "\n# TYPE " + name + " summary\n";
+                for (const auto& [labels, histogram] : family.metrics)
+                {
+                    HistogramSnapshot snapshot = histogram->Read();
+                    double scale = histogram->Scale();
+                    for (const char* q : {"0.5", "0.9", "0.99", "0.999"})
+                    {
+                        std::string quantile = std::string("quantile=\"") + q + "\"";
+                        uint64_t value = snapshot.Quantile(atof(q));
+                        if (value == HistogramSnapshot::OVERFLOWED)
+                        {
+                            // Beyond the bucket range: all that is known is that it is large
+                            snprintf(line, sizeof(line), "%s%s +Inf\n", name.c_str(), Braced(labels, quantile).c_str());
+                        }
+                        else
+                        {
+                            snprintf(line, sizeof(line), "%s%s %.9g\n", name.c_str(), Braced(labels, quantile).c_str(),
+                                     value * scale);
+                        }
+                        out += line;
+                    }
+                    snprintf(line, sizeof(line), "%s_sum%s %.9g\n%s_count%s %llu\n", name.c_str(),
+                             Braced(labels, "").c_str(), snapshot.sum * scale, name.c_str(), Braced(labels, "").c_str(),
+                             static_cast<unsigned long long>(snapshot.count));
+                    out += line;
+                }
+            }
+            return out;
+        }
+
+    private:
+        template <class T>
+        struct Family
+        {
+            std::string help;
+            std::map<std::string, std::unique_ptr<T>> metrics; // By labels
+        };
+
+        static std::string Braced(const std::string& labels, const std::string& extra)
+        {
+            if (labels.empty() && extra.empty())
+            {
+                return "";
+            }
+            return "{" + labels + (labels.empty() || extra.empty() ? "" : ",") + extra + "}";
+        }
+
+        std::mutex m_mutex; // Registration and export only, never taken by updates
+        std::map<std::string, Family<Counter>> m_counters;
+        std::map<std::string, Family<Histogram>> m_histograms;
+    };
+
+    Counter& GetCounter(const std::string& name, const std::string& labels, const std::string& help)
+    {
+        return Registry::Instance().GetCounter(name, labels, help);
+    }
+
+    Histogram& GetHistogram(const std::string& name, const std::string& labels, const std::string& help, double scale)
+    {
+        return Registry::Instance().GetHistogram(name, labels, help, scale);
+    }
+
+    std::string PrometheusText()
+    {
+        return Registry::Instance().PrometheusText();
+    }
+
+    bool WritePrometheusFile(const std::string& fileName)
+    {
+        std::string text = PrometheusText();
+        std::string temporary = fileName + ".tmp";
+        FILE* file = fopen(temporary.c_str(), "wb");
+        bool written = file && fwrite(text.data(), 1, text.size(), file) == text.size();
+        if (file)
+        {
+            written = fclose(file) == 0 && written;
+        }
+        std::error_code ec;
+        if (written)
+        {
+            std::filesystem::rename(temporary, fileName, ec);
+        }
+        if (!written || ec)
+        {
+            std::filesystem::remove(temporary, ec);
+            return false;
+        }
+        return true;
+    }
+
+    // Set from the signal handler, which can do nothing else safely
+    static std::atomic<bool> g_dumpRequested{false};
+
+#ifdef _WIN32
+    static BOOL WINAPI OnConsoleControl(DWORD type)
+    {
+        if (type != CTRL_BREAK_EVENT)
+        {
+            return FALSE;
+        }
+        g_dumpRequested = true;
+        return TRUE;
+    }
+#else
+    static void OnDumpSignal(int)
+    {
+        g_dumpRequested = true;
+    }
+#endif
+
+    class Exporter
+    {
+    public:
+        static Exporter& Instance()
+        {
+            static Exporter exporter;
+            return exporter;
+        }
+
+        void Start(const std::string& fileName, std::chrono::milliseconds interval)
+        {
+            Stop();
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_fileName = fileName;
+            m_interval = interval;
+            m_stop = false;
+#ifdef _WIN32
+            SetConsoleCtrlHandler(OnConsoleControl, TRUE);
+#else
+            signal(SIGUSR1, OnDumpSignal);
+#endif
+            m_thread = std::thread(&Exporter::Run, this);
+        }
+
+        void Stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!m_thread.joinable())
+                {
+                    return;
+                }
+                m_stop = true;
+            }
+            m_wake.notify_all();
+            m_thread.join();
+            WritePrometheusFile(m_fileName);
+        }
+
+        ~Exporter()
+        {
+            Stop();
+        }
+
+    private:
+        // The registry has to outlive the last write in ~Exporter
+        Exporter()
+        {
+            Registry::Instance();
+        }
+
+        // Signal handlers cannot notify, so a pending dump waits for the next check
+        void Run()
+        {
+            const auto check = std::chrono::milliseconds(100);
+            auto due = std::chrono::steady_clock::now() + m_interval;
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (!m_stop)
+            {
+                m_wake.wait_for(lock, check, [this] { return m_stop; });
+                auto now = std::chrono::steady_clock::now();
+                if (g_dumpRequested.exchange(false) || now >= due)
+                {
+                    lock.unlock();
+                    WritePrometheusFile(m_fileName);
+                    lock.lock();
+                    due = now + m_interval;
+                }
+            }
+        }
+
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::thread m_thread;
+        std::string m_fileName;
+        std::chrono::milliseconds m_interval{};
+        bool m_stop{false};
+    };
+
+    void StartExporter(const std::string& fileName, std::chrono::milliseconds interval)
+    {
+        Exporter::Instance().Start(fileName, interval);
+    }
+
+    void StopExporter()
+    {
+        Exporter::Instance().Stop();
+    }
+
+    Operation::Operation(const std::string& prefix, const std::string& op)
+        : calls(GetCounter(prefix + "_total", "op=\"" + op + "\"", "Calls")),
+          errors(GetCounter(prefix + "_errors_total", "op=\"" + op + "\"", "Failed calls")),
+          duration(GetHistogram(prefix + "_duration_seconds", "op=\"" + op + "\"", "Call duration", 1e-9))
+    {}
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Process-wide counters and latency histograms, exported as Prometheus text.
+// Every metric is split into per-thread shards: an update is one relaxed
+// atomic add on a cache line that other threads rarely touch, and readers
+// sum the shards. Histograms use HDR-style log-linear buckets, 16 per power
+// of two, so any quantile is within about 3% of the recorded value.
+namespace Metrics
+{
+    constexpr size_t SHARDS = 8;
+
+    // Threads are spread over the shards in the order they first update a metric
+    size_t ThisShard();
+
+    class Counter
+    {
+    public:
+        void Add(uint64_t count = 1)
+        {
+            m_shards[ThisShard()].value.fetch_add(count, std::memory_order_relaxed);
+        }
+        uint64_t Value() const;
+
+    private:
+        struct alignas(64) Shard
+        {
+            std::atomic<uint64_t> value{0};
+        };
+        Shard m_shards[SHARDS];
+    };
+
+    struct HistogramSnapshot
+    {
+        std::vector<uint64_t> buckets;
+        uint64_t count = 0;
+        uint64_t sum = 0;
+
+        // Quantile returns this when the quantile lies in the overflow bucket
+        static constexpr uint64_t OVERFLOWED = UINT64_MAX;
+
+        // A value no more than about 3% from the true quantile; 0 when empty
+        uint64_t Quantile(double q) const;
+    };
+
+    class Histogram
+    {
+    public:
+        // Values below 2^44 keep their precision; larger ones are only counted,
+        // in an overflow bucket of their own after the last real one
+        static constexpr int SUB_BITS = 4;
+        static constexpr size_t OVERFLOW_BUCKET = (44 - SUB_BITS + 1) << SUB_BITS;
+        static constexpr size_t BUCKETS = OVERFLOW_BUCKET + 1;
+
+        // scale converts recorded values to the exported unit, e.g. 1e-9 for ns to seconds
+        explicit Histogram(double scale = 1) : m_scale(scale)
+        {}
+
+        void Record(uint64_t value)
+        {
+            Shard& shard = m_shards[ThisShard()];
+            shard.buckets[BucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+            shard.sum.fetch_add(value, std::memory_order_relaxed);
+        }
+
+        HistogramSnapshot Read() const;
+        double Scale() const { return m_scale; }
+
+        static size_t BucketOf(uint64_t value);
+        static uint64_t BucketMidpoint(size_t bucket); // OVERFLOWED for the overflow bucket
+
+    private:
+        struct alignas(64) Shard
+        {
+            std::atomic<uint64_t> buckets[BUCKETS]{};
+            std::atomic<uint64_t> sum{0};
+        };
+        double m_scale;
+        Shard m_shards[SHARDS];
+    };
+
+    // The same name and labels always return the same metric. labels is the
+    // Prometheus label list without braces, e.g. op="CreateKey", or empty.
+    Counter& GetCounter(const std::string& name, const std::string& labels, const std::string& help);
+    Histogram& GetHistogram(const std::string& name, const std::string& labels, const std::string& help,
+                            double scale = 1);
+
+    // Counters as counter, histograms as summary with 0.5/0.9/0.99/0.999 quantiles
+    std::string PrometheusText();
+
+    // Written to a temporary name and renamed, as the node_exporter textfile collector expects
+    bool WritePrometheusFile(const std::string& fileName);
+
+    // Writes the file every interval from a background thread, and right away
+    // on SIGUSR1 (Ctrl+Break for Windows console programs). Stopping writes
+    // it one last time.
+    void StartExporter(const std::string& fileName, std::chrono::milliseconds interval);
+    void StopExporter();
+
+    // Calls, failed calls and duration of one kind of operation:
+    // <prefix>_total, <prefix>_errors_total and <prefix>_duration_seconds, labelled op="<op>"
+    struct Operation
+    {
+        Operation(const std::string& prefix, const std::string& op);
+
+        Counter& calls;
+        Counter& errors;
+        Histogram& duration; // Nanoseconds
+    };
+
+    // Counts the call and records its duration when it goes out of scope
+    class OperationTimer
+    {
+    public:
+        explicit OperationTimer(Operation& operation)
+            : m_operation(operation), m_start(std::chrono::steady_clock::now())
+        {}
+        ~OperationTimer()
+        {
+            m_operation.calls.Add();
+            if (m_failed)
+            {
+                m_operation.errors.Add();
+            }
+            m_operation.duration.Record(static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count()));
+        }
+        OperationTimer(const OperationTimer&) = delete;
+        OperationTimer& operator=(const OperationTimer&) = delete;
+
+        void Fail() { m_failed = true; }
+
+    private:
+        Operation& m_operation;
+        std::chrono::steady_clock::time_point m_start;
+        bool m_failed = false;
+    };
+}
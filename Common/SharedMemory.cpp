@@ -0,0 +1,171 @@
+#include "SharedMemory.h"
+#include <cerrno>
+
+#ifdef _WIN32
+#include <windows.h>
+#include "Utf.h"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+SharedMemory::SharedMemory()
+{}
+
+SharedMemory::~SharedMemory()
+{
+    Close();
+}
+
+#ifdef _WIN32
+
+int32_t SharedMemory::Create(const std::string& name, size_t size)
+{
+    Close();
+    std::wstring mappingName = L"Local\\" + Widen(name);
+    uint64_t size64 = size;
+    HANDLE mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, static_cast<DWORD>(size64 >> 32),
+                                        static_cast<DWORD>(size64), mappingName.c_str());
+    if (!mapping)
+    {
+        return static_cast<int32_t>(GetLastError());
+    }
+    // Page-file mappings live as long as a handle does, so an existing one
+    // belongs to a running owner
+    if (GetLastError() == ERROR_ALREADY_EXISTS)
+    {
+        CloseHandle(mapping);
+        return ERROR_ALREADY_EXISTS;
+    }
+    m_data = static_cast<uint8_t*>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, size));
+    if (!m_data)
+    {
+        int32_t result = static_cast<int32_t>(GetLastError());
+        CloseHandle(mapping);
+        return result;
+    }
+    m_mapping = mapping;
+    m_size = size;
+    return 0;
+}
+
+int32_t SharedMemory::Open(const std::string& name)
+{
+    Close();
+    std::wstring mappingName = L"Local\\" + Widen(name);
+    HANDLE mapping = OpenFileMappingW(FILE_MAP_READ, FALSE, mappingName.c_str());
+    if (!mapping)
+    {
+        return static_cast<int32_t>(GetLastError());
+    }
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    MEMORY_BASIC_INFORMATION info;
+    if (!data || VirtualQuery(data, &info, sizeof(info)) == 0)
+    {
+        int32_t result = static_cast<int32_t>(GetLastError());
+        if (data)
+        {
+            UnmapViewOfFile(data);
+        }
+        CloseHandle(mapping);
+        return result;
+    }
+    m_data = static_cast<uint8_t*>(data);
+    m_size = info.RegionSize; // Rounded up to whole pages
+    m_mapping = mapping;
+    return 0;
+}
+
+void SharedMemory::Close()
+{
+    if (m_data)
+    {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping)
+    {
+        CloseHandle(m_mapping);
+    }
+    m_data = nullptr;
+    m_mapping = nullptr;
+    m_size = 0;
+}
+
+#else
+
+int32_t SharedMemory::Create(const std::string& name, size_t size)
+{
+    Close();
+    // A name left by an owner that crashed is replaced
+    std::string objectName = "/" + name;
+    shm_unlink(objectName.c_str());
+    int fd = shm_open(objectName.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        return errno;
+    }
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0)
+    {
+        int32_t result = errno;
+        close(fd);
+        shm_unlink(objectName.c_str());
+        return result;
+    }
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        int32_t result = errno;
+        shm_unlink(objectName.c_str());
+        return result;
+    }
+    m_data = static_cast<uint8_t*>(data);
+    m_size = size;
+    m_unlinkName = objectName;
+    return 0;
+}
+
+int32_t SharedMemory::Open(const std::string& name)
+{
+    Close();
+    int fd = shm_open(("/" + name).c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return errno;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        int32_t result = info.st_size == 0 ? EINVAL : errno;
+        close(fd);
+        return result;
+    }
+    void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return errno;
+    }
+    m_data = static_cast<uint8_t*>(data);
+    m_size = static_cast<size_t>(info.st_size);
+    return 0;
+}
+
+void SharedMemory::Close()
+{
+    if (m_data)
+    {
+        munmap(m_data, m_size);
+    }
+    if (!m_unlinkName.empty())
+    {
+        shm_unlink(m_unlinkName.c_str());
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_unlinkName.clear();
+}
+
+#endif
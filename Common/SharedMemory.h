@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Named memory shared between processes: a file mapping backed by the page
+// file on Windows ("Local\<name>"), a POSIX shared memory object elsewhere
+// ("/<name>"). The creator maps it writable; everyone else maps it read-only,
+// so a reader can never corrupt what the others see.
+class SharedMemory
+{
+public:
+    SharedMemory();
+    ~SharedMemory();
+    SharedMemory(const SharedMemory&) = delete;
+    SharedMemory& operator=(const SharedMemory&) = delete;
+
+    // Zero-filled. A segment a crashed owner left under the name is replaced;
+    // on Windows one still held open elsewhere fails with ERROR_ALREADY_EXISTS.
+    // Returns 0, or the GetLastError/errno code.
+    int32_t Create(const std::string& name, size_t size);
+
+    // Maps an existing segment read-only; returns 0 or the error code
+    int32_t Open(const std::string& name);
+
+    // Unmaps. The creator also removes the name, so later Opens fail;
+    // processes that still have it mapped keep their view.
+    void Close();
+
+    bool IsOpen() const { return m_data != nullptr; }
+    uint8_t* Data() const { return m_data; } // Writable only for the creator
+    size_t Size() const { return m_size; }
+
+private:
+    uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    void* m_mapping = nullptr; // HANDLE
+#else
+    std::string m_unlinkName; // Set for the creator
+#endif
+};
@@ -0,0 +1,140 @@
+#include "SystemMessages.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// Common codes are read from a lock-free table; the rest go through a map.
+// Native and errno codes overlap, so each numbering has its own cache.
+static constexpr int32_t DIRECT_SLOTS = 1024;
+
+struct MessageCache
+{
+    std::atomic<const std::string*> directSlots[DIRECT_SLOTS];
+    std::shared_mutex mutex;
+    std::unordered_map<int32_t, std::unique_ptr<const std::string>> messages;
+};
+
+static MessageCache g_systemMessages;
+#ifdef _WIN32
+static MessageCache g_errnoMessages;
+#endif
+
+// strerror_r is the GNU variant on glibc and the XSI variant elsewhere
+[[maybe_unused]] static const char* StrErrorResult(int result, const char* buffer)
+{
+    return result == 0 ? buffer : nullptr;
+}
+
+[[maybe_unused]] static const char* StrErrorResult(const char* result, const char*)
+{
+    return result;
+}
+
+static std::string TrimMessage(std::string message, int32_t code)
+{
+    // System texts end in a line break, callers append their own context
+    while (!message.empty() && (message.back() == '\n' || message.back() == '\r' || message.back() == ' '))
+    {
+        message.pop_back();
+    }
+    if (message.empty())
+    {
+        message = "Unknown error " + std::to_string(code);
+    }
+    return message;
+}
+
+static std::string FormatErrnoMessage(int32_t code)
+{
+    char buffer[512];
+    buffer[0] = '\0';
+#ifdef _WIN32
+    const char* text = strerror_s(buffer, sizeof(buffer), code) == 0 ? buffer : nullptr;
+#else
+    const char* text = StrErrorResult(strerror_r(code, buffer, sizeof(buffer)), buffer);
+#endif
+    return TrimMessage(text ? text : "", code);
+}
+
+static std::string FormatSystemMessage(int32_t code)
+{
+#ifdef _WIN32
+    char buffer[512];
+    DWORD size = FormatMessageA(FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
+                                nullptr, static_cast<DWORD>(code),
+                                MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT),
+                                buffer, sizeof(buffer), nullptr);
+    return TrimMessage(std::string(buffer, size), code);
+#else
+    return FormatErrnoMessage(code);
+#endif
+}
+
+static const std::string& CachedMessage(MessageCache& cache, int32_t code, std::string (*format)(int32_t))
+{
+    bool direct = code >= 0 && code < DIRECT_SLOTS;
+    if (direct)
+    {
+        if (const std::string* cached = cache.directSlots[code].load(std::memory_order_acquire))
+        {
+            return *cached;
+        }
+    }
+    else
+    {
+        std::shared_lock<std::shared_mutex> lock(cache.mutex);
+        auto it = cache.messages.find(code);
+        if (it != cache.messages.end())
+        {
+            return *it->second;
+        }
+    }
+
+    // First time for this code: format outside the lock, keep whichever copy wins
+    auto message = std::make_unique<const std::string>(format(code));
+    std::unique_lock<std::shared_mutex> lock(cache.mutex);
+    auto& stored = cache.messages.emplace(code, std::move(message)).first->second;
+    if (direct)
+    {
+        cache.directSlots[code].store(stored.get(), std::memory_order_release);
+    }
+    return *stored;
+}
+
+const std::string& SystemMessage(int32_t code)
+{
+    return CachedMessage(g_systemMessages, code, FormatSystemMessage);
+}
+
+const std::string& ErrnoMessage(int32_t code)
+{
+#ifdef _WIN32
+    return CachedMessage(g_errnoMessages, code, FormatErrnoMessage);
+#else
+    return CachedMessage(g_systemMessages, code, FormatErrnoMessage);
+#endif
+}
+
+SystemError SystemError::From(const std::error_code& ec)
+{
+    if (!ec)
+    {
+        return {};
+    }
+    // generic_category holds errno values; system_category is GetLastError on
+    // Windows and errno elsewhere
+    return ec.category() == std::generic_category() ? Errno(ec.value()) : Native(ec.value());
+}
+
+const std::string& SystemError::Message() const
+{
+    return domain == ERRNO ? ErrnoMessage(code) : SystemMessage(code);
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <system_error>
+
+// Text for a system error code: FormatMessage on Windows, strerror elsewhere.
+// Each code is formatted once per process and the text is kept for good, so
+// repeated failures with the same code cost a table lookup and no allocation.
+const std::string& SystemMessage(int32_t code);
+
+// Text for a C runtime errno value, strerror on every platform. On Windows
+// errno and GetLastError number their codes differently.
+const std::string& ErrnoMessage(int32_t code);
+
+// An OS error code together with the numbering it uses
+struct SystemError
+{
+    enum Domain : uint8_t
+    {
+        NONE,
+        NATIVE, // GetLastError or WSAGetLastError on Windows, errno elsewhere
+        ERRNO,  // C runtime errno on every platform
+    };
+
+    int32_t code = 0;
+    Domain domain = NONE;
+
+    static SystemError Native(int32_t code) { return {code, NATIVE}; }
+    static SystemError Errno(int32_t code) { return {code, ERRNO}; }
+    static SystemError From(const std::error_code& ec);
+
+    explicit operator bool() const { return domain != NONE && code != 0; }
+    const std::string& Message() const;
+};
@@ -0,0 +1,297 @@
+#include "Trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace Trace
+{
+    std::atomic<bool> g_enabled{false};
+
+    struct Event
+    {
+        const Site* site;
+        uint64_t begin;
+        uint64_t end;
+    };
+
+    // Single-producer single-consumer ring of spans: the owning thread pushes,
+    // TakeChromeTrace pops. Positions only grow; the mask wraps them.
+    struct ThreadBuffer
+    {
+        explicit ThreadBuffer(uint32_t id) : events(CAPACITY), threadId(id)
+        {}
+
+        static constexpr size_t CAPACITY = 64 * 1024;
+        std::vector<Event> events;
+        alignas(64) std::atomic<uint64_t> head{0};
+        alignas(64) std::atomic<uint64_t> tail{0};
+        uint32_t threadId;
+        std::atomic<uint64_t> recorded{0};
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<bool> retired{false}; // Owning thread has exited
+
+        std::mutex nameMutex;
+        std::string name;
+    };
+
+    class Tracer
+    {
+    public:
+        static Tracer& Instance()
+        {
+            static Tracer tracer;
+            return tracer;
+        }
+
+        std::shared_ptr<ThreadBuffer> Register(const std::string& name)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto buffer = std::make_shared<ThreadBuffer>(++m_nextThreadId);
+            buffer->name = name;
+            m_buffers.push_back(buffer);
+            return buffer;
+        }
+
+        std::string TakeChromeTrace()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            double ticksPerUs = TicksPerUs();
+
+            struct Pending
+            {
+                Event event;
+                uint32_t threadId;
+            };
+            std::vector<Pending> pending;
+            std::vector<std::pair<uint32_t, std::string>> names;
+            std::vector<ThreadBuffer*> finished;
+            for (const auto& buffer : m_buffers)
+            {
+                // Checked first: a thread that has exited cannot push after the drain
+                if (buffer->retired.load(std::memory_order_acquire))
+                {
+                    finished.push_back(buffer.get());
+                }
+                uint64_t tail = buffer->tail.load(std::memory_order_relaxed);
+                uint64_t head = buffer->head.load(std::memory_order_acquire);
+                for (uint64_t position = tail; position < head; ++position)
+                {
+                    pending.push_back({buffer->events[position & (ThreadBuffer::CAPACITY - 1)], buffer->threadId});
+                }
+                buffer->tail.store(head, std::memory_order_release);
+
+                std::lock_guard<std::mutex> nameLock(buffer->nameMutex);
+                if (!buffer->name.empty())
+                {
+                    names.emplace_back(buffer->threadId, buffer->name);
+                }
+            }
+
+            // Forget buffers whose thread is gone; they were just emptied
+            m_buffers.erase(std::remove_if(m_buffers.begin(), m_buffers.end(), [&](const std::shared_ptr<ThreadBuffer>& buffer)
+            {
+                if (std::find(finished.begin(), finished.end(), buffer.get()) == finished.end())
+                {
+                    return false;
+                }
+                m_recordedRetired += buffer->recorded;
+                m_droppedRetired += buffer->dropped;
+                return true;
+            }), m_buffers.end());
+
+            std::sort(pending.begin(), pending.end(),
+                      [](const Pending& a, const Pending& b) { return a.event.begin < b.event.begin; });
+
+            std::string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+            char number[160];
+            bool first = true;
+            for (const Pending& p : pending)
+            {
+                double ts = static_cast<double>(static_cast<int64_t>(p.event.begin - m_startTicks)) / ticksPerUs;
+                double dur = static_cast<double>(p.event.end - p.event.begin) / ticksPerUs;
+                out += first ? "\n{\"name\":" : ",\n{\"name\":";
+                AppendString(out, p.event.site->name);
+                out += ",\"cat\":";
+                AppendString(out, p.event.site->category);
+                snprintf(number, sizeof(number), ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%u,\"tid\":%u}", ts, dur,
+                         m_processId, p.threadId);
+                out += number;
+                first = false;
+            }
+            for (const auto& [threadId, name] : names)
+            {
+                snprintf(number, sizeof(number), "\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":", m_processId,
+                         threadId);
+                out += first ? "\n{\"name\":\"thread_name\"," : ",\n{\"name\":\"thread_name\",";
+                out += number;
+                AppendString(out, name.c_str());
+                out += "}}";
+                first = false;
+            }
+            out += "\n]}\n";
+            return out;
+        }
+
+        Stats GetStats()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            Stats stats{m_recordedRetired, m_droppedRetired, m_buffers.size()};
+            for (const auto& buffer : m_buffers)
+            {
+                stats.recorded += buffer->recorded.load(std::memory_order_relaxed);
+                stats.dropped += buffer->dropped.load(std::memory_order_relaxed);
+            }
+            return stats;
+        }
+
+    private:
+        Tracer() : m_startTicks(Ticks()), m_startTime(std::chrono::steady_clock::now())
+        {
+#ifdef _WIN32
+            m_processId = GetCurrentProcessId();
+#else
+            m_processId = static_cast<uint32_t>(getpid());
+#endif
+        }
+
+        // Calibrated against the steady clock over everything since start-up,
+        // waiting until that is at least 10 ms so the ratio is meaningful
+        double TicksPerUs() const
+        {
+            auto elapsed = std::chrono::steady_clock::now() - m_startTime;
+            if (elapsed < std::chrono::milliseconds(10))
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10) - elapsed);
+            }
+            uint64_t ticks = Ticks();
+            double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - m_startTime).count();
+            return static_cast<double>(ticks - m_startTicks) / us;
+        }
+
+        static void AppendString(std::string& out, const char* text)
+        {
+            out += '"';
+            for (const char* p = text; *p; ++p)
+            {
+                unsigned char ch = static_cast<unsigned char>(*p);
+                if (ch == '"' || ch == '\\')
+                {
+                    out += '\\';
+                    out += static_cast<char>(ch);
+                }
+                else if (ch < 0x20)
+                {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", ch);
+                    out += escaped;
+                }
+                else
+                {
+                    out += static_cast<char>(ch);
+                }
+            }
+            out += '"';
+        }
+
+        uint64_t m_startTicks;
+        std::chrono::steady_clock::time_point m_startTime;
+        uint32_t m_processId{};
+
+        std::mutex m_mutex; // Guards registration and export, never taken when recording
+        std::vector<std::shared_ptr<ThreadBuffer>> m_buffers;
+        uint32_t m_nextThreadId{0};
+        uint64_t m_recordedRetired{0};
+        uint64_t m_droppedRetired{0};
+    };
+
+    // The ring is registered by the thread's first span, so threads that only
+    // name themselves cost a string. The shared_ptr keeps the ring alive for
+    // the exporter after its thread exits.
+    struct ThreadState
+    {
+        std::shared_ptr<ThreadBuffer> buffer;
+        std::string name;
+        ~ThreadState()
+        {
+            if (buffer)
+            {
+                buffer->retired.store(true, std::memory_order_release);
+            }
+        }
+    };
+
+    static thread_local ThreadState t_thread;
+
+    static ThreadBuffer& ThisThread()
+    {
+        if (!t_thread.buffer)
+        {
+            t_thread.buffer = Tracer::Instance().Register(t_thread.name);
+        }
+        return *t_thread.buffer;
+    }
+
+    void SetEnabled(bool enabled)
+    {
+        Tracer::Instance(); // Starts the clock calibration before the first span
+        g_enabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    void Record(const Site& site, uint64_t begin, uint64_t end)
+    {
+        ThreadBuffer& buffer = ThisThread();
+        uint64_t head = buffer.head.load(std::memory_order_relaxed);
+        if (head - buffer.tail.load(std::memory_order_acquire) >= ThreadBuffer::CAPACITY)
+        {
+            buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        buffer.events[head & (ThreadBuffer::CAPACITY - 1)] = {&site, begin, end};
+        buffer.head.store(head + 1, std::memory_order_release);
+        buffer.recorded.store(buffer.recorded.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+#if LY_TRACE
+    void SetThreadName(const std::string& name)
+    {
+        t_thread.name = name;
+        if (t_thread.buffer)
+        {
+            std::lock_guard<std::mutex> lock(t_thread.buffer->nameMutex);
+            t_thread.buffer->name = name;
+        }
+    }
+#endif
+
+    std::string TakeChromeTrace()
+    {
+        return Tracer::Instance().TakeChromeTrace();
+    }
+
+    bool WriteChromeTrace(const std::string& fileName)
+    {
+        std::string json = TakeChromeTrace();
+        FILE* file = fopen(fileName.c_str(), "wb");
+        if (!file)
+        {
+            return false;
+        }
+        bool written = fwrite(json.data(), 1, json.size(), file) == json.size();
+        return fclose(file) == 0 && written;
+    }
+
+    Stats GetStats()
+    {
+        return Tracer::Instance().GetStats();
+    }
+}
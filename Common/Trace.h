@@ -0,0 +1,113 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define LY_TRACE_TSC 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#else
+#include <chrono>
+#endif
+
+// Scoped-span tracing behind the LY_TRACE_* macros.
+// A span reads the time stamp counter when it opens and when it closes and
+// pushes the pair into a ring owned by the calling thread; nothing is shared
+// on that path. WriteChromeTrace drains every ring into Chrome trace event
+// JSON, which chrome://tracing and ui.perfetto.dev open as they are.
+// Spans are recorded only while tracing is enabled at run time.
+
+// Set to 0 to compile every span out
+#ifndef LY_TRACE
+#define LY_TRACE 1
+#endif
+
+namespace Trace
+{
+    // Everything known at compile time about one span
+    struct Site
+    {
+        const char* name;
+        const char* category;
+    };
+
+    // TSC ticks on x86, nanoseconds elsewhere; converted when written out
+    inline uint64_t Ticks()
+    {
+#ifdef LY_TRACE_TSC
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+
+    extern std::atomic<bool> g_enabled;
+
+    inline bool Enabled()
+    {
+        return g_enabled.load(std::memory_order_relaxed);
+    }
+
+    void SetEnabled(bool enabled);
+
+    // Never blocks: when this thread's ring is full the span is dropped and counted
+    void Record(const Site& site, uint64_t begin, uint64_t end);
+
+    class Span
+    {
+    public:
+        explicit Span(const Site& site) : m_site(site), m_begin(Enabled() ? Ticks() : 0)
+        {}
+        ~Span()
+        {
+            if (m_begin != 0)
+            {
+                Record(m_site, m_begin, Ticks());
+            }
+        }
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+    private:
+        const Site& m_site;
+        uint64_t m_begin;
+    };
+
+    // Shown instead of the thread id in the trace viewer. Only kept until the
+    // thread's first span registers its ring.
+#if LY_TRACE
+    void SetThreadName(const std::string& name);
+#else
+    inline void SetThreadName(const std::string&)
+    {}
+#endif
+
+    // Takes every span recorded so far; the rings are empty afterwards
+    std::string TakeChromeTrace();
+    bool WriteChromeTrace(const std::string& fileName);
+
+    struct Stats
+    {
+        uint64_t recorded;
+        uint64_t dropped;
+        size_t threads; // Rings registered and not yet retired by an export
+    };
+    Stats GetStats();
+}
+
+#if LY_TRACE
+#define LY_TRACE_CONCAT_(_a_, _b_) _a_##_b_
+#define LY_TRACE_CONCAT(_a_, _b_) LY_TRACE_CONCAT_(_a_, _b_)
+#define LY_TRACE_SCOPE(_name_, _category_) \
+static const ::Trace::Site LY_TRACE_CONCAT(__traceSite, __LINE__) = { _name_, _category_ };\
+::Trace::Span LY_TRACE_CONCAT(__traceSpan, __LINE__)(LY_TRACE_CONCAT(__traceSite, __LINE__))
+#else
+#define LY_TRACE_SCOPE(_name_, _category_) do {} while (0)
+#endif
+
+#define LY_TRACE_FUNCTION(_category_) LY_TRACE_SCOPE(__FUNCTION__, _category_)
@@ -0,0 +1,523 @@
+#include "Utf.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define UTF_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// The SIMD kernels are built for their instruction set whatever the project's
+// target, and only called after the CPU has been checked
+#if defined(__GNUC__) || defined(__clang__)
+#define UTF_TARGET(isa) __attribute__((target(isa)))
+#else
+#define UTF_TARGET(isa)
+#endif
+
+static const char16_t REPLACEMENT = 0xFFFD;
+
+// Each kernel converts whole blocks from the start of the input while they are
+// pure ASCII and returns how many characters it converted
+struct KernelTable
+{
+    size_t (*asciiToUtf16)(const uint8_t* in, size_t size, char16_t* out);
+    size_t (*asciiFromUtf16)(const char16_t* in, size_t size, uint8_t* out);
+    size_t (*asciiPrefix)(const uint8_t* in, size_t size);
+};
+
+// Eight bytes or four units at a time in a 64-bit register
+static size_t ScalarToUtf16(const uint8_t* in, size_t size, char16_t* out)
+{
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, in + i, 8);
+        if (word & 0x8080808080808080ull)
+        {
+            break;
+        }
+        for (size_t k = 0; k < 8; ++k)
+        {
+            out[i + k] = in[i + k];
+        }
+    }
+    return i;
+}
+
+static size_t ScalarFromUtf16(const char16_t* in, size_t size, uint8_t* out)
+{
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4)
+    {
+        uint64_t word;
+        memcpy(&word, in + i, 8);
+        if (word & 0xFF80FF80FF80FF80ull)
+        {
+            break;
+        }
+        for (size_t k = 0; k < 4; ++k)
+        {
+            out[i + k] = static_cast<uint8_t>(in[i + k]);
+        }
+    }
+    return i;
+}
+
+static size_t ScalarAsciiPrefix(const uint8_t* in, size_t size)
+{
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, in + i, 8);
+        if (word & 0x8080808080808080ull)
+        {
+            break;
+        }
+    }
+    return i;
+}
+
+#if defined(UTF_X86)
+UTF_TARGET("sse4.1") static size_t Sse41ToUtf16(const uint8_t* in, size_t size, char16_t* out)
+{
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        if (_mm_movemask_epi8(bytes))
+        {
+            break;
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_cvtepu8_epi16(bytes));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 8), _mm_cvtepu8_epi16(_mm_srli_si128(bytes, 8)));
+    }
+    return i;
+}
+
+UTF_TARGET("sse4.1") static size_t Sse41FromUtf16(const char16_t* in, size_t size, uint8_t* out)
+{
+    const __m128i nonAscii = _mm_set1_epi16(static_cast<short>(0xFF80));
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 8));
+        if (!_mm_testz_si128(_mm_or_si128(low, high), nonAscii))
+        {
+            break;
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(low, high));
+    }
+    return i;
+}
+
+UTF_TARGET("sse4.1") static size_t Sse41AsciiPrefix(const uint8_t* in, size_t size)
+{
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        if (_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i))))
+        {
+            break;
+        }
+    }
+    return i;
+}
+
+// The AVX2 kernels finish with one SSE4.1 block so a 16-character tail is not left to the scalar loop
+UTF_TARGET("avx2") static size_t Avx2ToUtf16(const uint8_t* in, size_t size, char16_t* out)
+{
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        if (_mm256_movemask_epi8(bytes))
+        {
+            break;
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_cvtepu8_epi16(_mm256_castsi256_si128(bytes)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i + 16),
+                            _mm256_cvtepu8_epi16(_mm256_extracti128_si256(bytes, 1)));
+    }
+    return i + Sse41ToUtf16(in + i, std::min<size_t>(size - i, 16), out + i);
+}
+
+UTF_TARGET("avx2") static size_t Avx2FromUtf16(const char16_t* in, size_t size, uint8_t* out)
+{
+    const __m256i nonAscii = _mm256_set1_epi16(static_cast<short>(0xFF80));
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i + 16));
+        if (!_mm256_testz_si256(_mm256_or_si256(low, high), nonAscii))
+        {
+            break;
+        }
+        // packus works per 128-bit lane, so the quarters come out as low0 high0 low1 high1
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(low, high), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), packed);
+    }
+    return i + Sse41FromUtf16(in + i, std::min<size_t>(size - i, 16), out + i);
+}
+
+UTF_TARGET("avx2") static size_t Avx2AsciiPrefix(const uint8_t* in, size_t size)
+{
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        if (_mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i))))
+        {
+            break;
+        }
+    }
+    return i + Sse41AsciiPrefix(in + i, std::min<size_t>(size - i, 16));
+}
+#endif
+
+static const KernelTable KERNELS[] = {
+    {ScalarToUtf16, ScalarFromUtf16, ScalarAsciiPrefix},
+#if defined(UTF_X86)
+    {Sse41ToUtf16, Sse41FromUtf16, Sse41AsciiPrefix},
+    {Avx2ToUtf16, Avx2FromUtf16, Avx2AsciiPrefix},
+#endif
+};
+
+static std::atomic<int> g_kernel{-1};
+
+TextKernel BestTextKernel()
+{
+    static const TextKernel best = []
+    {
+#if defined(UTF_X86)
+#if defined(_MSC_VER) && !defined(__clang__)
+        int info[4];
+        __cpuid(info, 0);
+        int maxLeaf = info[0];
+        __cpuid(info, 1);
+        bool sse41 = (info[2] >> 19) & 1;
+        // AVX2 also needs the OS to save the YMM registers
+        bool osAvx = ((info[2] >> 27) & 1) && ((info[2] >> 28) & 1) && (_xgetbv(0) & 6) == 6;
+        bool avx2 = false;
+        if (osAvx && maxLeaf >= 7)
+        {
+            __cpuidex(info, 7, 0);
+            avx2 = (info[1] >> 5) & 1;
+        }
+#else
+        __builtin_cpu_init();
+        bool sse41 = __builtin_cpu_supports("sse4.1");
+        bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+        if (avx2)
+        {
+            return TextKernel::Avx2;
+        }
+        if (sse41)
+        {
+            return TextKernel::Sse41;
+        }
+#endif
+        return TextKernel::Scalar;
+    }();
+    return best;
+}
+
+TextKernel ActiveTextKernel()
+{
+    int kernel = g_kernel.load(std::memory_order_relaxed);
+    if (kernel < 0)
+    {
+        kernel = static_cast<int>(BestTextKernel());
+        g_kernel.store(kernel, std::memory_order_relaxed);
+    }
+    return static_cast<TextKernel>(kernel);
+}
+
+void SetTextKernel(TextKernel kernel)
+{
+    g_kernel.store(static_cast<int>(std::min(kernel, BestTextKernel())), std::memory_order_relaxed);
+}
+
+const char* TextKernelName(TextKernel kernel)
+{
+    switch (kernel)
+    {
+        case TextKernel::Scalar: return "scalar";
+        case TextKernel::Sse41: return "sse4.1";
+        case TextKernel::Avx2: return "avx2";
+    }
+    return "?";
+}
+
+static const KernelTable& Kernels()
+{
+    return KERNELS[static_cast<int>(ActiveTextKernel())];
+}
+
+// Decodes one sequence. An invalid one gives U+FFFD in cp, false, and the
+// length of its maximal subpart: the longest prefix that could still have
+// started a valid sequence, or one byte (Unicode 3.9, table 3-7).
+static bool DecodeSequence(const uint8_t* in, size_t size, uint32_t& cp, size_t& length)
+{
+    uint8_t lead = in[0];
+    size_t need;
+    uint8_t low = 0x80, high = 0xBF; // Allowed range of the second byte
+    if (lead < 0x80)
+    {
+        cp = lead;
+        length = 1;
+        return true;
+    }
+    else if (lead >= 0xC2 && lead <= 0xDF)
+    {
+        need = 1;
+        cp = lead & 0x1F;
+    }
+    else if (lead >= 0xE0 && lead <= 0xEF)
+    {
+        need = 2;
+        cp = lead & 0x0F;
+        if (lead == 0xE0) low = 0xA0;  // Overlong
+        if (lead == 0xED) high = 0x9F; // Surrogates
+    }
+    else if (lead >= 0xF0 && lead <= 0xF4)
+    {
+        need = 3;
+        cp = lead & 0x07;
+        if (lead == 0xF0) low = 0x90;  // Overlong
+        if (lead == 0xF4) high = 0x8F; // Above U+10FFFF
+    }
+    else
+    {
+        cp = REPLACEMENT;
+        length = 1;
+        return false;
+    }
+
+    for (size_t k = 1; k <= need; ++k)
+    {
+        uint8_t byte = k < size ? in[k] : 0;
+        if (k >= size || byte < (k == 1 ? low : 0x80) || byte > (k == 1 ? high : 0xBF))
+        {
+            cp = REPLACEMENT;
+            length = k;
+            return false;
+        }
+        cp = (cp << 6) | (byte & 0x3F);
+    }
+    length = need + 1;
+    return true;
+}
+
+static bool ToUtf16(const uint8_t* in, size_t size, char16_t* out, size_t& written, InvalidText invalid,
+                    size_t* errorOffset)
+{
+    const KernelTable& kernels = Kernels();
+    size_t i = 0, o = 0;
+    while (i < size)
+    {
+        size_t ascii = kernels.asciiToUtf16(in + i, size - i, out + o);
+        i += ascii;
+        o += ascii;
+
+        // The block that stopped the kernel goes through the scalar loop, so
+        // text with few ASCII runs does not pay for a failed check every character
+        size_t stop = std::min(size, i + 32);
+        while (i < stop)
+        {
+            if (in[i] < 0x80)
+            {
+                out[o++] = in[i++];
+                continue;
+            }
+            uint32_t cp;
+            size_t length;
+            if (!DecodeSequence(in + i, size - i, cp, length) && invalid == InvalidText::Fail)
+            {
+                written = o;
+                if (errorOffset)
+                {
+                    *errorOffset = i;
+                }
+                return false;
+            }
+            if (cp >= 0x10000)
+            {
+                out[o++] = static_cast<char16_t>(0xD800 + ((cp - 0x10000) >> 10));
+                out[o++] = static_cast<char16_t>(0xDC00 + ((cp - 0x10000) & 0x3FF));
+            }
+            else
+            {
+                out[o++] = static_cast<char16_t>(cp);
+            }
+            i += length;
+        }
+    }
+    written = o;
+    return true;
+}
+
+static bool ToUtf8(const char16_t* in, size_t size, uint8_t* out, size_t& written, InvalidText invalid,
+                   size_t* errorOffset)
+{
+    const KernelTable& kernels = Kernels();
+    size_t i = 0, o = 0;
+    while (i < size)
+    {
+        size_t ascii = kernels.asciiFromUtf16(in + i, size - i, out + o);
+        i += ascii;
+        o += ascii;
+
+        size_t stop = std::min(size, i + 32);
+        while (i < stop)
+        {
+            uint32_t cp = in[i];
+            if (cp < 0x80)
+            {
+                out[o++] = static_cast<uint8_t>(cp);
+                ++i;
+                continue;
+            }
+            if (cp >= 0xD800 && cp < 0xE000)
+            {
+                if (cp < 0xDC00 && i + 1 < size && in[i + 1] >= 0xDC00 && in[i + 1] < 0xE000)
+                {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (in[i + 1] - 0xDC00);
+                    ++i;
+                }
+                else if (invalid == InvalidText::Fail)
+                {
+                    written = o;
+                    if (errorOffset)
+                    {
+                        *errorOffset = i;
+                    }
+                    return false;
+                }
+                else
+                {
+                    cp = REPLACEMENT;
+                }
+            }
+            if (cp < 0x800)
+            {
+                out[o++] = static_cast<uint8_t>(0xC0 | (cp >> 6));
+            }
+            else if (cp < 0x10000)
+            {
+                out[o++] = static_cast<uint8_t>(0xE0 | (cp >> 12));
+                out[o++] = static_cast<uint8_t>(0x80 | ((cp >> 6) & 0x3F));
+            }
+            else
+            {
+                out[o++] = static_cast<uint8_t>(0xF0 | (cp >> 18));
+                out[o++] = static_cast<uint8_t>(0x80 | ((cp >> 12) & 0x3F));
+                out[o++] = static_cast<uint8_t>(0x80 | ((cp >> 6) & 0x3F));
+            }
+            out[o++] = static_cast<uint8_t>(0x80 | (cp & 0x3F));
+            ++i;
+        }
+    }
+    written = o;
+    return true;
+}
+
+// Outputs are sized for the worst case and trimmed: UTF-8 never takes more
+// UTF-16 units than bytes, and UTF-16 never more than three bytes per unit
+bool Utf8ToUtf16(std::string_view text, std::u16string& out, InvalidText invalid, size_t* errorOffset)
+{
+    out.resize(text.size());
+    size_t written = 0;
+    bool ok = ToUtf16(reinterpret_cast<const uint8_t*>(text.data()), text.size(), out.data(), written, invalid,
+                      errorOffset);
+    out.resize(written);
+    return ok;
+}
+
+bool Utf16ToUtf8(std::u16string_view text, std::string& out, InvalidText invalid, size_t* errorOffset)
+{
+    out.resize(text.size() * 3);
+    size_t written = 0;
+    bool ok = ToUtf8(text.data(), text.size(), reinterpret_cast<uint8_t*>(out.data()), written, invalid,
+                     errorOffset);
+    out.resize(written);
+    return ok;
+}
+
+bool IsAscii(std::string_view text)
+{
+    const uint8_t* in = reinterpret_cast<const uint8_t*>(text.data());
+    size_t i = Kernels().asciiPrefix(in, text.size());
+    for (; i < text.size(); ++i)
+    {
+        if (in[i] >= 0x80)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool IsValidUtf8(std::string_view text)
+{
+    const uint8_t* in = reinterpret_cast<const uint8_t*>(text.data());
+    const KernelTable& kernels = Kernels();
+    size_t i = 0;
+    while (i < text.size())
+    {
+        i += kernels.asciiPrefix(in + i, text.size() - i);
+        size_t stop = std::min(text.size(), i + 32);
+        while (i < stop)
+        {
+            uint32_t cp;
+            size_t length;
+            if (!DecodeSequence(in + i, text.size() - i, cp, length))
+            {
+                return false;
+            }
+            i += length;
+        }
+    }
+    return true;
+}
+
+uint32_t NextCodePoint(std::string_view text, size_t& offset)
+{
+    uint32_t cp;
+    size_t length;
+    DecodeSequence(reinterpret_cast<const uint8_t*>(text.data()) + offset, text.size() - offset, cp, length);
+    offset += length;
+    return cp;
+}
+
+#ifdef _WIN32
+static_assert(sizeof(wchar_t) == sizeof(char16_t), "The W APIs take UTF-16");
+
+std::wstring Widen(std::string_view text)
+{
+    std::wstring out(text.size(), L'\0');
+    size_t written = 0;
+    ToUtf16(reinterpret_cast<const uint8_t*>(text.data()), text.size(), reinterpret_cast<char16_t*>(out.data()),
+            written, InvalidText::Replace, nullptr);
+    out.resize(written);
+    return out;
+}
+
+std::string Narrow(std::wstring_view text)
+{
+    std::string out(text.size() * 3, '\0');
+    size_t written = 0;
+    ToUtf8(reinterpret_cast<const char16_t*>(text.data()), text.size(), reinterpret_cast<uint8_t*>(out.data()),
+           written, InvalidText::Replace, nullptr);
+    out.resize(written);
+    return out;
+}
+#endif
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// UTF-8 <-> UTF-16 transcoding. Text is UTF-8 inside the program and UTF-16
+// only at API boundaries. Runs of ASCII are converted 16 or 32 characters at
+// a time with SSE4.1 or AVX2, picked once from what the CPU supports; the
+// rest goes through a scalar converter that validates as it goes.
+
+enum class TextKernel
+{
+    Scalar,
+    Sse41,
+    Avx2,
+};
+
+// What an invalid sequence does to a conversion
+enum class InvalidText
+{
+    Fail,    // The conversion stops and returns false
+    Replace, // Each maximal invalid subpart becomes U+FFFD, as MultiByteToWideChar does
+};
+
+// The kernel conversions use; SetTextKernel is for benchmarks and falls back
+// to the best supported kernel when asked for one the CPU lacks
+TextKernel BestTextKernel();
+TextKernel ActiveTextKernel();
+void SetTextKernel(TextKernel kernel);
+const char* TextKernelName(TextKernel kernel);
+
+// On failure out holds what was converted before the first invalid
+// sequence and errorOffset, when given, its position in the input
+bool Utf8ToUtf16(std::string_view text, std::u16string& out, InvalidText invalid = InvalidText::Fail,
+                 size_t* errorOffset = nullptr);
+bool Utf16ToUtf8(std::u16string_view text, std::string& out, InvalidText invalid = InvalidText::Fail,
+                 size_t* errorOffset = nullptr);
+
+bool IsAscii(std::string_view text);
+bool IsValidUtf8(std::string_view text);
+
+// Decodes the code point at offset and moves past it; invalid bytes give U+FFFD
+uint32_t NextCodePoint(std::string_view text, size_t& offset);
+
+#ifdef _WIN32
+// For the W APIs; invalid input is replaced rather than rejected
+std::wstring Widen(std::string_view text);
+std::string Narrow(std::wstring_view text);
+#endif
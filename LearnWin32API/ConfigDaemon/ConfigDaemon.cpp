@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../../Common/MappedFile.h"
+#include "../../Registry/ConfigService.h"
+#include "../../Registry/MemoryBackend.h"
+#include "../../Registry/RegFile.h"
+#include "../../Registry/RegistryBundle.h"
+#include "../../Registry/RegistryDiff.h"
+#include "../../Registry/RegistryTransaction.h"
+#include "../../Registry/RegistryTree.h"
+#ifdef _WIN32
+#include "../../Registry/Win32Backend.h"
+#endif
+
+// Serves a registry subtree to local processes through ConfigService: they
+// map the segment with SharedConfigReader and may subscribe to the socket
+// for change events. The source is either a .reg file, loaded into the
+// in-memory backend and reloaded whenever the file changes (the stand-in that
+// works everywhere), or on Windows the live registry under HKEY_CURRENT_USER.
+//
+// Usage: ConfigDaemon [--reg <file>] [--hive <name>] [--root <path>] [--segment <name>]
+//                     [--socket <path>] [--interval-ms <n>]
+//
+// --hive picks the part of the .reg file to serve (HKEY_CURRENT_USER by
+// default); --root the subtree below it, or below HKEY_CURRENT_USER without
+// --reg. The socket defaults to learn-win32api-config.sock in the temp
+// directory. Runs until Ctrl+C.
+
+static std::atomic<bool> g_stop{false};
+
+static void OnStopSignal(int)
+{
+    g_stop = true;
+}
+
+// Makes the backend hold exactly what the file describes. The file is built
+// into a scratch backend and only the difference is applied, as one batch,
+// so the service never captures a half-loaded tree.
+static bool LoadRegFile(const std::string& fileName, const std::string& hive, MemoryRegistryBackend& backend,
+                        RegistryError& error)
+{
+    std::vector<RegistryDelta> entries;
+    if (!ReadRegFile(fileName, entries, error))
+    {
+        return false;
+    }
+    RegistryBundle bundle;
+    CompileBundle(entries, bundle);
+
+    auto loaded = std::make_shared<MemoryRegistryBackend>();
+    RegistryTransaction load(loaded, nullptr);
+    BundleApplyStats stats;
+    if (!ApplyBundle(load, bundle, hive, stats, error))
+    {
+        return false;
+    }
+
+    RegistryTree before, after;
+    std::vector<RegistryDelta> delta;
+    if (!CaptureTree(backend.TakeSnapshot(), "", before, error) || !CaptureTree(loaded->TakeSnapshot(), "", after, error))
+    {
+        return false;
+    }
+    if (before.keys.empty() || after.keys.empty())
+    {
+        // DiffTrees needs both roots; start over from the file instead
+        std::vector<RegistryChange> changes;
+        loaded->Export(changes);
+        backend.Clear();
+        size_t failedIndex;
+        return backend.ApplyChanges(changes, failedIndex) == REGISTRY_SUCCESS;
+    }
+    DiffTrees(before, after, delta);
+    if (delta.empty())
+    {
+        return true;
+    }
+    std::shared_ptr<RegistryBackend> target(&backend, [](RegistryBackend*) {});
+    RegistryTransaction transaction(target, nullptr);
+    return ApplyDelta(transaction, "", delta, error);
+}
+
+int main(int argc, char** argv)
+{
+    std::string regFile;
+    std::string hive = "HKEY_CURRENT_USER";
+    int intervalMs = 250;
+    ConfigServiceOptions options;
+    options.socketPath = (std::filesystem::temp_directory_path() / "learn-win32api-config.sock").string();
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--reg") && i + 1 < argc) regFile = argv[++i];
+        else if (!strcmp(argv[i], "--hive") && i + 1 < argc) hive = argv[++i];
+        else if (!strcmp(argv[i], "--root") && i + 1 < argc) options.rootPath = argv[++i];
+        else if (!strcmp(argv[i], "--segment") && i + 1 < argc) options.segmentName = argv[++i];
+        else if (!strcmp(argv[i], "--socket") && i + 1 < argc) options.socketPath = argv[++i];
+        else if (!strcmp(argv[i], "--interval-ms") && i + 1 < argc) intervalMs = (std::max)(10, atoi(argv[++i]));
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--reg <file>] [--hive <name>] [--root <path>] [--segment <name>]"
+                      << " [--socket <path>] [--interval-ms <n>]\n";
+            return 2;
+        }
+    }
+    options.pollInterval = std::chrono::milliseconds(intervalMs);
+
+    RegistryError error;
+    std::shared_ptr<RegistryBackend> backend;
+    std::shared_ptr<MemoryRegistryBackend> memory;
+    FileStamp stamp;
+    if (!regFile.empty())
+    {
+        memory = std::make_shared<MemoryRegistryBackend>();
+        stamp = ReadFileStamp(regFile);
+        if (!LoadRegFile(regFile, hive, *memory, error))
+        {
+            std::cerr << error.Message() << "\n";
+            return 1;
+        }
+        backend = memory;
+    }
+    else
+    {
+#ifdef _WIN32
+        backend = std::make_shared<Win32RegistryBackend>(HKEY_CURRENT_USER);
+#else
+        std::cerr << "Only --reg files can be served on this platform\n";
+        return 2;
+#endif
+    }
+
+    ConfigService service(backend, options);
+    if (!service.Start(error))
+    {
+        std::cerr << error.Message() << "\n";
+        return 1;
+    }
+    printf("Serving '%s' as segment '%s'%s%s, generation %llu\n", options.rootPath.c_str(), options.segmentName.c_str(),
+           options.socketPath.empty() ? "" : ", events on ", options.socketPath.c_str(),
+           static_cast<unsigned long long>(service.Generation()));
+
+    std::signal(SIGINT, OnStopSignal);
+    std::signal(SIGTERM, OnStopSignal);
+    while (!g_stop)
+    {
+        std::this_thread::sleep_for(options.pollInterval);
+        if (!memory)
+        {
+            continue; // The service polls the registry itself
+        }
+        FileStamp current = ReadFileStamp(regFile);
+        if (current == stamp)
+        {
+            continue;
+        }
+        stamp = current;
+        if (!LoadRegFile(regFile, hive, *memory, error) || !service.Refresh(error))
+        {
+            std::cerr << error.Message() << "\n"; // Keeps serving the last good generation
+            continue;
+        }
+        printf("Reloaded %s, generation %llu\n", regFile.c_str(), static_cast<unsigned long long>(service.Generation()));
+    }
+    service.Stop();
+    return 0;
+}
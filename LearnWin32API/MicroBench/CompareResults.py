@@ -0,0 +1,68 @@
+import argparse
+import json
+import sys
+
+# Compares two MicroBench --json result files case by case.
+# A case regresses when its median grew by more than --threshold and the
+# runs do not overlap: the fastest new sample is slower than the baseline
+# p90, so one noisy sample is not enough to flag it.
+# Exits with 1 when anything regressed, so it can gate a build.
+#
+# Usage: python CompareResults.py baseline.json current.json [--threshold 0.10]
+
+
+def load_results(file_name):
+    with open(file_name, encoding="utf-8") as f:
+        document = json.load(f)
+    return document.get("context", {}), {r["name"]: r for r in document["results"]}
+
+
+def format_ns(ns):
+    if ns < 1e3:
+        return f"{ns:.1f} ns"
+    if ns < 1e6:
+        return f"{ns / 1e3:.2f} us"
+    return f"{ns / 1e6:.2f} ms"
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Flags MicroBench regressions against a baseline")
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=0.10,
+                        help="relative growth of the median that counts, 0.10 by default")
+    args = parser.parse_args()
+
+    base_context, baseline = load_results(args.baseline)
+    context, current = load_results(args.current)
+    for key in ("platform", "build", "compiler"):
+        if base_context.get(key) != context.get(key):
+            print(f"warning: {key} differs: {base_context.get(key)} -> {context.get(key)}")
+
+    regressions = 0
+    print(f"{'case':<22} {'baseline':>12} {'current':>12} {'change':>9}  status")
+    for name in sorted(set(baseline) | set(current)):
+        if name not in current:
+            print(f"{name:<22} {format_ns(baseline[name]['median']):>12} {'':>12} {'':>9}  missing")
+            continue
+        if name not in baseline:
+            print(f"{name:<22} {'':>12} {format_ns(current[name]['median']):>12} {'':>9}  new")
+            continue
+        old, new = baseline[name], current[name]
+        change = new["median"] / old["median"] - 1 if old["median"] > 0 else 0.0
+        status = "ok"
+        if change > args.threshold and new["min"] > old["p90"]:
+            status = "REGRESSION"
+            regressions += 1
+        elif change < -args.threshold and new["p90"] < old["min"]:
+            status = "faster"
+        print(f"{name:<22} {format_ns(old['median']):>12} {format_ns(new['median']):>12} {change:>+8.1%}  {status}")
+
+    if regressions:
+        print(f"\n{regressions} case(s) regressed by more than {args.threshold:.0%}")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
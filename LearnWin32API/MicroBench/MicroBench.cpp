@@ -0,0 +1,1053 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "../../Common/CommandGraph.h"
+#include "../../Common/CommandRunner.h"
+#include "../../Common/Json.h"
+#include "../../Common/Metrics.h"
+#include "../../Common/Utf.h"
+#include "../../Registry/MemoryBackend.h"
+#include "../../Registry/RegFile.h"
+#include "../../Registry/RegistryManager.h"
+#include "../OverlayingRectangles/SoftwareRasterizer.h"
+
+// One suite for the hot paths of every part of the repo, run on the portable
+// backends so it gives comparable numbers on any machine. Each case is timed
+// over --samples samples of a fixed number of operations after one warm-up
+// sample; min, median and p90 are per operation.
+// registry/: RegistryManager reads and writes on the in-memory backend, hot
+//            (one key over and over) and cold (10000 keys in shuffled order).
+// enum/:     EnumSubkeys and EnumValues on one key with 10000 subkeys and
+//            10000 values, and a full walk of a 12 level binary tree.
+// regparse/: ParseRegFile on a 5000 key export, as UTF-8 and as UTF-16LE.
+// process/:  ExecuteCommand running /bin/true (exit 0 through PowerShell on
+//            Windows), end to end and the spawn alone from command metrics;
+//            RunCommandGraph on a probe-shaped graph of them (one, then three
+//            in parallel, then one). Also checks that a graph of sleeps takes
+//            its critical path rather than the sum, piping, that a failure or
+//            the batch deadline cancels what depends on it, and that cycles
+//            are refused. process/json: ExecuteJsonCommand on a product
+//            listing, read record by record.
+// json/:     JsonParser on a 25000 product ConvertTo-Json listing fed in
+//            64 KB chunks, once per text kernel, then into records and into a
+//            whole document. Checks exact events for escapes, surrogates and
+//            numbers, the same events from every kernel and any chunking
+//            (including mutated documents), and that invalid JSON is refused.
+// overlay/:  headless RenderRectangles at 1080p with 10 to 10000 rectangles.
+// Every case checks its results, so a broken build cannot report fast numbers.
+//
+// --json <file> writes the results for CompareResults.py, which flags
+// regressions against a baseline from an earlier run.
+//
+// Usage: MicroBench [--filter <name prefix>] [--samples <n>] [--json <file>]
+
+struct Result
+{
+    std::string name;
+    int samples;
+    uint64_t operations; // Per sample
+    double minNs, medianNs, p90Ns;
+    double throughput; // Per second, 0 when not meaningful
+    const char* throughputUnit;
+};
+
+static std::string g_filter;
+static int g_samples = 10;
+static std::vector<Result> g_results;
+
+// Prefix match either way, so a group runs when the filter names one of its cases
+static bool Selected(const std::string& name)
+{
+    return name.compare(0, g_filter.size(), g_filter) == 0 || g_filter.compare(0, name.size(), name) == 0;
+}
+
+static Result Summarize(const std::string& name, uint64_t operations, std::vector<double> nsPerOperation)
+{
+    std::sort(nsPerOperation.begin(), nsPerOperation.end());
+    Result result{name, static_cast<int>(nsPerOperation.size()), operations, nsPerOperation.front(),
+                  nsPerOperation[nsPerOperation.size() / 2],
+                  nsPerOperation[(std::min)(nsPerOperation.size() - 1, nsPerOperation.size() * 9 / 10)], 0, ""};
+    return result;
+}
+
+// body(i) runs operation i; itemsPerOperation turns the median into a throughput
+template <typename Fn>
+static Result* Measure(const std::string& name, uint64_t operations, Fn&& body, double itemsPerOperation = 0,
+                       const char* throughputUnit = "")
+{
+    if (!Selected(name))
+    {
+        return nullptr;
+    }
+    std::vector<double> samples;
+    for (int sample = -1; sample < g_samples; ++sample)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < operations; ++i)
+        {
+            body(i);
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        if (sample >= 0)
+        {
+            samples.push_back(ns / operations);
+        }
+    }
+    g_results.push_back(Summarize(name, operations, samples));
+    Result& result = g_results.back();
+    if (itemsPerOperation > 0)
+    {
+        result.throughput = itemsPerOperation * 1e9 / result.medianNs;
+        result.throughputUnit = throughputUnit;
+    }
+    return &result;
+}
+
+static std::string FormatNs(double ns)
+{
+    char text[32];
+    if (ns < 1e3) snprintf(text, sizeof(text), "%.1f ns", ns);
+    else if (ns < 1e6) snprintf(text, sizeof(text), "%.2f us", ns / 1e3);
+    else snprintf(text, sizeof(text), "%.2f ms", ns / 1e6);
+    return text;
+}
+
+// Deterministic, so every run measures the same keys in the same order
+class Random
+{
+public:
+    explicit Random(uint32_t seed) : m_state(seed)
+    {}
+
+    uint32_t Next(uint32_t range)
+    {
+        m_state = m_state * 1664525u + 1013904223u;
+        return (m_state >> 8) % range;
+    }
+
+private:
+    uint32_t m_state;
+};
+
+static int RunRegistryCases()
+{
+    if (!Selected("registry/"))
+    {
+        return 0;
+    }
+    const int KEYS = 10000;
+    auto backend = std::make_shared<MemoryRegistryBackend>();
+    RegistryManager manager(backend);
+    RegistryError error;
+
+    std::vector<std::string> keys;
+    Random random(0xC01D);
+    for (int i = 0; i < KEYS; ++i)
+    {
+        char key[96];
+        snprintf(key, sizeof(key), "Software\\Vendor%u\\Product%u\\Component%d", random.Next(50), random.Next(20), i);
+        keys.push_back(key);
+        manager.CreateKey(key, error);
+        manager.WriteStringValue(key, "InstallPath", "C:\\Program Files\\Component" + std::to_string(i), error);
+    }
+    std::vector<size_t> order(KEYS);
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+    for (size_t i = order.size() - 1; i > 0; --i)
+    {
+        std::swap(order[i], order[random.Next(static_cast<uint32_t>(i + 1))]);
+    }
+
+    int failures = 0;
+    std::string data;
+    const std::string& hot = keys[0];
+    Measure("registry/read/hot", 20000, [&](uint64_t)
+    {
+        failures += !manager.ReadStringValue(hot, "InstallPath", data, error);
+    });
+    Measure("registry/read/cold", 20000, [&](uint64_t i)
+    {
+        failures += !manager.ReadStringValue(keys[order[i % KEYS]], "InstallPath", data, error);
+    });
+    Measure("registry/write/hot", 20000, [&](uint64_t)
+    {
+        failures += !manager.WriteStringValue(hot, "InstallPath", "C:\\Program Files\\Hot", error);
+    });
+    Measure("registry/write/cold", 20000, [&](uint64_t i)
+    {
+        failures += !manager.WriteStringValue(keys[order[i % KEYS]], "InstallPath", "C:\\Program Files\\Cold", error);
+    });
+    if (failures > 0)
+    {
+        std::cerr << "registry: " << failures << " operations failed, last: " << error.Message() << "\n";
+    }
+    return failures > 0 ? 1 : 0;
+}
+
+static void BuildBinaryTree(MemoryRegistryBackend& backend, const std::string& path, int depth)
+{
+    backend.CreateKey(path);
+    backend.SetValue(path, "Name", RegistryValue::String(path));
+    backend.SetValue(path, "Depth", RegistryValue::DWord(depth));
+    if (depth > 1)
+    {
+        BuildBinaryTree(backend, path + "\\Left", depth - 1);
+        BuildBinaryTree(backend, path + "\\Right", depth - 1);
+    }
+}
+
+// Returns the number of keys visited
+static size_t WalkTree(RegistryBackend& backend, const std::string& path)
+{
+    std::vector<std::string> subkeys;
+    std::vector<std::pair<std::string, RegistryValue>> values;
+    backend.EnumSubkeys(path, subkeys);
+    backend.EnumValues(path, values);
+    size_t visited = 1;
+    for (const std::string& subkey : subkeys)
+    {
+        visited += WalkTree(backend, path + "\\" + subkey);
+    }
+    return visited;
+}
+
+static int RunEnumerationCases()
+{
+    if (!Selected("enum/"))
+    {
+        return 0;
+    }
+    const int WIDTH = 10000;
+    const int DEPTH = 12;
+    MemoryRegistryBackend backend;
+    std::vector<RegistryChange> changes;
+    for (int i = 0; i < WIDTH; ++i)
+    {
+        std::string name = "Entry" + std::to_string(i);
+        changes.push_back({RegistryChange::CREATE_KEY, "Wide\\" + name, "", {}});
+        changes.push_back({RegistryChange::SET_VALUE, "Wide", name, RegistryValue::DWord(i)});
+    }
+    size_t failedIndex = 0;
+    backend.ApplyChanges(changes, failedIndex);
+    BuildBinaryTree(backend, "Deep", DEPTH);
+
+    int failures = 0;
+    std::vector<std::string> subkeys;
+    std::vector<std::pair<std::string, RegistryValue>> values;
+    Measure("enum/wide", 20, [&](uint64_t)
+    {
+        subkeys.clear();
+        values.clear();
+        backend.EnumSubkeys("Wide", subkeys);
+        backend.EnumValues("Wide", values);
+    }, 2.0 * WIDTH, "items/s");
+    if (Selected("enum/wide") && (subkeys.size() != WIDTH || values.size() != WIDTH))
+    {
+        std::cerr << "enum/wide: found " << subkeys.size() << " subkeys and " << values.size() << " values\n";
+        ++failures;
+    }
+
+    const size_t treeKeys = (size_t(1) << DEPTH) - 1;
+    size_t visited = 0;
+    Measure("enum/deep", 5, [&](uint64_t) { visited = WalkTree(backend, "Deep"); }, static_cast<double>(treeKeys), "keys/s");
+    if (Selected("enum/deep") && visited != treeKeys)
+    {
+        std::cerr << "enum/deep: visited " << visited << " keys of " << treeKeys << "\n";
+        ++failures;
+    }
+    return failures;
+}
+
+// What regedit exports for an installed product: strings, a DWORD and a binary blob
+static std::string MakeRegText(int keys)
+{
+    std::string text = "Windows Registry Editor Version 5.00\r\n";
+    char entry[512];
+    for (int i = 0; i < keys; ++i)
+    {
+        snprintf(entry, sizeof(entry),
+                 "\r\n[HKEY_LOCAL_MACHINE\\SOFTWARE\\Vendor%d\\Product%d]\r\n"
+                 "\"DisplayName\"=\"Product %d\"\r\n"
+                 "\"InstallLocation\"=\"C:\\\\Program Files\\\\Vendor%d\\\\Product%d\"\r\n"
+                 "\"Version\"=dword:%08x\r\n"
+                 "\"Signature\"=hex:%02x,01,02,03,04,05,06,07,08,09,0a,0b,0c,0d,0e,0f\r\n",
+                 i % 97, i, i, i % 97, i, i, i & 0xFF);
+        text += entry;
+    }
+    return text;
+}
+
+static int RunRegParseCases()
+{
+    if (!Selected("regparse/"))
+    {
+        return 0;
+    }
+    const int KEYS = 5000;
+    const size_t ENTRIES = KEYS * 5;
+    std::string utf8 = MakeRegText(KEYS);
+    std::u16string wide;
+    Utf8ToUtf16(utf8, wide);
+    std::string utf16 = "\xFF\xFE";
+    for (char16_t unit : wide)
+    {
+        utf16 += static_cast<char>(unit & 0xFF);
+        utf16 += static_cast<char>(unit >> 8);
+    }
+
+    int failures = 0;
+    for (const auto& [name, text] : {std::make_pair("regparse/utf8", &utf8), std::make_pair("regparse/utf16", &utf16)})
+    {
+        std::vector<RegistryDelta> entries;
+        RegistryError error;
+        bool parsed = true;
+        Measure(name, 3, [&](uint64_t)
+        {
+            entries.clear();
+            parsed = ParseRegFile(*text, "bench.reg", entries, error) && parsed;
+        }, text->size() / 1e6, "MB/s");
+        if (Selected(name) && (!parsed || entries.size() != ENTRIES))
+        {
+            std::cerr << name << ": " << entries.size() << " entries of " << ENTRIES << " " << error.Message() << "\n";
+            ++failures;
+        }
+    }
+    return failures;
+}
+
+// The recorded values since before, as a snapshot of its own
+static Metrics::HistogramSnapshot Since(const Metrics::HistogramSnapshot& before, const Metrics::HistogramSnapshot& after)
+{
+    Metrics::HistogramSnapshot delta = after;
+    for (size_t i = 0; i < delta.buckets.size(); ++i)
+    {
+        delta.buckets[i] -= before.buckets[i];
+    }
+    delta.count -= before.count;
+    delta.sum -= before.sum;
+    return delta;
+}
+
+static int RunProcessCases()
+{
+    if (!Selected("process/"))
+    {
+        return 0;
+    }
+#ifdef _WIN32
+    const char* command = "exit 0";
+#else
+    const char* command = "/bin/true";
+#endif
+    int failures = 0;
+    std::string echoed = ExecuteCommand("echo ready", 5000);
+    if (echoed.compare(0, 5, "ready") != 0)
+    {
+        std::cerr << "process: echo returned \"" << echoed << "\"\n";
+        return 1;
+    }
+
+    // Spawn times come from the metric ExecuteCommand records, one median per sample
+    Metrics::Histogram& spawn = Metrics::GetHistogram("command_spawn_duration_seconds", "", "Time spent starting the process", 1e-9);
+    std::vector<double> spawnSamples;
+    Metrics::HistogramSnapshot before = spawn.Read();
+    const uint64_t RUNS = 20;
+    uint64_t completed = 0;
+    Result* execute = Measure("process/execute", RUNS, [&](uint64_t i)
+    {
+        failures += !ExecuteCommand(command, 5000).empty();
+        if (++completed % RUNS == 0)
+        {
+            Metrics::HistogramSnapshot after = spawn.Read();
+            if (completed > RUNS) // After the warm-up sample
+            {
+                spawnSamples.push_back(static_cast<double>(Since(before, after).Quantile(0.5)));
+            }
+            before = after;
+        }
+        (void)i;
+    }, 1, "runs/s");
+    if (execute && Selected("process/spawn"))
+    {
+        g_results.push_back(Summarize("process/spawn", RUNS, spawnSamples));
+    }
+    if (failures > 0)
+    {
+        std::cerr << "process: " << failures << " runs of " << command << " failed or printed something\n";
+    }
+    return failures > 0 ? 1 : 0;
+}
+
+// Platform shell snippets for the graph checks
+struct GraphCommands
+{
+    const char* quick;
+    const char* sleep; // About 200 ms
+    const char* slow;  // Far longer than any deadline used
+    const char* produce;
+    const char* upper; // stdin in capitals
+    const char* fail;  // Exit code 3
+};
+
+#ifdef _WIN32
+static const GraphCommands GRAPH_COMMANDS = { "exit 0", "Start-Sleep -Milliseconds 200", "Start-Sleep -Seconds 10",
+                                              "Write-Output alpha beta", "$input | ForEach-Object { $_.ToUpper() }",
+                                              "exit 3" };
+#else
+static const GraphCommands GRAPH_COMMANDS = { "/bin/true", "sleep 0.2", "sleep 10", "printf 'alpha\\nbeta\\n'",
+                                              "tr a-z A-Z", "exit 3" };
+#endif
+
+// Query, three follow-ups on its output, then one that aggregates them
+static std::vector<CommandNode> ProbeGraph(const char* command)
+{
+    return {
+        {"products", command, {}, {}, 5000},
+        {"count", command, {}, {"products"}, 5000},
+        {"filter", command, {}, {"products"}, 5000},
+        {"details", command, {"products"}, {}, 5000},
+        {"report", command, {}, {"count", "filter", "details"}, 5000},
+    };
+}
+
+static int CheckCommandGraphs()
+{
+    int failures = 0;
+    CommandGraphOptions options;
+    CommandGraphResult result;
+    std::string error;
+
+    std::vector<CommandNode> sleeps = ProbeGraph(GRAPH_COMMANDS.sleep);
+    if (!RunCommandGraph(sleeps, options, result, error) || !result.Succeeded() ||
+        result.elapsedMs > result.commandMs * 0.8 ||
+        result.criticalPath.size() != 3 || result.criticalPath.front() != "products" || result.criticalPath.back() != "report")
+    {
+        std::cerr << "process: the probe graph did not run its follow-ups in parallel\n"
+                  << FormatCommandGraphResult(sleeps, result);
+        ++failures;
+    }
+
+    std::vector<CommandNode> pipe = {
+        {"produce", GRAPH_COMMANDS.produce, {}, {}, 5000},
+        {"upper", GRAPH_COMMANDS.upper, {}, {"produce"}, 5000},
+    };
+    if (!RunCommandGraph(pipe, options, result, error) || !result.Succeeded() ||
+        result.nodes[1].result.output.find("ALPHA") == std::string::npos ||
+        result.nodes[1].result.output.find("BETA") == std::string::npos)
+    {
+        std::cerr << "process: output was not piped\n" << FormatCommandGraphResult(pipe, result);
+        ++failures;
+    }
+
+    std::vector<CommandNode> failing = {
+        {"fail", GRAPH_COMMANDS.fail, {}, {}, 5000},
+        {"child", GRAPH_COMMANDS.quick, {"fail"}, {}, 5000},
+        {"grandchild", GRAPH_COMMANDS.quick, {"child"}, {}, 5000},
+        {"independent", GRAPH_COMMANDS.quick, {}, {}, 5000},
+    };
+    if (!RunCommandGraph(failing, options, result, error) ||
+        result.nodes[0].state != CommandNodeResult::FAILED || result.nodes[0].result.exitCode != 3 ||
+        result.nodes[1].state != CommandNodeResult::CANCELLED || result.nodes[2].state != CommandNodeResult::CANCELLED ||
+        result.nodes[3].state != CommandNodeResult::SUCCEEDED)
+    {
+        std::cerr << "process: a failure did not cancel exactly what depends on it\n"
+                  << FormatCommandGraphResult(failing, result);
+        ++failures;
+    }
+
+    std::vector<CommandNode> slow = {
+        {"slow", GRAPH_COMMANDS.slow, {}, {}, -1},
+        {"after", GRAPH_COMMANDS.quick, {"slow"}, {}, -1},
+    };
+    CommandGraphOptions deadline;
+    deadline.totalTimeout = 300;
+    if (!RunCommandGraph(slow, deadline, result, error) || result.nodes[0].state != CommandNodeResult::TIMED_OUT ||
+        result.nodes[1].state != CommandNodeResult::CANCELLED || result.elapsedMs > 5000)
+    {
+        std::cerr << "process: the batch deadline was not kept\n" << FormatCommandGraphResult(slow, result);
+        ++failures;
+    }
+
+    std::vector<CommandNode> cycle = {
+        {"a", GRAPH_COMMANDS.quick, {"c"}, {}, -1},
+        {"b", GRAPH_COMMANDS.quick, {"a"}, {}, -1},
+        {"c", GRAPH_COMMANDS.quick, {}, {"b"}, -1},
+    };
+    std::vector<CommandNode> unknown = { {"a", GRAPH_COMMANDS.quick, {"missing"}, {}, -1} };
+    if (RunCommandGraph(cycle, options, result, error) || error.find("cycle") == std::string::npos ||
+        RunCommandGraph(unknown, options, result, error) || error.find("'missing'") == std::string::npos)
+    {
+        std::cerr << "process: an invalid graph was not refused\n";
+        ++failures;
+    }
+    return failures;
+}
+
+static int RunGraphCases()
+{
+    if (!Selected("process/graph"))
+    {
+        return 0;
+    }
+    int failures = CheckCommandGraphs();
+    std::vector<CommandNode> probe = ProbeGraph(GRAPH_COMMANDS.quick);
+    CommandGraphOptions options;
+    Measure("process/graph", 5, [&](uint64_t)
+    {
+        CommandGraphResult result;
+        std::string error;
+        failures += !RunCommandGraph(probe, options, result, error) || !result.Succeeded();
+    }, 1, "graphs/s");
+    if (failures > 0)
+    {
+        std::cerr << "process: " << failures << " command graph checks or runs failed\n";
+    }
+    return failures > 0 ? 1 : 0;
+}
+
+// What ConvertTo-Json -Compress prints for Win32_Product through
+// Select-Object: Windows paths, \u escapes, numbers, booleans and nulls
+static std::string MakeProductJson(int products)
+{
+    std::string text = "[";
+    char entry[768];
+    for (int i = 0; i < products; ++i)
+    {
+        snprintf(entry, sizeof(entry),
+                 "%s{\"Name\":\"Product %d \\u00c9dition\",\"Version\":\"%d.%d.%d\",\"Vendor\":\"Vendor%d\\u0027s Software\","
+                 "\"InstallDate\":\"2024%02d%02d\",\"InstallLocation\":\"C:\\\\Program Files\\\\Vendor%d\\\\Product%d\\\\\","
+                 "\"IdentifyingNumber\":\"{%08X-0000-4000-8000-%012d}\",\"Size\":%d,\"Installed\":%s,\"Language\":null,"
+                 "\"Description\":\"Installs product %d for all users; see https://example.com/p/%d for details.\"}",
+                 i ? "," : "", i, i % 10, i % 7, i, i % 97, i % 12 + 1, i % 28 + 1, i % 97, i, i, i, i * 13,
+                 i % 3 ? "true" : "false", i, i);
+        text += entry;
+    }
+    return text + "]";
+}
+
+// Every event as text, to compare parses exactly
+class TraceHandler : public JsonHandler
+{
+public:
+    std::string trace;
+
+    bool StartObject() override { return Add("{"); }
+    bool Key(std::string_view key) override { return Add("k:", key); }
+    bool EndObject() override { return Add("}"); }
+    bool StartArray() override { return Add("["); }
+    bool EndArray() override { return Add("]"); }
+    bool String(std::string_view value) override { return Add("s:", value); }
+    bool Number(double, std::string_view text) override { return Add("n:", text); }
+    bool Bool(bool value) override { return Add(value ? "t" : "f"); }
+    bool Null() override { return Add("z"); }
+
+private:
+    bool Add(const char* event, std::string_view text = {})
+    {
+        trace.append(trace.empty() ? "" : "|").append(event).append(text.data(), text.size());
+        return true;
+    }
+};
+
+// Fed in chunks of the sizes given, in turn; the events, then "!" and the error if it failed
+static std::string TraceJson(std::string_view text, const std::vector<size_t>& chunks)
+{
+    TraceHandler handler;
+    JsonParser parser(handler);
+    bool ok = true;
+    for (size_t at = 0, i = 0; ok && at < text.size(); ++i)
+    {
+        size_t size = (std::min)(chunks[i % chunks.size()], text.size() - at);
+        ok = parser.Feed(text.substr(at, size));
+        at += size;
+    }
+    ok = ok && parser.Finish();
+    return ok ? handler.trace : handler.trace + "!" + parser.Error();
+}
+
+static std::vector<TextKernel> SupportedKernels()
+{
+    std::vector<TextKernel> kernels;
+    for (int kernel = 0; kernel <= static_cast<int>(BestTextKernel()); ++kernel)
+    {
+        kernels.push_back(static_cast<TextKernel>(kernel));
+    }
+    return kernels;
+}
+
+static int CheckJson(const std::string& products, int productCount)
+{
+    int failures = 0;
+    auto fail = [&failures](const std::string& what)
+    {
+        std::cerr << "json: " << what << "\n";
+        ++failures;
+    };
+    const std::vector<std::vector<size_t>> CHUNKINGS = { {1 << 20}, {1}, {7}, {63, 64, 65}, {4096} };
+
+    // Escapes, surrogate pairs, numbers past 2^53, empty containers and whitespace
+    const std::string SAMPLE = " {\"a\":[1, -2.5e+3,true,false,null,12345678901234567890],\r\n\t\"b\\\"c\":"
+                               "\"x\\\\y\\u00e9\\ud83d\\ude00\\n\",\"\":{},\"d\":[ ],\"e\":\"{[,:]}\"} ";
+    const std::string EXPECTED = "{|k:a|[|n:1|n:-2.5e+3|t|f|z|n:12345678901234567890|]|k:b\"c|s:x\\y\xC3\xA9\xF0\x9F\x98\x80\n"
+                                 "|k:|{|}|k:d|[|]|k:e|s:{[,:]}|}";
+
+    // A backslash pair then an escaped quote at every offset around two block edges
+    std::string edges = "[";
+    std::string edgesExpected = "[";
+    for (int pad = 0; pad < 140; ++pad)
+    {
+        edges += std::string(pad ? "," : "") + "\"" + std::string(pad, 'a') + "\\\\\\\"q\"";
+        edgesExpected += "|s:" + std::string(pad, 'a') + "\\\"q";
+    }
+    edges += "]";
+    edgesExpected += "|]";
+
+    const char* const INVALID[] = {
+        "{\"a\" 1}", "[1,]", "{\"a\":1,}", "[1 2]", "\"abc", "{\"a\":tru}", "01", "1.", "-", "[}", "{\"a\"}",
+        "\"\x01\"", "\"\\x\"", "[", "]", "nul", "{,}", "[1e]", "\"\\u12G4\"", "{\"a\":1", "\"\xC3\x28\"", "[\\]",
+    };
+
+    for (TextKernel kernel : SupportedKernels())
+    {
+        SetTextKernel(kernel);
+        std::string name = TextKernelName(kernel);
+        for (const std::vector<size_t>& chunks : CHUNKINGS)
+        {
+            std::string chunking = " in chunks of " + std::to_string(chunks[0]);
+            std::string trace = TraceJson(SAMPLE, chunks);
+            if (trace != EXPECTED)
+            {
+                fail(name + chunking + ": sample gave " + trace);
+            }
+            if (TraceJson(edges, chunks) != edgesExpected)
+            {
+                fail(name + chunking + ": escapes at block edges went wrong");
+            }
+            for (const char* invalid : INVALID)
+            {
+                if (TraceJson(invalid, chunks).find("!Invalid JSON at byte ") == std::string::npos)
+                {
+                    fail(name + chunking + ": accepted " + invalid);
+                }
+            }
+        }
+        if (TraceJson(std::string(3000, '[') + std::string(3000, ']'), {4096}).find("nested too deeply") == std::string::npos)
+        {
+            fail(name + ": no depth limit");
+        }
+        if (!TraceJson("", {1}).empty() || TraceJson("1 \"a\"\n[true]", {1}) != "n:1|s:a|[|t|]")
+        {
+            fail(name + ": empty input or several top-level values went wrong");
+        }
+    }
+
+    // Mutated documents: whatever the parse does, every kernel and chunking does the same
+    Random random(7);
+    const char MUTATIONS[] = "{}[]\":,\\ a1e-";
+    for (int round = 0; round < 3000; ++round)
+    {
+        std::string mutated = round % 2 ? SAMPLE : edges.substr(0, 400);
+        for (uint32_t n = random.Next(3) + 1; n > 0; --n)
+        {
+            mutated[random.Next(static_cast<uint32_t>(mutated.size()))] = MUTATIONS[random.Next(sizeof(MUTATIONS) - 1)];
+        }
+        SetTextKernel(TextKernel::Scalar);
+        std::string expected = TraceJson(mutated, {1 << 20});
+        for (TextKernel kernel : SupportedKernels())
+        {
+            SetTextKernel(kernel);
+            if (TraceJson(mutated, {random.Next(70) + 1, random.Next(70) + 1}) != expected)
+            {
+                fail(std::string(TextKernelName(kernel)) + " parsed a mutated document differently: " + mutated);
+                break;
+            }
+        }
+    }
+
+    // The benchmark listing, in random chunk sizes, against one whole parse
+    SetTextKernel(TextKernel::Scalar);
+    std::string whole = TraceJson(products, {products.size()});
+    for (TextKernel kernel : SupportedKernels())
+    {
+        SetTextKernel(kernel);
+        std::vector<size_t> chunks;
+        for (int i = 0; i < 64; ++i)
+        {
+            chunks.push_back(random.Next(10000) + 1);
+        }
+        if (TraceJson(products, chunks) != whole)
+        {
+            fail(std::string(TextKernelName(kernel)) + " parsed the listing differently in chunks");
+        }
+    }
+    SetTextKernel(BestTextKernel());
+
+    // Records and document lookups
+    uint64_t records = 0;
+    double sizes = 0;
+    bool firstRight = false;
+    JsonRecordReader reader([&](const JsonDocument::Value& product)
+    {
+        if (records == 0)
+        {
+            firstRight = product["Name"].AsString() == "Product 0 \xC3\x89" "dition" && product["Installed"].AsBool(true) == false &&
+                         product["Language"].IsNull() && !product["Missing"].Exists() && product.KeyAt(1) == "Version" &&
+                         product.At(4).AsString() == "C:\\Program Files\\Vendor0\\Product0\\";
+        }
+        ++records;
+        sizes += product["Size"].AsNumber();
+        return true;
+    });
+    JsonParser parser(reader);
+    if (!parser.Feed(products) || !parser.Finish() || records != static_cast<uint64_t>(productCount) || !firstRight ||
+        sizes != 13.0 * productCount * (productCount - 1) / 2)
+    {
+        fail("records of the listing went wrong " + parser.Error());
+    }
+    JsonDocument document;
+    JsonTapeBuilder builder(document);
+    JsonParser tapeParser(builder);
+    tapeParser.Feed(SAMPLE);
+    tapeParser.Feed("[7]");
+    bool finished = tapeParser.Finish();
+    JsonDocument::Value root = document.Root();
+    if (!finished || document.RootCount() != 2 || root.Size() != 5 || root["a"].Size() != 6 ||
+        root["a"].At(1).AsNumber() != -2500 || root["a"].At(5).AsNumber() != 12345678901234567890.0 ||
+        root["b\"c"].AsString() != "x\\y\xC3\xA9\xF0\x9F\x98\x80\n" || root[""].Type() != JsonType::Object ||
+        root["e"].AsString() != "{[,:]}" || document.Root(1).At(0).AsNumber() != 7 || document.Root(2).Exists())
+    {
+        fail("document lookups went wrong");
+    }
+
+    // A handler that stops the parser
+    JsonRecordReader first([](const JsonDocument::Value&) { return false; });
+    JsonParser stopped(first);
+    if (stopped.Feed("[1,2,3]") && stopped.Finish())
+    {
+        fail("a handler could not stop the parser");
+    }
+    return failures;
+}
+
+// Counts events without keeping anything, the cost of the parse alone
+class CountingHandler : public JsonHandler
+{
+public:
+    uint64_t events = 0;
+
+    bool StartObject() override { return ++events; }
+    bool Key(std::string_view) override { return ++events; }
+    bool EndObject() override { return ++events; }
+    bool StartArray() override { return ++events; }
+    bool EndArray() override { return ++events; }
+    bool String(std::string_view) override { return ++events; }
+    bool Number(double, std::string_view) override { return ++events; }
+    bool Bool(bool) override { return ++events; }
+    bool Null() override { return ++events; }
+};
+
+static int RunJsonCases()
+{
+    if (!Selected("json/"))
+    {
+        return 0;
+    }
+    const int PRODUCTS = 25000;
+    const size_t CHUNK = 1 << 16;
+    const uint64_t EVENTS = 1 + PRODUCTS * 22 + 1;
+    std::string products = MakeProductJson(PRODUCTS);
+    double megabytes = products.size() / 1e6;
+    int failures = CheckJson(products, PRODUCTS);
+
+    auto feedChunks = [&](JsonParser& parser)
+    {
+        bool ok = true;
+        for (size_t at = 0; at < products.size(); at += CHUNK)
+        {
+            ok = parser.Feed(std::string_view(products).substr(at, CHUNK)) && ok;
+        }
+        return parser.Finish() && ok;
+    };
+    for (TextKernel kernel : SupportedKernels())
+    {
+        SetTextKernel(kernel);
+        Measure(std::string("json/sax/") + TextKernelName(kernel), 1, [&](uint64_t)
+        {
+            CountingHandler handler;
+            JsonParser parser(handler);
+            failures += !feedChunks(parser) || handler.events != EVENTS;
+        }, megabytes, "MB/s");
+    }
+    SetTextKernel(BestTextKernel());
+
+    Measure("json/records", 1, [&](uint64_t)
+    {
+        uint64_t named = 0;
+        JsonRecordReader reader([&named](const JsonDocument::Value& product)
+        {
+            named += !product["Name"].AsString().empty();
+            return true;
+        });
+        JsonParser parser(reader);
+        failures += !feedChunks(parser) || named != PRODUCTS;
+    }, megabytes, "MB/s");
+
+    Measure("json/tape", 1, [&](uint64_t)
+    {
+        JsonDocument document;
+        JsonTapeBuilder builder(document);
+        JsonParser parser(builder);
+        failures += !parser.Feed(products) || !parser.Finish() || document.Root().Size() != PRODUCTS;
+    }, megabytes, "MB/s");
+
+    if (failures > 0)
+    {
+        std::cerr << "json: " << failures << " checks or parses failed\n";
+    }
+    return failures > 0 ? 1 : 0;
+}
+
+// Objects from PowerShell itself on Windows; elsewhere a listing printed by cat
+static int RunJsonProcessCases()
+{
+    if (!Selected("process/json"))
+    {
+        return 0;
+    }
+    const int PRODUCTS = 2000;
+#ifdef _WIN32
+    std::string command = "1.." + std::to_string(PRODUCTS) +
+                          " | ForEach-Object { [pscustomobject]@{ Name = \"Product $_\"; Version = \"1.0.$_\"; Size = $_ } }";
+#else
+    std::filesystem::path file = std::filesystem::temp_directory_path() / "microbench-products.json";
+    {
+        std::ofstream out(file, std::ios::binary);
+        out << MakeProductJson(PRODUCTS);
+    }
+    std::string command = "cat '" + file.string() + "'";
+#endif
+    int failures = 0;
+    std::string error;
+    Measure("process/json", 3, [&](uint64_t)
+    {
+        uint64_t named = 0;
+        JsonRecordReader reader([&named](const JsonDocument::Value& product)
+        {
+            named += product["Name"].AsString().compare(0, 8, "Product ") == 0;
+            return true;
+        });
+        if (!ExecuteJsonCommand(command, 30000, reader, error) || named != PRODUCTS)
+        {
+            std::cerr << "process: " << named << " of " << PRODUCTS << " products read " << error << "\n";
+            ++failures;
+        }
+    }, PRODUCTS, "records/s");
+
+    std::string exitError;
+    JsonRecordReader ignored([](const JsonDocument::Value&) { return true; });
+    if (ExecuteJsonCommand(GRAPH_COMMANDS.fail, 5000, ignored, exitError) || exitError.find("Exit code 3") != 0)
+    {
+        std::cerr << "process: a failed JSON command gave \"" << exitError << "\"\n";
+        ++failures;
+    }
+#ifndef _WIN32
+    std::error_code ignore;
+    std::filesystem::remove(file, ignore);
+    if (ExecuteJsonCommand("printf '[1,2'", 5000, ignored, exitError) || exitError.find("unexpected end") == std::string::npos)
+    {
+        std::cerr << "process: truncated JSON gave \"" << exitError << "\"\n";
+        ++failures;
+    }
+#endif
+    return failures > 0 ? 1 : 0;
+}
+
+// Same generator as OverlayBench, so the scenes are comparable
+static RectStore MakeScene(int count, uint32_t seed)
+{
+    RectStore rects;
+    rects.Reserve(count);
+    Random random(seed);
+    for (int i = 0; i < count; ++i)
+    {
+        int left = static_cast<int>(random.Next(90));
+        int top = static_cast<int>(random.Next(90));
+        int right = left + 1 + static_cast<int>(random.Next(100 - left));
+        int bottom = top + 1 + static_cast<int>(random.Next(100 - top));
+        bool isPrimary = random.Next(4) != 0;
+        std::string label = "Zone " + std::to_string(i);
+        if (!isPrimary)
+        {
+            label += " mapped to F" + std::to_string(random.Next(12) + 1);
+        }
+        rects.Add(label, left, top, right, bottom, isPrimary ? RectStore::FLAG_PRIMARY : 0);
+    }
+    return rects;
+}
+
+static int RunOverlayCases()
+{
+    if (!Selected("overlay/"))
+    {
+        return 0;
+    }
+    GlyphAtlas atlas = BuildBuiltinGlyphAtlas(3);
+    Framebuffer fb;
+    fb.Resize(1920, 1080);
+    int failures = 0;
+    for (int count : {10, 100, 1000, 10000})
+    {
+        std::string name = "overlay/paint/" + std::to_string(count);
+        RectStore scene = MakeScene(count, 0x5EED0000u + count);
+        uint64_t firstHash = 0;
+        bool stable = true;
+        Measure(name, count >= 1000 ? 2 : 20, [&](uint64_t)
+        {
+            ClearFramebuffer(fb, COLOR_TRANSPARENT);
+            RenderRectangles(fb, scene, atlas);
+            uint64_t hash = HashFramebuffer(fb);
+            stable = stable && (firstHash == 0 || hash == firstHash);
+            firstHash = hash;
+        }, count, "rects/s");
+        if (!stable)
+        {
+            std::cerr << name << ": frames of the same scene differ\n";
+            ++failures;
+        }
+    }
+    return failures;
+}
+
+static void AppendJsonString(std::string& out, const std::string& text)
+{
+    out += '"';
+    for (char ch : text)
+    {
+        if (ch == '"' || ch == '\\')
+        {
+            out += '\\';
+        }
+        out += ch;
+    }
+    out += '"';
+}
+
+static bool WriteJson(const std::string& fileName)
+{
+    char line[512];
+    time_t now = time(nullptr);
+    char timestamp[32];
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+#if defined(_WIN32)
+    const char* platform = "windows";
+#elif defined(__APPLE__)
+    const char* platform = "macos";
+#else
+    const char* platform = "linux";
+#endif
+#ifdef NDEBUG
+    const char* build = "release";
+#else
+    const char* build = "debug";
+#endif
+#if defined(_MSC_VER)
+    std::string compiler = "msvc " + std::to_string(_MSC_VER);
+#elif defined(__clang__)
+    std::string compiler = std::string("clang ") + __clang_version__;
+#elif defined(__GNUC__)
+    std::string compiler = std::string("gcc ") + __VERSION__;
+#else
+    std::string compiler = "unknown";
+#endif
+
+    std::string out = "{\n  \"suite\": \"MicroBench\",\n  \"context\": {\"timestamp\": ";
+    AppendJsonString(out, timestamp);
+    out += ", \"platform\": ";
+    AppendJsonString(out, platform);
+    out += ", \"build\": ";
+    AppendJsonString(out, build);
+    out += ", \"compiler\": ";
+    AppendJsonString(out, compiler);
+    out += "},\n  \"results\": [";
+    for (size_t i = 0; i < g_results.size(); ++i)
+    {
+        const Result& r = g_results[i];
+        out += i == 0 ? "\n    {\"name\": " : ",\n    {\"name\": ";
+        AppendJsonString(out, r.name);
+        snprintf(line, sizeof(line),
+                 ", \"unit\": \"ns\", \"samples\": %d, \"operations\": %llu, \"min\": %.3f, \"median\": %.3f, \"p90\": %.3f",
+                 r.samples, static_cast<unsigned long long>(r.operations), r.minNs, r.medianNs, r.p90Ns);
+        out += line;
+        if (r.throughput > 0)
+        {
+            snprintf(line, sizeof(line), ", \"throughput\": %.3f, \"throughput_unit\": ", r.throughput);
+            out += line;
+            AppendJsonString(out, r.throughputUnit);
+        }
+        out += "}";
+    }
+    out += "\n  ]\n}\n";
+
+    std::ofstream file(fileName, std::ios::binary);
+    file << out;
+    return static_cast<bool>(file.flush());
+}
+
+int main(int argc, char** argv)
+{
+    std::string jsonFile;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--filter") && i + 1 < argc) g_filter = argv[++i];
+        else if (!strcmp(argv[i], "--samples") && i + 1 < argc) g_samples = (std::max)(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--json") && i + 1 < argc) jsonFile = argv[++i];
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--filter <name prefix>] [--samples <n>] [--json <file>]\n";
+            return 2;
+        }
+    }
+
+    int failures = 0;
+    failures += RunRegistryCases();
+    failures += RunEnumerationCases();
+    failures += RunRegParseCases();
+    failures += RunProcessCases();
+    failures += RunGraphCases();
+    failures += RunJsonProcessCases();
+    failures += RunJsonCases();
+    failures += RunOverlayCases();
+
+    printf("%-22s %12s %12s %12s %18s\n", "case", "min", "median", "p90", "throughput");
+    for (const Result& r : g_results)
+    {
+        char throughput[48] = "";
+        if (r.throughput > 0)
+        {
+            snprintf(throughput, sizeof(throughput), "%.4g %s", r.throughput, r.throughputUnit);
+        }
+        printf("%-22s %12s %12s %12s %18s\n", r.name.c_str(), FormatNs(r.minNs).c_str(), FormatNs(r.medianNs).c_str(),
+               FormatNs(r.p90Ns).c_str(), throughput);
+    }
+    if (g_results.empty())
+    {
+        std::cerr << "No case matches \"" << g_filter << "\"\n";
+        ++failures;
+    }
+    if (!jsonFile.empty() && !WriteJson(jsonFile))
+    {
+        std::cerr << "Failed to write " << jsonFile << "\n";
+        ++failures;
+    }
+    return failures > 0 ? 1 : 0;
+}
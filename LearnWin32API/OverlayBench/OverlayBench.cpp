@@ -0,0 +1,885 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../OverlayingRectangles/AliasTable.h"
+#include "../OverlayingRectangles/LayoutFile.h"
+#include "../OverlayingRectangles/SoftwareRasterizer.h"
+#include "../OverlayingRectangles/MonitorLayout.h"
+#include "../OverlayingRectangles/OverlayLoader.h"
+#include "../OverlayingRectangles/SceneCache.h"
+
+// Headless benchmark for the overlay core.
+// render:  draws synthetic scenes at 1080p and 4K and checks every frame against
+//          the golden hashes, so a faster path can never silently change the output.
+// spatial: microbenchmarks for the SpatialIndex behind hit-testing, dirty-rect
+//          repaint and overlap detection, cross-checked against linear scans.
+// store:   percentage-to-pixel pass over the RectStore columns compared with the
+//          array-of-structs layout it replaced.
+// loader:  background loads handed to a simulated UI thread; reports load time,
+//          publish latency and the median time the UI side spends taking a snapshot.
+// alias:   alternative-name tables for up to 5000 zones, built and resolved with
+//          AliasTable and with the std::map it replaced; checks both agree and
+//          that colliding suffixes are reported with the first mapping kept.
+// layout:  compiled layout files: first load, unchanged polls, rewrites and
+//          same-time replacements, checked against the scene built directly.
+// startup: time to the first full frame from the scene cache and from a simulated
+//          registry read with five queries per zone or one bulk query; checks the
+//          cached frame matches the live one and an unchanged scene is not rewritten.
+//
+// Usage: OverlayBench [--section render|spatial|store|loader|alias|layout|startup|all] [--golden <file>] [--update-golden]
+//                     [--dump <dir>] [--iterations <n>]
+
+struct Resolution
+{
+    const char* name;
+    int width, height;
+};
+
+// Deterministic generator so golden images are stable across runs and platforms.
+// maxSize limits width and height in percent; the render cases use anything up
+// to full screen, the spatial cases use zone-sized rectangles.
+static RectStore MakeScene(int count, uint32_t seed, int maxSize = 100)
+{
+    RectStore rects;
+    rects.Reserve(count);
+    uint32_t state = seed;
+    auto next = [&state](int range)
+    {
+        state = state * 1664525u + 1013904223u;
+        return static_cast<int>((state >> 8) % static_cast<uint32_t>(range));
+    };
+
+    for (int i = 0; i < count; ++i)
+    {
+        int left = next(90);
+        int top = next(90);
+        int right = left + 1 + next(std::min(maxSize, 100 - left));
+        int bottom = top + 1 + next(std::min(maxSize, 100 - top));
+        bool isPrimary = next(4) != 0;
+
+        char name[32];
+        snprintf(name, sizeof(name), "Zone %d", i);
+        std::string label = name;
+        if (!isPrimary)
+        {
+            label += " mapped to F" + std::to_string(next(12) + 1);
+        }
+        rects.Add(label, left, top, right, bottom, isPrimary ? RectStore::FLAG_PRIMARY : 0);
+    }
+    return rects;
+}
+
+static std::map<std::string, std::string> LoadGolden(const std::string& fileName)
+{
+    std::map<std::string, std::string> golden;
+    std::ifstream in(fileName);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        std::istringstream fields(line);
+        std::string name, hash;
+        if (fields >> name >> hash)
+        {
+            golden[name] = hash;
+        }
+    }
+    return golden;
+}
+
+static std::string ToHex(uint64_t value)
+{
+    char text[17];
+    snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(value));
+    return text;
+}
+
+template <typename Fn>
+static double MedianMs(int iterations, Fn&& fn)
+{
+    std::vector<double> samples;
+    for (int i = 0; i < iterations; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        auto end = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+static int RunSpatialBench(int iterations)
+{
+    const int counts[] = { 10, 100, 1000, 10000 };
+    const int pointQueries = 100000;
+    const int regionQueries = 10000;
+    int failures = 0;
+
+    MonitorInfo monitor;
+    monitor.right = 3840;
+    monitor.bottom = 2160;
+    monitor.isPrimary = true;
+
+    printf("\n%-12s %10s %10s %12s %12s %12s %12s\n", "rects", "build ms", "update ms",
+           "point ns", "region ns", "overlap ms", "scan ms");
+    for (int count : counts)
+    {
+        RectStore scene = MakeScene(count, 0x5EED0000u + count, 5);
+        MonitorLayout layout;
+
+        double buildMs = MedianMs(iterations, [&]
+        {
+            layout.SetMonitors({monitor});
+            layout.Update(scene);
+        });
+
+        // Nudge 1% of the rectangles, as a typical reload would
+        RectStore nudged = scene;
+        for (size_t i = 0; i < nudged.Size(); i += 100)
+        {
+            nudged.SetBounds(i, (nudged.Left()[i] + 1) % 90, nudged.Top()[i], nudged.Right()[i], nudged.Bottom()[i]);
+        }
+        int flip = 0;
+        double updateMs = MedianMs(iterations, [&]
+        {
+            layout.Update((flip++ & 1) ? scene : nudged);
+        });
+        layout.Update(scene);
+
+        const MonitorScene& result = layout.Scene(0);
+        uint32_t state = 12345;
+        auto next = [&state](int range)
+        {
+            state = state * 1664525u + 1013904223u;
+            return static_cast<int>((state >> 8) % static_cast<uint32_t>(range));
+        };
+
+        std::vector<uint32_t> hits;
+        size_t checksum = 0;
+        double pointMs = MedianMs(iterations, [&]
+        {
+            for (int i = 0; i < pointQueries; ++i)
+            {
+                result.index.QueryPoint(next(monitor.right), next(monitor.bottom), hits);
+                checksum += hits.size();
+            }
+        });
+
+        double regionMs = MedianMs(iterations, [&]
+        {
+            for (int i = 0; i < regionQueries; ++i)
+            {
+                int x = next(monitor.right), y = next(monitor.bottom);
+                result.index.QueryRegion({x, y, x + 256, y + 256}, hits);
+                checksum += hits.size();
+            }
+        });
+
+        std::vector<std::pair<uint32_t, uint32_t>> pairs;
+        double overlapMs = MedianMs(iterations, [&] { result.index.FindOverlaps(pairs); });
+
+        // The O(n^2) scan the index replaces, also used as the reference answer
+        std::vector<std::pair<uint32_t, uint32_t>> expected;
+        double scanMs = MedianMs(1, [&]
+        {
+            expected.clear();
+            for (uint32_t i = 0; i < result.rects.size(); ++i)
+            {
+                for (uint32_t j = i + 1; j < result.rects.size(); ++j)
+                {
+                    if (result.rects[i].Bounds().Intersects(result.rects[j].Bounds()))
+                    {
+                        expected.emplace_back(i, j);
+                    }
+                }
+            }
+        });
+
+        std::sort(pairs.begin(), pairs.end());
+        if (pairs != expected)
+        {
+            std::cerr << count << " rects: overlap pairs differ from the linear scan\n";
+            ++failures;
+        }
+
+        for (int i = 0; i < 1000; ++i)
+        {
+            int x = next(monitor.right), y = next(monitor.bottom);
+            result.index.QueryPoint(x, y, hits);
+            std::vector<uint32_t> reference;
+            for (uint32_t id = 0; id < result.rects.size(); ++id)
+            {
+                if (result.rects[id].Bounds().Contains(x, y))
+                {
+                    reference.push_back(id);
+                }
+            }
+            if (hits != reference)
+            {
+                std::cerr << count << " rects: point query differs from the linear scan\n";
+                ++failures;
+                break;
+            }
+        }
+
+        printf("%-12d %10.3f %10.3f %12.1f %12.1f %12.3f %12.3f\n", count, buildMs, updateMs,
+               pointMs * 1e6 / pointQueries, regionMs * 1e6 / regionQueries, overlapMs, scanMs);
+        if (checksum == 0 && count > 100)
+        {
+            std::cerr << count << " rects: queries found nothing\n";
+            ++failures;
+        }
+    }
+    return failures;
+}
+
+// The array-of-structs layout RectStore replaced
+struct LegacyRect
+{
+    std::string name{};
+    int top{}, left{}, right{}, bottom{};
+    bool isPrimary{};
+};
+
+static int RunStoreBench(int iterations)
+{
+    const int counts[] = { 10000, 100000, 1000000 };
+    const int width = 3840, height = 2160;
+    int failures = 0;
+
+    printf("\n%-12s %12s %12s %10s\n", "rects", "aos ns/rect", "soa ns/rect", "speedup");
+    for (int count : counts)
+    {
+        RectStore store = MakeScene(count, 0x5EED0000u + count, 5);
+        std::vector<LegacyRect> legacy(count);
+        for (int i = 0; i < count; ++i)
+        {
+            legacy[i] = {std::string(store.Name(i)), store.Top()[i], store.Left()[i],
+                         store.Right()[i], store.Bottom()[i], store.IsPrimary(i)};
+        }
+
+        std::vector<int32_t> outLeft(count), outTop(count), outRight(count), outBottom(count);
+        double aosMs = MedianMs(iterations, [&]
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                const LegacyRect& rect = legacy[i];
+                outLeft[i] = (rect.left * width) / 100;
+                outTop[i] = (rect.top * height) / 100;
+                outRight[i] = (rect.right * width) / 100;
+                outBottom[i] = (rect.bottom * height) / 100;
+            }
+        });
+        std::vector<int32_t> expectedLeft = outLeft, expectedBottom = outBottom;
+
+        std::vector<int32_t> rows(count, 0);
+        int32_t lutX[PERCENT_LUT_SIZE], lutY[PERCENT_LUT_SIZE];
+        double soaMs = MedianMs(iterations, [&]
+        {
+            BuildPercentLut(width, lutX);
+            BuildPercentLut(height, lutY);
+            PercentToPixels(store.Left(), rows.data(), lutX, outLeft.data(), count);
+            PercentToPixels(store.Top(), rows.data(), lutY, outTop.data(), count);
+            PercentToPixels(store.Right(), rows.data(), lutX, outRight.data(), count);
+            PercentToPixels(store.Bottom(), rows.data(), lutY, outBottom.data(), count);
+        });
+
+        if (outLeft != expectedLeft || outBottom != expectedBottom)
+        {
+            std::cerr << count << " rects: column pass differs from the per-struct conversion\n";
+            ++failures;
+        }
+        printf("%-12d %12.2f %12.2f %9.1fx\n", count, aosMs * 1e6 / count, soaMs * 1e6 / count,
+               soaMs > 0 ? aosMs / soaMs : 0.0);
+    }
+    return failures;
+}
+
+static int RunLoaderBench(int iterations)
+{
+    const int counts[] = { 1000, 100000 };
+    int failures = 0;
+
+    printf("\n%-12s %8s %12s %12s %14s %12s\n", "rects", "loads", "load ms", "publish ms", "max publish ms", "take us");
+    for (int count : counts)
+    {
+        // The notification stands in for PostMessage; the UI side times every
+        // Take() so any blocking on the loader would show up in "take us"
+        std::atomic<int> notifications{0};
+        OverlayLoader loader;
+        loader.Start([count]
+                     {
+                         auto snapshot = std::make_unique<OverlaySnapshot>();
+                         snapshot->rects = MakeScene(count, 0x10AD0000u + count, 5);
+                         return snapshot;
+                     },
+                     [&notifications] { notifications.fetch_add(1); },
+                     std::chrono::milliseconds(1));
+
+        int received = 0, seen = 0;
+        uint64_t lastGeneration = 0;
+        std::vector<double> takeUs;
+        while (received < iterations * 4)
+        {
+            if (notifications.load() == seen)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            seen = notifications.load();
+
+            auto start = std::chrono::steady_clock::now();
+            std::unique_ptr<const OverlaySnapshot> snapshot = loader.Take();
+            takeUs.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+            if (!snapshot)
+            {
+                continue;
+            }
+
+            if (snapshot->generation <= lastGeneration || snapshot->rects.Size() != static_cast<size_t>(count))
+            {
+                std::cerr << count << " rects: snapshot " << snapshot->generation << " is stale or incomplete\n";
+                ++failures;
+            }
+            lastGeneration = snapshot->generation;
+            ++received;
+        }
+        loader.Stop();
+
+        LoaderMetrics metrics = loader.Metrics();
+        if (notifications.load() == 0 || metrics.loads < static_cast<uint64_t>(received))
+        {
+            std::cerr << count << " rects: loader metrics do not match the snapshots received\n";
+            ++failures;
+        }
+        std::sort(takeUs.begin(), takeUs.end());
+        printf("%-12d %8llu %12.3f %12.3f %14.3f %12.2f\n", count, static_cast<unsigned long long>(metrics.loads),
+               metrics.lastLoadMs, metrics.lastPublishLatencyMs, metrics.maxPublishLatencyMs, takeUs[takeUs.size() / 2]);
+    }
+    return failures;
+}
+
+static int RunRenderBench(int iterations, const std::string& goldenFile, bool updateGolden, const std::string& dumpDir)
+{
+    const Resolution resolutions[] = { {"1080p", 1920, 1080}, {"4k", 3840, 2160} };
+    const int counts[] = { 10, 100, 1000, 10000 };
+
+    GlyphAtlas atlas = BuildBuiltinGlyphAtlas(3);
+    std::map<std::string, std::string> golden = LoadGolden(goldenFile);
+    std::map<std::string, std::string> actual;
+    int failures = 0;
+
+    printf("%-16s %10s %10s %10s  %s\n", "case", "min ms", "median ms", "rects/ms", "golden");
+    for (const auto& res : resolutions)
+    {
+        Framebuffer fb;
+        fb.Resize(res.width, res.height);
+
+        for (int count : counts)
+        {
+            RectStore scene = MakeScene(count, 0x5EED0000u + count);
+            std::vector<double> samples;
+            for (int i = 0; i < iterations; ++i)
+            {
+                auto start = std::chrono::steady_clock::now();
+                ClearFramebuffer(fb, COLOR_TRANSPARENT);
+                RenderRectangles(fb, scene, atlas);
+                auto end = std::chrono::steady_clock::now();
+                samples.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+            }
+            std::sort(samples.begin(), samples.end());
+
+            std::string name = std::string(res.name) + "-" + std::to_string(count);
+            std::string hash = ToHex(HashFramebuffer(fb));
+            actual[name] = hash;
+
+            const char* status = "new";
+            auto it = golden.find(name);
+            if (it != golden.end())
+            {
+                status = it->second == hash ? "ok" : "MISMATCH";
+                if (it->second != hash)
+                {
+                    ++failures;
+                    if (!dumpDir.empty())
+                    {
+                        WritePPM(fb, dumpDir + "/" + name + ".ppm");
+                    }
+                }
+            }
+
+            double median = samples[samples.size() / 2];
+            printf("%-16s %10.3f %10.3f %10.1f  %s\n", name.c_str(), samples.front(), median,
+                   median > 0 ? count / median : 0.0, status);
+        }
+    }
+
+    if (updateGolden)
+    {
+        std::ofstream out(goldenFile);
+        out << "# Overlay golden images: <case> <FNV-1a of the RGBA framebuffer>\n";
+        out << "# Regenerate with OverlayBench --update-golden after an intended visual change\n";
+        for (const auto& entry : actual)
+        {
+            out << entry.first << " " << entry.second << "\n";
+        }
+        std::cout << "Golden hashes written to " << goldenFile << "\n";
+        return 0;
+    }
+
+    if (failures > 0)
+    {
+        std::cerr << failures << " case(s) differ from the golden images\n";
+    }
+
+    // Labels are UTF-8: a character outside the atlas is one '?', however many bytes it takes
+    Framebuffer utf8, ascii;
+    utf8.Resize(200, 40);
+    ascii.Resize(200, 40);
+    ClearFramebuffer(utf8, COLOR_TRANSPARENT);
+    ClearFramebuffer(ascii, COLOR_TRANSPARENT);
+    DrawCenteredText(utf8, atlas, "Z\xC3\xB6ne \xE6\x97\xA5\xF0\x9F\x8E\xB5", 0, 0, 200, 40, 0xFFFFFFFF);
+    DrawCenteredText(ascii, atlas, "Z?ne ??", 0, 0, 200, 40, 0xFFFFFFFF);
+    if (HashFramebuffer(utf8) != HashFramebuffer(ascii))
+    {
+        std::cerr << "render: a UTF-8 label is not drawn one glyph per character\n";
+        ++failures;
+    }
+    return failures;
+}
+
+// Alternative-name resolution: the AliasTable against the std::map it
+// replaced, rebuilt and queried once per rectangle as every load did
+static int RunAliasBench(int iterations)
+{
+    const int counts[] = { 100, 1000, 5000 };
+    int failures = 0;
+
+    printf("\n%-8s %14s %14s %14s %14s\n", "zones", "map build us", "table build us", "map lookup us", "table lookup us");
+    for (int count : counts)
+    {
+        // Zone names are four hex digits; alt-names values end in them
+        RectStore rects;
+        std::vector<std::pair<std::string, std::string>> values;
+        char name[32];
+        for (int i = 0; i < count; ++i)
+        {
+            snprintf(name, sizeof(name), "%04X", i);
+            rects.Add(name, 0, 0, 1, 1, RectStore::FLAG_PRIMARY);
+            if (i % 2 == 0)
+            {
+                values.emplace_back(std::string("FDK_Zone_") + name, "Alt " + std::to_string(i));
+            }
+        }
+
+        std::map<std::string, std::string, std::less<>> legacy;
+        double mapBuildMs = MedianMs(iterations, [&]
+        {
+            legacy.clear();
+            for (const auto& value : values)
+            {
+                legacy[value.first.substr(value.first.size() - 4)] = value.second;
+            }
+        });
+        AliasTable table(4);
+        double tableBuildMs = MedianMs(iterations, [&]
+        {
+            table.Clear();
+            for (const auto& value : values)
+            {
+                table.Add(value.first, value.second);
+            }
+        });
+
+        size_t mapHits = 0, tableHits = 0, mismatches = 0;
+        double mapLookupMs = MedianMs(iterations, [&]
+        {
+            mapHits = 0;
+            for (size_t i = 0; i < rects.Size(); ++i)
+            {
+                mapHits += legacy.find(rects.Name(i)) != legacy.end();
+            }
+        });
+        double tableLookupMs = MedianMs(iterations, [&]
+        {
+            tableHits = 0;
+            for (size_t i = 0; i < rects.Size(); ++i)
+            {
+                tableHits += !table.Resolve(rects.Name(i), rects.NameHash(i)).empty();
+            }
+        });
+        for (size_t i = 0; i < rects.Size(); ++i)
+        {
+            auto it = legacy.find(rects.Name(i));
+            mismatches += (it == legacy.end() ? std::string_view() : std::string_view(it->second)) != table.Resolve(rects.Name(i));
+        }
+        if (mapHits != tableHits || mismatches != 0 || !table.Collisions().empty())
+        {
+            std::cerr << count << " zones: alias table resolves differently from the map\n";
+            ++failures;
+        }
+        printf("%-8d %14.1f %14.1f %14.1f %14.1f\n", count, mapBuildMs * 1000, tableBuildMs * 1000,
+               mapLookupMs * 1000, tableLookupMs * 1000);
+
+        if (table.ApplyTo(rects) != values.size() || rects.Name(2) != "0002 mapped to Alt 2" || rects.IsPrimary(2) ||
+            !rects.IsPrimary(1))
+        {
+            std::cerr << count << " zones: mapped rectangles were not renamed\n";
+            ++failures;
+        }
+    }
+
+    // The registry layout: two-character suffixes, where long names can collide
+    AliasTable table;
+    bool added = table.Add("Left_Shift_A1", "Shift") && table.Add("Other_A1", "Shift") && table.Add("B", "Short");
+    bool collided = !table.Add("Right_Alt_A1", "AltGr");
+    if (!added || !collided || table.Collisions().size() != 1 || table.Resolve("A1") != "Shift" ||
+        table.Resolve("B") != "Short" || table.Collisions()[0].keptName != "Left_Shift_A1" ||
+        table.Collisions()[0].droppedTarget != "AltGr")
+    {
+        std::cerr << "alias: colliding suffixes were not reported with the first mapping kept\n";
+        ++failures;
+    }
+
+    // Suffixes count characters, not UTF-8 bytes: "Key_\u00DC" maps "_\u00DC"
+    AliasTable wide;
+    if (!wide.Add("Key_\xC3\x9C", "Umlaut") || wide.Resolve("_\xC3\x9C") != "Umlaut" ||
+        !wide.Add("Key_\xE2\x82\xAC" "9", "Euro") || wide.Resolve("\xE2\x82\xAC" "9") != "Euro" ||
+        !wide.Collisions().empty())
+    {
+        std::cerr << "alias: non-ASCII value names were not mapped by their last two characters\n";
+        ++failures;
+    }
+    return failures;
+}
+
+static bool SameRects(const RectStore& a, const RectStore& b)
+{
+    if (a.Size() != b.Size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < a.Size(); ++i)
+    {
+        if (a.Name(i) != b.Name(i) || a.Left()[i] != b.Left()[i] || a.Top()[i] != b.Top()[i] ||
+            a.Right()[i] != b.Right()[i] || a.Bottom()[i] != b.Bottom()[i] || a.Monitor()[i] != b.Monitor()[i] ||
+            a.Flags()[i] != b.Flags()[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int RunLayoutBench(int iterations)
+{
+    const int counts[] = { 100, 1000, 5000 };
+    const std::string fileName = "overlay-bench-layout.bin";
+    int failures = 0;
+
+    printf("\n%-8s %10s %12s %12s %12s\n", "zones", "file KB", "write ms", "load ms", "unchanged us");
+    for (int count : counts)
+    {
+        LayoutData layout;
+        layout.rects = MakeScene(count, 0x1A7000u + count, 10);
+        for (int i = 0; i < count; i += 3)
+        {
+            layout.altNames.emplace_back("FDK_Zone " + std::to_string(i), "Alt " + std::to_string(i % 40));
+        }
+        // Two values with the same suffix, so the warnings go through the file as well
+        layout.altNames.emplace_back("Other_Zone 0", "Duplicate");
+
+        std::string error;
+        double writeMs = MedianMs(iterations, [&]
+        {
+            if (!WriteLayoutFile(layout, fileName, error))
+            {
+                std::cerr << "layout: " << error << "\n";
+            }
+        });
+
+        // The scene the registry source would build from the same data
+        OverlaySnapshot expected;
+        expected.rects = layout.rects;
+        AliasTable aliases;
+        for (const auto& [name, target] : layout.altNames)
+        {
+            aliases.Add(name, target);
+        }
+        ApplyAliases(aliases, expected);
+
+        std::unique_ptr<OverlaySnapshot> scene;
+        double loadMs = MedianMs(iterations, [&]
+        {
+            LayoutFileSource source(fileName);
+            scene = source.Load();
+        });
+        if (!scene || !scene->error.empty() || !SameRects(scene->rects, expected.rects) ||
+            scene->warnings != expected.warnings || expected.warnings.empty())
+        {
+            std::cerr << count << " zones: the layout file loads a different scene\n";
+            ++failures;
+        }
+
+        LayoutFileSource source(fileName);
+        source.Load();
+        const int polls = 1000;
+        bool unchanged = true;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < polls; ++i)
+        {
+            unchanged = unchanged && source.Load() == nullptr;
+        }
+        double pollUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / polls;
+        if (!unchanged || source.Reloads() != 1)
+        {
+            std::cerr << count << " zones: an unchanged layout file was read again\n";
+            ++failures;
+        }
+
+        printf("%-8d %10.1f %12.3f %12.3f %12.2f\n", count, std::filesystem::file_size(fileName) / 1024.0, writeMs,
+               loadMs, pollUs);
+
+        // A rewrite renames a new file into place: a new id even when the write time is unchanged
+        auto writeTime = std::filesystem::last_write_time(fileName);
+        layout.rects.SetBounds(0, 1, 2, 3, 4);
+        WriteLayoutFile(layout, fileName, error);
+        std::filesystem::last_write_time(fileName, writeTime);
+        scene = source.Load();
+        if (!scene || scene->rects.Size() != layout.rects.Size() || scene->rects.Left()[0] != 1 ||
+            scene->rects.Bottom()[0] != 4 || source.Load() != nullptr)
+        {
+            std::cerr << count << " zones: a replaced layout file with the same write time was not reloaded\n";
+            ++failures;
+        }
+    }
+
+    // A damaged file is reported in the scene instead of being applied
+    {
+        std::string contents;
+        {
+            std::ifstream in(fileName, std::ios::binary);
+            contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+        contents[contents.size() / 2] ^= 0x5A;
+        std::ofstream(fileName, std::ios::binary | std::ios::trunc).write(contents.data(), contents.size());
+        LayoutFileSource source(fileName);
+        auto scene = source.Load();
+        if (!scene || scene->error.empty() || scene->rects.Size() != 0)
+        {
+            std::cerr << "layout: a damaged layout file was not reported\n";
+            ++failures;
+        }
+    }
+    {
+        LayoutFileSource source("overlay-bench-missing.bin");
+        auto scene = source.Load();
+        if (!scene || scene->error.empty() || source.Load() != nullptr)
+        {
+            std::cerr << "layout: a missing layout file was not reported once\n";
+            ++failures;
+        }
+    }
+    std::filesystem::remove(fileName);
+    return failures;
+}
+
+// Stands in for one registry call on a machine where the hive is not cached yet
+static void SimulatedQuery()
+{
+    const auto latency = std::chrono::microseconds(10);
+    auto end = std::chrono::steady_clock::now() + latency;
+    while (std::chrono::steady_clock::now() < end)
+    {
+    }
+}
+
+// What the overlay does before the first WM_PAINT returns: lay the scene out
+// on a 1080p monitor and draw all of it
+static uint64_t FirstFrame(const RectStore& rects, const GlyphAtlas& atlas)
+{
+    MonitorLayout layout;
+    layout.SetMonitors({ MonitorInfo{0, 0, 1920, 1080, 96, true} });
+    layout.Update(rects);
+    const MonitorScene& scene = layout.Scene(0);
+    Framebuffer fb;
+    fb.Resize(1920, 1080);
+    ClearFramebuffer(fb, COLOR_TRANSPARENT);
+    RenderPlacedRectangles(fb, rects, scene.rects, scene.borderThickness, atlas);
+    return HashFramebuffer(fb);
+}
+
+static int RunStartupBench(int iterations)
+{
+    const int counts[] = { 100, 1000, 5000 };
+    const std::string fileName = "overlay-bench-scene.cache";
+    GlyphAtlas atlas = BuildBuiltinGlyphAtlas(2);
+    int failures = 0;
+
+    printf("\n%-8s %10s %12s %14s %14s %12s\n", "zones", "cache KB", "cache ms", "5 queries ms", "bulk query ms",
+           "unchanged us");
+    for (int count : counts)
+    {
+        RectStore live = MakeScene(count, 0x57A27000u + count, 10);
+        std::filesystem::remove(fileName);
+
+        // Cold start: enumerate the zones and query each one, then paint
+        auto coldFrame = [&](int queriesPerZone)
+        {
+            RectStore rects;
+            for (size_t i = 0; i < live.Size(); ++i)
+            {
+                for (int q = 0; q < queriesPerZone; ++q)
+                {
+                    SimulatedQuery();
+                }
+                rects.Add(live.Name(i), live.Left()[i], live.Top()[i], live.Right()[i], live.Bottom()[i],
+                          live.Flags()[i], live.Monitor()[i]);
+            }
+            return FirstFrame(rects, atlas);
+        };
+        uint64_t liveHash = 0;
+        double queriesMs = MedianMs(iterations, [&] { liveHash = coldFrame(5); });
+        double bulkMs = MedianMs(iterations, [&] { coldFrame(1); });
+
+        OverlaySnapshot scene;
+        scene.rects = live;
+        std::string error;
+        SceneCache writer(fileName);
+        if (writer.Load() != nullptr || !writer.Save(scene, error) || writer.Writes() != 1)
+        {
+            std::cerr << count << " zones: the scene cache was not written: " << error << "\n";
+            ++failures;
+            continue;
+        }
+
+        // Warm start: paint whatever the previous run left behind
+        uint64_t cachedHash = 0;
+        double cacheMs = MedianMs(iterations, [&]
+        {
+            SceneCache cache(fileName);
+            std::unique_ptr<OverlaySnapshot> cached = cache.Load();
+            cachedHash = cached ? FirstFrame(cached->rects, atlas) : 0;
+        });
+        if (cachedHash != liveHash)
+        {
+            std::cerr << count << " zones: the cached scene paints a different frame\n";
+            ++failures;
+        }
+
+        // Every poll saves the scene it loaded; only a change may reach the disk
+        SceneCache cache(fileName);
+        std::unique_ptr<OverlaySnapshot> cached = cache.Load();
+        if (!cached || !SameRects(cached->rects, live))
+        {
+            std::cerr << count << " zones: the scene cache does not round-trip\n";
+            ++failures;
+        }
+        const int polls = 100;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < polls; ++i)
+        {
+            cache.Save(scene, error);
+        }
+        double unchangedUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / polls;
+        scene.rects.SetBounds(0, 1, 2, 3, 4);
+        if (cache.Writes() != 0 || !cache.Save(scene, error) || cache.Writes() != 1 || !cache.Save(scene, error) ||
+            cache.Writes() != 1)
+        {
+            std::cerr << count << " zones: the scene cache was rewritten without a change or not after one\n";
+            ++failures;
+        }
+
+        printf("%-8d %10.1f %12.3f %14.3f %14.3f %12.2f\n", count, std::filesystem::file_size(fileName) / 1024.0,
+               cacheMs, queriesMs, bulkMs, unchangedUs);
+    }
+
+    // No cache and a damaged cache both mean waiting for the live scene
+    {
+        OverlaySnapshot scene;
+        scene.rects = MakeScene(10, 0x57A27BADu, 10);
+        std::string error, contents;
+        SceneCache(fileName).Save(scene, error);
+        {
+            std::ifstream in(fileName, std::ios::binary);
+            contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+        contents[contents.size() / 2] ^= 0x5A;
+        std::ofstream(fileName, std::ios::binary | std::ios::trunc).write(contents.data(), contents.size());
+        if (SceneCache(fileName).Load() != nullptr || SceneCache("overlay-bench-missing.cache").Load() != nullptr)
+        {
+            std::cerr << "startup: a damaged or missing scene cache was used\n";
+            ++failures;
+        }
+    }
+    std::filesystem::remove(fileName);
+    return failures;
+}
+
+int main(int argc, char** argv)
+{
+    std::string goldenFile = "golden/overlay-golden.txt";
+    std::string dumpDir;
+    std::string section = "all";
+    bool updateGolden = false;
+    int iterations = 5;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--golden") && i + 1 < argc) goldenFile = argv[++i];
+        else if (!strcmp(argv[i], "--dump") && i + 1 < argc) dumpDir = argv[++i];
+        else if (!strcmp(argv[i], "--iterations") && i + 1 < argc) iterations = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--section") && i + 1 < argc) section = argv[++i];
+        else if (!strcmp(argv[i], "--update-golden")) updateGolden = true;
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--section render|spatial|store|loader|alias|layout|startup|all] [--golden <file>] [--update-golden] [--dump <dir>] [--iterations <n>]\n";
+            return 2;
+        }
+    }
+
+    int failures = 0;
+    if (section == "render" || section == "all")
+    {
+        failures += RunRenderBench(iterations, goldenFile, updateGolden, dumpDir);
+    }
+    if (section == "spatial" || section == "all")
+    {
+        failures += RunSpatialBench(iterations);
+    }
+    if (section == "store" || section == "all")
+    {
+        failures += RunStoreBench(iterations);
+    }
+    if (section == "loader" || section == "all")
+    {
+        failures += RunLoaderBench(iterations);
+    }
+    if (section == "alias" || section == "all")
+    {
+        failures += RunAliasBench(iterations);
+    }
+    if (section == "layout" || section == "all")
+    {
+        failures += RunLayoutBench(iterations);
+    }
+    if (section == "startup" || section == "all")
+    {
+        failures += RunStartupBench(iterations);
+    }
+    return failures > 0 ? 1 : 0;
+}
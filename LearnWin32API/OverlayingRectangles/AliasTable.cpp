@@ -0,0 +1,76 @@
+#include "AliasTable.h"
+#include <algorithm>
+#include "../../Common/Utf.h"
+
+void AliasTable::Clear()
+{
+    m_suffixes.Clear();
+    m_strings.Clear();
+    m_targets.clear();
+    m_names.clear();
+    m_collisions.clear();
+    m_source = AliasSource();
+}
+
+bool AliasTable::Add(std::string_view valueName, std::string_view target)
+{
+    // Value names are UTF-8: the suffix is the last code points, never part of
+    // a character. Names shorter than a suffix map as a whole.
+    size_t count = 0;
+    for (size_t offset = 0; offset < valueName.size(); ++count)
+    {
+        NextCodePoint(valueName, offset);
+    }
+    size_t start = 0;
+    for (size_t skip = count - std::min(count, m_suffixLength); skip > 0; --skip)
+    {
+        NextCodePoint(valueName, start);
+    }
+    std::string_view suffix = valueName.substr(start);
+    uint32_t id = m_suffixes.Intern(suffix);
+    if (id < m_targets.size())
+    {
+        std::string_view kept = m_strings.Get(m_targets[id]);
+        if (kept == target)
+        {
+            return true;
+        }
+        m_collisions.push_back({std::string(suffix), std::string(m_strings.Get(m_names[id])), std::string(kept),
+                                std::string(valueName), std::string(target)});
+        return false;
+    }
+    m_targets.push_back(m_strings.Intern(target));
+    m_names.push_back(m_strings.Intern(valueName));
+    return true;
+}
+
+std::string_view AliasTable::Resolve(std::string_view name) const
+{
+    return Resolve(name, StringArena::HashOf(name));
+}
+
+std::string_view AliasTable::Resolve(std::string_view name, uint64_t hash) const
+{
+    uint32_t id = m_suffixes.Find(name, hash);
+    return id == StringArena::NOT_FOUND ? std::string_view() : m_strings.Get(m_targets[id]);
+}
+
+size_t AliasTable::ApplyTo(RectStore& rects) const
+{
+    size_t mapped = 0;
+    std::string label;
+    for (size_t i = 0; i < rects.Size(); ++i)
+    {
+        std::string_view target = Resolve(rects.Name(i), rects.NameHash(i));
+        if (!target.empty())
+        {
+            label.assign(rects.Name(i));
+            label += " mapped to ";
+            label += target;
+            rects.SetName(i, label);
+            rects.Flags()[i] &= ~RectStore::FLAG_PRIMARY;
+            ++mapped;
+        }
+    }
+    return mapped;
+}
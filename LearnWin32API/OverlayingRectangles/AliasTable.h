@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "RectStore.h"
+#include "StringArena.h"
+
+// What an alias table was built from. The loader compares it with the
+// current state and only reads the alt-names key again when it differs.
+struct AliasSource
+{
+    std::string keyPath;       // Alt-names key, from fdklayout.txt
+    uint64_t keyWriteTime{};   // Last write time of that key, 0 if it does not exist
+    uint32_t valueCount{};
+    uint64_t layoutFileTime{}; // Last write time of fdklayout.txt, 0 if it does not exist
+
+    bool operator==(const AliasSource& o) const
+    {
+        return keyPath == o.keyPath && keyWriteTime == o.keyWriteTime && valueCount == o.valueCount &&
+               layoutFileTime == o.layoutFileTime;
+    }
+    bool operator!=(const AliasSource& o) const { return !(*this == o); }
+};
+
+// Two values under the alt-names key that name the same rectangle
+struct AliasCollision
+{
+    std::string suffix;
+    std::string keptName, keptTarget; // The first one, which stays in effect
+    std::string droppedName, droppedTarget;
+};
+
+// Alternative names for rectangles. Each value under the alt-names key names
+// a rectangle by the last characters (code points) of the UTF-8 value name
+// and holds the name to show instead. Suffixes live in a StringArena, so resolving is one probe of
+// its open-addressing table; targets are interned in a second arena.
+class AliasTable
+{
+public:
+    explicit AliasTable(size_t suffixLength = 2) : m_suffixLength(suffixLength)
+    {}
+
+    void Clear();
+
+    // Returns false and records a collision when another value already maps
+    // the same suffix to a different target; the first mapping is kept
+    bool Add(std::string_view valueName, std::string_view target);
+
+    // Empty when the name has no alias; hash is StringArena::HashOf(name)
+    std::string_view Resolve(std::string_view name) const;
+    std::string_view Resolve(std::string_view name, uint64_t hash) const;
+
+    // Renames mapped rectangles to "<name> mapped to <target>" and clears
+    // their primary flag; returns how many were mapped
+    size_t ApplyTo(RectStore& rects) const;
+
+    size_t Size() const { return m_targets.size(); }
+    const std::vector<AliasCollision>& Collisions() const { return m_collisions; }
+
+    const AliasSource& Source() const { return m_source; }
+    void SetSource(AliasSource source) { m_source = std::move(source); }
+
+private:
+    size_t m_suffixLength;
+    StringArena m_suffixes;          // Suffix id indexes the columns below
+    StringArena m_strings;           // Value names and targets
+    std::vector<uint32_t> m_targets; // Ids in m_strings
+    std::vector<uint32_t> m_names;   // Ids in m_strings, for collision reports
+    std::vector<AliasCollision> m_collisions;
+    AliasSource m_source;
+};
@@ -0,0 +1,242 @@
+#include "LayoutFile.h"
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include "StringArena.h"
+#include "../../Common/Checksum.h"
+#include "../../Common/Trace.h"
+
+// File layout, little-endian:
+//   LayoutHeader
+//   LayoutRect[rectCount]
+//   LayoutAlt[altCount]
+//   uint32_t[stringCount + 1] offsets into the string bytes, then the bytes;
+//                             names and targets are stored once each
+static const uint32_t LAYOUT_MAGIC = 0x59414C4F; // "OLAY"
+static const uint16_t LAYOUT_VERSION = 1;
+
+struct LayoutHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t headerSize;
+    uint32_t rectCount;
+    uint32_t altCount;
+    uint32_t stringCount;
+    uint32_t stringBytes;
+    uint32_t bodyCrc;   // Everything after the header
+    uint32_t headerCrc; // The header up to this field
+};
+
+struct LayoutRect
+{
+    uint8_t left, top, right, bottom; // Percentages
+    uint8_t flags;
+    uint8_t reserved[3];
+    int32_t monitor;
+    uint32_t name;
+};
+
+struct LayoutAlt
+{
+    uint32_t name;
+    uint32_t target;
+};
+
+static_assert(sizeof(LayoutHeader) == 32 && sizeof(LayoutRect) == 16 && sizeof(LayoutAlt) == 8,
+              "layout records are the file format");
+
+std::string EncodeLayoutFile(const LayoutData& layout)
+{
+    StringArena strings;
+    std::vector<LayoutRect> rects(layout.rects.Size());
+    for (size_t i = 0; i < rects.size(); ++i)
+    {
+        LayoutRect& rect = rects[i];
+        rect.left = static_cast<uint8_t>(layout.rects.Left()[i]);
+        rect.top = static_cast<uint8_t>(layout.rects.Top()[i]);
+        rect.right = static_cast<uint8_t>(layout.rects.Right()[i]);
+        rect.bottom = static_cast<uint8_t>(layout.rects.Bottom()[i]);
+        rect.flags = layout.rects.Flags()[i];
+        rect.monitor = layout.rects.Monitor()[i];
+        rect.name = strings.Intern(layout.rects.Name(i));
+    }
+    std::vector<LayoutAlt> alts;
+    for (const auto& [name, target] : layout.altNames)
+    {
+        alts.push_back({strings.Intern(name), strings.Intern(target)});
+    }
+
+    std::vector<uint32_t> offsets{0};
+    std::string bytes;
+    for (uint32_t id = 0; id < strings.Size(); ++id)
+    {
+        bytes += strings.Get(id);
+        offsets.push_back(static_cast<uint32_t>(bytes.size()));
+    }
+
+    std::string body;
+    body.append(reinterpret_cast<const char*>(rects.data()), rects.size() * sizeof(LayoutRect));
+    body.append(reinterpret_cast<const char*>(alts.data()), alts.size() * sizeof(LayoutAlt));
+    body.append(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint32_t));
+    body += bytes;
+
+    LayoutHeader header{};
+    header.magic = LAYOUT_MAGIC;
+    header.version = LAYOUT_VERSION;
+    header.headerSize = sizeof(LayoutHeader);
+    header.rectCount = static_cast<uint32_t>(rects.size());
+    header.altCount = static_cast<uint32_t>(alts.size());
+    header.stringCount = static_cast<uint32_t>(strings.Size());
+    header.stringBytes = static_cast<uint32_t>(bytes.size());
+    header.bodyCrc = Crc32(body.data(), body.size());
+    header.headerCrc = Crc32(&header, offsetof(LayoutHeader, headerCrc));
+
+    std::string image(reinterpret_cast<const char*>(&header), sizeof(header));
+    return image + body;
+}
+
+bool WriteLayoutFile(const LayoutData& layout, const std::string& fileName, std::string& error)
+{
+    return WriteLayoutImage(EncodeLayoutFile(layout), fileName, error);
+}
+
+bool WriteLayoutImage(const std::string& image, const std::string& fileName, std::string& error)
+{
+    std::string temporary = fileName + ".tmp";
+    FILE* file = OpenUtf8File(temporary, "wb");
+    bool written = file && fwrite(image.data(), 1, image.size(), file) == image.size();
+    if (file)
+    {
+        written = fclose(file) == 0 && written;
+    }
+    std::error_code ec;
+    if (written)
+    {
+        std::filesystem::rename(std::filesystem::u8path(temporary), std::filesystem::u8path(fileName), ec);
+    }
+    if (!written || ec)
+    {
+        error = "Failed to write layout file " + fileName;
+        std::filesystem::remove(std::filesystem::u8path(temporary), ec);
+        return false;
+    }
+    return true;
+}
+
+bool ReadLayoutFile(const uint8_t* data, size_t size, LayoutData& layout, std::string& error)
+{
+    layout.rects.Clear();
+    layout.altNames.clear();
+    error.clear();
+
+    LayoutHeader header;
+    if (size < sizeof(header))
+    {
+        error = "Layout file is too short";
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != LAYOUT_MAGIC || header.version != LAYOUT_VERSION || header.headerSize != sizeof(header) ||
+        header.headerCrc != Crc32(&header, offsetof(LayoutHeader, headerCrc)))
+    {
+        error = "Not a layout file or unsupported version";
+        return false;
+    }
+
+    uint64_t bodySize = uint64_t(header.rectCount) * sizeof(LayoutRect) + uint64_t(header.altCount) * sizeof(LayoutAlt) +
+                        (uint64_t(header.stringCount) + 1) * sizeof(uint32_t) + header.stringBytes;
+    const uint8_t* body = data + sizeof(header);
+    if (bodySize != size - sizeof(header) || header.bodyCrc != Crc32(body, static_cast<size_t>(bodySize)))
+    {
+        error = "Layout file is damaged";
+        return false;
+    }
+
+    // The mapping is only byte-aligned as far as we know, so records are copied out
+    const uint8_t* rects = body;
+    const uint8_t* alts = rects + size_t(header.rectCount) * sizeof(LayoutRect);
+    const uint8_t* offsets = alts + size_t(header.altCount) * sizeof(LayoutAlt);
+    const char* bytes = reinterpret_cast<const char*>(offsets + (size_t(header.stringCount) + 1) * sizeof(uint32_t));
+    auto text = [&](uint32_t id, std::string_view& out)
+    {
+        uint32_t begin, end;
+        if (id >= header.stringCount)
+        {
+            return false;
+        }
+        memcpy(&begin, offsets + size_t(id) * sizeof(uint32_t), sizeof(begin));
+        memcpy(&end, offsets + (size_t(id) + 1) * sizeof(uint32_t), sizeof(end));
+        if (begin > end || end > header.stringBytes)
+        {
+            return false;
+        }
+        out = std::string_view(bytes + begin, end - begin);
+        return true;
+    };
+
+    layout.rects.Reserve(header.rectCount);
+    for (uint32_t i = 0; i < header.rectCount; ++i)
+    {
+        LayoutRect rect;
+        std::string_view name;
+        memcpy(&rect, rects + size_t(i) * sizeof(rect), sizeof(rect));
+        if (!text(rect.name, name))
+        {
+            error = "Layout file is damaged";
+            return false;
+        }
+        layout.rects.Add(name, rect.left, rect.top, rect.right, rect.bottom, rect.flags, rect.monitor);
+    }
+    layout.altNames.reserve(header.altCount);
+    for (uint32_t i = 0; i < header.altCount; ++i)
+    {
+        LayoutAlt alt;
+        std::string_view name, target;
+        memcpy(&alt, alts + size_t(i) * sizeof(alt), sizeof(alt));
+        if (!text(alt.name, name) || !text(alt.target, target))
+        {
+            error = "Layout file is damaged";
+            return false;
+        }
+        layout.altNames.emplace_back(name, target);
+    }
+    return true;
+}
+
+std::unique_ptr<OverlaySnapshot> LayoutFileSource::Load()
+{
+    LY_TRACE_FUNCTION("overlay");
+    FileStamp stamp = ReadFileStamp(m_fileName);
+    if (m_loaded && stamp == m_stamp)
+    {
+        return nullptr;
+    }
+    m_stamp = stamp;
+    m_loaded = true;
+    ++m_reloads;
+
+    auto scene = std::make_unique<OverlaySnapshot>();
+    MappedFile file;
+    LayoutData layout;
+    if (file.Open(m_fileName) != 0)
+    {
+        scene->error = "Failed to open layout file " + m_fileName;
+        return scene;
+    }
+    if (!ReadLayoutFile(file.Data(), file.Size(), layout, scene->error))
+    {
+        scene->error += ": " + m_fileName;
+        return scene;
+    }
+
+    AliasTable aliases;
+    for (const auto& [name, target] : layout.altNames)
+    {
+        aliases.Add(name, target);
+    }
+    scene->rects = std::move(layout.rects);
+    ApplyAliases(aliases, *scene);
+    return scene;
+}
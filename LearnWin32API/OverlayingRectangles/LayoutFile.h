@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "LayoutSource.h"
+#include "../../Common/MappedFile.h"
+
+// Compiled layout: the rectangles and alternative names of one layout in a
+// single binary file, so loading it is one file mapping instead of a
+// registry open per rectangle. Written to a temporary name and renamed into
+// place, so readers never see a partial file.
+bool WriteLayoutFile(const LayoutData& layout, const std::string& fileName, std::string& error);
+
+// The file image WriteLayoutFile writes, and writing an image the same way
+std::string EncodeLayoutFile(const LayoutData& layout);
+bool WriteLayoutImage(const std::string& image, const std::string& fileName, std::string& error);
+
+// Checks and decodes a whole file image
+bool ReadLayoutFile(const uint8_t* data, size_t size, LayoutData& layout, std::string& error);
+
+// Layout source over a compiled layout file. Each Load compares the file's
+// write time, id and size with the previous load and maps and decodes it
+// only when one of them changed.
+class LayoutFileSource : public LayoutSource
+{
+public:
+    explicit LayoutFileSource(std::string fileName) : m_fileName(std::move(fileName))
+    {}
+
+    std::unique_ptr<OverlaySnapshot> Load() override;
+
+    uint64_t Reloads() const { return m_reloads; } // Loads that read the file
+
+private:
+    std::string m_fileName;
+    FileStamp m_stamp;
+    bool m_loaded = false;
+    uint64_t m_reloads = 0;
+};
@@ -0,0 +1,12 @@
+#include "LayoutSource.h"
+
+void ApplyAliases(const AliasTable& aliases, OverlaySnapshot& scene)
+{
+    aliases.ApplyTo(scene.rects);
+    for (const AliasCollision& collision : aliases.Collisions())
+    {
+        scene.warnings.push_back("'" + collision.droppedName + "' maps '" + collision.suffix + "' to '" +
+                                 collision.droppedTarget + "', ignored in favour of '" + collision.keptName + "' (" +
+                                 collision.keptTarget + ")");
+    }
+}
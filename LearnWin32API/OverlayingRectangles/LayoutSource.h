@@ -0,0 +1,28 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "AliasTable.h"
+#include "OverlayLoader.h"
+#include "RectStore.h"
+
+// Everything a layout source provides, before alternative names are applied
+struct LayoutData
+{
+    RectStore rects;
+    std::vector<std::pair<std::string, std::string>> altNames; // Value name and target, in source order
+};
+
+// Where the overlay gets its rectangles and alternative names from. Load runs
+// on the loader thread and returns the next scene, or nullptr when the source
+// has not changed since the previous call.
+class LayoutSource
+{
+public:
+    virtual ~LayoutSource() = default;
+    virtual std::unique_ptr<OverlaySnapshot> Load() = 0;
+};
+
+// Renames the scene's mapped rectangles and reports alias collisions as warnings
+void ApplyAliases(const AliasTable& aliases, OverlaySnapshot& scene);
@@ -0,0 +1,208 @@
+#include "MonitorLayout.h"
+#include <algorithm>
+
+static uint64_t HashMix(uint64_t hash, uint64_t value)
+{
+    hash ^= value + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+static PixelBounds Inflate(const PixelBounds& b, int amount)
+{
+    return {b.left - amount, b.top - amount, b.right + amount, b.bottom + amount};
+}
+
+void MonitorLayout::SetMonitors(std::vector<MonitorInfo> monitors)
+{
+    std::stable_sort(monitors.begin(), monitors.end(), [](const MonitorInfo& a, const MonitorInfo& b)
+    {
+        if (a.isPrimary != b.isPrimary) return a.isPrimary;
+        if (a.left != b.left) return a.left < b.left;
+        return a.top < b.top;
+    });
+
+    m_monitors = std::move(monitors);
+    m_scenes.clear();
+    m_scenes.resize(m_monitors.size());
+    m_monitorsChanged = true;
+}
+
+void MonitorLayout::SetMonitorDpi(size_t monitor, int dpi)
+{
+    if (monitor < m_monitors.size() && m_monitors[monitor].dpi != dpi)
+    {
+        m_monitors[monitor].dpi = dpi;
+        m_monitorsChanged = true;
+    }
+}
+
+size_t MonitorLayout::TargetMonitor(int monitor) const
+{
+    // Rectangles aimed at a monitor that is not connected fall back to the primary one
+    if (monitor < 0 || static_cast<size_t>(monitor) >= m_monitors.size())
+    {
+        return 0;
+    }
+    return static_cast<size_t>(monitor);
+}
+
+std::vector<size_t> MonitorLayout::Update(const RectStore& rects)
+{
+    std::vector<size_t> changed;
+    if (m_monitors.empty())
+    {
+        return changed;
+    }
+
+    // One lookup table row per monitor, then a single pass per coordinate column
+    size_t count = rects.Size();
+    m_lutX.resize(m_monitors.size() * PERCENT_LUT_SIZE);
+    m_lutY.resize(m_monitors.size() * PERCENT_LUT_SIZE);
+    for (size_t m = 0; m < m_monitors.size(); ++m)
+    {
+        BuildPercentLut(m_monitors[m].Width(), m_lutX.data() + m * PERCENT_LUT_SIZE);
+        BuildPercentLut(m_monitors[m].Height(), m_lutY.data() + m * PERCENT_LUT_SIZE);
+    }
+
+    m_rows.resize(count);
+    const int32_t* monitorColumn = rects.Monitor();
+    for (size_t i = 0; i < count; ++i)
+    {
+        m_rows[i] = static_cast<int32_t>(TargetMonitor(monitorColumn[i]));
+    }
+
+    m_pixelLeft.resize(count);
+    m_pixelTop.resize(count);
+    m_pixelRight.resize(count);
+    m_pixelBottom.resize(count);
+    PercentToPixels(rects.Left(), m_rows.data(), m_lutX.data(), m_pixelLeft.data(), count);
+    PercentToPixels(rects.Top(), m_rows.data(), m_lutY.data(), m_pixelTop.data(), count);
+    PercentToPixels(rects.Right(), m_rows.data(), m_lutX.data(), m_pixelRight.data(), count);
+    PercentToPixels(rects.Bottom(), m_rows.data(), m_lutY.data(), m_pixelBottom.data(), count);
+
+    std::vector<std::vector<PlacedRect>> placedPerMonitor(m_monitors.size());
+    std::vector<std::vector<uint64_t>> hashesPerMonitor(m_monitors.size());
+    for (size_t i = 0; i < count; ++i)
+    {
+        size_t m = static_cast<size_t>(m_rows[i]);
+
+        PlacedRect placed;
+        placed.rectIndex = i;
+        placed.left = m_pixelLeft[i];
+        placed.top = m_pixelTop[i];
+        placed.right = m_pixelRight[i];
+        placed.bottom = m_pixelBottom[i];
+        placedPerMonitor[m].push_back(placed);
+        hashesPerMonitor[m].push_back(HashMix(rects.NameHash(i), rects.IsPrimary(i) ? 1 : 0));
+    }
+
+    for (size_t m = 0; m < m_monitors.size(); ++m)
+    {
+        MonitorScene& scene = m_scenes[m];
+        std::vector<PlacedRect>& placed = placedPerMonitor[m];
+        std::vector<uint64_t>& hashes = hashesPerMonitor[m];
+
+        // Keep the 2px border at 96 DPI and scale it with the monitor
+        int thickness = std::max(1, (2 * m_monitors[m].dpi + 48) / 96);
+        scene.dirty.clear();
+        scene.fullRepaint = m_monitorsChanged;
+
+        if (m_monitorsChanged)
+        {
+            scene.index.Reset(m_monitors[m].Width(), m_monitors[m].Height());
+            for (size_t i = 0; i < placed.size(); ++i)
+            {
+                scene.index.Insert(static_cast<uint32_t>(i), placed[i].Bounds());
+            }
+        }
+        else
+        {
+            // Touch only the entries whose bounds or label changed
+            size_t count = std::max(placed.size(), scene.rects.size());
+            for (size_t i = 0; i < count; ++i)
+            {
+                uint32_t id = static_cast<uint32_t>(i);
+                if (i >= placed.size())
+                {
+                    scene.dirty.push_back(Inflate(scene.rects[i].Bounds(), thickness));
+                    scene.index.Remove(id);
+                }
+                else if (i >= scene.rects.size())
+                {
+                    scene.dirty.push_back(Inflate(placed[i].Bounds(), thickness));
+                    scene.index.Insert(id, placed[i].Bounds());
+                }
+                else
+                {
+                    PixelBounds before = scene.rects[i].Bounds();
+                    PixelBounds after = placed[i].Bounds();
+                    bool moved = before.left != after.left || before.top != after.top ||
+                                 before.right != after.right || before.bottom != after.bottom;
+                    if (moved)
+                    {
+                        scene.dirty.push_back(Inflate(before, thickness));
+                        scene.dirty.push_back(Inflate(after, thickness));
+                        scene.index.Move(id, after);
+                    }
+                    else if (scene.rectHashes[i] != hashes[i])
+                    {
+                        scene.dirty.push_back(Inflate(after, thickness));
+                    }
+                }
+            }
+        }
+
+        uint64_t contentHash = HashMix(0, static_cast<uint64_t>(m_monitors[m].dpi));
+        for (size_t i = 0; i < placed.size(); ++i)
+        {
+            contentHash = HashMix(contentHash, hashes[i]);
+            contentHash = HashMix(contentHash, (static_cast<uint64_t>(static_cast<uint32_t>(placed[i].left)) << 32) | static_cast<uint32_t>(placed[i].top));
+            contentHash = HashMix(contentHash, (static_cast<uint64_t>(static_cast<uint32_t>(placed[i].right)) << 32) | static_cast<uint32_t>(placed[i].bottom));
+        }
+
+        if (scene.fullRepaint || contentHash != scene.contentHash)
+        {
+            changed.push_back(m);
+        }
+
+        scene.rects = std::move(placed);
+        scene.rectHashes = std::move(hashes);
+        scene.borderThickness = thickness;
+        scene.contentHash = contentHash;
+    }
+
+    m_monitorsChanged = false;
+    return changed;
+}
+
+int MonitorLayout::HitTest(size_t monitor, int x, int y) const
+{
+    if (monitor >= m_scenes.size())
+    {
+        return -1;
+    }
+
+    std::vector<uint32_t> hits;
+    const MonitorScene& scene = m_scenes[monitor];
+    scene.index.QueryPoint(x, y, hits);
+    // Later rectangles are painted on top
+    return hits.empty() ? -1 : static_cast<int>(scene.rects[hits.back()].rectIndex);
+}
+
+std::vector<std::pair<size_t, size_t>> MonitorLayout::Overlaps(size_t monitor) const
+{
+    std::vector<std::pair<size_t, size_t>> result;
+    if (monitor >= m_scenes.size())
+    {
+        return result;
+    }
+
+    std::vector<std::pair<uint32_t, uint32_t>> pairs;
+    const MonitorScene& scene = m_scenes[monitor];
+    scene.index.FindOverlaps(pairs);
+    for (const auto& pair : pairs)
+    {
+        result.emplace_back(scene.rects[pair.first].rectIndex, scene.rects[pair.second].rectIndex);
+    }
+    return result;
+}
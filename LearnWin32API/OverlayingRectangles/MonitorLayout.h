@@ -0,0 +1,66 @@
+#pragma once
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "OverlayScene.h"
+#include "RectStore.h"
+#include "SpatialIndex.h"
+
+// Monitor rectangle in virtual-screen pixels
+struct MonitorInfo
+{
+    int left{}, top{}, right{}, bottom{};
+    int dpi{96};
+    bool isPrimary{};
+
+    int Width() const { return right - left; }
+    int Height() const { return bottom - top; }
+};
+
+// What one monitor's overlay window has to draw
+struct MonitorScene
+{
+    std::vector<PlacedRect> rects;     // Monitor-local pixels, position is the SpatialIndex id
+    std::vector<uint64_t> rectHashes;  // Per-rect content, to spot label-only changes
+    SpatialIndex index;
+    int borderThickness{2};
+    uint64_t contentHash{};            // Changes only when the drawn output would change
+
+    // Filled by MonitorLayout::Update: areas to repaint, already inflated by the border
+    bool fullRepaint{true};
+    std::vector<PixelBounds> dirty;
+};
+
+// Maps every rectangle to a target monitor and caches the pixel rectangles.
+// Nothing is recomputed on paint; callers push new monitors (display or DPI
+// change) or new rectangles (registry reload) and get back the monitors
+// whose content actually changed, so only those windows are repainted.
+class MonitorLayout
+{
+public:
+    // Monitors are reordered primary first, then left to right, top to bottom;
+    // the RectStore monitor column indexes into that order
+    void SetMonitors(std::vector<MonitorInfo> monitors);
+    void SetMonitorDpi(size_t monitor, int dpi);
+
+    // Returns the indices of monitors whose scene changed since the last call
+    std::vector<size_t> Update(const RectStore& rects);
+
+    const std::vector<MonitorInfo>& Monitors() const { return m_monitors; }
+    const MonitorScene& Scene(size_t monitor) const { return m_scenes[monitor]; }
+    size_t TargetMonitor(int monitor) const;
+
+    // RectStore index of the topmost rectangle under a monitor-local point, or -1
+    int HitTest(size_t monitor, int x, int y) const;
+    // Pairs of RectStore indices whose rectangles overlap on the monitor
+    std::vector<std::pair<size_t, size_t>> Overlaps(size_t monitor) const;
+
+private:
+    std::vector<MonitorInfo> m_monitors;
+    std::vector<MonitorScene> m_scenes;
+    bool m_monitorsChanged{true};
+
+    // Scratch columns for the percentage-to-pixel pass, kept to avoid reallocating
+    std::vector<int32_t> m_rows, m_lutX, m_lutY;
+    std::vector<int32_t> m_pixelLeft, m_pixelTop, m_pixelRight, m_pixelBottom;
+};
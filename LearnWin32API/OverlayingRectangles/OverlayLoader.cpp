@@ -0,0 +1,107 @@
+#include "OverlayLoader.h"
+#include "../../Common/Trace.h"
+
+static void StoreMax(std::atomic<uint64_t>& target, uint64_t value)
+{
+    uint64_t current = target.load(std::memory_order_relaxed);
+    while (value > current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed))
+    {}
+}
+
+OverlayLoader::~OverlayLoader()
+{
+    Stop();
+}
+
+void OverlayLoader::Start(LoadFunction load, NotifyFunction notify, std::chrono::milliseconds interval)
+{
+    Stop();
+    m_load = std::move(load);
+    m_notify = std::move(notify);
+    m_interval = interval;
+    m_stop = false;
+    m_thread = std::thread(&OverlayLoader::Run, this);
+}
+
+void OverlayLoader::Stop()
+{
+    if (!m_thread.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    m_thread.join();
+
+    delete m_pending.exchange(nullptr);
+    m_notified = false;
+}
+
+void OverlayLoader::Run()
+{
+    Trace::SetThreadName("OverlayLoader");
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stop)
+    {
+        lock.unlock();
+        auto start = std::chrono::steady_clock::now();
+        std::unique_ptr<OverlaySnapshot> snapshot = m_load();
+        uint64_t loadNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+
+        m_loads.fetch_add(1, std::memory_order_relaxed);
+        m_lastLoadNs.store(loadNs, std::memory_order_relaxed);
+        StoreMax(m_maxLoadNs, loadNs);
+        if (snapshot)
+        {
+            Publish(std::move(snapshot));
+        }
+
+        lock.lock();
+        m_wake.wait_for(lock, m_interval, [this] { return m_stop; });
+    }
+}
+
+void OverlayLoader::Publish(std::unique_ptr<OverlaySnapshot> snapshot)
+{
+    snapshot->generation = ++m_generation;
+    snapshot->publishedAt = std::chrono::steady_clock::now();
+
+    // Swap the new snapshot in; one the UI has not taken yet is stale, drop it
+    delete m_pending.exchange(snapshot.release(), std::memory_order_acq_rel);
+
+    // One notification per pickup is enough, the UI always takes the newest
+    if (!m_notified.exchange(true, std::memory_order_acq_rel) && m_notify)
+    {
+        m_notify();
+    }
+}
+
+std::unique_ptr<const OverlaySnapshot> OverlayLoader::Take()
+{
+    m_notified.store(false, std::memory_order_release);
+    std::unique_ptr<const OverlaySnapshot> snapshot(m_pending.exchange(nullptr, std::memory_order_acq_rel));
+    if (snapshot)
+    {
+        uint64_t latencyNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - snapshot->publishedAt).count());
+        m_lastPublishNs.store(latencyNs, std::memory_order_relaxed);
+        StoreMax(m_maxPublishNs, latencyNs);
+    }
+    return snapshot;
+}
+
+LoaderMetrics OverlayLoader::Metrics() const
+{
+    LoaderMetrics metrics;
+    metrics.loads = m_loads.load(std::memory_order_relaxed);
+    metrics.lastLoadMs = m_lastLoadNs.load(std::memory_order_relaxed) / 1e6;
+    metrics.maxLoadMs = m_maxLoadNs.load(std::memory_order_relaxed) / 1e6;
+    metrics.lastPublishLatencyMs = m_lastPublishNs.load(std::memory_order_relaxed) / 1e6;
+    metrics.maxPublishLatencyMs = m_maxPublishNs.load(std::memory_order_relaxed) / 1e6;
+    return metrics;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "RectStore.h"
+
+// Immutable result of one load; never modified after it is published
+struct OverlaySnapshot
+{
+    RectStore rects;
+    std::string error; // Non-empty when loading failed
+    std::vector<std::string> warnings; // Problems that do not stop the overlay, e.g. alias collisions
+    uint64_t generation{};
+    std::chrono::steady_clock::time_point publishedAt{};
+};
+
+struct LoaderMetrics
+{
+    uint64_t loads{};
+    double lastLoadMs{}, maxLoadMs{};
+    double lastPublishLatencyMs{}, maxPublishLatencyMs{};
+};
+
+// Runs the overlay data source on a worker thread so the UI thread never
+// waits for registry or file I/O. Every load builds a fresh snapshot that is
+// handed over through a single atomic pointer slot: the worker swaps the new
+// snapshot in, the UI thread swaps it out when notified. Neither side takes a
+// lock, and a snapshot the UI never picked up is simply replaced.
+class OverlayLoader
+{
+public:
+    using LoadFunction = std::function<std::unique_ptr<OverlaySnapshot>()>;
+    using NotifyFunction = std::function<void()>; // Called on the worker, e.g. PostMessage
+
+    ~OverlayLoader();
+
+    void Start(LoadFunction load, NotifyFunction notify, std::chrono::milliseconds interval);
+    void Stop();
+
+    // UI side: takes the newest unconsumed snapshot, or nullptr if there is none
+    std::unique_ptr<const OverlaySnapshot> Take();
+
+    LoaderMetrics Metrics() const;
+
+private:
+    void Run();
+    void Publish(std::unique_ptr<OverlaySnapshot> snapshot);
+
+    LoadFunction m_load;
+    NotifyFunction m_notify;
+    std::chrono::milliseconds m_interval{};
+    std::thread m_thread;
+
+    std::atomic<OverlaySnapshot*> m_pending{nullptr};
+    std::atomic<bool> m_notified{false};
+    uint64_t m_generation{};
+
+    // Only used to sleep between loads and to wake up for Stop()
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_stop{false};
+
+    std::atomic<uint64_t> m_loads{0};
+    std::atomic<uint64_t> m_lastLoadNs{0}, m_maxLoadNs{0};
+    std::atomic<uint64_t> m_lastPublishNs{0}, m_maxPublishNs{0};
+};
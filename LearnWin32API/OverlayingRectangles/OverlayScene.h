@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+
+// Pixel rectangle, right and bottom exclusive
+struct PixelBounds
+{
+    int left{}, top{}, right{}, bottom{};
+
+    bool Contains(int x, int y) const { return x >= left && x < right && y >= top && y < bottom; }
+    bool Intersects(const PixelBounds& o) const
+    {
+        return left < o.right && o.left < right && top < o.bottom && o.top < bottom;
+    }
+};
+
+// A rectangle resolved to pixels on one monitor
+struct PlacedRect
+{
+    size_t rectIndex{}; // Index into the RectStore it came from
+    int left{}, top{}, right{}, bottom{};
+
+    PixelBounds Bounds() const { return {left, top, right, bottom}; }
+};
@@ -1,41 +1,98 @@
 #include <windows.h>
-#include <gdiplus.h>
+#include <shellscalingapi.h>
+#include <algorithm>
+#include <cstring>
 #include <vector>
 #include <string>
 #include <map>
+#include <memory>
 #include <sstream>
 #include <fstream>
+#include "OverlayScene.h"
+#include "RectStore.h"
+#include "SoftwareRasterizer.h"
+#include "MonitorLayout.h"
+#include "OverlayLoader.h"
+#include "AliasTable.h"
+#include "LayoutFile.h"
+#include "LayoutSource.h"
+#include "SceneCache.h"
+#include "../../Common/Metrics.h"
+#include "../../Common/Trace.h"
+#include "../../Common/Utf.h"
 
-#pragma comment(lib, "gdiplus.lib")
 #pragma comment(lib, "user32.lib")
+#pragma comment(lib, "gdi32.lib")
+#pragma comment(lib, "shcore.lib")
 
-// Structure to hold rectangle data
-struct MyRect
+// The registry layout: one subkey per rectangle under REG_PATH_RECTS and
+// alternative names under the key named in fdklayout.txt
+class RegistryLayoutSource : public LayoutSource
 {
-    std::string name{};
-    int top{}, left{}, right{}, bottom{};
-    bool isPrimary{};
+public:
+    std::unique_ptr<OverlaySnapshot> Load() override;
+    // One full read, for compiling the layout into a file
+    bool Read(LayoutData& layout, std::string& error);
+
+private:
+    bool ReadRects(RectStore& rects, std::string& error);
+    void RefreshAliases();
+
+    AliasTable m_aliases; // Kept across loads
+    std::vector<std::pair<std::string, std::string>> m_altValues; // What m_aliases was built from
+};
+
+// Time to first paint, in ms since the process was created so that loading
+// the executable and everything before wWinMain is included; -1 until it happens
+struct StartupTimes
+{
+    double cachedPaintMs = -1; // The cached scene is on screen
+    double livePaintMs = -1;   // The first scene from the layout source is on screen
+};
+
+// One layered overlay window per monitor
+struct OverlayWindow
+{
+    HWND hwnd{};
+    Framebuffer framebuffer;
 };
 
 // Global variables
 HINSTANCE g_hInstance;
-HWND g_hwnd;
-NOTIFYICONDATA g_nid = { sizeof(NOTIFYICONDATA) };
-std::vector<MyRect> g_rectangles;
-std::map<std::string, std::string> g_altNames;
-Gdiplus::GdiplusStartupInput gdiplusStartupInput;
-ULONG_PTR gdiplusToken;
+HWND g_hwnd; // Hidden controller window: tray icon, scene updates, display changes
+NOTIFYICONDATAW g_nid = { sizeof(NOTIFYICONDATAW) };
+OverlayLoader g_loader; // Polls the registry on its own thread
+std::unique_ptr<const OverlaySnapshot> g_scene; // UI thread only, the snapshot g_layout was built from
+std::unique_ptr<LayoutSource> g_source; // Loader thread only once the loader runs
+MonitorLayout g_layout;
+std::vector<OverlayWindow> g_overlays; // Same order as g_layout.Monitors()
+std::map<int, GlyphAtlas> g_glyphAtlases; // Keyed by DPI
 std::string REG_PATH_RECTS = "";
-std::string REG_PATH_ALT_NAMES = "";
+std::string REG_PATH_ALT_NAMES = ""; // Loader thread only
+const char* LAYOUT_FILE = "fdklayout.bin"; // Compiled layout, used instead of the registry when present
+SceneCache g_cache("overlay-scene.cache"); // Loader thread only once the loader runs
+StartupTimes g_startup;
 const UINT WM_APP_TRAY = WM_APP + 1;
+const UINT WM_APP_SCENE_READY = WM_APP + 2; // Posted by the loader thread
 
 // Forward declarations
 LRESULT CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);
-void LoadRegistryData();
+LRESULT CALLBACK OverlayWndProc(HWND, UINT, WPARAM, LPARAM);
+int CompileLayoutFile(const std::string& fileName);
+void ApplySnapshot();
+void UpdateTrayTip();
 void ShowErrorAndExit(const char* message);
+void ShowTrayWarning(const std::string& message);
 void CreateTrayIcon(HWND hwnd);
 void ShowContextMenu(HWND hwnd);
-void DrawRectangles(HDC hdc);
+void DrawRectangles(HDC hdc, size_t monitor, const RECT& paintRect);
+std::vector<MonitorInfo> EnumerateMonitors();
+void RebuildOverlayWindows();
+void ApplyLayout();
+double MsSinceProcessStart();
+void ReportStartup(const char* what, double ms);
+const GlyphAtlas& GlyphAtlasForDpi(int dpi);
+GlyphAtlas BuildGdiGlyphAtlas(const char* faceName, int pointSize, int dpi);
 
 std::string ReadOneLineFromFile(std::string const& fileName)
 {
@@ -54,80 +111,144 @@ std::string ReadOneLineFromFile(std::string const& fileName)
     return "";
 }
 
-// Initialize GDI+ and register window class
-int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE, LPWSTR, int nCmdShow)
+// Register window classes and create the overlay windows
+int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE, LPWSTR, int)
 {
-    Gdiplus::GdiplusStartup(&gdiplusToken, &gdiplusStartupInput, nullptr);
     g_hInstance = hInstance;
 
-    WNDCLASSEX wc = { sizeof(WNDCLASSEX) };
+    // OverlayingRectangles --compile-layout [file]: save the registry layout as a layout file and exit
+    int argc = 0;
+    LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    if (argv && argc >= 2 && wcscmp(argv[1], L"--compile-layout") == 0)
+    {
+        std::string fileName = argc >= 3 ? Narrow(argv[2]) : LAYOUT_FILE;
+        LocalFree(argv);
+        return CompileLayoutFile(fileName);
+    }
+    // --trace <file>: record spans and write them as Chrome trace JSON on exit
+    // --metrics <file>: write load, apply and paint metrics as Prometheus text every 10 seconds
+    std::string traceFile, metricsFile;
+    for (int i = 1; argv && i + 1 < argc; i += 2)
+    {
+        if (wcscmp(argv[i], L"--trace") == 0)
+        {
+            traceFile = Narrow(argv[i + 1]);
+        }
+        else if (wcscmp(argv[i], L"--metrics") == 0)
+        {
+            metricsFile = Narrow(argv[i + 1]);
+        }
+    }
+    LocalFree(argv);
+    Trace::SetEnabled(!traceFile.empty());
+    if (!metricsFile.empty())
+    {
+        Metrics::StartExporter(metricsFile, std::chrono::seconds(10));
+    }
+    Trace::SetThreadName("UI");
+
+    // Monitor rectangles and DPI are then reported in physical pixels
+    SetProcessDpiAwarenessContext(DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2);
+
+    WNDCLASSEXW wc = { sizeof(WNDCLASSEXW) };
     wc.lpfnWndProc = WndProc;
     wc.hInstance = hInstance;
-    wc.lpszClassName = "OverlayWindow";
-    RegisterClassEx(&wc);
-
-    // Get primary monitor dimensions
-    int screenWidth = GetSystemMetrics(SM_CXSCREEN);
-    int screenHeight = GetSystemMetrics(SM_CYSCREEN);
-
-    // Create window
-    g_hwnd = CreateWindowEx(
-        WS_EX_LAYERED | WS_EX_TRANSPARENT | WS_EX_TOPMOST,
-        "OverlayWindow",
-        "Overlay",
-        WS_POPUP,
-        0, 0, screenWidth, screenHeight,
-        nullptr, nullptr, hInstance, nullptr
-    );
+    wc.lpszClassName = L"OverlayController";
+    RegisterClassExW(&wc);
 
+    wc.lpfnWndProc = OverlayWndProc;
+    wc.lpszClassName = L"OverlayWindow";
+    RegisterClassExW(&wc);
+
+    // Never shown, but top-level so it still receives WM_DISPLAYCHANGE
+    g_hwnd = CreateWindowExW(0, L"OverlayController", L"Overlay", WS_POPUP,
+                             0, 0, 0, 0, nullptr, nullptr, hInstance, nullptr);
     if (!g_hwnd)
     {
         ShowErrorAndExit("Failed to create window");
         return 1;
     }
 
-    // Set window transparency (fully transparent background)
-    SetLayeredWindowAttributes(g_hwnd, RGB(0, 0, 0), 0, LWA_COLORKEY);
-    ShowWindow(g_hwnd, nCmdShow);
-    UpdateWindow(g_hwnd);
+    // Read before the loader starts, which owns the cache from then on
+    std::unique_ptr<OverlaySnapshot> cached = g_cache.Load();
 
+    // A compiled layout file takes precedence over the registry
+    if (GetFileAttributesA(LAYOUT_FILE) != INVALID_FILE_ATTRIBUTES)
+    {
+        g_source = std::make_unique<LayoutFileSource>(LAYOUT_FILE);
+    }
+    else
+    {
+        g_source = std::make_unique<RegistryLayoutSource>();
+    }
+
+    // 5-second polling; the first load starts right away, so the layout is
+    // read while the overlay windows are created and the cached scene painted.
+    // Scenes that loaded cleanly become the cache for the next start.
+    g_loader.Start([]
+                   {
+                       static Metrics::Operation metrics("overlay_op", "load");
+                       std::unique_ptr<OverlaySnapshot> scene;
+                       {
+                           Metrics::OperationTimer timer(metrics);
+                           scene = g_source->Load();
+                           if (scene && !scene->error.empty())
+                           {
+                               timer.Fail();
+                           }
+                       }
+                       std::string error;
+                       if (scene && scene->error.empty() && !g_cache.Save(*scene, error))
+                       {
+                           OutputDebugStringA((error + "\n").c_str());
+                       }
+                       return scene;
+                   },
+                   [] { PostMessageW(g_hwnd, WM_APP_SCENE_READY, 0, 0); },
+                   std::chrono::milliseconds(5000));
+
+    g_layout.SetMonitors(EnumerateMonitors());
+    RebuildOverlayWindows();
     CreateTrayIcon(g_hwnd);
-    LoadRegistryData();
-    InvalidateRect(g_hwnd, nullptr, TRUE); // Force initial repaint
-    SetTimer(g_hwnd, 1, 5000, nullptr); // 5-second registry polling
+
+    // Empty until the first load lands if there is no cache
+    g_scene = cached ? std::move(cached) : std::make_unique<OverlaySnapshot>();
+    if (g_scene->rects.Size() > 0)
+    {
+        ApplyLayout();
+        g_startup.cachedPaintMs = MsSinceProcessStart();
+        ReportStartup("cached scene", g_startup.cachedPaintMs);
+    }
 
     MSG msg;
-    while (GetMessage(&msg, nullptr, 0, 0))
+    while (GetMessageW(&msg, nullptr, 0, 0))
     {
         TranslateMessage(&msg);
-        DispatchMessage(&msg);
+        DispatchMessageW(&msg);
     }
 
-    Gdiplus::GdiplusShutdown(gdiplusToken);
+    g_loader.Stop();
+    Metrics::StopExporter();
+    if (!traceFile.empty() && !Trace::WriteChromeTrace(traceFile))
+    {
+        MessageBoxW(nullptr, Widen("Failed to write trace file " + traceFile).c_str(), L"Error", MB_OK | MB_ICONERROR);
+    }
     return (int)msg.wParam;
 }
 
-// Window procedure
+// Controller window procedure
 LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 {
     switch (msg)
     {
-        case WM_PAINT:
-        {
-            PAINTSTRUCT ps;
-            HDC hdc = BeginPaint(hwnd, &ps);
-            // Fill background with transparent color
-            HBRUSH hBrush = CreateSolidBrush(RGB(0, 0, 0));
-            FillRect(hdc, &ps.rcPaint, hBrush);
-            DeleteObject(hBrush);
-            DrawRectangles(hdc);
-            EndPaint(hwnd, &ps);
+        case WM_APP_SCENE_READY:
+            ApplySnapshot();
             return 0;
-        }
-        case WM_TIMER:
-            LoadRegistryData();
-            InvalidateRect(hwnd, nullptr, TRUE);
-            UpdateWindow(hwnd); // Ensure immediate update
+        case WM_DISPLAYCHANGE:
+            // Monitors were added, removed, moved or changed resolution
+            g_layout.SetMonitors(EnumerateMonitors());
+            RebuildOverlayWindows();
+            ApplyLayout();
             return 0;
         case WM_APP_TRAY:
             if (lParam == WM_RBUTTONUP)
@@ -138,13 +259,53 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
         case WM_COMMAND:
             if (LOWORD(wParam) == 1000)
             {
-                Shell_NotifyIcon(NIM_DELETE, &g_nid);
+                Shell_NotifyIconW(NIM_DELETE, &g_nid);
                 DestroyWindow(hwnd);
             }
             return 0;
         case WM_DESTROY:
+            for (auto& overlay : g_overlays)
+            {
+                DestroyWindow(overlay.hwnd);
+            }
+            g_overlays.clear();
             PostQuitMessage(0);
             return 0;
+    }
+    return DefWindowProcW(hwnd, msg, wParam, lParam);
+}
+
+// Overlay window procedure, one window per monitor
+LRESULT CALLBACK OverlayWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
+{
+    size_t monitor = static_cast<size_t>(GetWindowLongPtr(hwnd, GWLP_USERDATA));
+    switch (msg)
+    {
+        case WM_PAINT:
+        {
+            PAINTSTRUCT ps;
+            HDC hdc = BeginPaint(hwnd, &ps);
+            // The framebuffer is cleared to the transparent color key, so no background fill
+            DrawRectangles(hdc, monitor, ps.rcPaint);
+            EndPaint(hwnd, &ps);
+            return 0;
+        }
+        case WM_ERASEBKGND:
+            return 1;
+        case WM_DPICHANGED:
+        {
+            // The suggested rect in lParam is scaled by the DPI ratio; the
+            // overlay must keep covering its monitor's physical bounds
+            if (monitor < g_layout.Monitors().size())
+            {
+                const MonitorInfo& info = g_layout.Monitors()[monitor];
+                SetWindowPos(hwnd, nullptr, info.left, info.top, info.Width(), info.Height(),
+                             SWP_NOZORDER | SWP_NOACTIVATE);
+            }
+            g_layout.SetMonitorDpi(monitor, LOWORD(wParam));
+            ApplyLayout();
+            return 0;
+        }
             // Ignore mouse and keyboard input
         case WM_MOUSEMOVE:
         case WM_LBUTTONDOWN:
@@ -153,140 +314,407 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
         case WM_KEYUP:
             return 0;
     }
-    return DefWindowProc(hwnd, msg, wParam, lParam);
+    return DefWindowProcW(hwnd, msg, wParam, lParam);
+}
+
+static BOOL CALLBACK AddMonitor(HMONITOR hMonitor, HDC, LPRECT, LPARAM data)
+{
+    MONITORINFO mi = { sizeof(MONITORINFO) };
+    if (GetMonitorInfo(hMonitor, &mi))
+    {
+        MonitorInfo info;
+        info.left = mi.rcMonitor.left;
+        info.top = mi.rcMonitor.top;
+        info.right = mi.rcMonitor.right;
+        info.bottom = mi.rcMonitor.bottom;
+        info.isPrimary = (mi.dwFlags & MONITORINFOF_PRIMARY) != 0;
+
+        UINT dpiX = 96, dpiY = 96;
+        if (SUCCEEDED(GetDpiForMonitor(hMonitor, MDT_EFFECTIVE_DPI, &dpiX, &dpiY)))
+        {
+            info.dpi = static_cast<int>(dpiX);
+        }
+        reinterpret_cast<std::vector<MonitorInfo>*>(data)->push_back(info);
+    }
+    return TRUE;
+}
+
+std::vector<MonitorInfo> EnumerateMonitors()
+{
+    std::vector<MonitorInfo> monitors;
+    EnumDisplayMonitors(nullptr, nullptr, AddMonitor, reinterpret_cast<LPARAM>(&monitors));
+    return monitors;
+}
+
+// Create one overlay window per monitor, replacing any previous set
+void RebuildOverlayWindows()
+{
+    LY_TRACE_FUNCTION("overlay");
+    for (auto& overlay : g_overlays)
+    {
+        DestroyWindow(overlay.hwnd);
+    }
+
+    const auto& monitors = g_layout.Monitors();
+    g_overlays.clear();
+    g_overlays.resize(monitors.size());
+    for (size_t i = 0; i < monitors.size(); ++i)
+    {
+        const MonitorInfo& info = monitors[i];
+        HWND hwnd = CreateWindowExW(
+            WS_EX_LAYERED | WS_EX_TRANSPARENT | WS_EX_TOPMOST | WS_EX_TOOLWINDOW,
+            L"OverlayWindow",
+            L"Overlay",
+            WS_POPUP,
+            info.left, info.top, info.Width(), info.Height(),
+            g_hwnd, nullptr, g_hInstance, nullptr
+        );
+        if (!hwnd)
+        {
+            ShowErrorAndExit("Failed to create window");
+            return;
+        }
+
+        SetWindowLongPtr(hwnd, GWLP_USERDATA, static_cast<LONG_PTR>(i));
+        // Set window transparency (fully transparent background)
+        SetLayeredWindowAttributes(hwnd, RGB(0, 0, 0), 0, LWA_COLORKEY);
+        ShowWindow(hwnd, SW_SHOWNOACTIVATE);
+        g_overlays[i].hwnd = hwnd;
+    }
+}
+
+// Recompute the cached layout and repaint only what changed
+void ApplyLayout()
+{
+    LY_TRACE_FUNCTION("overlay");
+    for (size_t monitor : g_layout.Update(g_scene->rects))
+    {
+        if (monitor >= g_overlays.size())
+        {
+            continue;
+        }
+
+        HWND hwnd = g_overlays[monitor].hwnd;
+        const MonitorScene& scene = g_layout.Scene(monitor);
+        if (scene.fullRepaint)
+        {
+            InvalidateRect(hwnd, nullptr, FALSE);
+        }
+        else
+        {
+            for (const auto& bounds : scene.dirty)
+            {
+                RECT rc = {bounds.left, bounds.top, bounds.right, bounds.bottom};
+                InvalidateRect(hwnd, &rc, FALSE);
+            }
+        }
+        UpdateWindow(hwnd); // Ensure immediate update
+    }
+}
+
+// ApplyLayout paints synchronously, so right after it the scene is on screen
+double MsSinceProcessStart()
+{
+    FILETIME creation, exitTime, kernel, user, now;
+    GetProcessTimes(GetCurrentProcess(), &creation, &exitTime, &kernel, &user);
+    GetSystemTimePreciseAsFileTime(&now);
+    uint64_t start = (uint64_t(creation.dwHighDateTime) << 32) | creation.dwLowDateTime;
+    uint64_t end = (uint64_t(now.dwHighDateTime) << 32) | now.dwLowDateTime;
+    return (end - start) / 10000.0; // 100 ns units
+}
+
+void ReportStartup(const char* what, double ms)
+{
+    char line[128];
+    sprintf_s(line, "Overlay: %s painted %.1f ms after process start\n", what, ms);
+    OutputDebugStringA(line);
+}
+
+// Swap in the newest snapshot from the loader and repaint what changed
+void ApplySnapshot()
+{
+    LY_TRACE_FUNCTION("overlay");
+    std::unique_ptr<const OverlaySnapshot> snapshot = g_loader.Take();
+    if (!snapshot)
+    {
+        return;
+    }
+    // Includes the repaint, which UpdateWindow does before returning
+    static Metrics::Operation metrics("overlay_op", "apply");
+    Metrics::OperationTimer timer(metrics);
+    if (!snapshot->error.empty())
+    {
+        ShowErrorAndExit(snapshot->error.c_str());
+        return;
+    }
+
+    // The layout keeps indices into the snapshot, so it is replaced first
+    bool newWarnings = !snapshot->warnings.empty() && (!g_scene || g_scene->warnings != snapshot->warnings);
+    g_scene = std::move(snapshot);
+    ApplyLayout();
+    if (g_startup.livePaintMs < 0)
+    {
+        g_startup.livePaintMs = MsSinceProcessStart();
+        ReportStartup("live scene", g_startup.livePaintMs);
+    }
+    UpdateTrayTip();
+    if (newWarnings)
+    {
+        ShowTrayWarning(g_scene->warnings.front());
+    }
 }
 
 // Load rectangle and alternative name data from registry
-void LoadRegistryData()
+// Runs on the loader thread: errors are returned in the snapshot, never shown here.
+std::unique_ptr<OverlaySnapshot> RegistryLayoutSource::Load()
+{
+    LY_TRACE_FUNCTION("overlay");
+    auto scene = std::make_unique<OverlaySnapshot>();
+    if (!ReadRects(scene->rects, scene->error))
+    {
+        return scene;
+    }
+    RefreshAliases();
+    ApplyAliases(m_aliases, *scene);
+    return scene;
+}
+
+bool RegistryLayoutSource::Read(LayoutData& layout, std::string& error)
+{
+    layout.rects.Clear();
+    if (!ReadRects(layout.rects, error))
+    {
+        return false;
+    }
+    RefreshAliases();
+    layout.altNames = m_altValues;
+    return true;
+}
+
+// Top, Left, Right and Bottom of one rectangle key in a single
+// RegQueryMultipleValuesW call instead of four queries. Fails if any of them
+// is missing or not a DWORD; the caller then reads them one at a time to find
+// out which value is wrong. Monitor is optional and missing from layouts
+// written before it existed, so it is never part of the bulk read: one
+// missing name fails the whole call with ERROR_CANTREAD.
+static bool QueryRectValues(HKEY key, DWORD (&values)[4])
+{
+    static const wchar_t* NAMES[4] = {L"Top", L"Left", L"Right", L"Bottom"};
+    VALENTW entries[4]{};
+    for (size_t i = 0; i < 4; ++i)
+    {
+        entries[i].ve_valuename = const_cast<LPWSTR>(NAMES[i]);
+    }
+    BYTE buffer[64];
+    DWORD bufferSize = sizeof(buffer);
+    if (RegQueryMultipleValuesW(key, entries, 4, reinterpret_cast<LPWSTR>(buffer), &bufferSize) != ERROR_SUCCESS)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < 4; ++i)
+    {
+        if (entries[i].ve_type != REG_DWORD || entries[i].ve_valuelen != sizeof(DWORD))
+        {
+            return false;
+        }
+        memcpy(&values[i], reinterpret_cast<const void*>(entries[i].ve_valueptr), sizeof(DWORD));
+    }
+    return true;
+}
+
+bool RegistryLayoutSource::ReadRects(RectStore& rectangles, std::string& errorText)
 {
-    g_rectangles.clear();
-    g_altNames.clear();
     HKEY hKey;
 
     // Load primary rectangles
-    if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, REG_PATH_RECTS.c_str(), 0, KEY_READ, &hKey) == ERROR_SUCCESS)
+    // Paths and names are UTF-8 here and UTF-16 in the registry
+    std::wstring rectsPath = Widen(REG_PATH_RECTS);
+    if (RegOpenKeyExW(HKEY_LOCAL_MACHINE, rectsPath.c_str(), 0, KEY_READ, &hKey) == ERROR_SUCCESS)
     {
         DWORD index = 0;
-        char subKeyName[256];
-        DWORD nameLen = sizeof(subKeyName) / sizeof(char);
-        while (RegEnumKeyExA(hKey, index, subKeyName, &nameLen, nullptr, nullptr, nullptr, nullptr) == ERROR_SUCCESS)
+        wchar_t wideName[256];
+        DWORD nameLen = static_cast<DWORD>(std::size(wideName));
+        while (RegEnumKeyExW(hKey, index, wideName, &nameLen, nullptr, nullptr, nullptr, nullptr) == ERROR_SUCCESS)
         {
             HKEY hSubKey;
-            std::string path = std::string(REG_PATH_RECTS) + "\\" + subKeyName;
-            if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, path.c_str(), 0, KEY_READ, &hSubKey) == ERROR_SUCCESS)
+            std::string subKeyName = Narrow(std::wstring_view(wideName, nameLen));
+            if (RegOpenKeyExW(hKey, wideName, 0, KEY_READ, &hSubKey) == ERROR_SUCCESS)
             {
-                MyRect rect;
-                rect.name = subKeyName;
-                rect.isPrimary = true;
-                DWORD data{}, dataSize = sizeof(DWORD);
+                int top{}, left{}, right{}, bottom{}, monitor{};
                 bool valid = true;
                 std::stringstream error;
 
-                if (RegQueryValueEx(hSubKey, "Top", nullptr, nullptr, (LPBYTE)&data, &dataSize) != ERROR_SUCCESS || data > 100)
-                {
-                    error << "Invalid or missing 'Top' for " << subKeyName;
-                    valid = false;
-                }
-                else
-                {
-                    rect.top = data;
-                }
-                if (RegQueryValueEx(hSubKey, "Left", nullptr, nullptr, (LPBYTE)&data, &dataSize) != ERROR_SUCCESS || data > 100)
-                {
-                    error << "Invalid or missing 'Left' for " << subKeyName;
-                    valid = false;
-                }
-                else
-                {
-                    rect.left = data;
-                }
-                if (RegQueryValueEx(hSubKey, "Right", nullptr, nullptr, (LPBYTE)&data, &dataSize) != ERROR_SUCCESS || data > 100)
+                DWORD data{}, dataSize = sizeof(DWORD);
+                DWORD values[4]{};
+                if (QueryRectValues(hSubKey, values) && values[0] <= 100 && values[1] <= 100 && values[2] <= 100 &&
+                    values[3] <= 100)
                 {
-                    error << "Invalid or missing 'Right' for " << subKeyName;
-                    valid = false;
+                    top = values[0];
+                    left = values[1];
+                    right = values[2];
+                    bottom = values[3];
                 }
                 else
                 {
-                    rect.right = data;
-                }
-                if (RegQueryValueEx(hSubKey, "Bottom", nullptr, nullptr, (LPBYTE)&data, &dataSize) != ERROR_SUCCESS || data > 100)
-                {
-                    error << "Invalid or missing 'Bottom' for " << subKeyName;
-                    valid = false;
+                    if (RegQueryValueExW(hSubKey, L"Top", nullptr, nullptr, (LPBYTE)&data, &dataSize) != ERROR_SUCCESS || data > 100)
+                    {
+                        error << "Invalid or missing 'Top' for " << subKeyName;
+                        valid = false;
+                    }
+                    else
+                    {
+                        top = data;
+                    }
+                    dataSize = sizeof(DWORD);
+                    if (RegQueryValueExW(hSubKey, L"Left", nullptr, nullptr, (LPBYTE)&data, &dataSize) != ERROR_SUCCESS || data > 100)
+                    {
+                        error << "Invalid or missing 'Left' for " << subKeyName;
+                        valid = false;
+                    }
+                    else
+                    {
+                        left = data;
+                    }
+                    dataSize = sizeof(DWORD);
+                    if (RegQueryValueExW(hSubKey, L"Right", nullptr, nullptr, (LPBYTE)&data, &dataSize) != ERROR_SUCCESS || data > 100)
+                    {
+                        error << "Invalid or missing 'Right' for " << subKeyName;
+                        valid = false;
+                    }
+                    else
+                    {
+                        right = data;
+                    }
+                    dataSize = sizeof(DWORD);
+                    if (RegQueryValueExW(hSubKey, L"Bottom", nullptr, nullptr, (LPBYTE)&data, &dataSize) != ERROR_SUCCESS || data > 100)
+                    {
+                        error << "Invalid or missing 'Bottom' for " << subKeyName;
+                        valid = false;
+                    }
+                    else
+                    {
+                        bottom = data;
+                    }
                 }
-                else
+                // Optional target monitor, defaults to the primary one
+                dataSize = sizeof(DWORD);
+                if (RegQueryValueExW(hSubKey, L"Monitor", nullptr, nullptr, (LPBYTE)&data, &dataSize) == ERROR_SUCCESS &&
+                    dataSize == sizeof(DWORD))
                 {
-                    rect.bottom = data;
+                    monitor = static_cast<int>(data);
                 }
 
                 if (valid)
                 {
-                    g_rectangles.push_back(rect);
+                    rectangles.Add(subKeyName, left, top, right, bottom, RectStore::FLAG_PRIMARY, monitor);
                 }
                 else
                 {
                     RegCloseKey(hSubKey);
                     RegCloseKey(hKey);
-                    ShowErrorAndExit(error.str().c_str());
-                    return;
+                    errorText = error.str();
+                    return false;
                 }
                 RegCloseKey(hSubKey);
             }
-            nameLen = sizeof(subKeyName) / sizeof(wchar_t);
+            nameLen = static_cast<DWORD>(std::size(wideName));
             index++;
         }
         RegCloseKey(hKey);
     }
     else
     {
-        ShowErrorAndExit("Failed to open registry path for Rects");
-        return;
+        errorText = "Failed to open registry path for Rects";
+        return false;
     }
+    return true;
+}
 
-    // Load alternative names (optional)
-    auto pathFromFile = ReadOneLineFromFile("fdklayout.txt");
-    if (pathFromFile.size() > 0)
+// Load alternative names (optional). The table is only rebuilt when
+// fdklayout.txt or the alt-names key has been written since the last load.
+void RegistryLayoutSource::RefreshAliases()
+{
+    HKEY hKey;
+    AliasSource source;
+    WIN32_FILE_ATTRIBUTE_DATA fileInfo;
+    if (GetFileAttributesExA("fdklayout.txt", GetFileExInfoStandard, &fileInfo))
     {
-        REG_PATH_ALT_NAMES = pathFromFile;
+        source.layoutFileTime = (uint64_t(fileInfo.ftLastWriteTime.dwHighDateTime) << 32) | fileInfo.ftLastWriteTime.dwLowDateTime;
     }
-    if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, REG_PATH_ALT_NAMES.c_str(), 0, KEY_READ, &hKey) == ERROR_SUCCESS)
+    if (source.layoutFileTime != m_aliases.Source().layoutFileTime)
     {
-        DWORD index = 0;
-        char valueName[256]{};
-        DWORD nameLen = sizeof(valueName) / sizeof(char);
-        char valueData[256]{};
-        DWORD dataLen = sizeof(valueData);
-        while (RegEnumValueA(hKey, index, valueName, &nameLen, nullptr, nullptr, (LPBYTE)valueData, &dataLen) == ERROR_SUCCESS)
+        auto pathFromFile = ReadOneLineFromFile("fdklayout.txt");
+        if (pathFromFile.size() > 0)
         {
-            char simplifyName[255]{};
-            strcpy_s(simplifyName, 255, valueName + strlen(valueName) - 2);
-            g_altNames[simplifyName] = valueData;
-            nameLen = sizeof(valueName) / sizeof(wchar_t);
-            dataLen = sizeof(valueData);
-            index++;
+            REG_PATH_ALT_NAMES = pathFromFile;
         }
-        RegCloseKey(hKey);
     }
-
-    // Apply alternative names
-    for (auto& rect : g_rectangles)
+    source.keyPath = REG_PATH_ALT_NAMES;
+    if (RegOpenKeyExW(HKEY_LOCAL_MACHINE, Widen(REG_PATH_ALT_NAMES).c_str(), 0, KEY_READ, &hKey) == ERROR_SUCCESS)
     {
-        auto it = g_altNames.find(rect.name);
-        if (it != g_altNames.end())
+        DWORD valueCount{};
+        FILETIME writeTime{};
+        if (RegQueryInfoKeyW(hKey, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, &valueCount, nullptr, nullptr,
+                             nullptr, &writeTime) == ERROR_SUCCESS)
         {
-            rect.name += " mapped to " + it->second;
-            rect.isPrimary = false;
+            source.valueCount = valueCount;
+            source.keyWriteTime = (uint64_t(writeTime.dwHighDateTime) << 32) | writeTime.dwLowDateTime;
         }
+        if (source != m_aliases.Source())
+        {
+            m_aliases.Clear();
+            m_altValues.clear();
+            DWORD index = 0;
+            wchar_t valueName[256]{};
+            DWORD nameLen = static_cast<DWORD>(std::size(valueName));
+            wchar_t valueData[256]{};
+            DWORD dataLen = sizeof(valueData);
+            while (RegEnumValueW(hKey, index, valueName, &nameLen, nullptr, nullptr, (LPBYTE)valueData, &dataLen) == ERROR_SUCCESS)
+            {
+                std::wstring_view target(valueData, dataLen / sizeof(wchar_t));
+                target = target.substr(0, target.find(L'\0'));
+                m_altValues.emplace_back(Narrow(std::wstring_view(valueName, nameLen)), Narrow(target));
+                m_aliases.Add(m_altValues.back().first, m_altValues.back().second);
+                nameLen = static_cast<DWORD>(std::size(valueName));
+                dataLen = sizeof(valueData);
+                index++;
+            }
+            m_aliases.SetSource(source);
+        }
+        RegCloseKey(hKey);
+    }
+    else if (source != m_aliases.Source())
+    {
+        m_aliases.Clear();
+        m_altValues.clear();
+        m_aliases.SetSource(source);
     }
 }
 
-// Display error message and exit
+// Save the registry layout as a compiled layout file
+int CompileLayoutFile(const std::string& fileName)
+{
+    RegistryLayoutSource source;
+    LayoutData layout;
+    std::string error;
+    if (!source.Read(layout, error) || !WriteLayoutFile(layout, fileName, error))
+    {
+        MessageBoxW(nullptr, Widen(error).c_str(), L"Error", MB_OK | MB_ICONERROR);
+        return 1;
+    }
+    std::string message = "Wrote " + std::to_string(layout.rects.Size()) + " rectangles and " +
+                          std::to_string(layout.altNames.size()) + " alternative names to " + fileName;
+    MessageBoxW(nullptr, Widen(message).c_str(), L"Overlay layout", MB_OK | MB_ICONINFORMATION);
+    return 0;
+}
+
+// Display error message and exit; the message is UTF-8
 void ShowErrorAndExit(const char* message)
 {
-    MessageBox(nullptr, message, "Error", MB_OK | MB_ICONERROR);
+    MessageBoxW(nullptr, Widen(message).c_str(), L"Error", MB_OK | MB_ICONERROR);
     if (g_hwnd)
     {
-        Shell_NotifyIcon(NIM_DELETE, &g_nid);
+        Shell_NotifyIconW(NIM_DELETE, &g_nid);
         DestroyWindow(g_hwnd);
     }
     ExitProcess(1);
@@ -300,8 +728,34 @@ void CreateTrayIcon(HWND hwnd)
     g_nid.uFlags = NIF_MESSAGE | NIF_ICON | NIF_TIP;
     g_nid.uCallbackMessage = WM_APP_TRAY;
     g_nid.hIcon = LoadIcon(nullptr, IDI_APPLICATION);
-    strcpy_s(g_nid.szTip, "Overlay Application");
-    Shell_NotifyIcon(NIM_ADD, &g_nid);
+    wcscpy_s(g_nid.szTip, L"Overlay Application");
+    Shell_NotifyIconW(NIM_ADD, &g_nid);
+}
+
+// Show the zone count, loader timings and time to first paint in the tray tooltip
+void UpdateTrayTip()
+{
+    LoaderMetrics metrics = g_loader.Metrics();
+    char cached[32] = "no cache";
+    if (g_startup.cachedPaintMs >= 0)
+    {
+        sprintf_s(cached, "cache %.0f ms", g_startup.cachedPaintMs);
+    }
+    swprintf_s(g_nid.szTip, L"Overlay: %zu zones, load %.1f ms, publish %.1f ms, %zu warnings\nFirst paint: %ls, live %.0f ms",
+               g_scene->rects.Size(), metrics.lastLoadMs, metrics.lastPublishLatencyMs, g_scene->warnings.size(),
+               Widen(cached).c_str(), g_startup.livePaintMs);
+    Shell_NotifyIconW(NIM_MODIFY, &g_nid);
+}
+
+// Balloon from the tray icon for problems that do not stop the overlay
+void ShowTrayWarning(const std::string& message)
+{
+    NOTIFYICONDATAW info = g_nid;
+    info.uFlags = NIF_INFO;
+    info.dwInfoFlags = NIIF_WARNING;
+    wcscpy_s(info.szInfoTitle, L"Overlay alias collision");
+    wcsncpy_s(info.szInfo, Widen(message).c_str(), _TRUNCATE);
+    Shell_NotifyIconW(NIM_MODIFY, &info);
 }
 
 // Show context menu for system tray
@@ -310,50 +764,133 @@ void ShowContextMenu(HWND hwnd)
     POINT pt;
     GetCursorPos(&pt);
     HMENU hMenu = CreatePopupMenu();
-    AppendMenu(hMenu, MF_STRING, 1000, "Exit");
+    AppendMenuW(hMenu, MF_STRING, 1000, L"Exit");
     SetForegroundWindow(hwnd);
     TrackPopupMenu(hMenu, TPM_RIGHTBUTTON, pt.x, pt.y, 0, hwnd, nullptr);
     DestroyMenu(hMenu);
 }
 
-std::wstring stringToWstringStream(const std::string& str)
+const GlyphAtlas& GlyphAtlasForDpi(int dpi)
 {
-    // This method is generally for simple conversions where the characters
-    // in string and wstring are byte-compatible or handled by a basic locale.
-    // It's not robust for complex encoding conversions like UTF-8 to UTF-16.
-    std::wstringstream wss;
-    wss << str.c_str(); // This might not correctly convert multi-byte characters
-    return wss.str();
+    auto it = g_glyphAtlases.find(dpi);
+    if (it == g_glyphAtlases.end())
+    {
+        it = g_glyphAtlases.emplace(dpi, BuildGdiGlyphAtlas("Consolas", 18, dpi)).first;
+    }
+    return it->second;
 }
 
-// Draw rectangles and labels
-void DrawRectangles(HDC hdc)
+// Render the glyphs of a GDI font into an atlas so labels keep the Consolas look
+GlyphAtlas BuildGdiGlyphAtlas(const char* faceName, int pointSize, int dpi)
 {
-    Gdiplus::Graphics graphics(hdc);
-    graphics.SetSmoothingMode(Gdiplus::SmoothingModeAntiAlias);
+    HDC memDC = CreateCompatibleDC(nullptr);
+    int height = -MulDiv(pointSize, dpi, 72);
+
+    HFONT hFont = CreateFontA(height, 0, 0, 0, FW_BOLD, FALSE, FALSE, FALSE, DEFAULT_CHARSET,
+                              OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, ANTIALIASED_QUALITY,
+                              FIXED_PITCH | FF_MODERN, faceName);
+    if (!memDC || !hFont)
+    {
+        if (hFont) DeleteObject(hFont);
+        if (memDC) DeleteDC(memDC);
+        return BuildBuiltinGlyphAtlas((std::max)(1, (3 * dpi + 48) / 96));
+    }
 
-    int screenWidth = GetSystemMetrics(SM_CXSCREEN);
-    int screenHeight = GetSystemMetrics(SM_CYSCREEN);
+    HGDIOBJ oldFont = SelectObject(memDC, hFont);
+    TEXTMETRICA tm{};
+    GetTextMetricsA(memDC, &tm);
 
-    for (const auto& rect : g_rectangles)
+    GlyphAtlas atlas;
+    atlas.cellWidth = tm.tmAveCharWidth;
+    atlas.cellHeight = tm.tmHeight;
+    size_t cellSize = static_cast<size_t>(atlas.cellWidth) * atlas.cellHeight;
+    atlas.coverage.assign(cellSize * GlyphAtlas::CHAR_COUNT, 0);
+
+    BITMAPINFO bmi{};
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = atlas.cellWidth;
+    bmi.bmiHeader.biHeight = -atlas.cellHeight; // top-down
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+    void* bits = nullptr;
+    HBITMAP hBitmap = CreateDIBSection(memDC, &bmi, DIB_RGB_COLORS, &bits, nullptr, 0);
+    HGDIOBJ oldBitmap = SelectObject(memDC, hBitmap);
+    SetTextColor(memDC, RGB(255, 255, 255));
+    SetBkColor(memDC, RGB(0, 0, 0));
+    SetBkMode(memDC, OPAQUE);
+
+    for (int ch = 0; ch < GlyphAtlas::CHAR_COUNT; ++ch)
     {
-        // Calculate rectangle coordinates
-        int left = (rect.left * screenWidth) / 100;
-        int top = (rect.top * screenHeight) / 100;
-        int right = (rect.right * screenWidth) / 100;
-        int bottom = (rect.bottom * screenHeight) / 100;
+        char text = static_cast<char>(GlyphAtlas::FIRST_CHAR + ch);
+        RECT cell = {0, 0, atlas.cellWidth, atlas.cellHeight};
+        ExtTextOutA(memDC, 0, 0, ETO_OPAQUE, &cell, &text, 1, nullptr);
+        GdiFlush();
 
-        // Draw rectangle border
-        Gdiplus::Pen pen(rect.isPrimary ? Gdiplus::Color::Red : Gdiplus::Color::Blue, 2.0f);
-        graphics.DrawRectangle(&pen, left, top, right - left, bottom - top);
+        // White text on black: any channel is the coverage
+        const uint32_t* pixels = static_cast<const uint32_t*>(bits);
+        uint8_t* dst = atlas.coverage.data() + cellSize * ch;
+        for (size_t i = 0; i < cellSize; ++i)
+        {
+            dst[i] = static_cast<uint8_t>((pixels[i] >> 8) & 0xFF);
+        }
+    }
 
-        // Draw text
-        Gdiplus::Font font(L"Consolas", 18, Gdiplus::FontStyleBold);
-        Gdiplus::SolidBrush brush(rect.isPrimary ? Gdiplus::Color::Red : Gdiplus::Color::Blue);
-        Gdiplus::StringFormat format;
-        format.SetAlignment(Gdiplus::StringAlignmentCenter);
-        format.SetLineAlignment(Gdiplus::StringAlignmentCenter);
-        Gdiplus::RectF textRect((float)left, (float)top, (float)(right - left), (float)(bottom - top));
-        graphics.DrawString(stringToWstringStream(rect.name.c_str()).c_str(), -1, &font, textRect, &format, &brush);
+    SelectObject(memDC, oldBitmap);
+    SelectObject(memDC, oldFont);
+    DeleteObject(hBitmap);
+    DeleteObject(hFont);
+    DeleteDC(memDC);
+    return atlas;
+}
+
+// Draw rectangles and labels for one monitor
+// Rendering happens in the portable core; this only blits the finished frame.
+// Only the paint rectangle is re-rendered, the framebuffer keeps the rest.
+void DrawRectangles(HDC hdc, size_t monitor, const RECT& paintRect)
+{
+    LY_TRACE_FUNCTION("overlay");
+    static Metrics::Operation metrics("overlay_op", "paint");
+    Metrics::OperationTimer timer(metrics);
+    if (monitor >= g_overlays.size() || monitor >= g_layout.Monitors().size())
+    {
+        return;
+    }
+
+    const MonitorInfo& info = g_layout.Monitors()[monitor];
+    const MonitorScene& scene = g_layout.Scene(monitor);
+    Framebuffer& fb = g_overlays[monitor].framebuffer;
+    PixelBounds region = {paintRect.left, paintRect.top, paintRect.right, paintRect.bottom};
+    if (fb.width != info.Width() || fb.height != info.Height())
+    {
+        fb.Resize(info.Width(), info.Height());
+        region = {0, 0, fb.width, fb.height};
+    }
+
+    // Borders reach outside their rectangle, so look a little wider than the region
+    std::vector<uint32_t> ids;
+    PixelBounds query = {region.left - scene.borderThickness, region.top - scene.borderThickness,
+                         region.right + scene.borderThickness, region.bottom + scene.borderThickness};
+    scene.index.QueryRegion(query, ids);
+    std::vector<PlacedRect> visible;
+    visible.reserve(ids.size());
+    for (uint32_t id : ids)
+    {
+        visible.push_back(scene.rects[id]);
     }
+
+    fb.SetClip(region);
+    FillRectangle(fb, region.left, region.top, region.right, region.bottom, COLOR_TRANSPARENT);
+    RenderPlacedRectangles(fb, g_scene->rects, visible, scene.borderThickness, GlyphAtlasForDpi(info.dpi));
+    fb.ResetClip();
+
+    BITMAPINFO bmi{};
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = fb.width;
+    bmi.bmiHeader.biHeight = -fb.height; // top-down
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+    SetDIBitsToDevice(hdc, 0, 0, fb.width, fb.height,
+                      0, 0, 0, fb.height, fb.pixels.data(), &bmi, DIB_RGB_COLORS);
 }
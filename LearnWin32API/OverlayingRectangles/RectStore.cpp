@@ -0,0 +1,82 @@
+#include "RectStore.h"
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// The layout pass indexes lookup tables with coordinates, keep them in range
+static int32_t ClampPercent(int value)
+{
+    return std::min(std::max(value, 0), 100);
+}
+
+uint32_t RectStore::Add(std::string_view name, int left, int top, int right, int bottom, uint8_t flags, int monitor)
+{
+    m_left.push_back(ClampPercent(left));
+    m_top.push_back(ClampPercent(top));
+    m_right.push_back(ClampPercent(right));
+    m_bottom.push_back(ClampPercent(bottom));
+    m_monitor.push_back(monitor);
+    m_flags.push_back(flags);
+    m_nameIds.push_back(m_names.Intern(name));
+    return static_cast<uint32_t>(m_nameIds.size() - 1);
+}
+
+void RectStore::SetBounds(size_t i, int left, int top, int right, int bottom)
+{
+    m_left[i] = ClampPercent(left);
+    m_top[i] = ClampPercent(top);
+    m_right[i] = ClampPercent(right);
+    m_bottom[i] = ClampPercent(bottom);
+}
+
+void RectStore::Clear()
+{
+    m_left.clear();
+    m_top.clear();
+    m_right.clear();
+    m_bottom.clear();
+    m_monitor.clear();
+    m_flags.clear();
+    m_nameIds.clear();
+    m_names.Clear();
+}
+
+void RectStore::Reserve(size_t count)
+{
+    m_left.reserve(count);
+    m_top.reserve(count);
+    m_right.reserve(count);
+    m_bottom.reserve(count);
+    m_monitor.reserve(count);
+    m_flags.reserve(count);
+    m_nameIds.reserve(count);
+}
+
+void BuildPercentLut(int extent, int32_t* lut)
+{
+    for (int p = 0; p < PERCENT_LUT_SIZE; ++p)
+    {
+        lut[p] = (p * extent) / 100;
+    }
+}
+
+void PercentToPixels(const int32_t* percent, const int32_t* rows, const int32_t* lut, int32_t* out, size_t count)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i stride = _mm256_set1_epi32(PERCENT_LUT_SIZE);
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(percent + i));
+        __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows + i));
+        __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(r, stride), p);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_i32gather_epi32(lut, index, 4));
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        out[i] = lut[rows[i] * PERCENT_LUT_SIZE + percent[i]];
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "StringArena.h"
+
+// Structure-of-arrays store for the overlay rectangles.
+// Coordinates, flags and monitor indices live in their own contiguous
+// columns so layout and culling passes never touch label data; labels are
+// interned in a StringArena and referenced by id.
+class RectStore
+{
+public:
+    static const uint8_t FLAG_PRIMARY = 0x01;
+
+    // Coordinates are percentages (0-100) of the target monitor;
+    // monitor 0 is the primary monitor, see MonitorLayout for the ordering
+    uint32_t Add(std::string_view name, int left, int top, int right, int bottom, uint8_t flags, int monitor = 0);
+    void Clear();
+    void Reserve(size_t count);
+    size_t Size() const { return m_nameIds.size(); }
+
+    std::string_view Name(size_t i) const { return m_names.Get(m_nameIds[i]); }
+    uint64_t NameHash(size_t i) const { return m_names.Hash(m_nameIds[i]); }
+    void SetName(size_t i, std::string_view name) { m_nameIds[i] = m_names.Intern(name); }
+    void SetBounds(size_t i, int left, int top, int right, int bottom);
+    bool IsPrimary(size_t i) const { return (m_flags[i] & FLAG_PRIMARY) != 0; }
+
+    // Columns
+    const int32_t* Left() const { return m_left.data(); }
+    const int32_t* Top() const { return m_top.data(); }
+    const int32_t* Right() const { return m_right.data(); }
+    const int32_t* Bottom() const { return m_bottom.data(); }
+    const int32_t* Monitor() const { return m_monitor.data(); }
+    std::vector<uint8_t>& Flags() { return m_flags; }
+    const std::vector<uint8_t>& Flags() const { return m_flags; }
+
+private:
+    std::vector<int32_t> m_left, m_top, m_right, m_bottom;
+    std::vector<int32_t> m_monitor;
+    std::vector<uint8_t> m_flags;
+    std::vector<uint32_t> m_nameIds;
+    StringArena m_names;
+};
+
+// Lookup table for one pixel extent: entry p is (p * extent) / 100
+const int PERCENT_LUT_SIZE = 101;
+void BuildPercentLut(int extent, int32_t* lut);
+
+// Percentage-to-pixel pass over a coordinate column:
+// out[i] = lut[rows[i] * PERCENT_LUT_SIZE + percent[i]], rows selects the monitor's table.
+// Percentages must already be within 0-100.
+void PercentToPixels(const int32_t* percent, const int32_t* rows, const int32_t* lut, int32_t* out, size_t count);
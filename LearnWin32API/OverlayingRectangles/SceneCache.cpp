@@ -0,0 +1,44 @@
+#include "SceneCache.h"
+#include "LayoutFile.h"
+#include "../../Common/Checksum.h"
+#include "../../Common/MappedFile.h"
+#include "../../Common/Trace.h"
+
+std::unique_ptr<OverlaySnapshot> SceneCache::Load()
+{
+    LY_TRACE_FUNCTION("overlay");
+    MappedFile file;
+    LayoutData layout;
+    std::string error;
+    if (file.Open(m_fileName) != 0 || !ReadLayoutFile(file.Data(), file.Size(), layout, error))
+    {
+        m_hash = 0;
+        return nullptr;
+    }
+    m_hash = Hash64(file.Data(), file.Size());
+
+    auto scene = std::make_unique<OverlaySnapshot>();
+    scene->rects = std::move(layout.rects);
+    return scene;
+}
+
+bool SceneCache::Save(const OverlaySnapshot& scene, std::string& error)
+{
+    LY_TRACE_FUNCTION("overlay");
+    LayoutData layout;
+    layout.rects = scene.rects;
+    std::string image = EncodeLayoutFile(layout);
+    uint64_t hash = Hash64(image.data(), image.size());
+    if (hash == m_hash)
+    {
+        return true;
+    }
+    if (!WriteLayoutImage(image, m_fileName, error))
+    {
+        m_hash = 0;
+        return false;
+    }
+    m_hash = hash;
+    ++m_writes;
+    return true;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "OverlayLoader.h"
+
+// The last scene that loaded without error, kept on disk in the layout file
+// format so the next start can paint it before the live source has been
+// read. Aliases are already applied, so the file holds rectangles only.
+class SceneCache
+{
+public:
+    explicit SceneCache(std::string fileName) : m_fileName(std::move(fileName))
+    {}
+
+    // nullptr when there is no usable cache; a missing or damaged file is
+    // not an error, the overlay just waits for the live scene
+    std::unique_ptr<OverlaySnapshot> Load();
+
+    // Rewrites the file only when the scene differs from what it holds.
+    // Load and Save may run on different threads, but not at the same time.
+    bool Save(const OverlaySnapshot& scene, std::string& error);
+
+    uint64_t Writes() const { return m_writes; }
+
+private:
+    std::string m_fileName;
+    uint64_t m_hash = 0; // Of the file image, 0 when unknown
+    uint64_t m_writes = 0;
+};
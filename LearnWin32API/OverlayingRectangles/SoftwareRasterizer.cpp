@@ -0,0 +1,256 @@
+#include "SoftwareRasterizer.h"
+#include <algorithm>
+#include <fstream>
+#include "../../Common/Utf.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define RASTER_USE_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RASTER_USE_SSE2
+#endif
+
+void Framebuffer::Resize(int w, int h)
+{
+    width = std::max(w, 0);
+    height = std::max(h, 0);
+    pixels.resize(static_cast<size_t>(width) * height);
+    ResetClip();
+}
+
+void Framebuffer::SetClip(const PixelBounds& bounds)
+{
+    clip.left = std::min(std::max(bounds.left, 0), width);
+    clip.top = std::min(std::max(bounds.top, 0), height);
+    clip.right = std::max(std::min(bounds.right, width), clip.left);
+    clip.bottom = std::max(std::min(bounds.bottom, height), clip.top);
+}
+
+const uint8_t* GlyphAtlas::Glyph(char ch) const
+{
+    int index = static_cast<unsigned char>(ch) - FIRST_CHAR;
+    if (index < 0 || index >= CHAR_COUNT)
+    {
+        index = '?' - FIRST_CHAR;
+    }
+    return coverage.data() + static_cast<size_t>(index) * cellWidth * cellHeight;
+}
+
+void FillSpan(uint32_t* dst, size_t count, uint32_t color)
+{
+    size_t i = 0;
+#if defined(RASTER_USE_AVX2)
+    const __m256i value = _mm256_set1_epi32(static_cast<int>(color));
+    for (; i + 8 <= count; i += 8)
+    {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), value);
+    }
+#elif defined(RASTER_USE_SSE2)
+    const __m128i value = _mm_set1_epi32(static_cast<int>(color));
+    for (; i + 4 <= count; i += 4)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), value);
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        dst[i] = color;
+    }
+}
+
+void ClearFramebuffer(Framebuffer& fb, uint32_t color)
+{
+    // Rows are contiguous, so the whole buffer is one span
+    FillSpan(fb.pixels.data(), fb.pixels.size(), color);
+}
+
+void FillRectangle(Framebuffer& fb, int left, int top, int right, int bottom, uint32_t color)
+{
+    left = std::max(left, fb.clip.left);
+    top = std::max(top, fb.clip.top);
+    right = std::min(right, fb.clip.right);
+    bottom = std::min(bottom, fb.clip.bottom);
+    if (left >= right || top >= bottom)
+    {
+        return;
+    }
+
+    for (int y = top; y < bottom; ++y)
+    {
+        FillSpan(fb.Row(y) + left, static_cast<size_t>(right - left), color);
+    }
+}
+
+void DrawRectangleBorder(Framebuffer& fb, int left, int top, int right, int bottom, int thickness, uint32_t color)
+{
+    // Centered on the edge like a GDI+ pen: half outside, half inside
+    int outer = thickness / 2;
+    int inner = thickness - outer;
+
+    FillRectangle(fb, left - outer, top - outer, right + outer, top + inner, color);        // top
+    FillRectangle(fb, left - outer, bottom - inner, right + outer, bottom + outer, color);  // bottom
+    FillRectangle(fb, left - outer, top + inner, left + inner, bottom - inner, color);      // left
+    FillRectangle(fb, right - inner, top + inner, right + outer, bottom - inner, color);    // right
+}
+
+static inline uint32_t BlendPixel(uint32_t dst, uint32_t src, uint32_t alpha)
+{
+    // Integer blend so the output is bit-exact on every platform
+    uint32_t inv = 255 - alpha;
+    uint32_t r = (((src >> 16) & 0xFF) * alpha + ((dst >> 16) & 0xFF) * inv + 127) / 255;
+    uint32_t g = (((src >> 8) & 0xFF) * alpha + ((dst >> 8) & 0xFF) * inv + 127) / 255;
+    uint32_t b = ((src & 0xFF) * alpha + (dst & 0xFF) * inv + 127) / 255;
+    return 0xFF000000 | (r << 16) | (g << 8) | b;
+}
+
+void DrawCenteredText(Framebuffer& fb, const GlyphAtlas& atlas, std::string_view text,
+                      int left, int top, int right, int bottom, uint32_t color)
+{
+    if (text.empty() || atlas.cellWidth == 0)
+    {
+        return;
+    }
+
+    // Labels are UTF-8 and the atlas is ASCII only: anything else draws as one '?' per character
+    std::string folded;
+    if (!IsAscii(text))
+    {
+        for (size_t offset = 0; offset < text.size();)
+        {
+            uint32_t cp = NextCodePoint(text, offset);
+            folded += cp < 0x80 ? static_cast<char>(cp) : '?';
+        }
+        text = folded;
+    }
+
+    int textWidth = static_cast<int>(text.size()) * atlas.cellWidth;
+    int x0 = left + ((right - left) - textWidth) / 2;
+    int y0 = top + ((bottom - top) - atlas.cellHeight) / 2;
+
+    // Labels are clipped to their rectangle as well as to the framebuffer
+    int clipLeft = std::max(left, fb.clip.left);
+    int clipTop = std::max(top, fb.clip.top);
+    int clipRight = std::min(right, fb.clip.right);
+    int clipBottom = std::min(bottom, fb.clip.bottom);
+
+    int rowBegin = std::max(y0, clipTop);
+    int rowEnd = std::min(y0 + atlas.cellHeight, clipBottom);
+    if (rowBegin >= rowEnd)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < text.size(); ++i)
+    {
+        int gx = x0 + static_cast<int>(i) * atlas.cellWidth;
+        int colBegin = std::max(gx, clipLeft);
+        int colEnd = std::min(gx + atlas.cellWidth, clipRight);
+        if (colBegin >= colEnd)
+        {
+            continue;
+        }
+
+        const uint8_t* glyph = atlas.Glyph(text[i]);
+        for (int y = rowBegin; y < rowEnd; ++y)
+        {
+            const uint8_t* mask = glyph + static_cast<size_t>(y - y0) * atlas.cellWidth;
+            uint32_t* row = fb.Row(y);
+            for (int x = colBegin; x < colEnd; ++x)
+            {
+                uint32_t alpha = mask[x - gx];
+                if (alpha == 255)
+                {
+                    row[x] = color;
+                }
+                else if (alpha != 0)
+                {
+                    row[x] = BlendPixel(row[x], color, alpha);
+                }
+            }
+        }
+    }
+}
+
+void RenderRectangles(Framebuffer& fb, const RectStore& rects, const GlyphAtlas& atlas)
+{
+    // Calculate rectangle coordinates, one column at a time
+    size_t count = rects.Size();
+    int32_t lutX[PERCENT_LUT_SIZE], lutY[PERCENT_LUT_SIZE];
+    BuildPercentLut(fb.width, lutX);
+    BuildPercentLut(fb.height, lutY);
+
+    std::vector<int32_t> rows(count, 0);
+    std::vector<int32_t> left(count), top(count), right(count), bottom(count);
+    PercentToPixels(rects.Left(), rows.data(), lutX, left.data(), count);
+    PercentToPixels(rects.Top(), rows.data(), lutY, top.data(), count);
+    PercentToPixels(rects.Right(), rows.data(), lutX, right.data(), count);
+    PercentToPixels(rects.Bottom(), rows.data(), lutY, bottom.data(), count);
+
+    std::vector<PlacedRect> placed(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        placed[i] = {i, left[i], top[i], right[i], bottom[i]};
+    }
+    RenderPlacedRectangles(fb, rects, placed, 2, atlas);
+}
+
+void RenderPlacedRectangles(Framebuffer& fb, const RectStore& rects, const std::vector<PlacedRect>& placed,
+                            int borderThickness, const GlyphAtlas& atlas)
+{
+    for (const auto& p : placed)
+    {
+        if (p.rectIndex >= rects.Size())
+        {
+            continue; // Layout is stale, the next update repaints this monitor
+        }
+        uint32_t color = rects.IsPrimary(p.rectIndex) ? COLOR_PRIMARY : COLOR_MAPPED;
+        DrawRectangleBorder(fb, p.left, p.top, p.right, p.bottom, borderThickness, color);
+        DrawCenteredText(fb, atlas, rects.Name(p.rectIndex), p.left, p.top, p.right, p.bottom, color);
+    }
+}
+
+uint64_t HashFramebuffer(const Framebuffer& fb)
+{
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](uint32_t value)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            hash ^= (value >> (i * 8)) & 0xFF;
+            hash *= 1099511628211ull;
+        }
+    };
+
+    mix(static_cast<uint32_t>(fb.width));
+    mix(static_cast<uint32_t>(fb.height));
+    for (uint32_t pixel : fb.pixels)
+    {
+        mix(pixel);
+    }
+    return hash;
+}
+
+bool WritePPM(const Framebuffer& fb, const std::string& fileName)
+{
+    std::ofstream out(fileName, std::ios::binary);
+    if (!out.is_open())
+    {
+        return false;
+    }
+
+    out << "P6\n" << fb.width << " " << fb.height << "\n255\n";
+    std::vector<char> line(static_cast<size_t>(fb.width) * 3);
+    for (int y = 0; y < fb.height; ++y)
+    {
+        const uint32_t* row = fb.Row(y);
+        for (int x = 0; x < fb.width; ++x)
+        {
+            line[x * 3 + 0] = static_cast<char>((row[x] >> 16) & 0xFF);
+            line[x * 3 + 1] = static_cast<char>((row[x] >> 8) & 0xFF);
+            line[x * 3 + 2] = static_cast<char>(row[x] & 0xFF);
+        }
+        out.write(line.data(), static_cast<std::streamsize>(line.size()));
+    }
+    return out.good();
+}
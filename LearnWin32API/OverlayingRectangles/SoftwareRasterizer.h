@@ -0,0 +1,66 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "OverlayScene.h"
+#include "RectStore.h"
+
+// Platform-independent rendering core for the overlay.
+// Everything here draws into plain memory so it can be profiled and
+// verified without a desktop; the Win32 side only blits the result.
+
+// 0xAARRGGBB, the same layout a top-down 32-bit BI_RGB DIB uses
+const uint32_t COLOR_TRANSPARENT = 0xFF000000; // Matches the window's color key
+const uint32_t COLOR_PRIMARY = 0xFFFF0000;
+const uint32_t COLOR_MAPPED = 0xFF0000FF;
+
+struct Framebuffer
+{
+    int width{}, height{};
+    std::vector<uint32_t> pixels;
+    PixelBounds clip{}; // Every draw call is limited to this, the whole buffer by default
+
+    void Resize(int w, int h);
+    void SetClip(const PixelBounds& bounds);
+    void ResetClip() { clip = {0, 0, width, height}; }
+    uint32_t* Row(int y) { return pixels.data() + static_cast<size_t>(y) * width; }
+    const uint32_t* Row(int y) const { return pixels.data() + static_cast<size_t>(y) * width; }
+};
+
+// 8-bit coverage masks for printable ASCII (32..126), one cell per glyph
+struct GlyphAtlas
+{
+    static const int FIRST_CHAR = 32;
+    static const int CHAR_COUNT = 95;
+
+    int cellWidth{}, cellHeight{};
+    std::vector<uint8_t> coverage;
+
+    // Returns the top-left coverage byte of the glyph, '?' for anything unsupported
+    const uint8_t* Glyph(char ch) const;
+};
+
+// Scaled-up 5x7 bitmap font; always available, so headless output is reproducible
+GlyphAtlas BuildBuiltinGlyphAtlas(int scale);
+
+void FillSpan(uint32_t* dst, size_t count, uint32_t color);
+void ClearFramebuffer(Framebuffer& fb, uint32_t color); // Ignores the clip
+void FillRectangle(Framebuffer& fb, int left, int top, int right, int bottom, uint32_t color);
+void DrawRectangleBorder(Framebuffer& fb, int left, int top, int right, int bottom, int thickness, uint32_t color);
+void DrawCenteredText(Framebuffer& fb, const GlyphAtlas& atlas, std::string_view text,
+                      int left, int top, int right, int bottom, uint32_t color);
+
+// Equivalent of the GDI+ DrawRectangles: 2px borders and centered labels,
+// red for primary rectangles and blue for mapped ones.
+// Percentages are resolved against the whole framebuffer.
+void RenderRectangles(Framebuffer& fb, const RectStore& rects, const GlyphAtlas& atlas);
+
+// Same, for rectangles already resolved to pixels (see MonitorLayout)
+void RenderPlacedRectangles(Framebuffer& fb, const RectStore& rects, const std::vector<PlacedRect>& placed,
+                            int borderThickness, const GlyphAtlas& atlas);
+
+// FNV-1a over the pixels, used to compare against golden images
+uint64_t HashFramebuffer(const Framebuffer& fb);
+bool WritePPM(const Framebuffer& fb, const std::string& fileName);
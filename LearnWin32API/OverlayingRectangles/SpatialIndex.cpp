@@ -0,0 +1,205 @@
+#include "SpatialIndex.h"
+#include <algorithm>
+
+SpatialIndex::SpatialIndex(int cellSize) : m_cellSize(std::max(cellSize, 1))
+{}
+
+void SpatialIndex::Reset(int width, int height)
+{
+    m_columns = std::max(1, (width + m_cellSize - 1) / m_cellSize);
+    m_rows = std::max(1, (height + m_cellSize - 1) / m_cellSize);
+    m_cells.assign(static_cast<size_t>(m_columns) * m_rows, {});
+    m_bounds.clear();
+    m_present.clear();
+    m_visited.clear();
+    m_visitStamp = 0;
+}
+
+bool SpatialIndex::CellRange(const PixelBounds& bounds, int& x0, int& y0, int& x1, int& y1) const
+{
+    if (bounds.left >= bounds.right || bounds.top >= bounds.bottom)
+    {
+        return false;
+    }
+
+    // Anything off the surface is clamped into the border cells
+    x0 = std::min(std::max(bounds.left / m_cellSize, 0), m_columns - 1);
+    y0 = std::min(std::max(bounds.top / m_cellSize, 0), m_rows - 1);
+    x1 = std::min(std::max((bounds.right - 1) / m_cellSize, 0), m_columns - 1);
+    y1 = std::min(std::max((bounds.bottom - 1) / m_cellSize, 0), m_rows - 1);
+    return true;
+}
+
+void SpatialIndex::AddToCells(uint32_t id, const PixelBounds& bounds)
+{
+    int x0, y0, x1, y1;
+    if (!CellRange(bounds, x0, y0, x1, y1))
+    {
+        return;
+    }
+
+    for (int y = y0; y <= y1; ++y)
+    {
+        for (int x = x0; x <= x1; ++x)
+        {
+            auto& cell = m_cells[static_cast<size_t>(y) * m_columns + x];
+            // Keep cells sorted so queries come out in paint order without a sort
+            cell.insert(std::upper_bound(cell.begin(), cell.end(), id), id);
+        }
+    }
+}
+
+void SpatialIndex::RemoveFromCells(uint32_t id, const PixelBounds& bounds)
+{
+    int x0, y0, x1, y1;
+    if (!CellRange(bounds, x0, y0, x1, y1))
+    {
+        return;
+    }
+
+    for (int y = y0; y <= y1; ++y)
+    {
+        for (int x = x0; x <= x1; ++x)
+        {
+            auto& cell = m_cells[static_cast<size_t>(y) * m_columns + x];
+            auto it = std::lower_bound(cell.begin(), cell.end(), id);
+            if (it != cell.end() && *it == id)
+            {
+                cell.erase(it);
+            }
+        }
+    }
+}
+
+void SpatialIndex::Insert(uint32_t id, const PixelBounds& bounds)
+{
+    if (Contains(id))
+    {
+        Move(id, bounds);
+        return;
+    }
+    if (id >= m_bounds.size())
+    {
+        m_bounds.resize(id + 1);
+        m_present.resize(id + 1, 0);
+        m_visited.resize(id + 1, 0);
+    }
+
+    m_bounds[id] = bounds;
+    m_present[id] = 1;
+    AddToCells(id, bounds);
+}
+
+void SpatialIndex::Move(uint32_t id, const PixelBounds& bounds)
+{
+    if (!Contains(id))
+    {
+        Insert(id, bounds);
+        return;
+    }
+
+    RemoveFromCells(id, m_bounds[id]);
+    m_bounds[id] = bounds;
+    AddToCells(id, bounds);
+}
+
+void SpatialIndex::Remove(uint32_t id)
+{
+    if (!Contains(id))
+    {
+        return;
+    }
+
+    RemoveFromCells(id, m_bounds[id]);
+    m_present[id] = 0;
+}
+
+void SpatialIndex::QueryPoint(int x, int y, std::vector<uint32_t>& out) const
+{
+    out.clear();
+    if (m_cells.empty() || x < 0 || y < 0)
+    {
+        return;
+    }
+
+    int cx = std::min(x / m_cellSize, m_columns - 1);
+    int cy = std::min(y / m_cellSize, m_rows - 1);
+    for (uint32_t id : m_cells[static_cast<size_t>(cy) * m_columns + cx])
+    {
+        if (m_bounds[id].Contains(x, y))
+        {
+            out.push_back(id);
+        }
+    }
+}
+
+void SpatialIndex::QueryRegion(const PixelBounds& region, std::vector<uint32_t>& out) const
+{
+    out.clear();
+    int x0, y0, x1, y1;
+    if (m_cells.empty() || !CellRange(region, x0, y0, x1, y1))
+    {
+        return;
+    }
+
+    if (++m_visitStamp == 0)
+    {
+        // Stamp wrapped around; forget every previous visit
+        std::fill(m_visited.begin(), m_visited.end(), 0);
+        m_visitStamp = 1;
+    }
+
+    for (int y = y0; y <= y1; ++y)
+    {
+        for (int x = x0; x <= x1; ++x)
+        {
+            for (uint32_t id : m_cells[static_cast<size_t>(y) * m_columns + x])
+            {
+                if (m_visited[id] != m_visitStamp && m_bounds[id].Intersects(region))
+                {
+                    m_visited[id] = m_visitStamp;
+                    out.push_back(id);
+                }
+            }
+        }
+    }
+
+    if (x0 != x1 || y0 != y1)
+    {
+        std::sort(out.begin(), out.end());
+    }
+}
+
+void SpatialIndex::FindOverlaps(std::vector<std::pair<uint32_t, uint32_t>>& out) const
+{
+    out.clear();
+    for (int cy = 0; cy < m_rows; ++cy)
+    {
+        for (int cx = 0; cx < m_columns; ++cx)
+        {
+            const auto& cell = m_cells[static_cast<size_t>(cy) * m_columns + cx];
+            for (size_t i = 0; i < cell.size(); ++i)
+            {
+                const PixelBounds& a = m_bounds[cell[i]];
+                for (size_t j = i + 1; j < cell.size(); ++j)
+                {
+                    const PixelBounds& b = m_bounds[cell[j]];
+                    if (!a.Intersects(b))
+                    {
+                        continue;
+                    }
+
+                    // A pair shares every cell its intersection covers; report it
+                    // only from the cell holding the intersection's top-left corner
+                    PixelBounds overlap = {std::max(a.left, b.left), std::max(a.top, b.top), 0, 0};
+                    int ox = std::min(std::max(overlap.left / m_cellSize, 0), m_columns - 1);
+                    int oy = std::min(std::max(overlap.top / m_cellSize, 0), m_rows - 1);
+                    if (ox == cx && oy == cy)
+                    {
+                        out.emplace_back(cell[i], cell[j]);
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "OverlayScene.h"
+
+// Uniform grid over the pixel rectangles of one monitor.
+// Ids are small dense integers (the rectangle's position in its MonitorScene),
+// and entries can be inserted, moved and removed individually, so a reload
+// that touches a few rectangles only touches their grid cells.
+class SpatialIndex
+{
+public:
+    explicit SpatialIndex(int cellSize = 128);
+
+    // Drops every entry and sizes the grid for a width x height surface
+    void Reset(int width, int height);
+
+    void Insert(uint32_t id, const PixelBounds& bounds);
+    void Move(uint32_t id, const PixelBounds& bounds);
+    void Remove(uint32_t id);
+
+    bool Contains(uint32_t id) const { return id < m_present.size() && m_present[id]; }
+    const PixelBounds& Bounds(uint32_t id) const { return m_bounds[id]; }
+
+    // Ids are returned in ascending order, which is also paint order
+    void QueryPoint(int x, int y, std::vector<uint32_t>& out) const;
+    void QueryRegion(const PixelBounds& region, std::vector<uint32_t>& out) const;
+
+    // Every intersecting pair once, first < second
+    void FindOverlaps(std::vector<std::pair<uint32_t, uint32_t>>& out) const;
+
+private:
+    bool CellRange(const PixelBounds& bounds, int& x0, int& y0, int& x1, int& y1) const;
+    void AddToCells(uint32_t id, const PixelBounds& bounds);
+    void RemoveFromCells(uint32_t id, const PixelBounds& bounds);
+
+    int m_cellSize;
+    int m_columns{}, m_rows{};
+    std::vector<std::vector<uint32_t>> m_cells;
+    std::vector<PixelBounds> m_bounds;
+    std::vector<uint8_t> m_present;
+
+    // Per-id stamps to dedupe ids that span several cells during a query
+    mutable std::vector<uint32_t> m_visited;
+    mutable uint32_t m_visitStamp{};
+};
@@ -0,0 +1,87 @@
+#include "StringArena.h"
+
+uint64_t StringArena::HashOf(std::string_view text)
+{
+    // FNV-1a, good enough for short labels and identical on every platform
+    uint64_t hash = 14695981039346656037ull;
+    for (char ch : text)
+    {
+        hash ^= static_cast<unsigned char>(ch);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+size_t StringArena::Probe(std::string_view text, uint64_t hash) const
+{
+    size_t mask = m_slots.size() - 1;
+    for (size_t slot = static_cast<size_t>(hash) & mask;; slot = (slot + 1) & mask)
+    {
+        uint32_t id = m_slots[slot];
+        if (id == NOT_FOUND || (m_hashes[id] == hash && Get(id) == text))
+        {
+            return slot;
+        }
+    }
+}
+
+void StringArena::Grow()
+{
+    std::vector<uint32_t> slots(m_slots.empty() ? 64 : m_slots.size() * 2, NOT_FOUND);
+    size_t mask = slots.size() - 1;
+    for (uint32_t id = 0; id < m_hashes.size(); ++id)
+    {
+        size_t slot = static_cast<size_t>(m_hashes[id]) & mask;
+        while (slots[slot] != NOT_FOUND)
+        {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = id;
+    }
+    m_slots.swap(slots);
+}
+
+uint32_t StringArena::Intern(std::string_view text)
+{
+    // Stay below a 50% load factor so probes remain short
+    if ((m_hashes.size() + 1) * 2 > m_slots.size())
+    {
+        Grow();
+    }
+
+    uint64_t hash = HashOf(text);
+    size_t slot = Probe(text, hash);
+    if (m_slots[slot] != NOT_FOUND)
+    {
+        return m_slots[slot];
+    }
+
+    uint32_t id = static_cast<uint32_t>(m_hashes.size());
+    m_chars.insert(m_chars.end(), text.begin(), text.end());
+    m_offsets.push_back(static_cast<uint32_t>(m_chars.size()));
+    m_hashes.push_back(hash);
+    m_slots[slot] = id;
+    return id;
+}
+
+uint32_t StringArena::Find(std::string_view text) const
+{
+    return Find(text, HashOf(text));
+}
+
+uint32_t StringArena::Find(std::string_view text, uint64_t hash) const
+{
+    if (m_slots.empty())
+    {
+        return NOT_FOUND;
+    }
+    return m_slots[Probe(text, hash)];
+}
+
+void StringArena::Clear()
+{
+    m_chars.clear();
+    m_offsets.assign(1, 0);
+    m_hashes.clear();
+    m_slots.clear();
+}
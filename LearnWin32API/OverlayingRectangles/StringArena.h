@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Interned strings stored back to back in one buffer.
+// Equal strings share an id, ids are dense and stay valid until Clear().
+class StringArena
+{
+public:
+    uint32_t Intern(std::string_view text);
+    // Returns the id of an already interned string, or NOT_FOUND
+    uint32_t Find(std::string_view text) const;
+    // Same, for callers that already hold HashOf(text)
+    uint32_t Find(std::string_view text, uint64_t hash) const;
+    void Clear();
+
+    std::string_view Get(uint32_t id) const
+    {
+        return std::string_view(m_chars.data() + m_offsets[id], m_offsets[id + 1] - m_offsets[id]);
+    }
+    uint64_t Hash(uint32_t id) const { return m_hashes[id]; }
+    size_t Size() const { return m_hashes.size(); }
+
+    static uint64_t HashOf(std::string_view text);
+    static constexpr uint32_t NOT_FOUND = 0xFFFFFFFF;
+
+private:
+    size_t Probe(std::string_view text, uint64_t hash) const;
+    void Grow();
+
+    std::vector<char> m_chars;
+    std::vector<uint32_t> m_offsets{0}; // String i spans [m_offsets[i], m_offsets[i + 1])
+    std::vector<uint64_t> m_hashes;
+    std::vector<uint32_t> m_slots;      // Open addressing, NOT_FOUND marks an empty slot
+};
@@ -0,0 +1,3097 @@
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <shared_mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "../../Common/Metrics.h"
+#include "../../Common/Trace.h"
+#include "../../Common/Utf.h"
+#include "../../Registry/AppendLog.h"
+#include "../../Registry/ConfigService.h"
+#include "../../Registry/KeyExistenceCache.h"
+#include "../../Registry/LogStore.h"
+#include "../../Registry/MemoryBackend.h"
+#include "../../Registry/RegFile.h"
+#include "../../Registry/RegistryBundle.h"
+#include "../../Registry/RegistryDiff.h"
+#include "../../Registry/RegistryIndex.h"
+#include "../../Registry/RegistryManager.h"
+#include "../../Registry/RegistryTransaction.h"
+#include "../../Registry/RegistryTree.h"
+#include "../../Registry/SharedConfig.h"
+#include "../../Registry/SnapshotFile.h"
+#include "../../Registry/TransactionJournal.h"
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// Headless benchmark for the portable registry code.
+// exists: KeyExistenceCache against probing every path, 1M candidate paths at a
+//         95% miss rate. The registry is modelled by a set of existing paths and
+//         a fixed busy-wait per probe standing in for a RegOpenKeyEx round trip.
+// txn:    context-menu installs (one key, MUIVerb, Icon, command\(Default)) on
+//         the portable backend: plain individual writes, individual writes each
+//         journaled, one journaled transaction per install, and transactions
+//         from several threads sharing journal syncs. Also checks that a failed
+//         commit leaves nothing behind and that a crash mid-commit is rolled
+//         back when the journal is reopened.
+// store:  LogStoreBackend write throughput (single writes from one and several
+//         threads, 100-write transactions), recovery time from logs and from a
+//         checkpoint, and space amplification with and without compaction, on
+//         a workload that overwrites every value ten times. Also checks that
+//         a reopened store matches what was written and survives a torn tail.
+// mvcc:   MemoryRegistryBackend reads from 1 to 32 threads with 10% writes,
+//         against the same tree behind one reader/writer lock. Every write
+//         batch sets Pair\A and Pair\B to the same number; readers check that
+//         a snapshot never shows them apart. Also checks snapshot isolation
+//         and that replaced versions are reclaimed.
+// diff:   drift detection between two snapshots of a fleet tree (1M values by
+//         default, about 0.1% of them drifted): capture time, the Merkle diff
+//         against comparing every value, and .reg patch size. Checks that both
+//         diffs agree, that applying the delta reproduces the second snapshot
+//         and the exact patch text for a small tree.
+// snapshot: binary snapshot files of the fleet tree at two sizes, raw and
+//         with compressed blocks: size against the same tree as .reg text,
+//         write time, open time (should not grow with the file), random
+//         value lookups and a full Verify. Checks that files read back and
+//         export as the captured tree, that RegistryManager reads work and
+//         writes are refused, and that damaged files are detected.
+// search: RegistryIndex queries (substring, prefix, short pattern, DWORD
+//         range) on the fleet tree with COM server keys, against scanning
+//         every key and value. Checks that both give the same hits, after a
+//         drift batch applied incrementally too, and across snapshot-diff
+//         updates that rewrite everything until the index rebuilds.
+// bundle: .reg files compiled to bundles: parse and compile speed on the
+//         fleet tree (a tenth of --fleet-values) as .reg text, bundle size,
+//         and applying it to an empty, an unchanged and a drifted tree
+//         against rewriting every value. Checks that an unchanged tree gets
+//         no writes, that removed and recreated keys, value removals and the
+//         hex types apply as regedit would, that context-menus.reg applies
+//         twice with one set of writes, and that damaged bundles are refused.
+// text:   UTF-8 <-> UTF-16 conversion and validation in GB/s on ASCII, Latin,
+//         CJK and emoji text with every kernel the CPU supports, and random
+//         damaged input (--fuzz-cases) checked on every kernel against a
+//         reference decoder written from the definition of UTF-8.
+// trace:  cost of a traced span, enabled and disabled at run time, against an
+//         empty loop. Checks the Chrome trace JSON of nested spans from
+//         several threads, thread names, escaping, that a full ring drops and
+//         counts instead of blocking and that durations match the clock.
+// metrics: sharded counter and histogram updates from 1 to 8 threads against
+//         one shared atomic. Checks exact totals, histogram quantiles within
+//         the bucket error of the exact ones, the RegistryManager operation
+//         counts, the Prometheus text and the dump on SIGUSR1.
+// shm:    the configuration service publishing a 10,000 value tree to shared
+//         memory: SharedConfigReader lookups from 1 and 4 threads against
+//         RegistryManager reads, and the change event latency through the
+//         polling thread. Checks that readers see the backend, that Pair\A
+//         and Pair\B read together never disagree while a writer republishes,
+//         the keys listed in change events, that a tree too big for its slot
+//         keeps the last generation, that Stop reaches readers and
+//         subscribers, and (POSIX) a reader in another process.
+//
+// --trace <file> records spans for every section before trace and writes them
+// to the file as Chrome trace JSON. --metrics <file> writes the metrics of
+// the whole run as Prometheus text.
+//
+// Usage: RegistryBench [--section exists|txn|store|mvcc|diff|snapshot|search|bundle|text|trace|metrics|shm|all]
+//                      [--iterations <n>] [--probe-ns <n>] [--installs <n>] [--threads <n>] [--values <n>]
+//                      [--duration-ms <n>] [--fleet-values <n>] [--fuzz-cases <n>] [--trace <file>] [--metrics <file>]
+
+// Deterministic path generator: Vendor/Product/Component style trees
+class PathGenerator
+{
+public:
+    explicit PathGenerator(uint32_t seed) : m_state(seed)
+    {}
+
+    uint32_t Next(uint32_t range)
+    {
+        m_state = m_state * 1664525u + 1013904223u;
+        return (m_state >> 8) % range;
+    }
+
+    std::string Path(uint32_t salt)
+    {
+        char path[96];
+        snprintf(path, sizeof(path), "Vendor%u\\Product%u\\Component%u\\Item%u",
+                 Next(200), Next(50), Next(20), Next(1000) + salt * 1000);
+        return path;
+    }
+
+private:
+    uint32_t m_state;
+};
+
+template <typename Fn>
+static double MedianMs(int iterations, Fn&& fn)
+{
+    std::vector<double> samples;
+    for (int i = 0; i < iterations; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        auto end = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+static void SpinFor(int nanoseconds)
+{
+    auto until = std::chrono::steady_clock::now() + std::chrono::nanoseconds(nanoseconds);
+    while (std::chrono::steady_clock::now() < until)
+    {}
+}
+
+static int RunExistsBench(int iterations, int probeNs)
+{
+    const int existingCount = 200000;
+    const int candidateCount = 1000000;
+    int failures = 0;
+
+    // Existing keys, plus candidates of which 5% exist
+    PathGenerator generator(0xE215u);
+    std::vector<std::string> existing;
+    std::unordered_set<std::string> registry;
+    while (static_cast<int>(existing.size()) < existingCount)
+    {
+        std::string path = generator.Path(0);
+        if (registry.insert(path).second)
+        {
+            existing.push_back(path);
+        }
+    }
+    std::vector<std::string> candidates;
+    candidates.reserve(candidateCount);
+    for (int i = 0; i < candidateCount; ++i)
+    {
+        candidates.push_back(generator.Next(100) < 5 ? existing[generator.Next(existingCount)] : generator.Path(1));
+    }
+
+    uint64_t probes = 0;
+    auto probe = [&](std::string_view path)
+    {
+        ++probes;
+        SpinFor(probeNs);
+        return registry.count(std::string(path)) != 0;
+    };
+
+    std::vector<char> expected(candidateCount);
+    double directMs = MedianMs(iterations, [&]
+    {
+        for (int i = 0; i < candidateCount; ++i)
+        {
+            expected[i] = probe(candidates[i]);
+        }
+    });
+    uint64_t directProbes = probes / iterations;
+
+    KeyExistenceCache cache;
+    auto buildStart = std::chrono::steady_clock::now();
+    cache.LoadSnapshot(existing);
+    double buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+
+    probes = 0;
+    size_t mismatches = 0;
+    double cachedMs = MedianMs(iterations, [&]
+    {
+        for (int i = 0; i < candidateCount; ++i)
+        {
+            mismatches += cache.Exists(candidates[i], probe) != (expected[i] != 0);
+        }
+    });
+    uint64_t cachedProbes = probes / iterations;
+
+    // A key created after the snapshot must show up once the change is signalled
+    std::string created = "Vendor999\\Created\\After\\Snapshot";
+    registry.insert(created);
+    cache.Invalidate();
+    if (!cache.Exists(created, probe))
+    {
+        std::cerr << "exists: key created after the snapshot is hidden after Invalidate()\n";
+        ++failures;
+    }
+    // A trailing or doubled separator names the same key and must not be rejected
+    existing.push_back(created);
+    cache.LoadSnapshot(existing);
+    if (!cache.Exists(created + "\\", probe) || !cache.Exists("Vendor999\\\\Created\\After\\\\Snapshot", probe) ||
+        !cache.Exists("\\" + created, probe))
+    {
+        std::cerr << "exists: a key spelled with extra separators was rejected\n";
+        ++failures;
+    }
+    // Non-ASCII names compare case-insensitively in the registry too, beyond
+    // what the filter folds: a different spelling must still be found
+    std::string accented = "Vendor998\\\xC3\x84pfel";
+    existing.push_back(accented);
+    cache.LoadSnapshot(existing);
+    auto caseInsensitiveProbe = [&](std::string_view path)
+    {
+        return path == "vendor998\\\xC3\xA4pfel" || probe(path);
+    };
+    if (!cache.Exists("vendor998\\\xC3\xA4pfel", caseInsensitiveProbe))
+    {
+        std::cerr << "exists: a non-ASCII key spelled in another case was rejected\n";
+        ++failures;
+    }
+    if (mismatches != 0)
+    {
+        std::cerr << "exists: " << mismatches << " cached answer(s) differ from the probe\n";
+        ++failures;
+    }
+
+    KeyExistenceCache::Stats stats = cache.GetStats();
+    printf("\n%-10s %12s %12s %10s %12s %12s\n", "paths", "direct ms", "cached ms", "speedup", "probes", "bloom rej");
+    printf("%-10d %12.1f %12.1f %9.1fx %12llu %12llu\n", candidateCount, directMs, cachedMs,
+           cachedMs > 0 ? directMs / cachedMs : 0.0, static_cast<unsigned long long>(cachedProbes),
+           static_cast<unsigned long long>(stats.bloomRejects / iterations));
+    printf("snapshot of %d keys built in %.1f ms, direct probes per pass %llu, probe cost %d ns\n",
+           existingCount, buildMs, static_cast<unsigned long long>(directProbes), probeNs);
+    return failures;
+}
+
+// Portable backend that stops dead after a number of writes, like a process
+// killed in the middle of a commit
+class CrashingBackend : public MemoryRegistryBackend
+{
+public:
+    explicit CrashingBackend(int writesBeforeCrash) : m_writesLeft(writesBeforeCrash)
+    {}
+
+    int32_t SetValue(std::string_view path, std::string_view name, const RegistryValue& value) override
+    {
+        if (m_writesLeft-- == 0)
+        {
+            throw std::runtime_error("crash");
+        }
+        return MemoryRegistryBackend::SetValue(path, name, value);
+    }
+
+    // Change by change, so the crash leaves a half-applied batch behind
+    int32_t ApplyChanges(const std::vector<RegistryChange>& changes, size_t& failedIndex) override
+    {
+        return RegistryBackend::ApplyChanges(changes, failedIndex);
+    }
+    bool AtomicBatches() const override { return false; }
+
+private:
+    int m_writesLeft;
+};
+
+static std::string MenuKey(int thread, int install)
+{
+    return "Software\\Classes\\Directory\\shell\\Bench" + std::to_string(thread) + "_" + std::to_string(install);
+}
+
+static void QueueInstall(RegistryManager::Transaction& txn, const std::string& key)
+{
+    txn.CreateKey(key + "\\command");
+    txn.WriteStringValue(key, "MUIVerb", "Open in Bench");
+    txn.WriteStringValue(key, "Icon", "bench.exe,0");
+    txn.WriteStringValue(key + "\\command", "", "bench.exe \"%V\"");
+}
+
+static bool InstallIndividually(RegistryManager& manager, const std::string& key, bool journaled, RegistryError& error)
+{
+    if (!journaled)
+    {
+        return manager.CreateKey(key + "\\command", error) &&
+               manager.WriteStringValue(key, "MUIVerb", "Open in Bench", error) &&
+               manager.WriteStringValue(key, "Icon", "bench.exe,0", error) &&
+               manager.WriteStringValue(key + "\\command", "", "bench.exe \"%V\"", error);
+    }
+
+    // Each write as its own one-change transaction
+    RegistryManager::Transaction txn = manager.BeginTransaction();
+    txn.CreateKey(key + "\\command");
+    bool ok = txn.Commit(error);
+    txn.WriteStringValue(key, "MUIVerb", "Open in Bench");
+    ok = ok && txn.Commit(error);
+    txn.WriteStringValue(key, "Icon", "bench.exe,0");
+    ok = ok && txn.Commit(error);
+    txn.WriteStringValue(key + "\\command", "", "bench.exe \"%V\"");
+    return ok && txn.Commit(error);
+}
+
+static int CheckInstalled(RegistryManager& manager, const std::string& key, const char* label)
+{
+    std::string verb, command;
+    RegistryError error;
+    if (!manager.ReadStringValue(key, "MUIVerb", verb, error) || verb != "Open in Bench" ||
+        !manager.ReadStringValue(key + "\\command", "", command, error) || command != "bench.exe \"%V\"")
+    {
+        std::cerr << "txn: " << label << ": " << key << " is not fully installed\n";
+        return 1;
+    }
+    return 0;
+}
+
+static int RunTransactionBench(int iterations, int installs, int threads)
+{
+    int failures = 0;
+    std::string journalFile = (std::filesystem::temp_directory_path() / "RegistryBench.journal").string();
+
+    struct Run
+    {
+        const char* name;
+        bool transaction;
+        bool journaled;
+        int threads;
+    };
+    const Run runs[] = {
+        {"individual", false, false, 1},
+        {"individual+journal", false, true, 1},
+        {"transaction", true, true, 1},
+        {"transaction", true, true, threads},
+    };
+
+    printf("\n%-20s %8s %12s %14s %10s\n", "mode", "threads", "ms", "installs/s", "syncs");
+    for (const Run& run : runs)
+    {
+        uint64_t syncs = 0;
+        double ms = MedianMs(iterations, [&]
+        {
+            auto backend = std::make_shared<MemoryRegistryBackend>();
+            RegistryManager manager(backend);
+            RegistryError error;
+            if (run.journaled && !manager.EnableJournal(journalFile, error))
+            {
+                std::cerr << "txn: " << error.Message() << "\n";
+                ++failures;
+                return;
+            }
+
+            std::vector<std::thread> workers;
+            std::vector<int> errors(run.threads);
+            for (int t = 0; t < run.threads; ++t)
+            {
+                workers.emplace_back([&, t]
+                {
+                    RegistryError threadError;
+                    for (int i = t; i < installs; i += run.threads)
+                    {
+                        std::string key = MenuKey(t, i);
+                        bool ok;
+                        if (run.transaction)
+                        {
+                            RegistryManager::Transaction txn = manager.BeginTransaction();
+                            QueueInstall(txn, key);
+                            ok = txn.Commit(threadError);
+                        }
+                        else
+                        {
+                            ok = InstallIndividually(manager, key, run.journaled, threadError);
+                        }
+                        errors[t] += ok ? 0 : 1;
+                    }
+                });
+            }
+            for (std::thread& worker : workers)
+            {
+                worker.join();
+            }
+            for (int t = 0; t < run.threads; ++t)
+            {
+                failures += errors[t] != 0;
+            }
+            failures += CheckInstalled(manager, MenuKey((installs - 1) % run.threads, installs - 1), run.name);
+
+            // Recovery on the next open must find nothing to undo
+            TransactionJournal reopened;
+            if (run.journaled && (!reopened.Open(journalFile, *backend, error) || reopened.GetStats().recovered != 0))
+            {
+                std::cerr << "txn: " << run.name << ": finished transactions were rolled back on reopen\n";
+                ++failures;
+            }
+            syncs = run.journaled ? manager.Journal()->GetStats().syncs : 0;
+        });
+        printf("%-20s %8d %12.1f %14.0f %10llu\n", run.name, run.threads, ms, ms > 0 ? installs * 1000.0 / ms : 0.0,
+               static_cast<unsigned long long>(syncs));
+    }
+
+    // A batch that fails half way must leave nothing behind
+    {
+        RegistryManager manager(std::make_shared<MemoryRegistryBackend>());
+        RegistryError error;
+        manager.CreateKey("Busy\\Child", error);
+        RegistryManager::Transaction txn = manager.BeginTransaction();
+        QueueInstall(txn, "Software\\Partial");
+        txn.DeleteKey("Busy"); // Has a subkey, so this fails
+        if (txn.Commit(error) || error.operation != RegistryOperation::DeleteKey ||
+            manager.Backend().KeyExists("Software\\Partial") == REGISTRY_SUCCESS)
+        {
+            std::cerr << "txn: failed commit left changes behind\n";
+            ++failures;
+        }
+    }
+
+    // Creating a key that exists and then deleting it still restores it and its values
+    {
+        auto backend = std::make_shared<CrashingBackend>(1000); // Only for its change-by-change batches
+        RegistryManager manager(backend);
+        RegistryError error;
+        backend->CreateKey("Software\\Existing");
+        backend->SetValue("Software\\Existing", "Kept", RegistryValue::String("before"));
+        backend->CreateKey("Busy\\Child");
+        RegistryManager::Transaction txn = manager.BeginTransaction();
+        txn.CreateKey("Software\\Existing");
+        txn.DeleteKey("Software\\Existing");
+        txn.DeleteKey("Busy"); // Has a subkey, so this fails and the batch is undone
+        RegistryValue kept;
+        if (txn.Commit(error) || backend->QueryValue("Software\\Existing", "Kept", kept) != REGISTRY_SUCCESS ||
+            kept != RegistryValue::String("before"))
+        {
+            std::cerr << "txn: a key created and then deleted in a rolled back batch was lost\n";
+            ++failures;
+        }
+    }
+
+    // A crash after two of three writes is rolled back when the journal is reopened
+    {
+        auto backend = std::make_shared<CrashingBackend>(2);
+        RegistryError error;
+        backend->CreateKey("Software\\Existing");
+        backend->SetValue("Software\\Existing", "Kept", RegistryValue::String("before"));
+        {
+            RegistryManager manager(backend);
+            manager.EnableJournal(journalFile, error);
+            RegistryManager::Transaction txn = manager.BeginTransaction();
+            txn.WriteStringValue("Software\\Existing", "Kept", "after");
+            QueueInstall(txn, "Software\\Crashed");
+            try
+            {
+                txn.Commit(error);
+                std::cerr << "txn: simulated crash did not happen\n";
+                ++failures;
+            }
+            catch (const std::runtime_error&)
+            {}
+        }
+
+        RegistryManager restarted(backend);
+        RegistryValue kept;
+        bool recovered = restarted.EnableJournal(journalFile, error);
+        backend->QueryValue("Software\\Existing", "Kept", kept);
+        if (!recovered || kept != RegistryValue::String("before") ||
+            backend->KeyExists("Software\\Crashed") == REGISTRY_SUCCESS)
+        {
+            std::cerr << "txn: crash in the middle of a commit was not rolled back\n";
+            ++failures;
+        }
+    }
+
+    std::filesystem::remove(journalFile);
+    return failures;
+}
+
+// Writes of the store bench: value i goes to slot i % slots, so every slot is
+// overwritten values / slots times. Slots are split between threads so that
+// each slot still sees its writes in order.
+struct StoreWorkload
+{
+    int values;
+    int slots;
+
+    static std::string Key(int slot) { return "Agents\\Agent" + std::to_string(slot % 1000); }
+    static std::string Name(int slot) { return "Setting" + std::to_string(slot / 1000); }
+    static std::string Data(int i) { return "value-" + std::to_string(i) + "-0123456789abcdef"; }
+
+    bool Owns(int i, int thread, int threads) const { return (i % slots) % threads == thread; }
+};
+
+static uint64_t DirectoryBytes(const std::string& directory)
+{
+    uint64_t bytes = 0;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, ec))
+    {
+        bytes += entry.file_size(ec);
+    }
+    return bytes;
+}
+
+// Every slot must hold its last write
+static int CheckStore(RegistryManager& manager, const StoreWorkload& workload, const char* label)
+{
+    for (int slot = 0; slot < workload.slots; ++slot)
+    {
+        int last = slot + (workload.values - 1 - slot) / workload.slots * workload.slots;
+        std::string data;
+        RegistryError error;
+        if (!manager.ReadStringValue(StoreWorkload::Key(slot), StoreWorkload::Name(slot), data, error) ||
+            data != StoreWorkload::Data(last))
+        {
+            std::cerr << "store: " << label << ": slot " << slot << " does not hold its last write\n";
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int RunStoreBench(int iterations, int values, int threads)
+{
+    int failures = 0;
+    std::string directory = (std::filesystem::temp_directory_path() / "RegistryBench.store").string();
+    StoreWorkload workload{values, std::max(1, values / 10)};
+
+    struct Run
+    {
+        const char* name;
+        int threads;
+        int batch; // Writes per transaction, 1 for plain WriteStringValue
+        bool compaction;
+    };
+    const Run runs[] = {
+        {"write", 1, 1, true},
+        {"write", threads, 1, true},
+        {"transaction", 1, 100, true},
+        {"write, no compaction", 1, 1, false},
+    };
+
+    printf("\n%-22s %8s %10s %12s %10s %12s %10s\n", "mode", "threads", "ms", "writes/s", "syncs", "disk KiB", "space amp");
+    for (const Run& run : runs)
+    {
+        LogStoreBackend::Stats stats{};
+        uint64_t diskBytes = 0;
+        double ms = MedianMs(iterations, [&]
+        {
+            std::filesystem::remove_all(directory);
+            LogStoreBackend::Options options;
+            options.backgroundCompaction = run.compaction;
+            options.compactMinBytes = 256 << 10;
+            auto store = std::make_shared<LogStoreBackend>();
+            RegistryError error;
+            if (!store->Open(directory, options, error))
+            {
+                std::cerr << "store: " << error.Message() << "\n";
+                ++failures;
+                return;
+            }
+            RegistryManager manager(store);
+            RegistryManager::Transaction keys = manager.BeginTransaction();
+            for (int key = 0; key < std::min(workload.slots, 1000); ++key)
+            {
+                keys.CreateKey(StoreWorkload::Key(key));
+            }
+            keys.Commit(error);
+
+            std::vector<std::thread> workers;
+            std::vector<int> errors(run.threads);
+            for (int t = 0; t < run.threads; ++t)
+            {
+                workers.emplace_back([&, t]
+                {
+                    RegistryError threadError;
+                    RegistryManager::Transaction txn = manager.BeginTransaction();
+                    for (int i = 0; i < workload.values; ++i)
+                    {
+                        if (!workload.Owns(i, t, run.threads))
+                        {
+                            continue;
+                        }
+                        int slot = i % workload.slots;
+                        if (run.batch == 1)
+                        {
+                            errors[t] += !manager.WriteStringValue(StoreWorkload::Key(slot), StoreWorkload::Name(slot),
+                                                                   StoreWorkload::Data(i), threadError);
+                            continue;
+                        }
+                        txn.WriteStringValue(StoreWorkload::Key(slot), StoreWorkload::Name(slot), StoreWorkload::Data(i));
+                        if (static_cast<int>(txn.Size()) == run.batch)
+                        {
+                            errors[t] += !txn.Commit(threadError);
+                        }
+                    }
+                    errors[t] += !txn.Commit(threadError);
+                });
+            }
+            for (std::thread& worker : workers)
+            {
+                worker.join();
+            }
+            for (int t = 0; t < run.threads; ++t)
+            {
+                failures += errors[t] != 0;
+            }
+            failures += CheckStore(manager, workload, run.name);
+            stats = store->GetStats();
+            store->Close();
+            diskBytes = DirectoryBytes(directory);
+        });
+
+        // Live size: what a full compaction leaves behind
+        auto store = std::make_shared<LogStoreBackend>();
+        RegistryError error;
+        LogStoreBackend::Options options;
+        options.backgroundCompaction = false;
+        store->Open(directory, options, error);
+        store->Compact(error);
+        store->Close();
+        uint64_t liveBytes = DirectoryBytes(directory);
+
+        printf("%-22s %8d %10.1f %12.0f %10llu %12.1f %9.2fx\n", run.name, run.threads, ms,
+               ms > 0 ? values * 1000.0 / ms : 0.0, static_cast<unsigned long long>(stats.syncs), diskBytes / 1024.0,
+               liveBytes ? static_cast<double>(diskBytes) / liveBytes : 0.0);
+    }
+
+    // Recovery: the last run left logs only, so replay them, then from a checkpoint
+    {
+        std::filesystem::remove_all(directory);
+        LogStoreBackend::Options options;
+        options.backgroundCompaction = false;
+        auto store = std::make_shared<LogStoreBackend>();
+        RegistryError error;
+        store->Open(directory, options, error);
+        RegistryManager manager(store);
+        manager.CreateKey("Agents", error);
+        for (int key = 0; key < std::min(workload.slots, 1000); ++key)
+        {
+            manager.CreateKey(StoreWorkload::Key(key), error);
+        }
+        RegistryManager::Transaction txn = manager.BeginTransaction();
+        for (int i = 0; i < workload.values; ++i)
+        {
+            int slot = i % workload.slots;
+            txn.WriteStringValue(StoreWorkload::Key(slot), StoreWorkload::Name(slot), StoreWorkload::Data(i));
+            if (txn.Size() == 100)
+            {
+                txn.Commit(error);
+            }
+        }
+        txn.Commit(error);
+        store->Close();
+
+        // A crash in the middle of a write leaves a torn record behind
+        std::vector<std::string> logs;
+        for (const auto& entry : std::filesystem::directory_iterator(directory))
+        {
+            logs.push_back(entry.path().string());
+        }
+        std::sort(logs.begin(), logs.end());
+        if (FILE* file = fopen(logs.back().c_str(), "ab"))
+        {
+            fwrite("\x40\x00\x00\x00torn", 1, 8, file);
+            fclose(file);
+        }
+
+        printf("\n%-22s %10s %12s %12s\n", "recovery from", "ms", "records", "disk KiB");
+        uint64_t logBytes = DirectoryBytes(directory);
+        double logMs = MedianMs(iterations, [&] { store->Open(directory, options, error); store->Close(); });
+        store->Open(directory, options, error);
+        uint64_t replayed = store->GetStats().replayedRecords;
+        failures += CheckStore(manager, workload, "reopened from logs");
+        store->Compact(error);
+        store->Close();
+        printf("%-22s %10.1f %12llu %12.1f\n", "logs", logMs, static_cast<unsigned long long>(replayed), logBytes / 1024.0);
+
+        uint64_t checkpointBytes = DirectoryBytes(directory);
+        double checkpointMs = MedianMs(iterations, [&] { store->Open(directory, options, error); store->Close(); });
+        if (!store->Open(directory, options, error))
+        {
+            std::cerr << "store: " << error.Message() << "\n";
+            ++failures;
+        }
+        failures += CheckStore(manager, workload, "reopened from checkpoint");
+        printf("%-22s %10.1f %12llu %12.1f\n", "checkpoint", checkpointMs,
+               static_cast<unsigned long long>(store->GetStats().replayedRecords), checkpointBytes / 1024.0);
+        store->Close();
+    }
+
+    std::filesystem::remove_all(directory);
+    return failures;
+}
+
+static uint32_t DWordOf(const RegistryValue& value)
+{
+    uint32_t number = 0;
+    for (size_t i = 0; i < value.data.size() && i < 4; ++i)
+    {
+        number |= static_cast<uint32_t>(static_cast<uint8_t>(value.data[i])) << (i * 8);
+    }
+    return number;
+}
+
+static int RunMvccBench(int durationMs)
+{
+    int failures = 0;
+    const int keyCount = 1000;
+    const int valuesPerKey = 10;
+    auto keyName = [](int key) { return "Fleet\\Host" + std::to_string(key); };
+    auto valueName = [](int value) { return "Value" + std::to_string(value); };
+
+    MemoryRegistryBackend backend;
+    std::vector<RegistryChange> setup;
+    for (int key = 0; key < keyCount; ++key)
+    {
+        setup.push_back({RegistryChange::CREATE_KEY, keyName(key), {}, {}});
+        for (int value = 0; value < valuesPerKey; ++value)
+        {
+            setup.push_back({RegistryChange::SET_VALUE, keyName(key), valueName(value), RegistryValue::DWord(0)});
+        }
+    }
+    setup.push_back({RegistryChange::CREATE_KEY, "Pair", {}, {}});
+    size_t failedIndex;
+    backend.ApplyChanges(setup, failedIndex);
+
+    // Snapshot isolation: a snapshot keeps its version while writes go on
+    {
+        backend.SetValue("Pair", "A", RegistryValue::DWord(1));
+        MemoryRegistryBackend::Snapshot before = backend.TakeSnapshot();
+        backend.SetValue("Pair", "A", RegistryValue::DWord(2));
+        RegistryValue old, current;
+        before.QueryValue("Pair", "A", old);
+        backend.QueryValue("Pair", "A", current);
+        if (DWordOf(old) != 1 || DWordOf(current) != 2)
+        {
+            std::cerr << "mvcc: snapshot does not keep its version\n";
+            ++failures;
+        }
+        if (backend.GetStats().retiredPending == 0)
+        {
+            std::cerr << "mvcc: version still visible to a snapshot was reclaimed\n";
+            ++failures;
+        }
+        backend.SetValue("Pair", "B", RegistryValue::DWord(2));
+    }
+
+    std::shared_mutex lock; // The "rwlock" mode: one lock around the whole tree
+    printf("\n%-8s %8s %14s %14s %10s %12s\n", "mode", "threads", "reads/s", "writes/s", "scaling", "torn pairs");
+    for (bool locked : {true, false})
+    {
+        double singleThread = 0;
+        for (int threads = 1; threads <= 32; threads *= 2)
+        {
+            std::atomic<bool> stop{false};
+            std::atomic<uint64_t> reads{0}, writes{0}, torn{0};
+            std::vector<std::thread> workers;
+            for (int t = 0; t < threads; ++t)
+            {
+                workers.emplace_back([&, t]
+                {
+                    PathGenerator random(0x5EED + t);
+                    uint64_t localReads = 0, localWrites = 0, localTorn = 0;
+                    uint32_t counter = static_cast<uint32_t>(t) << 24;
+                    RegistryValue value, a, b;
+                    while (!stop.load(std::memory_order_relaxed))
+                    {
+                        if (random.Next(10) == 0)
+                        {
+                            ++counter;
+                            std::vector<RegistryChange> batch{
+                                {RegistryChange::SET_VALUE, "Pair", "A", RegistryValue::DWord(counter)},
+                                {RegistryChange::SET_VALUE, "Pair", "B", RegistryValue::DWord(counter)},
+                                {RegistryChange::SET_VALUE, keyName(random.Next(keyCount)), valueName(random.Next(valuesPerKey)),
+                                 RegistryValue::DWord(counter)},
+                            };
+                            size_t failed;
+                            if (locked)
+                            {
+                                std::unique_lock<std::shared_mutex> exclusive(lock);
+                                backend.ApplyChanges(batch, failed);
+                            }
+                            else
+                            {
+                                backend.ApplyChanges(batch, failed);
+                            }
+                            ++localWrites;
+                            continue;
+                        }
+
+                        // Sixteen reads against one version, the last one checking the pair
+                        auto readBurst = [&](const MemoryRegistryBackend::Snapshot& snapshot)
+                        {
+                            for (int i = 0; i < 15; ++i)
+                            {
+                                snapshot.QueryValue(keyName(random.Next(keyCount)), valueName(random.Next(valuesPerKey)), value);
+                            }
+                            snapshot.QueryValue("Pair", "A", a);
+                            snapshot.QueryValue("Pair", "B", b);
+                            localTorn += a != b;
+                            localReads += 16;
+                        };
+                        if (locked)
+                        {
+                            std::shared_lock<std::shared_mutex> shared(lock);
+                            readBurst(backend.TakeSnapshot());
+                        }
+                        else
+                        {
+                            readBurst(backend.TakeSnapshot());
+                        }
+                    }
+                    reads += localReads;
+                    writes += localWrites;
+                    torn += localTorn;
+                });
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(durationMs));
+            stop = true;
+            for (std::thread& worker : workers)
+            {
+                worker.join();
+            }
+
+            double seconds = durationMs / 1000.0;
+            double readRate = reads / seconds;
+            if (threads == 1)
+            {
+                singleThread = readRate;
+            }
+            printf("%-8s %8d %14.0f %14.0f %9.2fx %12llu\n", locked ? "rwlock" : "mvcc", threads, readRate, writes / seconds,
+                   singleThread > 0 ? readRate / singleThread : 0.0, static_cast<unsigned long long>(torn.load()));
+            if (torn != 0)
+            {
+                std::cerr << "mvcc: a snapshot showed half of a write batch\n";
+                ++failures;
+            }
+        }
+    }
+
+    // With no snapshot alive, the next write frees every replaced version
+    backend.SetValue("Pair", "A", RegistryValue::DWord(0));
+    MemoryRegistryBackend::Stats stats = backend.GetStats();
+    printf("versions %llu, reclaimed %llu, pending %llu\n", static_cast<unsigned long long>(stats.versions),
+           static_cast<unsigned long long>(stats.reclaimed), static_cast<unsigned long long>(stats.retiredPending));
+    if (stats.retiredPending != 0)
+    {
+        std::cerr << "mvcc: replaced versions were not reclaimed\n";
+        ++failures;
+    }
+    return failures;
+}
+
+// The small-tree case, with every kind of difference and the exact .reg text
+static int CheckRegPatch()
+{
+    auto before = std::make_shared<MemoryRegistryBackend>();
+    std::vector<RegistryChange> setup{
+        {RegistryChange::CREATE_KEY, "Menu\\Gone\\command", {}, {}},
+        {RegistryChange::SET_VALUE, "Menu", "Icon", RegistryValue::String("a.dll,1")},
+        {RegistryChange::SET_VALUE, "Menu", "Old", RegistryValue::DWord(1)},
+        {RegistryChange::SET_VALUE, "Menu\\Gone\\command", "", RegistryValue::String("calc.exe")},
+    };
+    MemoryRegistryBackend after;
+    std::vector<RegistryChange> target{
+        {RegistryChange::CREATE_KEY, "Menu\\New\\command", {}, {}},
+        {RegistryChange::SET_VALUE, "Menu", "", RegistryValue::String("Say \"hi\"")},
+        {RegistryChange::SET_VALUE, "Menu", "Count", RegistryValue::DWord(10)},
+        {RegistryChange::SET_VALUE, "Menu", "Icon", RegistryValue::String("C:\\b.dll,2")},
+        {RegistryChange::SET_VALUE, "Menu\\New", "Path", {VALUE_EXPAND_STRING, "%A%"}},
+        {RegistryChange::SET_VALUE, "Menu\\New\\command", "", RegistryValue::String("notepad.exe")},
+    };
+    size_t failedIndex;
+    before->ApplyChanges(setup, failedIndex);
+    after.ApplyChanges(target, failedIndex);
+
+    RegistryTree treeA, treeB;
+    RegistryError error;
+    std::vector<RegistryDelta> delta;
+    CaptureTree(*before, "Menu", treeA, error);
+    CaptureTree(after, "Menu", treeB, error);
+    DiffTrees(treeA, treeB, delta);
+
+    const char* expected =
+        "Windows Registry Editor Version 5.00\r\n"
+        "\r\n[HKEY_CURRENT_USER\\Software\\Test\\Menu]\r\n"
+        "@=\"Say \\\"hi\\\"\"\r\n"
+        "\"Count\"=dword:0000000a\r\n"
+        "\"Icon\"=\"C:\\\\b.dll,2\"\r\n"
+        "\"Old\"=-\r\n"
+        "\r\n[-HKEY_CURRENT_USER\\Software\\Test\\Menu\\Gone]\r\n"
+        "\r\n[HKEY_CURRENT_USER\\Software\\Test\\Menu\\New]\r\n"
+        "\"Path\"=hex(2):25,00,41,00,25,00,00,00\r\n"
+        "\r\n[HKEY_CURRENT_USER\\Software\\Test\\Menu\\New\\command]\r\n"
+        "@=\"notepad.exe\"\r\n";
+    int failures = 0;
+    std::string patch = FormatRegPatch(delta, "HKEY_CURRENT_USER\\Software\\Test\\Menu");
+    if (patch != expected)
+    {
+        std::cerr << "diff: unexpected .reg patch:\n" << patch;
+        ++failures;
+    }
+
+    RegistryTransaction transaction(before, nullptr);
+    RegistryTree applied;
+    if (!ApplyDelta(transaction, "Menu", delta, error) || !CaptureTree(*before, "Menu", applied, error) ||
+        applied.RootHash() != treeB.RootHash())
+    {
+        std::cerr << "diff: small delta does not reproduce the target " << error.Message() << "\n";
+        ++failures;
+    }
+    return failures;
+}
+
+// Every value keyed by its full path, compared one by one: what a diff
+// without subtree hashes has to do
+static size_t NaiveDiffCount(const MemoryRegistryBackend::Snapshot& a, const MemoryRegistryBackend::Snapshot& b)
+{
+    std::vector<RegistryChange> exportA, exportB;
+    a.Export(exportA);
+    b.Export(exportB);
+    std::unordered_map<std::string, const RegistryChange*> index;
+    auto lower = [](std::string text)
+    {
+        for (char& ch : text)
+        {
+            ch = static_cast<char>(tolower(static_cast<unsigned char>(ch)));
+        }
+        return text;
+    };
+    for (const RegistryChange& change : exportA)
+    {
+        index.emplace(lower(change.path + '\n' + (change.kind == RegistryChange::SET_VALUE ? change.name : "\n")), &change);
+    }
+    size_t differences = 0;
+    for (const RegistryChange& change : exportB)
+    {
+        auto it = index.find(lower(change.path + '\n' + (change.kind == RegistryChange::SET_VALUE ? change.name : "\n")));
+        if (it == index.end())
+        {
+            ++differences;
+            continue;
+        }
+        differences += it->second->value != change.value;
+        index.erase(it);
+    }
+    return differences + index.size();
+}
+
+// Fleet tree: Fleet\\Host<n>\\Component<n> keys with 50 values each, half
+// DLL paths and half DWORDs, 1000 values per host
+static const int FLEET_COMPONENTS = 20;
+static const int FLEET_VALUES_PER_COMPONENT = 50;
+
+static std::string FleetComponentKey(int host, int component)
+{
+    return "Fleet\\Host" + std::to_string(host) + "\\Component" + std::to_string(component);
+}
+
+static int FleetHosts(int fleetValues)
+{
+    return std::max(1, fleetValues / (FLEET_COMPONENTS * FLEET_VALUES_PER_COMPONENT));
+}
+
+static void BuildFleet(MemoryRegistryBackend& backend, int fleetValues)
+{
+    std::vector<RegistryChange> batch;
+    size_t failedIndex;
+    for (int host = 0; host < FleetHosts(fleetValues); ++host)
+    {
+        batch.clear();
+        for (int component = 0; component < FLEET_COMPONENTS; ++component)
+        {
+            std::string key = FleetComponentKey(host, component);
+            batch.push_back({RegistryChange::CREATE_KEY, key, {}, {}});
+            for (int value = 0; value < FLEET_VALUES_PER_COMPONENT; ++value)
+            {
+                std::string name = "Setting" + std::to_string(value);
+                batch.push_back({RegistryChange::SET_VALUE, key, name,
+                                 value % 2 ? RegistryValue::DWord(host * 31 + value)
+                                           : RegistryValue::String("C:\\Program Files\\App\\" + name + ".dll")});
+            }
+        }
+        backend.ApplyChanges(batch, failedIndex);
+    }
+}
+
+static int RunDiffBench(int fleetValues)
+{
+    const int hosts = FleetHosts(fleetValues);
+    const int components = FLEET_COMPONENTS;
+    const int valuesPerComponent = FLEET_VALUES_PER_COMPONENT;
+    auto componentKey = FleetComponentKey;
+
+    MemoryRegistryBackend backend;
+    std::vector<RegistryChange> batch;
+    size_t failedIndex;
+    BuildFleet(backend, fleetValues);
+    MemoryRegistryBackend::Snapshot snapshotA = backend.TakeSnapshot();
+
+    // Drift: about one value in a thousand changed, removed or added, plus
+    // whole components dropped and hosts joining
+    PathGenerator random(0xD1FF);
+    batch.clear();
+    size_t drifted = std::max(1, fleetValues / 1000);
+    for (size_t i = 0; i < drifted; ++i)
+    {
+        std::string key = componentKey(random.Next(hosts), random.Next(components));
+        std::string name = "Setting" + std::to_string(random.Next(valuesPerComponent));
+        switch (random.Next(3))
+        {
+            case 0: batch.push_back({RegistryChange::SET_VALUE, key, name, RegistryValue::DWord(0xD21F7000 + static_cast<uint32_t>(i))}); break;
+            case 1: batch.push_back({RegistryChange::DELETE_VALUE, key, name, {}}); break;
+            case 2: batch.push_back({RegistryChange::SET_VALUE, key, "Extra" + std::to_string(i), RegistryValue::String("drift")}); break;
+        }
+    }
+    for (int i = 0; i < 5; ++i)
+    {
+        std::string key = componentKey(random.Next(hosts), random.Next(components));
+        std::vector<std::pair<std::string, RegistryValue>> values;
+        backend.EnumValues(key, values);
+        for (const auto& value : values)
+        {
+            batch.push_back({RegistryChange::DELETE_VALUE, key, value.first, {}});
+        }
+        batch.push_back({RegistryChange::DELETE_KEY, key, {}, {}});
+        std::string newKey = "Fleet\\NewHost" + std::to_string(i) + "\\Component0";
+        batch.push_back({RegistryChange::CREATE_KEY, newKey, {}, {}});
+        batch.push_back({RegistryChange::SET_VALUE, newKey, "Setting0", RegistryValue::DWord(static_cast<uint32_t>(i))});
+    }
+    if (backend.ApplyChanges(batch, failedIndex) != REGISTRY_SUCCESS)
+    {
+        std::cerr << "diff: drift batch failed at " << failedIndex << "\n";
+        return 1;
+    }
+    MemoryRegistryBackend::Snapshot snapshotB = backend.TakeSnapshot();
+
+    int failures = 0;
+    RegistryError error;
+    RegistryTree treeA, treeB;
+    auto start = std::chrono::steady_clock::now();
+    CaptureTree(snapshotA, "Fleet", treeA, error);
+    auto captured = std::chrono::steady_clock::now();
+    CaptureTree(snapshotB, "Fleet", treeB, error);
+
+    std::vector<RegistryDelta> delta;
+    auto diffStart = std::chrono::steady_clock::now();
+    DiffStats stats = DiffTrees(treeA, treeB, delta);
+    auto diffEnd = std::chrono::steady_clock::now();
+    std::string patch = FormatRegPatch(delta, "HKEY_LOCAL_MACHINE\\SOFTWARE\\Fleet");
+    auto formatted = std::chrono::steady_clock::now();
+    size_t naive = NaiveDiffCount(snapshotA, snapshotB);
+    auto naiveEnd = std::chrono::steady_clock::now();
+
+    auto ms = [](auto from, auto to) { return std::chrono::duration<double, std::milli>(to - from).count(); };
+    printf("\nfleet: %zu keys, %zu values; %zu values drifted, delta %zu entries\n", treeA.keys.size(), treeA.values.size(),
+           drifted, delta.size());
+    printf("%-28s %10.1f ms\n", "capture + hash (one side)", ms(start, captured));
+    printf("%-28s %10.2f ms  (%llu keys compared, %llu subtrees skipped)\n", "merkle diff", ms(diffStart, diffEnd),
+           static_cast<unsigned long long>(stats.keysCompared), static_cast<unsigned long long>(stats.subtreesSkipped));
+    printf("%-28s %10.1f ms  (%zu differences)\n", "compare every value", ms(formatted, naiveEnd), naive);
+    printf("%-28s %10.2f ms  (%zu bytes)\n", ".reg patch", ms(diffEnd, formatted), patch.size());
+
+    // Removed keys count once in the delta but once per key and value in the
+    // naive count, so compare after expanding them
+    size_t expanded = 0;
+    for (const RegistryDelta& entry : delta)
+    {
+        expanded += entry.kind == RegistryDelta::KEY_REMOVED ? 1 + valuesPerComponent : 1;
+    }
+    if (expanded != naive)
+    {
+        std::cerr << "diff: merkle diff found " << expanded << " differences, full comparison " << naive << "\n";
+        ++failures;
+    }
+
+    // The delta turns a copy of the first snapshot into the second
+    auto replica = std::make_shared<MemoryRegistryBackend>();
+    std::vector<RegistryChange> image;
+    snapshotA.Export(image);
+    replica->ApplyChanges(image, failedIndex);
+    RegistryTransaction transaction(replica, nullptr);
+    RegistryTree replayed;
+    auto applyStart = std::chrono::steady_clock::now();
+    bool applied = ApplyDelta(transaction, "Fleet", delta, error);
+    auto applyEnd = std::chrono::steady_clock::now();
+    printf("%-28s %10.1f ms\n", "apply delta", ms(applyStart, applyEnd));
+    if (!applied || !CaptureTree(*replica, "Fleet", replayed, error) || replayed.RootHash() != treeB.RootHash())
+    {
+        std::cerr << "diff: applying the delta does not reproduce the second snapshot " << error.Message() << "\n";
+        ++failures;
+    }
+
+    return failures + CheckRegPatch();
+}
+
+// Opens the file, reports failures and returns the backend ready to read
+static bool OpenSnapshot(SnapshotFileBackend& backend, const std::string& fileName, const char* label)
+{
+    RegistryError error;
+    if (!backend.Open(fileName, error))
+    {
+        std::cerr << "snapshot: " << label << ": " << error.Message() << "\n";
+        return false;
+    }
+    return true;
+}
+
+// Reading the file back must give the captured tree, hash for hash
+static int CheckSnapshotFile(const std::string& fileName, const RegistryTree& tree, const char* label)
+{
+    SnapshotFileBackend file;
+    RegistryError error;
+    RegistryTree reread;
+    if (!OpenSnapshot(file, fileName, label))
+    {
+        return 1;
+    }
+    if (!file.Verify(error) || !CaptureTree(file, "", reread, error) || reread.RootHash() != tree.RootHash() ||
+        file.RootHash() != tree.RootHash())
+    {
+        std::cerr << "snapshot: " << label << " does not read back as written " << error.Message() << "\n";
+        return 1;
+    }
+
+    // Seeding a writable backend from it gives the same tree again
+    MemoryRegistryBackend seeded;
+    std::vector<RegistryChange> changes;
+    size_t failedIndex;
+    file.Export(changes);
+    seeded.ApplyChanges(changes, failedIndex);
+    if (!CaptureTree(seeded, "", reread, error) || reread.RootHash() != tree.RootHash())
+    {
+        std::cerr << "snapshot: " << label << " exports a different tree\n";
+        return 1;
+    }
+    return 0;
+}
+
+// Empty data, default values and a value bigger than a block, through the
+// RegistryManager read calls; writes must be refused
+static int CheckSnapshotEdgeCases(const std::string& fileName)
+{
+    int failures = 0;
+    MemoryRegistryBackend source;
+    std::string large(200000, '\0');
+    for (size_t i = 0; i < large.size(); ++i)
+    {
+        large[i] = static_cast<char>(i * 7 + i / 1000);
+    }
+    std::vector<RegistryChange> setup{
+        {RegistryChange::CREATE_KEY, "Shell\\Advanced Hello\\command", {}, {}},
+        {RegistryChange::SET_VALUE, "Shell\\Advanced Hello", "Extended", RegistryValue::String("")},
+        {RegistryChange::SET_VALUE, "Shell\\Advanced Hello\\command", "", RegistryValue::String("calc.exe")},
+        {RegistryChange::SET_VALUE, "Shell", "Blob", {VALUE_BINARY, large}},
+        {RegistryChange::SET_VALUE, "Shell", "Count", RegistryValue::DWord(42)},
+    };
+    size_t failedIndex;
+    source.ApplyChanges(setup, failedIndex);
+
+    RegistryTree tree;
+    RegistryError error;
+    CaptureTree(source, "", tree, error);
+    for (bool compress : {false, true})
+    {
+        SnapshotWriteOptions options;
+        options.compress = compress;
+        options.blockSize = 4096;
+        if (!WriteSnapshotFile(tree, fileName, options, error))
+        {
+            std::cerr << "snapshot: " << error.Message() << "\n";
+            return failures + 1;
+        }
+        failures += CheckSnapshotFile(fileName, tree, compress ? "compressed edge cases" : "edge cases");
+
+        auto file = std::make_shared<SnapshotFileBackend>();
+        if (!OpenSnapshot(*file, fileName, "edge cases"))
+        {
+            return failures + 1;
+        }
+        RegistryManager manager(file);
+        std::string text;
+        uint32_t number = 0;
+        RegistryValue blob;
+        bool read = manager.ReadStringValue("shell\\advanced hello\\COMMAND", "", text, error) && text == "calc.exe" &&
+                    manager.ReadStringValue("Shell\\Advanced Hello", "Extended", text, error) && text.empty() &&
+                    manager.ReadDWORDValue("Shell", "Count", number, error) && number == 42 &&
+                    file->QueryValue("Shell", "Blob", blob) == REGISTRY_SUCCESS && blob.data == large;
+        if (!read)
+        {
+            std::cerr << "snapshot: values read through RegistryManager differ " << error.Message() << "\n";
+            ++failures;
+        }
+        if (manager.WriteDWORDValue("Shell", "Count", 1, error) || error.code != REGISTRY_ACCESS_DENIED)
+        {
+            std::cerr << "snapshot: a write to a snapshot file was not refused\n";
+            ++failures;
+        }
+        // A missing key fails the open step, a missing value the read itself
+        RegistryError missingKey;
+        RegistryError missingValue;
+        if (manager.ReadStringValue("Shell\\Nowhere", "", text, missingKey) ||
+            missingKey.operation != RegistryOperation::OpenKeyForReading || missingKey.code != REGISTRY_KEY_NOT_FOUND ||
+            manager.ReadStringValue("Shell", "Nowhere", text, missingValue) ||
+            missingValue.operation != RegistryOperation::QueryString || missingValue.code != REGISTRY_NOT_FOUND)
+        {
+            std::cerr << "snapshot: a missing key and a missing value were not told apart\n";
+            ++failures;
+        }
+        // Reading a string as a DWORD names the mismatch, not the success code
+        RegistryError mismatch;
+        if (manager.ReadDWORDValue("Shell\\Advanced Hello", "Extended", number, mismatch) ||
+            mismatch.operation != RegistryOperation::ReadDWORD || mismatch.code != REGISTRY_TYPE_MISMATCH ||
+            mismatch.Message().find(RegistryCodeText(REGISTRY_TYPE_MISMATCH)) == std::string::npos)
+        {
+            std::cerr << "snapshot: a type mismatch was not reported: " << mismatch.Message() << "\n";
+            ++failures;
+        }
+    }
+
+    // A damaged header is refused by Open, damaged data by Verify
+    std::string bytes;
+    {
+        std::ifstream in(fileName, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    auto writeDamaged = [&](size_t offset)
+    {
+        std::string damaged = bytes;
+        damaged[offset] ^= 0x10;
+        std::ofstream(fileName, std::ios::binary | std::ios::trunc).write(damaged.data(), damaged.size());
+    };
+    SnapshotFileBackend damaged;
+    writeDamaged(20);
+    if (damaged.Open(fileName, error) || error.code != REGISTRY_CORRUPT)
+    {
+        std::cerr << "snapshot: a damaged header was accepted\n";
+        ++failures;
+    }
+    writeDamaged(bytes.size() - 100);
+    if (!damaged.Open(fileName, error) || damaged.Verify(error))
+    {
+        std::cerr << "snapshot: damaged value data passed Verify\n";
+        ++failures;
+    }
+    damaged.Close();
+    std::filesystem::remove(fileName);
+    return failures;
+}
+
+static int RunSnapshotBench(int iterations, int fleetValues)
+{
+    int failures = 0;
+    std::string fileName = (std::filesystem::temp_directory_path() / "RegistryBench.snapshot").string();
+    std::string compressedName = fileName + ".lz";
+
+    printf("\n%-10s %-10s %12s %12s %10s %12s %12s %10s %10s\n", "values", "format", "bytes", ".reg bytes", "write ms",
+           "open us", "lookup ns", "verify ms", "inflated");
+    for (int values : {std::max(1000, fleetValues / 100), fleetValues})
+    {
+        MemoryRegistryBackend backend;
+        BuildFleet(backend, values);
+        RegistryTree tree;
+        RegistryError error;
+        CaptureTree(backend.TakeSnapshot(), "", tree, error);
+
+        // The same tree as .reg text, for scale
+        RegistryTree empty;
+        empty.keys.push_back({std::string(), 0, 0, 0, 0, 0});
+        std::vector<RegistryDelta> everything;
+        DiffTrees(empty, tree, everything);
+        size_t regBytes = FormatRegPatch(everything, "HKEY_LOCAL_MACHINE\\SOFTWARE").size();
+        everything.clear();
+
+        // Lookups of random existing values, the same sequence for each file
+        std::vector<std::pair<std::string, std::string>> probes;
+        PathGenerator random(0x5A7);
+        for (int i = 0; i < 100000; ++i)
+        {
+            probes.emplace_back(FleetComponentKey(random.Next(FleetHosts(values)), random.Next(FLEET_COMPONENTS)),
+                                "Setting" + std::to_string(random.Next(FLEET_VALUES_PER_COMPONENT)));
+        }
+
+        for (bool compress : {false, true})
+        {
+            const std::string& name = compress ? compressedName : fileName;
+            SnapshotWriteOptions options;
+            options.compress = compress;
+            double writeMs = MedianMs(1, [&] { WriteSnapshotFile(tree, name, options, error); });
+            failures += CheckSnapshotFile(name, tree, compress ? "compressed fleet" : "fleet");
+
+            SnapshotFileBackend file;
+            double openMs = MedianMs(iterations * 10, [&] { OpenSnapshot(file, name, "fleet"); });
+            RegistryValue value;
+            size_t missing = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (const auto& probe : probes)
+            {
+                missing += file.QueryValue(probe.first, probe.second, value) != REGISTRY_SUCCESS;
+            }
+            double lookupNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() /
+                              probes.size();
+            double verifyMs = MedianMs(1, [&] { file.Verify(error); });
+            SnapshotFileBackend::Stats stats = file.GetStats();
+            printf("%-10d %-10s %12llu %12zu %10.1f %12.1f %12.0f %10.1f %5llu/%-4llu\n", values, compress ? "lz" : "raw",
+                   static_cast<unsigned long long>(stats.fileBytes), regBytes, writeMs, openMs * 1000, lookupNs, verifyMs,
+                   static_cast<unsigned long long>(stats.blocksInflated),
+                   static_cast<unsigned long long>(stats.compressedBlocks));
+            if (missing != 0)
+            {
+                std::cerr << "snapshot: " << missing << " existing values not found\n";
+                ++failures;
+            }
+            file.Close();
+            std::filesystem::remove(name);
+        }
+    }
+
+    return failures + CheckSnapshotEdgeCases(fileName);
+}
+
+// Hits as sorted "field path\nname" lines, to compare result sets
+static std::vector<std::string> HitLines(const std::vector<RegistrySearchHit>& hits)
+{
+    std::vector<std::string> lines;
+    for (const RegistrySearchHit& hit : hits)
+    {
+        lines.push_back(std::to_string(hit.field) + ' ' + hit.path + '\n' + hit.name);
+    }
+    std::sort(lines.begin(), lines.end());
+    return lines;
+}
+
+static std::string FoldText(std::string text)
+{
+    for (char& ch : text)
+    {
+        ch = ch == '\0' ? '\n' : static_cast<char>(tolower(static_cast<unsigned char>(ch)));
+    }
+    return text;
+}
+
+// Every key and value checked in turn, like enumerating with RegEnumValue
+static std::vector<RegistrySearchHit> ScanSubstring(const std::vector<RegistryChange>& tree, const std::string& text, bool prefix)
+{
+    std::string pattern = FoldText(text);
+    auto matches = [&](const std::string& candidate)
+    {
+        std::string folded = FoldText(candidate);
+        return prefix ? folded.compare(0, pattern.size(), pattern) == 0 : folded.find(pattern) != std::string::npos;
+    };
+    std::vector<RegistrySearchHit> hits;
+    for (const RegistryChange& change : tree)
+    {
+        if (change.kind == RegistryChange::CREATE_KEY)
+        {
+            size_t slash = change.path.rfind('\\');
+            if (matches(change.path.substr(slash == std::string::npos ? 0 : slash + 1)))
+            {
+                hits.push_back({RegistrySearchHit::KEY_NAME, change.path, {}});
+            }
+            continue;
+        }
+        if (matches(change.name))
+        {
+            hits.push_back({RegistrySearchHit::VALUE_NAME, change.path, change.name});
+        }
+        uint32_t type = change.value.type;
+        if ((type == VALUE_STRING || type == VALUE_EXPAND_STRING || type == VALUE_MULTI_STRING) && matches(change.value.data))
+        {
+            hits.push_back({RegistrySearchHit::VALUE_DATA, change.path, change.name});
+        }
+    }
+    return hits;
+}
+
+static std::vector<RegistrySearchHit> ScanNumberRange(const std::vector<RegistryChange>& tree, uint64_t low, uint64_t high)
+{
+    std::vector<RegistrySearchHit> hits;
+    for (const RegistryChange& change : tree)
+    {
+        if (change.kind == RegistryChange::SET_VALUE && change.value.type == VALUE_DWORD)
+        {
+            uint32_t number = DWordOf(change.value);
+            if (number >= low && number <= high)
+            {
+                hits.push_back({RegistrySearchHit::VALUE_DATA, change.path, change.name});
+            }
+        }
+    }
+    return hits;
+}
+
+struct SearchQuery
+{
+    const char* label;
+    const char* text; // Null for the number range
+    bool prefix;
+};
+
+static const SearchQuery SEARCH_QUERIES[] = {
+    {"rare dll substring", "probe42", false},
+    {"common dll substring", "Setting12.dll", false},
+    {"path prefix", "C:\\Windows\\", true},
+    {"clsid", "{0000002A-", false},
+    {"short substring", "g4", false},
+    {"dword range", nullptr, false},
+};
+
+// Runs every query on the index and by scanning; counts result mismatches
+static int CompareSearches(const RegistryIndex& index, const std::vector<RegistryChange>& tree, bool print)
+{
+    int failures = 0;
+    for (const SearchQuery& query : SEARCH_QUERIES)
+    {
+        std::vector<RegistrySearchHit> indexed, scanned;
+        double indexMs = MedianMs(3, [&]
+        {
+            if (query.text)
+            {
+                indexed = query.prefix ? index.FindPrefix(query.text) : index.FindSubstring(query.text);
+            }
+            else
+            {
+                indexed = index.FindNumberRange(1000, 1200);
+            }
+        });
+        double scanMs = MedianMs(1, [&]
+        {
+            scanned = query.text ? ScanSubstring(tree, query.text, query.prefix) : ScanNumberRange(tree, 1000, 1200);
+        });
+        if (print)
+        {
+            printf("%-22s %10zu %12.1f %12.1f\n", query.label, indexed.size(), indexMs * 1000, scanMs);
+        }
+        if (HitLines(indexed) != HitLines(scanned))
+        {
+            std::cerr << "search: '" << query.label << "' found " << indexed.size() << ", scanning found " << scanned.size() << "\n";
+            ++failures;
+        }
+    }
+    return failures;
+}
+
+// The fleet with per-host COM registrations to look for
+static void AddFleetServers(MemoryRegistryBackend& backend, int fleetValues)
+{
+    std::vector<RegistryChange> batch;
+    size_t failedIndex;
+    for (int host = 0; host < FleetHosts(fleetValues); ++host)
+    {
+        char clsid[48];
+        snprintf(clsid, sizeof(clsid), "{%08X-0000-0000-C000-000000000046}", host);
+        std::string key = FleetComponentKey(host, 0) + "\\InprocServer32";
+        batch.push_back({RegistryChange::CREATE_KEY, key, {}, {}});
+        batch.push_back({RegistryChange::SET_VALUE, key, "", RegistryValue::String("C:\\Windows\\System32\\probe" + std::to_string(host) + ".dll")});
+        batch.push_back({RegistryChange::SET_VALUE, key, "Clsid", RegistryValue::String(clsid)});
+    }
+    backend.ApplyChanges(batch, failedIndex);
+}
+
+// Updates fed from snapshot diffs on a small fleet, rewriting every value
+// until dead entries force rebuilds; answers must match a scan throughout
+static int CheckIndexChurn()
+{
+    int failures = 0;
+    const int fleetValues = 20000;
+    MemoryRegistryBackend backend;
+    BuildFleet(backend, fleetValues);
+    AddFleetServers(backend, fleetValues);
+
+    RegistryTree previous, current;
+    RegistryError error;
+    CaptureTree(backend.TakeSnapshot(), "", previous, error);
+    RegistryIndex index;
+    index.Build(previous);
+    for (int round = 0; round < 3; ++round)
+    {
+        std::vector<RegistryChange> churn;
+        for (int host = 0; host < FleetHosts(fleetValues); ++host)
+        {
+            for (int component = 0; component < FLEET_COMPONENTS; ++component)
+            {
+                for (int value = 0; value < FLEET_VALUES_PER_COMPONENT; ++value)
+                {
+                    churn.push_back({RegistryChange::SET_VALUE, FleetComponentKey(host, component), "Setting" + std::to_string(value),
+                                     value % 2 ? RegistryValue::DWord(1000 + round * 100 + value)
+                                               : RegistryValue::String("C:\\Windows\\Round" + std::to_string(round) + "\\probe" +
+                                                                       std::to_string(host * 100 + value))});
+                }
+            }
+        }
+        size_t failedIndex;
+        backend.ApplyChanges(churn, failedIndex);
+
+        std::vector<RegistryDelta> delta;
+        std::vector<RegistryChange> exported;
+        CaptureTree(backend.TakeSnapshot(), "", current, error);
+        DiffTrees(previous, current, delta);
+        index.Apply(delta);
+        backend.Export(exported);
+        failures += CompareSearches(index, exported, false);
+        std::swap(previous, current);
+    }
+    if (index.GetStats().rebuilds == 0)
+    {
+        std::cerr << "search: rewriting every value never rebuilt the index\n";
+        ++failures;
+    }
+    return failures;
+}
+
+static int RunSearchBench(int fleetValues)
+{
+    int failures = 0;
+    MemoryRegistryBackend backend;
+    BuildFleet(backend, fleetValues);
+    AddFleetServers(backend, fleetValues);
+
+    RegistryTree tree;
+    RegistryError error;
+    std::vector<RegistryChange> exported;
+    CaptureTree(backend.TakeSnapshot(), "", tree, error);
+    backend.Export(exported);
+
+    RegistryIndex index;
+    double buildMs = MedianMs(1, [&] { index.Build(tree); });
+    RegistryIndex::Stats stats = index.GetStats();
+    printf("\nindex: %llu keys, %llu values, %llu texts, %llu postings, built in %.0f ms\n",
+           static_cast<unsigned long long>(stats.keys), static_cast<unsigned long long>(stats.values),
+           static_cast<unsigned long long>(stats.liveEntries), static_cast<unsigned long long>(stats.postings), buildMs);
+    printf("%-22s %10s %12s %12s\n", "query", "hits", "index us", "scan ms");
+    failures += CompareSearches(index, exported, true);
+
+    // Incremental: a drift batch goes to the backend and the index, which
+    // must then answer like a scan of the new tree
+    PathGenerator random(0x1DE);
+    std::vector<RegistryChange> drift;
+    std::unordered_set<std::string> deleted;
+    int hosts = FleetHosts(fleetValues);
+    for (int i = 0; i < 2000; ++i)
+    {
+        std::string key = FleetComponentKey(random.Next(hosts), 1 + random.Next(FLEET_COMPONENTS - 1));
+        std::string name = "Setting" + std::to_string(random.Next(FLEET_VALUES_PER_COMPONENT));
+        if (i % 4 == 3)
+        {
+            // Deleting a value twice would fail the batch
+            if (deleted.insert(key + '\n' + name).second)
+            {
+                drift.push_back({RegistryChange::DELETE_VALUE, key, name, {}});
+            }
+        }
+        else
+        {
+            deleted.erase(key + '\n' + name);
+            drift.push_back({RegistryChange::SET_VALUE, key, name,
+                             i % 2 ? RegistryValue::DWord(1000 + i) : RegistryValue::String("D:\\probe42\\moved.dll")});
+        }
+    }
+    std::string server = FleetComponentKey(42 % hosts, 0) + "\\InprocServer32";
+    drift.push_back({RegistryChange::DELETE_VALUE, server, "", {}});
+    drift.push_back({RegistryChange::DELETE_VALUE, server, "Clsid", {}});
+    drift.push_back({RegistryChange::DELETE_KEY, server, {}, {}});
+    size_t failedIndex;
+    if (backend.ApplyChanges(drift, failedIndex) != REGISTRY_SUCCESS)
+    {
+        std::cerr << "search: drift batch failed at " << failedIndex << "\n";
+        return failures + 1;
+    }
+    double updateMs = MedianMs(1, [&] { index.Apply(drift); });
+    exported.clear();
+    backend.Export(exported);
+    printf("%zu changes applied to the index in %.1f ms\n", drift.size(), updateMs);
+    failures += CompareSearches(index, exported, false);
+
+    return failures + CheckIndexChurn();
+}
+
+static void PrintApplyStats(const char* label, double ms, const BundleApplyStats& stats)
+{
+    printf("%-22s %10.1f ms  %8llu keys created %8llu deleted %8llu values written %8llu deleted %8llu skipped\n", label,
+           ms, static_cast<unsigned long long>(stats.keysCreated), static_cast<unsigned long long>(stats.keysDeleted),
+           static_cast<unsigned long long>(stats.valuesWritten), static_cast<unsigned long long>(stats.valuesDeleted),
+           static_cast<unsigned long long>(stats.skipped));
+}
+
+static bool SameBundle(const RegistryBundle& a, const RegistryBundle& b)
+{
+    if (a.keys.size() != b.keys.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < a.keys.size(); ++i)
+    {
+        const RegistryBundle::Key& x = a.keys[i];
+        const RegistryBundle::Key& y = b.keys[i];
+        if (x.path != y.path || x.removeFirst != y.removeFirst || x.create != y.create || x.values.size() != y.values.size())
+        {
+            return false;
+        }
+        for (size_t j = 0; j < x.values.size(); ++j)
+        {
+            if (x.values[j].name != y.values[j].name || x.values[j].remove != y.values[j].remove ||
+                x.values[j].value != y.values[j].value || x.values[j].hash != y.values[j].hash)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Key removal and recreation, value removal, the hex types, short hive names,
+// UTF-16 input and parse errors on a small hand-written file
+static int CheckBundleSemantics()
+{
+    const char* text =
+        "Windows Registry Editor Version 5.00\r\n"
+        "\r\n"
+        "; Written and removed again in the same file\r\n"
+        "[HKCU\\Software\\Bundle\\Old]\r\n"
+        "\"Stale\"=\"x\"\r\n"
+        "\r\n"
+        "[-HKEY_CURRENT_USER\\Software\\Bundle\\Old]\r\n"
+        "\r\n"
+        "[HKEY_CURRENT_USER\\Software\\Bundle\\Menu]\r\n"
+        "@=\"Say \\\"hi\\\"\"\r\n"
+        "\"Count\"=dword:00000001\r\n"
+        "\"Count\"=dword:0000000a\r\n"
+        "\"Path\"=hex(2):25,00,41,00,25,00,00,00\r\n"
+        "\"List\"=hex(7):61,00,00,00,62,00,00,00,00,00\r\n"
+        "\"Blob\"=hex:00,01,02,03,04,05,06,07,08,09,0a,0b,0c,0d,0e,0f,10,11,12,13,14,15,16,\\\r\n"
+        "  17,18,19\r\n"
+        "\"Gone\"=-\r\n"
+        "\r\n"
+        "[-HKEY_CURRENT_USER\\Software\\Bundle\\Menu\\Sub]\r\n"
+        "\r\n"
+        "[HKEY_CURRENT_USER\\Software\\Bundle\\Menu\\Sub\\command]\r\n"
+        "@=\"notepad.exe\"\r\n"
+        "\r\n"
+        "[HKEY_LOCAL_MACHINE\\SOFTWARE\\Elsewhere]\r\n"
+        "\"Ignored\"=dword:1\r\n";
+
+    int failures = 0;
+    RegistryError error;
+    std::vector<RegistryDelta> entries;
+    RegistryBundle bundle;
+    if (!ParseRegFile(text, "semantics.reg", entries, error))
+    {
+        std::cerr << "bundle: " << error.Message() << "\n";
+        return 1;
+    }
+    CompileBundle(entries, bundle);
+
+    // The same file as regedit saves it: UTF-16LE with a byte order mark
+    std::string wide = "\xFF\xFE";
+    for (const char* p = text; *p; ++p)
+    {
+        wide += *p;
+        wide += '\0';
+    }
+    std::vector<RegistryDelta> wideEntries;
+    RegistryBundle wideBundle;
+    if (!ParseRegFile(wide, "wide.reg", wideEntries, error) || (CompileBundle(wideEntries, wideBundle), !SameBundle(bundle, wideBundle)))
+    {
+        std::cerr << "bundle: UTF-16 input does not compile to the same bundle\n";
+        ++failures;
+    }
+
+    auto backend = std::make_shared<MemoryRegistryBackend>();
+    std::vector<RegistryChange> setup{
+        {RegistryChange::CREATE_KEY, "Software\\Bundle\\Old", {}, {}},
+        {RegistryChange::SET_VALUE, "Software\\Bundle\\Old", "Keep", RegistryValue::String("1")},
+        {RegistryChange::CREATE_KEY, "Software\\Bundle\\Menu\\Sub\\Extra\\Deep", {}, {}},
+        {RegistryChange::CREATE_KEY, "Software\\Bundle\\Menu\\Sub\\command", {}, {}},
+        {RegistryChange::SET_VALUE, "Software\\Bundle\\Menu", "Gone", RegistryValue::String("bye")},
+        {RegistryChange::SET_VALUE, "Software\\Bundle\\Menu", "Count", RegistryValue::DWord(10)},
+        {RegistryChange::SET_VALUE, "Software\\Bundle\\Menu", "Other", RegistryValue::DWord(5)},
+        {RegistryChange::SET_VALUE, "Software\\Bundle\\Menu\\Sub", "Junk", RegistryValue::String("x")},
+        {RegistryChange::SET_VALUE, "Software\\Bundle\\Menu\\Sub\\command", "", RegistryValue::String("calc.exe")},
+        {RegistryChange::SET_VALUE, "Software\\Bundle\\Menu\\Sub\\command", "Stale", RegistryValue::String("y")},
+    };
+    MemoryRegistryBackend expected;
+    std::string blob;
+    for (int i = 0; i < 26; ++i)
+    {
+        blob += static_cast<char>(i);
+    }
+    std::vector<RegistryChange> target{
+        {RegistryChange::CREATE_KEY, "Software\\Bundle\\Menu\\Sub\\command", {}, {}},
+        {RegistryChange::SET_VALUE, "Software\\Bundle\\Menu", "", RegistryValue::String("Say \"hi\"")},
+        {RegistryChange::SET_VALUE, "Software\\Bundle\\Menu", "Count", RegistryValue::DWord(10)},
+        {RegistryChange::SET_VALUE, "Software\\Bundle\\Menu", "Other", RegistryValue::DWord(5)},
+        {RegistryChange::SET_VALUE, "Software\\Bundle\\Menu", "Path", {VALUE_EXPAND_STRING, "%A%"}},
+        {RegistryChange::SET_VALUE, "Software\\Bundle\\Menu", "List", {VALUE_MULTI_STRING, std::string("a\0b", 3)}},
+        {RegistryChange::SET_VALUE, "Software\\Bundle\\Menu", "Blob", {VALUE_BINARY, blob}},
+        {RegistryChange::SET_VALUE, "Software\\Bundle\\Menu\\Sub\\command", "", RegistryValue::String("notepad.exe")},
+    };
+    size_t failedIndex;
+    backend->ApplyChanges(setup, failedIndex);
+    expected.ApplyChanges(target, failedIndex);
+
+    RegistryTransaction transaction(backend, nullptr);
+    BundleApplyStats first, second;
+    RegistryTree applied, wanted;
+    bool ok = ApplyBundle(transaction, bundle, "HKEY_CURRENT_USER", first, error) &&
+              CaptureTree(*backend, "Software\\Bundle", applied, error) &&
+              CaptureTree(expected, "Software\\Bundle", wanted, error);
+    if (!ok || applied.RootHash() != wanted.RootHash())
+    {
+        std::cerr << "bundle: applying the small bundle does not give the expected tree " << error.Message() << "\n";
+        ++failures;
+    }
+    if (first.keysCreated != 0 || first.keysDeleted != 3 || first.valuesWritten != 5 || first.valuesDeleted != 3 ||
+        first.skipped != 3 || first.keysIgnored != 1)
+    {
+        PrintApplyStats("small bundle", 0, first);
+        std::cerr << "bundle: unexpected counts for the small bundle\n";
+        ++failures;
+    }
+    if (!ApplyBundle(transaction, bundle, "HKEY_CURRENT_USER", second, error) || second.keysCreated != 0 ||
+        second.keysDeleted != 0 || second.valuesWritten != 0 || second.valuesDeleted != 0 || second.skipped != 11)
+    {
+        PrintApplyStats("small bundle again", 0, second);
+        std::cerr << "bundle: applying the small bundle twice changed something\n";
+        ++failures;
+    }
+
+    // Errors point at the line
+    const std::pair<const char*, const char*> broken[] = {
+        {"[HKEY_CURRENT_USER\\A]\r\n", "bad.reg:1"},
+        {"REGEDIT4\n\n\"Orphan\"=\"x\"\n", "bad.reg:3"},
+        {"REGEDIT4\n[HKEY_CURRENT_USER\\A]\n\"Fine\"=dword:1\n\"X\"=dword:xyz\n", "bad.reg:4"},
+        {"REGEDIT4\n[HKEY_CURRENT_USER\\A]\n\"Bin\"=hex:01,\\\n  0g\n", "bad.reg:3"},
+        {"REGEDIT4\n[HKEY_CURRENT_USER\\A]\n\"Open=\"x\"\n", "bad.reg:3"},
+    };
+    for (const auto& [source, where] : broken)
+    {
+        entries.clear();
+        RegistryError parseError;
+        if (ParseRegFile(source, "bad.reg", entries, parseError) || KeyPathOf(parseError.keyPathId) != where)
+        {
+            std::cerr << "bundle: expected a parse error at " << where << ", got '" << parseError.Message() << "'\n";
+            ++failures;
+        }
+    }
+    return failures;
+}
+
+// The repository's own context-menus.reg against HKEY_CLASSES_ROOT. CMake
+// builds know the source directory, so the file is found whatever directory
+// the bench runs from; other builds look next to and above it.
+static int CheckContextMenus()
+{
+    std::string fileName;
+#ifdef REGISTRY_BENCH_SOURCE_DIR
+    const std::string sourceFile = std::string(REGISTRY_BENCH_SOURCE_DIR) + "/context-menus.reg";
+    for (const char* candidate : {sourceFile.c_str(), "context-menus.reg"})
+#else
+    for (const char* candidate : {"context-menus.reg", "../context-menus.reg", "../../context-menus.reg"})
+#endif
+    {
+        if (std::filesystem::exists(candidate))
+        {
+            fileName = candidate;
+            break;
+        }
+    }
+    if (fileName.empty())
+    {
+        printf("context-menus.reg not found, skipped\n");
+        return 0;
+    }
+
+    RegistryError error;
+    std::vector<RegistryDelta> entries;
+    RegistryBundle bundle;
+    if (!ReadRegFile(fileName, entries, error))
+    {
+        std::cerr << "bundle: " << error.Message() << "\n";
+        return 1;
+    }
+    CompileBundle(entries, bundle);
+    size_t values = std::count_if(entries.begin(), entries.end(),
+                                  [](const RegistryDelta& entry) { return entry.kind == RegistryDelta::VALUE_ADDED; });
+
+    int failures = 0;
+    auto backend = std::make_shared<MemoryRegistryBackend>();
+    RegistryTransaction transaction(backend, nullptr);
+    BundleApplyStats first, second;
+    RegistryValue command;
+    if (!ApplyBundle(transaction, bundle, "HKEY_CLASSES_ROOT", first, error) || first.valuesWritten != values ||
+        first.keysCreated != bundle.keys.size() ||
+        backend->QueryValue("Directory\\shell\\Open it\\command", "", command) != REGISTRY_SUCCESS ||
+        command != RegistryValue::String("explorer.exe %1"))
+    {
+        std::cerr << "bundle: context-menus.reg did not apply as written " << error.Message() << "\n";
+        ++failures;
+    }
+    if (!ApplyBundle(transaction, bundle, "HKEY_CLASSES_ROOT", second, error) || second.valuesWritten != 0 ||
+        second.keysCreated != 0 || second.skipped != bundle.OperationCount())
+    {
+        std::cerr << "bundle: context-menus.reg applied twice wrote again\n";
+        ++failures;
+    }
+    printf("context-menus.reg: %zu keys, %zu values; second apply skipped %llu of %zu operations\n", bundle.keys.size(),
+           values, static_cast<unsigned long long>(second.skipped), bundle.OperationCount());
+    return failures;
+}
+
+// Damaged and cut-off bundle files must not load
+static int CheckBundleFile(const std::string& fileName)
+{
+    int failures = 0;
+    std::string contents;
+    AppendLog::ReadFile(fileName, contents);
+    for (int damage = 0; damage < 2; ++damage)
+    {
+        std::string broken = contents;
+        if (damage == 0)
+        {
+            broken[broken.size() / 2] ^= 0x20;
+        }
+        else
+        {
+            broken.resize(broken.size() - 5);
+        }
+        std::ofstream(fileName, std::ios::binary | std::ios::trunc) << broken;
+        RegistryBundle bundle;
+        RegistryError error;
+        if (LoadBundle(fileName, bundle, error) || error.code != REGISTRY_CORRUPT)
+        {
+            std::cerr << "bundle: " << (damage == 0 ? "damaged" : "truncated") << " file was not detected\n";
+            ++failures;
+        }
+    }
+    std::filesystem::remove(fileName);
+    return failures;
+}
+
+static int RunBundleBench(int iterations, int fleetValues)
+{
+    int failures = 0;
+    int values = std::max(1000, fleetValues / 10);
+    MemoryRegistryBackend source;
+    BuildFleet(source, values);
+    RegistryTree tree;
+    RegistryError error;
+    CaptureTree(source.TakeSnapshot(), "", tree, error);
+
+    // The fleet as one .reg file, the way it is deployed today
+    RegistryTree empty;
+    empty.keys.push_back({std::string(), 0, 0, 0, 0, 0});
+    std::vector<RegistryDelta> everything;
+    DiffTrees(empty, tree, everything);
+    std::string regText = FormatRegPatch(everything, "HKEY_LOCAL_MACHINE\\SOFTWARE");
+    everything.clear();
+
+    std::vector<RegistryDelta> entries;
+    double parseMs = MedianMs(iterations, [&]
+    {
+        entries.clear();
+        ParseRegFile(regText, "fleet.reg", entries, error);
+    });
+    RegistryBundle bundle;
+    double compileMs = MedianMs(iterations, [&] { CompileBundle(entries, bundle); });
+
+    std::string fileName = (std::filesystem::temp_directory_path() / "RegistryBench.bundle").string();
+    RegistryBundle loaded;
+    double saveMs = MedianMs(1, [&] { SaveBundle(bundle, fileName, error); });
+    double loadMs = MedianMs(iterations, [&] { LoadBundle(fileName, loaded, error); });
+    uint64_t bundleBytes = std::filesystem::file_size(fileName);
+    if (!SameBundle(bundle, loaded))
+    {
+        std::cerr << "bundle: the loaded bundle differs from the saved one " << error.Message() << "\n";
+        ++failures;
+    }
+
+    printf("\nbundle: %zu keys, %zu operations; .reg %zu bytes, bundle %llu bytes\n", bundle.keys.size(),
+           bundle.OperationCount(), regText.size(), static_cast<unsigned long long>(bundleBytes));
+    printf("%-22s %10.1f ms  (%.0f MB/s)\n", "parse .reg", parseMs, regText.size() / 1e3 / parseMs);
+    printf("%-22s %10.1f ms\n", "compile", compileMs);
+    printf("%-22s %10.1f ms\n", "save bundle", saveMs);
+    printf("%-22s %10.1f ms\n", "load bundle", loadMs);
+
+    // First boot: everything is written
+    auto backend = std::make_shared<MemoryRegistryBackend>();
+    RegistryTransaction transaction(backend, nullptr);
+    BundleApplyStats stats;
+    RegistryTree applied;
+    double applyMs = MedianMs(1, [&] { ApplyBundle(transaction, loaded, "HKEY_LOCAL_MACHINE\\SOFTWARE", stats, error); });
+    PrintApplyStats("apply (empty)", applyMs, stats);
+    if (!CaptureTree(*backend, "", applied, error) || applied.RootHash() != tree.RootHash())
+    {
+        std::cerr << "bundle: applying the parsed .reg does not reproduce the tree " << error.Message() << "\n";
+        ++failures;
+    }
+
+    // Every later boot today: rewrite every key and value
+    double rewriteMs = MedianMs(1, [&]
+    {
+        for (const RegistryDelta& entry : entries)
+        {
+            std::string path = entry.path.substr(strlen("HKEY_LOCAL_MACHINE\\SOFTWARE\\"));
+            if (entry.kind == RegistryDelta::KEY_ADDED)
+            {
+                transaction.CreateKey(path);
+            }
+            else
+            {
+                transaction.WriteValue(path, entry.name, entry.newValue);
+            }
+        }
+        transaction.Commit(error);
+    });
+    printf("%-22s %10.1f ms  %8zu writes\n", "rewrite everything", rewriteMs, entries.size());
+
+    // With the bundle, an unchanged host costs reads only
+    double againMs = MedianMs(1, [&] { ApplyBundle(transaction, loaded, "HKEY_LOCAL_MACHINE\\SOFTWARE", stats, error); });
+    PrintApplyStats("apply (unchanged)", againMs, stats);
+    if (stats.keysCreated + stats.keysDeleted + stats.valuesWritten + stats.valuesDeleted != 0 ||
+        stats.skipped != loaded.OperationCount())
+    {
+        std::cerr << "bundle: applying to an unchanged tree wrote something\n";
+        ++failures;
+    }
+
+    // A drifted host gets back exactly what drifted
+    std::vector<RegistryChange> drift;
+    size_t drifted = std::min<size_t>(std::max(1, values / 1000), FleetHosts(values) * FLEET_COMPONENTS);
+    for (size_t i = 0; i < drifted; ++i)
+    {
+        std::string key = FleetComponentKey(static_cast<int>(i % FleetHosts(values)),
+                                            static_cast<int>(i / FleetHosts(values)));
+        drift.push_back({RegistryChange::SET_VALUE, key, "Setting1", RegistryValue::DWord(0xBAD00000 + static_cast<uint32_t>(i))});
+    }
+    drift.push_back({RegistryChange::DELETE_VALUE, FleetComponentKey(0, 0), "Setting2", {}});
+    size_t failedIndex;
+    backend->ApplyChanges(drift, failedIndex);
+    double driftMs = MedianMs(1, [&] { ApplyBundle(transaction, loaded, "HKEY_LOCAL_MACHINE\\SOFTWARE", stats, error); });
+    PrintApplyStats("apply (drifted)", driftMs, stats);
+    applied = RegistryTree();
+    if (stats.valuesWritten != drift.size() || !CaptureTree(*backend, "", applied, error) ||
+        applied.RootHash() != tree.RootHash())
+    {
+        std::cerr << "bundle: drift was not repaired exactly\n";
+        ++failures;
+    }
+
+    return failures + CheckBundleFile(fileName) + CheckBundleSemantics() + CheckContextMenus();
+}
+
+// Reference decoder for the text checks, written against the definition
+// rather than the decoder's tables: a prefix of a sequence can be continued
+// when some valid code point of that length starts with its bits, and an
+// invalid sequence is replaced up to its longest prefix that can
+struct ReferenceResult
+{
+    bool ok = true;
+    size_t errorOffset = 0;
+    std::u16string units;
+};
+
+static bool PrefixCanContinue(const uint8_t* bytes, size_t prefix, size_t length)
+{
+    static const uint32_t MIN_FOR_LENGTH[] = {0, 0, 0x80, 0x800, 0x10000};
+    uint32_t low = bytes[0] & (0x7F >> length);
+    for (size_t k = 1; k < prefix; ++k)
+    {
+        low = (low << 6) | (bytes[k] & 0x3F);
+    }
+    uint32_t high = low;
+    for (size_t k = prefix; k < length; ++k)
+    {
+        low <<= 6;
+        high = (high << 6) | 0x3F;
+    }
+    low = std::max(low, MIN_FOR_LENGTH[length]);
+    high = std::min<uint32_t>(high, 0x10FFFF);
+    if (low > high)
+    {
+        return false;
+    }
+    // Something in [low, high] outside the surrogates
+    return low < 0xD800 || high > 0xDFFF;
+}
+
+static ReferenceResult ReferenceUtf8ToUtf16(std::string_view text, InvalidText invalid)
+{
+    ReferenceResult result;
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(text.data());
+    size_t i = 0;
+    while (i < text.size())
+    {
+        uint8_t lead = bytes[i];
+        size_t length = lead < 0x80 ? 1 : (lead >> 5) == 0x6 ? 2 : (lead >> 4) == 0xE ? 3 : (lead >> 3) == 0x1E ? 4 : 0;
+        size_t viable = 0;
+        if (length == 1)
+        {
+            viable = 1;
+        }
+        else if (length > 1)
+        {
+            for (size_t prefix = 1; prefix <= length && i + prefix <= text.size(); ++prefix)
+            {
+                if ((prefix > 1 && (bytes[i + prefix - 1] & 0xC0) != 0x80) || !PrefixCanContinue(bytes + i, prefix, length))
+                {
+                    break;
+                }
+                viable = prefix;
+            }
+        }
+
+        if (length != 0 && viable == length)
+        {
+            uint32_t cp = length == 1 ? lead : lead & (0x7F >> length);
+            for (size_t k = 1; k < length; ++k)
+            {
+                cp = (cp << 6) | (bytes[i + k] & 0x3F);
+            }
+            if (cp >= 0x10000)
+            {
+                result.units += static_cast<char16_t>(0xD800 + ((cp - 0x10000) >> 10));
+                result.units += static_cast<char16_t>(0xDC00 + ((cp - 0x10000) & 0x3FF));
+            }
+            else
+            {
+                result.units += static_cast<char16_t>(cp);
+            }
+            i += length;
+            continue;
+        }
+        if (invalid == InvalidText::Fail)
+        {
+            result.ok = false;
+            result.errorOffset = i;
+            return result;
+        }
+        result.units += char16_t(0xFFFD);
+        i += std::max<size_t>(viable, 1);
+    }
+    return result;
+}
+
+static std::string ReferenceUtf16ToUtf8(std::u16string_view text, bool& ok, size_t& errorOffset, InvalidText invalid)
+{
+    std::string out;
+    ok = true;
+    for (size_t i = 0; i < text.size(); ++i)
+    {
+        uint32_t cp = text[i];
+        bool high = cp >= 0xD800 && cp <= 0xDBFF;
+        bool paired = high && i + 1 < text.size() && text[i + 1] >= 0xDC00 && text[i + 1] <= 0xDFFF;
+        if (paired)
+        {
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (text[++i] - 0xDC00);
+        }
+        else if (cp >= 0xD800 && cp <= 0xDFFF)
+        {
+            if (invalid == InvalidText::Fail)
+            {
+                ok = false;
+                errorOffset = i;
+                return out;
+            }
+            cp = 0xFFFD;
+        }
+        int length = cp < 0x80 ? 1 : cp < 0x800 ? 2 : cp < 0x10000 ? 3 : 4;
+        static const uint8_t LEAD[] = {0, 0x00, 0xC0, 0xE0, 0xF0};
+        for (int k = length - 1; k >= 0; --k)
+        {
+            uint32_t bits = (cp >> (6 * k)) & (k == length - 1 ? 0xFF : 0x3F);
+            out += static_cast<char>(k == length - 1 ? (LEAD[length] | bits) : (0x80 | bits));
+        }
+    }
+    return out;
+}
+
+static void AppendCodePoint(std::string& out, uint32_t cp)
+{
+    std::u16string units;
+    if (cp >= 0x10000)
+    {
+        units = {static_cast<char16_t>(0xD800 + ((cp - 0x10000) >> 10)), static_cast<char16_t>(0xDC00 + ((cp - 0x10000) & 0x3FF))};
+    }
+    else
+    {
+        units = {static_cast<char16_t>(cp)};
+    }
+    bool ok;
+    size_t offset;
+    out += ReferenceUtf16ToUtf8(units, ok, offset, InvalidText::Replace);
+}
+
+// Mostly well-formed text with ASCII runs long enough to reach the SIMD
+// kernels, broken up by multi-byte characters and by damage that real
+// input has: stray continuation bytes, truncated sequences, overlong forms,
+// encoded surrogates and bytes that never appear in UTF-8
+static std::string FuzzUtf8(PathGenerator& random)
+{
+    std::string out;
+    int pieces = 1 + random.Next(12);
+    for (int p = 0; p < pieces; ++p)
+    {
+        switch (random.Next(10))
+        {
+            case 0: case 1: case 2:
+                for (uint32_t n = random.Next(70); n > 0; --n)
+                {
+                    out += static_cast<char>(0x20 + random.Next(95));
+                }
+                break;
+            case 3: AppendCodePoint(out, 0x80 + random.Next(0x780)); break;
+            case 4: AppendCodePoint(out, 0x800 + random.Next(0xD000)); break;
+            case 5: AppendCodePoint(out, 0x10000 + random.Next(0x100000)); break;
+            case 6: out += static_cast<char>(random.Next(256)); break;
+            case 7:
+            {
+                std::string full;
+                AppendCodePoint(full, 0x80 + random.Next(0x10FF80));
+                out += full.substr(0, random.Next(static_cast<uint32_t>(full.size())));
+                break;
+            }
+            case 8:
+            {
+                static const char* const BAD[] = {"\xC0\xAF", "\xE0\x80\xAF", "\xED\xA0\x80", "\xED\xBF\xBF", "\xF4\x90\x80\x80",
+                                                  "\xF0\x8F\xBF\xBF", "\xC1\xBF", "\xF5\x80", "\xFF", "\x80\x80"};
+                out += BAD[random.Next(10)];
+                break;
+            }
+            default:
+                // A valid boundary case
+                static const uint32_t EDGES[] = {0x7F, 0x80, 0x7FF, 0x800, 0xD7FF, 0xE000, 0xFFFD, 0xFFFF, 0x10000, 0x10FFFF};
+                AppendCodePoint(out, EDGES[random.Next(10)]);
+                break;
+        }
+    }
+    return out;
+}
+
+static std::u16string FuzzUtf16(PathGenerator& random)
+{
+    std::u16string out;
+    int pieces = 1 + random.Next(12);
+    for (int p = 0; p < pieces; ++p)
+    {
+        switch (random.Next(6))
+        {
+            case 0: case 1: case 2:
+                for (uint32_t n = random.Next(70); n > 0; --n)
+                {
+                    out += static_cast<char16_t>(0x20 + random.Next(95));
+                }
+                break;
+            case 3: out += static_cast<char16_t>(0x80 + random.Next(0xFF80)); break;
+            case 4: out += static_cast<char16_t>(0xD800 + random.Next(0x800)); break; // Often unpaired
+            default:
+            {
+                uint32_t cp = 0x10000 + random.Next(0x100000);
+                out += static_cast<char16_t>(0xD800 + ((cp - 0x10000) >> 10));
+                out += static_cast<char16_t>(0xDC00 + ((cp - 0x10000) & 0x3FF));
+                break;
+            }
+        }
+    }
+    return out;
+}
+
+static int FuzzTextKernels(int cases)
+{
+    int failures = 0;
+    PathGenerator random(0x7E47u);
+    for (int c = 0; c < cases && failures < 10; ++c)
+    {
+        std::string utf8 = FuzzUtf8(random);
+        std::u16string utf16 = FuzzUtf16(random);
+        for (int k = 0; k <= static_cast<int>(BestTextKernel()); ++k)
+        {
+            SetTextKernel(static_cast<TextKernel>(k));
+            for (InvalidText invalid : {InvalidText::Fail, InvalidText::Replace})
+            {
+                ReferenceResult expected = ReferenceUtf8ToUtf16(utf8, invalid);
+                std::u16string units;
+                size_t errorOffset = SIZE_MAX;
+                bool ok = Utf8ToUtf16(utf8, units, invalid, &errorOffset);
+                bool same = ok == expected.ok && units == expected.units && (ok || errorOffset == expected.errorOffset);
+
+                bool expectedOk;
+                size_t expectedOffset = SIZE_MAX;
+                std::string expectedBytes = ReferenceUtf16ToUtf8(utf16, expectedOk, expectedOffset, invalid);
+                std::string bytes;
+                errorOffset = SIZE_MAX;
+                ok = Utf16ToUtf8(utf16, bytes, invalid, &errorOffset);
+                same = same && ok == expectedOk && bytes == expectedBytes && (ok || errorOffset == expectedOffset);
+
+                if (!same)
+                {
+                    std::cerr << "text: case " << c << " differs from the reference with the "
+                              << TextKernelName(static_cast<TextKernel>(k)) << " kernel\n";
+                    ++failures;
+                }
+            }
+
+            // Valid text survives a round trip, and the other entry points agree with the reference
+            ReferenceResult strict = ReferenceUtf8ToUtf16(utf8, InvalidText::Fail);
+            ReferenceResult replaced = ReferenceUtf8ToUtf16(utf8, InvalidText::Replace);
+            std::u16string units;
+            std::string back;
+            if (strict.ok && (!Utf8ToUtf16(utf8, units) || !Utf16ToUtf8(units, back) || back != utf8))
+            {
+                std::cerr << "text: case " << c << " does not survive a round trip\n";
+                ++failures;
+            }
+            std::string decoded;
+            for (size_t offset = 0; offset < utf8.size();)
+            {
+                AppendCodePoint(decoded, NextCodePoint(utf8, offset));
+            }
+            bool ascii = std::all_of(utf8.begin(), utf8.end(), [](char ch) { return static_cast<unsigned char>(ch) < 0x80; });
+            bool ok;
+            size_t offset;
+            if (IsValidUtf8(utf8) != strict.ok || IsAscii(utf8) != ascii ||
+                decoded != ReferenceUtf16ToUtf8(replaced.units, ok, offset, InvalidText::Replace))
+            {
+                std::cerr << "text: case " << c << " is classified differently from the reference\n";
+                ++failures;
+            }
+        }
+    }
+    SetTextKernel(BestTextKernel());
+    return failures;
+}
+
+// Registry-like text in four scripts, each about 4 MB of UTF-8
+static std::string TextCorpus(const char* script, size_t size)
+{
+    PathGenerator random(0xC0C0u);
+    std::string out;
+    while (out.size() < size)
+    {
+        if (!strcmp(script, "ascii"))
+        {
+            out += random.Path(0) + "\\";
+        }
+        else if (!strcmp(script, "latin"))
+        {
+            out += "Ger\xC3\xA4te\\Einstellungen\\Schl\xC3\xBCssel" + std::to_string(random.Next(1000)) + "\\";
+        }
+        else if (!strcmp(script, "cjk"))
+        {
+            for (int i = 0; i < 12; ++i)
+            {
+                AppendCodePoint(out, 0x4E00 + random.Next(0x5000));
+            }
+            out += "\\";
+        }
+        else
+        {
+            for (int i = 0; i < 8; ++i)
+            {
+                AppendCodePoint(out, 0x1F300 + random.Next(0x300));
+            }
+            out += " ";
+        }
+    }
+    return out;
+}
+
+static int RunTextBench(int iterations, int fuzzCases)
+{
+    int failures = 0;
+    const size_t corpusSize = 4 << 20;
+    printf("\nbest kernel: %s\n", TextKernelName(BestTextKernel()));
+    printf("%-8s %-8s %14s %14s %14s\n", "text", "kernel", "utf8->16 GB/s", "utf16->8 GB/s", "validate GB/s");
+    for (const char* script : {"ascii", "latin", "cjk", "emoji"})
+    {
+        std::string utf8 = TextCorpus(script, corpusSize);
+        std::u16string utf16;
+        std::u16string expected;
+        Utf8ToUtf16(utf8, expected);
+        for (int k = 0; k <= static_cast<int>(BestTextKernel()); ++k)
+        {
+            SetTextKernel(static_cast<TextKernel>(k));
+            std::string back;
+            bool ok = true;
+            double toUtf16Ms = MedianMs(iterations, [&] { ok = Utf8ToUtf16(utf8, utf16) && ok; });
+            double toUtf8Ms = MedianMs(iterations, [&] { ok = Utf16ToUtf8(utf16, back) && ok; });
+            double validateMs = MedianMs(iterations, [&] { ok = IsValidUtf8(utf8) && ok; });
+            if (!ok || utf16 != expected || back != utf8)
+            {
+                std::cerr << "text: " << script << " does not convert the same with the "
+                          << TextKernelName(static_cast<TextKernel>(k)) << " kernel\n";
+                ++failures;
+            }
+            // Throughput counts UTF-8 bytes in both directions
+            double gb = utf8.size() / 1e9;
+            printf("%-8s %-8s %14.2f %14.2f %14.2f\n", script, TextKernelName(static_cast<TextKernel>(k)),
+                   gb / (toUtf16Ms / 1000), gb / (toUtf8Ms / 1000), gb / (validateMs / 1000));
+        }
+    }
+    SetTextKernel(BestTextKernel());
+
+    auto start = std::chrono::steady_clock::now();
+    failures += FuzzTextKernels(fuzzCases);
+    double fuzzMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    printf("fuzz: %d cases against the reference on every kernel in %.0f ms\n", fuzzCases, fuzzMs);
+
+    // String types written as hex in .reg patches come back with their non-ASCII characters
+    std::vector<RegistryDelta> delta = {
+        {RegistryDelta::KEY_ADDED, "J\xC3\xBCrgen", {}, {}, {}},
+        {RegistryDelta::VALUE_ADDED, "J\xC3\xBCrgen", "Pfad", {}, {VALUE_EXPAND_STRING, "%USERPROFILE%\\Ger\xC3\xA4te \xE2\x82\xAC"}},
+        {RegistryDelta::VALUE_ADDED, "J\xC3\xBCrgen", "Liste", {}, {VALUE_MULTI_STRING, std::string("\xE6\x97\xA5\0\xF0\x9F\x8E\xB5", 8)}},
+    };
+    std::vector<RegistryDelta> parsed;
+    RegistryError error;
+    if (!ParseRegFile(FormatRegPatch(delta, "HKEY_CURRENT_USER"), "patch.reg", parsed, error) || parsed.size() != 3 ||
+        parsed[1].newValue.data != delta[1].newValue.data || parsed[2].newValue.data != delta[2].newValue.data ||
+        parsed[0].path != "HKEY_CURRENT_USER\\J\xC3\xBCrgen")
+    {
+        std::cerr << "text: non-ASCII string values do not survive a .reg patch\n";
+        ++failures;
+    }
+    return failures;
+}
+
+// One "ph":"X" line of a Chrome trace as written by Trace::TakeChromeTrace
+struct TraceSpan
+{
+    std::string name;
+    double ts, dur;
+    unsigned tid;
+};
+
+static std::vector<TraceSpan> ParseTraceSpans(const std::string& json)
+{
+    std::vector<TraceSpan> spans;
+    std::istringstream lines(json);
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        const char* fields = strstr(line.c_str(), "\"ph\":\"X\"");
+        size_t nameEnd = line.find("\",\"cat\"");
+        TraceSpan span;
+        if (!fields || line.compare(0, 9, "{\"name\":\"") != 0 || nameEnd == std::string::npos ||
+            sscanf(fields, "\"ph\":\"X\",\"ts\":%lf,\"dur\":%lf,\"pid\":%*u,\"tid\":%u", &span.ts, &span.dur, &span.tid) != 3)
+        {
+            continue;
+        }
+        span.name = line.substr(9, nameEnd - 9);
+        spans.push_back(span);
+    }
+    return spans;
+}
+
+// Nanoseconds per loop iteration; body runs spans times, the rings are drained
+// between batches outside the timed part so none of them are dropped
+template <typename Fn>
+static double NsPerSpan(int iterations, int spans, Fn&& body)
+{
+    const int batch = 32 * 1024;
+    std::vector<double> samples;
+    for (int i = 0; i < iterations; ++i)
+    {
+        std::chrono::steady_clock::duration elapsed{};
+        for (int done = 0; done < spans; done += batch)
+        {
+            auto start = std::chrono::steady_clock::now();
+            for (int n = 0; n < batch; ++n)
+            {
+                body();
+            }
+            elapsed += std::chrono::steady_clock::now() - start;
+            Trace::TakeChromeTrace();
+        }
+        samples.push_back(std::chrono::duration<double, std::nano>(elapsed).count() / spans);
+    }
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+static int RunTraceBench(int iterations)
+{
+    int failures = 0;
+    const int spans = 1 << 20;
+    Trace::TakeChromeTrace(); // Nothing from earlier sections
+    Trace::SetThreadName("RegistryBench");
+
+    // The fence keeps the empty loop from being optimised away
+    auto empty = [] { std::atomic_signal_fence(std::memory_order_seq_cst); };
+    auto traced = []
+    {
+        LY_TRACE_SCOPE("bench.span", "bench");
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+    };
+    Trace::SetEnabled(false);
+    double emptyNs = NsPerSpan(iterations, spans, empty);
+    Trace::Stats before = Trace::GetStats();
+    double disabledNs = NsPerSpan(iterations, spans, traced);
+    if (Trace::GetStats().recorded != before.recorded)
+    {
+        std::cerr << "trace: spans were recorded while tracing was disabled\n";
+        ++failures;
+    }
+    // Naming a thread does not allocate its ring; only a recorded span does
+    size_t threadsBefore = Trace::GetStats().threads;
+    std::thread([&]
+    {
+        Trace::SetThreadName("named only");
+        traced();
+    }).join();
+    if (Trace::GetStats().threads != threadsBefore)
+    {
+        std::cerr << "trace: a thread that recorded nothing registered a ring\n";
+        ++failures;
+    }
+    Trace::SetEnabled(true);
+    double enabledNs = NsPerSpan(iterations, spans, traced);
+    printf("\n%-10s %10s\n", "span", "ns");
+    printf("%-10s %10.2f\n%-10s %10.2f\n%-10s %10.2f\n", "empty", emptyNs, "disabled", disabledNs - emptyNs, "enabled",
+           enabledNs - emptyNs);
+    if (enabledNs - emptyNs > 50)
+    {
+        std::cerr << "trace: warning, a span costs more than the 50 ns budget on this machine\n";
+    }
+
+    // Nested spans from several threads come out with their thread and inside their parent
+    const int threadCount = 4, inner = 100;
+    before = Trace::GetStats();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threadCount; ++t)
+    {
+        workers.emplace_back([t]
+        {
+            Trace::SetThreadName("worker " + std::to_string(t));
+            LY_TRACE_SCOPE("outer", "bench");
+            for (int i = 0; i < inner; ++i)
+            {
+                LY_TRACE_SCOPE("inner", "bench");
+                std::atomic_signal_fence(std::memory_order_seq_cst);
+            }
+        });
+    }
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+    {
+        static const Trace::Site escaped = { "say \"hi\"\\\n", "bench" };
+        Trace::Span span(escaped);
+    }
+    std::string json = Trace::TakeChromeTrace();
+    std::vector<TraceSpan> parsed = ParseTraceSpans(json);
+    std::map<unsigned, std::pair<double, double>> outers;
+    for (const TraceSpan& span : parsed)
+    {
+        if (span.name == "outer")
+        {
+            outers[span.tid] = {span.ts, span.ts + span.dur};
+        }
+    }
+    size_t nested = 0;
+    for (const TraceSpan& span : parsed)
+    {
+        auto outer = outers.find(span.tid);
+        if (span.name == "inner" && outer != outers.end() && span.ts >= outer->second.first &&
+            span.ts + span.dur <= outer->second.second)
+        {
+            ++nested;
+        }
+    }
+    uint64_t recorded = Trace::GetStats().recorded - before.recorded;
+    if (parsed.size() != threadCount * (inner + 1) + 1 || outers.size() != threadCount ||
+        nested != threadCount * inner || recorded != parsed.size() ||
+        json.find("\"args\":{\"name\":\"worker 3\"}") == std::string::npos ||
+        json.find("say \\\"hi\\\"\\\\\\u000a") == std::string::npos)
+    {
+        std::cerr << "trace: the Chrome trace does not hold the spans recorded (" << parsed.size() << " spans, "
+                  << nested << " nested)\n";
+        ++failures;
+    }
+
+    // A full ring drops instead of blocking the traced thread
+    before = Trace::GetStats();
+    const int overflow = 100000;
+    std::thread([&]
+    {
+        for (int i = 0; i < overflow; ++i)
+        {
+            LY_TRACE_SCOPE("overflow", "bench");
+        }
+    }).join();
+    Trace::Stats after = Trace::GetStats();
+    size_t kept = ParseTraceSpans(Trace::TakeChromeTrace()).size();
+    if (after.dropped - before.dropped + kept != overflow || kept != after.recorded - before.recorded || kept == 0 ||
+        kept == overflow)
+    {
+        std::cerr << "trace: a full ring did not drop and count the extra spans\n";
+        ++failures;
+    }
+
+    // TSC ticks are converted with the calibrated rate
+    {
+        LY_TRACE_SCOPE("sleep", "bench");
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    parsed = ParseTraceSpans(Trace::TakeChromeTrace());
+    if (parsed.size() != 1 || parsed[0].dur < 19000 || parsed[0].dur > 60000)
+    {
+        std::cerr << "trace: a 20 ms span was written as " << (parsed.empty() ? 0 : parsed[0].dur) << " us\n";
+        ++failures;
+    }
+    Trace::SetEnabled(false);
+    return failures;
+}
+
+// Nanoseconds per update with every thread doing updates of its own
+template <typename Fn>
+static double NsPerUpdate(int threads, int updates, Fn&& update)
+{
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&, t]
+        {
+            for (int i = 0; i < updates; ++i)
+            {
+                update(t, i);
+            }
+        });
+    }
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / updates;
+}
+
+static std::string ReadWholeFile(const std::string& fileName)
+{
+    std::ifstream in(fileName, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static int RunMetricsBench()
+{
+    int failures = 0;
+    const int updates = 2000000;
+
+    // Wall time per update on each thread; flat as threads are added means no contention
+    printf("\n%-8s %14s %14s %14s\n", "threads", "atomic ns", "counter ns", "histogram ns");
+    for (int threads : {1, 2, 4, 8})
+    {
+        std::atomic<uint64_t> shared{0};
+        Metrics::Counter& counter = Metrics::GetCounter("bench_updates_total", "threads=\"" + std::to_string(threads) + "\"", "Bench updates");
+        Metrics::Histogram& histogram = Metrics::GetHistogram("bench_update_values", "threads=\"" + std::to_string(threads) + "\"", "Bench values");
+        double atomicNs = NsPerUpdate(threads, updates, [&](int, int) { shared.fetch_add(1, std::memory_order_relaxed); });
+        double counterNs = NsPerUpdate(threads, updates, [&](int, int) { counter.Add(); });
+        double histogramNs = NsPerUpdate(threads, updates, [&](int t, int i) { histogram.Record(uint64_t(i) * 7 + t); });
+        if (counter.Value() != uint64_t(threads) * updates || histogram.Read().count != uint64_t(threads) * updates)
+        {
+            std::cerr << "metrics: " << threads << " threads lost updates\n";
+            ++failures;
+        }
+        printf("%-8d %14.2f %14.2f %14.2f\n", threads, atomicNs, counterNs, histogramNs);
+    }
+
+    // Every value lands in a bucket whose midpoint is within 1/32 of it
+    for (uint64_t value = 0; value < (1u << 22); value += 1 + value / 1000)
+    {
+        size_t bucket = Metrics::Histogram::BucketOf(value);
+        uint64_t mid = Metrics::Histogram::BucketMidpoint(bucket);
+        if (bucket >= Metrics::Histogram::BUCKETS || (mid > value ? mid - value : value - mid) * 32 > value ||
+            (value > 0 && bucket < Metrics::Histogram::BucketOf(value - 1)))
+        {
+            std::cerr << "metrics: " << value << " is in bucket " << bucket << " around " << mid << "\n";
+            ++failures;
+            break;
+        }
+    }
+
+    // Values past the range go to the overflow bucket, not into the last real one
+    const uint64_t lastInRange = (uint64_t(1) << 44) - 1;
+    if (Metrics::Histogram::BucketOf(lastInRange) >= Metrics::Histogram::OVERFLOW_BUCKET ||
+        Metrics::Histogram::BucketOf(lastInRange + 1) != Metrics::Histogram::OVERFLOW_BUCKET ||
+        Metrics::Histogram::BucketOf(UINT64_MAX) != Metrics::Histogram::OVERFLOW_BUCKET)
+    {
+        std::cerr << "metrics: values past 2^44 share a bucket with values in range\n";
+        ++failures;
+    }
+
+    // Quantiles against sorting the same latencies: log-normal-ish, 1 us to 1 s
+    Metrics::Histogram latencies(1e-9);
+    std::vector<uint64_t> values;
+    PathGenerator random(0x4D455452);
+    for (int i = 0; i < 200000; ++i)
+    {
+        uint64_t value = (uint64_t(1000) << random.Next(20)) + random.Next(1000000);
+        values.push_back(value);
+        latencies.Record(value);
+    }
+    std::sort(values.begin(), values.end());
+    Metrics::HistogramSnapshot snapshot = latencies.Read();
+    for (double q : {0.5, 0.9, 0.99, 0.999})
+    {
+        uint64_t exact = values[static_cast<size_t>(q * values.size() + 0.5) - 1];
+        uint64_t estimate = snapshot.Quantile(q);
+        if ((estimate > exact ? estimate - exact : exact - estimate) * 25 > exact)
+        {
+            std::cerr << "metrics: quantile " << q << " is " << estimate << ", exactly " << exact << "\n";
+            ++failures;
+        }
+    }
+
+    // RegistryManager counts its calls and failures
+    {
+        Metrics::Operation writes("registry_op", "WriteStringValue");
+        Metrics::Operation reads("registry_op", "ReadStringValue");
+        Metrics::Operation deletes("registry_op", "DeleteValue");
+        uint64_t writesBefore = writes.calls.Value(), readsBefore = reads.calls.Value();
+        uint64_t writeErrorsBefore = writes.errors.Value(), readErrorsBefore = reads.errors.Value();
+        uint64_t deletesBefore = deletes.calls.Value(), deleteErrorsBefore = deletes.errors.Value();
+        RegistryManager manager(std::make_shared<MemoryRegistryBackend>());
+        RegistryError error;
+        std::string data;
+        manager.CreateKey("Metrics", error);
+        for (int i = 0; i < 100; ++i)
+        {
+            manager.WriteStringValue("Metrics", "Value" + std::to_string(i), "data", error);
+        }
+        for (int i = 0; i < 100; ++i)
+        {
+            manager.ReadStringValue("Metrics", "Value" + std::to_string(i), data, error);
+        }
+        for (int i = 50; i < 150; ++i)
+        {
+            manager.DeleteValue("Metrics", "Value" + std::to_string(i), error);
+        }
+        if (writes.calls.Value() - writesBefore != 100 || writes.errors.Value() != writeErrorsBefore ||
+            reads.calls.Value() - readsBefore != 100 || reads.errors.Value() != readErrorsBefore ||
+            deletes.calls.Value() - deletesBefore != 100 || deletes.errors.Value() - deleteErrorsBefore != 50 ||
+            reads.duration.Read().count < 100)
+        {
+            std::cerr << "metrics: RegistryManager calls were not counted\n";
+            ++failures;
+        }
+    }
+
+    // One HELP and TYPE per family, labels merged with the quantile
+    Metrics::GetCounter("bench_text_total", "kind=\"a\"", "Text check").Add(5);
+    Metrics::GetCounter("bench_text_total", "kind=\"b\"", "Text check").Add(7);
+    Metrics::GetHistogram("bench_text_seconds", "", "Text check", 1e-9).Record(1500);
+    Metrics::Histogram& overflowing = Metrics::GetHistogram("bench_overflow_seconds", "", "Overflow check", 1e-9);
+    overflowing.Record(1500);
+    overflowing.Record(uint64_t(1) << 50);
+    std::string text = Metrics::PrometheusText();
+    auto count = [&](const std::string& needle)
+    {
+        size_t found = 0;
+        for (size_t at = text.find(needle); at != std::string::npos; at = text.find(needle, at + 1))
+        {
+            ++found;
+        }
+        return found;
+    };
+    if (count("# TYPE bench_text_total counter\n") != 1 || count("\nbench_text_total{kind=\"a\"} 5\n") != 1 ||
+        count("\nbench_text_total{kind=\"b\"} 7\n") != 1 || count("# TYPE bench_text_seconds summary\n") != 1 ||
+        count("\nbench_text_seconds{quantile=\"0.99\"} 1.5") != 1 || count("\nbench_text_seconds_count 1\n") != 1 ||
+        count("registry_op_duration_seconds{op=\"ReadStringValue\",quantile=\"0.5\"}") != 1 ||
+        count("\nbench_overflow_seconds{quantile=\"0.5\"} 1.5") != 1 ||
+        count("\nbench_overflow_seconds{quantile=\"0.99\"} +Inf\n") != 1)
+    {
+        std::cerr << "metrics: unexpected Prometheus text\n" << text;
+        ++failures;
+    }
+
+    // The exporter writes on a signal long before its interval is up
+    const std::string fileName = "registry-bench-metrics.prom";
+    std::filesystem::remove(fileName);
+    Metrics::StartExporter(fileName, std::chrono::hours(1));
+#ifndef _WIN32
+    raise(SIGUSR1);
+    for (int i = 0; i < 100 && !std::filesystem::exists(fileName); ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if (ReadWholeFile(fileName).find("bench_text_total{kind=\"b\"} 7") == std::string::npos)
+    {
+        std::cerr << "metrics: SIGUSR1 did not write the metrics file\n";
+        ++failures;
+    }
+#endif
+    Metrics::StopExporter();
+    if (ReadWholeFile(fileName).find("# TYPE registry_op_total counter") == std::string::npos)
+    {
+        std::cerr << "metrics: stopping the exporter did not write the metrics file\n";
+        ++failures;
+    }
+    std::filesystem::remove(fileName);
+    return failures;
+}
+
+static int RunShmBench(int durationMs)
+{
+    int failures = 0;
+    const int keyCount = 1000;
+    const int valuesPerKey = 10;
+    auto keyName = [](int key) { return "Fleet\\Host" + std::to_string(key); };
+    auto valueName = [](int value) { return "Value" + std::to_string(value); };
+
+    auto backend = std::make_shared<MemoryRegistryBackend>();
+    std::vector<RegistryChange> setup;
+    for (int key = 0; key < keyCount; ++key)
+    {
+        setup.push_back({RegistryChange::CREATE_KEY, keyName(key), {}, {}});
+        for (int value = 0; value < valuesPerKey; ++value)
+        {
+            setup.push_back({RegistryChange::SET_VALUE, keyName(key), valueName(value),
+                             RegistryValue::String("data" + std::to_string(key * valuesPerKey + value))});
+        }
+    }
+    setup.push_back({RegistryChange::CREATE_KEY, "Pair", {}, {}});
+    setup.push_back({RegistryChange::SET_VALUE, "Pair", "A", RegistryValue::DWord(0)});
+    setup.push_back({RegistryChange::SET_VALUE, "Pair", "B", RegistryValue::DWord(0)});
+    size_t failedIndex;
+    backend->ApplyChanges(setup, failedIndex);
+
+    // Unique per run so benches running side by side do not meet
+    const std::string suffix = std::to_string(std::chrono::steady_clock::now().time_since_epoch().count() % 1000000007);
+    ConfigServiceOptions options;
+    options.segmentName = "RegistryBench-" + suffix;
+    options.socketPath = (std::filesystem::temp_directory_path() / ("registry-bench-" + suffix + ".sock")).string();
+    options.pollInterval = std::chrono::milliseconds(50);
+    ConfigService service(backend, options);
+    RegistryError error;
+    SharedConfigReader reader;
+    if (!service.Start(error) || !reader.Open(options.segmentName, error))
+    {
+        std::cerr << "shm: " << error.Message() << "\n";
+        return 1;
+    }
+
+    // Everything the backend has, nothing it has not
+    {
+        size_t mismatches = 0;
+        for (int key = 0; key < keyCount; ++key)
+        {
+            for (int value = 0; value < valuesPerKey; ++value)
+            {
+                RegistryValue published, expected;
+                backend->QueryValue(keyName(key), valueName(value), expected);
+                if (reader.QueryValue(keyName(key), valueName(value), published) != REGISTRY_SUCCESS || published != expected)
+                {
+                    ++mismatches;
+                }
+            }
+        }
+        std::vector<std::pair<std::string, RegistryValue>> published, expected;
+        backend->EnumValues("fleet\\HOST42", expected);
+        reader.EnumValues("fleet\\HOST42", published);
+        RegistryValue missing;
+        if (mismatches > 0 || published != expected || published.size() != size_t(valuesPerKey) ||
+            reader.QueryValue("Fleet\\Host42", "Value10", missing) != REGISTRY_NOT_FOUND ||
+            reader.QueryValue("Fleet\\Host4", "", missing) != REGISTRY_NOT_FOUND ||
+            reader.QueryValue("Fleet\\Host4200", "Value1", missing) != REGISTRY_NOT_FOUND)
+        {
+            std::cerr << "shm: reader disagrees with the backend (" << mismatches << " values)\n";
+            ++failures;
+        }
+    }
+
+    // Lookups of random values: the shared segment against RegistryManager
+    {
+        const int lookups = 200000;
+        std::vector<std::pair<std::string, std::string>> names;
+        PathGenerator random(0x53484D31);
+        for (int i = 0; i < 4096; ++i)
+        {
+            names.emplace_back(keyName(random.Next(keyCount)), valueName(random.Next(valuesPerKey)));
+        }
+        RegistryManager manager(backend);
+        printf("\n%-8s %14s %14s\n", "threads", "manager ns", "shared ns");
+        for (int threads : {1, 4})
+        {
+            std::atomic<size_t> misses{0};
+            double managerNs = NsPerUpdate(threads, lookups, [&](int t, int i)
+            {
+                const auto& name = names[(i * 7 + t) & 4095];
+                std::string data;
+                RegistryError readError;
+                if (!manager.ReadStringValue(name.first, name.second, data, readError))
+                {
+                    misses.fetch_add(1, std::memory_order_relaxed);
+                }
+            });
+            double sharedNs = NsPerUpdate(threads, lookups, [&](int t, int i)
+            {
+                const auto& name = names[(i * 7 + t) & 4095];
+                RegistryValue value;
+                if (reader.QueryValue(name.first, name.second, value) != REGISTRY_SUCCESS)
+                {
+                    misses.fetch_add(1, std::memory_order_relaxed);
+                }
+            });
+            if (misses > 0)
+            {
+                std::cerr << "shm: " << misses << " lookups failed with " << threads << " threads\n";
+                ++failures;
+            }
+            printf("%-8d %14.1f %14.1f\n", threads, managerNs, sharedNs);
+        }
+    }
+
+    // Change events: the hello, a write found by polling, a delete published at once
+    ConfigSubscription subscription;
+    ConfigChange change;
+    if (!subscription.Connect(options.socketPath, error))
+    {
+        std::cerr << "shm: " << error.Message() << "\n";
+        ++failures;
+    }
+    else if (!subscription.WaitForChange(1000, change) || change.generation != service.Generation() || !change.keys.empty())
+    {
+        std::cerr << "shm: no hello event on connect\n";
+        ++failures;
+    }
+    else
+    {
+        auto start = std::chrono::steady_clock::now();
+        backend->SetValue("Fleet\\Host7", "Value3", RegistryValue::String("changed"));
+        bool received = subscription.WaitForChange(2000, change);
+        double latencyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        RegistryValue value;
+        if (!received || change.keys != std::vector<std::string>{"Fleet\\Host7"} || reader.Generation() < change.generation ||
+            reader.QueryValue("Fleet\\Host7", "Value3", value) != REGISTRY_SUCCESS || value != RegistryValue::String("changed"))
+        {
+            std::cerr << "shm: the polled write was not published\n";
+            ++failures;
+        }
+        printf("\nchange event %.1f ms after a write, polling every %lld ms\n", latencyMs,
+               static_cast<long long>(options.pollInterval.count()));
+
+        uint64_t generation = service.Generation();
+        backend->DeleteValue("Fleet\\Host8", "Value0");
+        backend->SetValue("Fleet\\Host9", "Extra", RegistryValue::DWord(9));
+        if (!service.Refresh(error) || service.Generation() != generation + 1 ||
+            !subscription.WaitForChange(1000, change) || change.generation != generation + 1 ||
+            change.keys != std::vector<std::string>{"Fleet\\Host8", "Fleet\\Host9"} ||
+            reader.QueryValue("Fleet\\Host8", "Value0", value) != REGISTRY_NOT_FOUND ||
+            reader.QueryValue("Fleet\\Host9", "Extra", value) != REGISTRY_SUCCESS || value != RegistryValue::DWord(9))
+        {
+            std::cerr << "shm: the refreshed changes were not published\n";
+            ++failures;
+        }
+        if (!service.Refresh(error) || service.Generation() != generation + 1 || subscription.WaitForChange(100, change))
+        {
+            std::cerr << "shm: an unchanged tree was published again\n";
+            ++failures;
+        }
+    }
+
+    // Pair\A and Pair\B are always written together; a reader must never see them apart
+    {
+        std::atomic<bool> stop{false};
+        std::atomic<uint64_t> reads{0}, torn{0};
+        std::vector<std::thread> readers;
+        for (int t = 0; t < 2; ++t)
+        {
+            readers.emplace_back([&]
+            {
+                const std::vector<std::string> pair = {"A", "B"};
+                std::vector<RegistryValue> values;
+                while (!stop.load(std::memory_order_relaxed))
+                {
+                    if (reader.QueryValues("Pair", pair, values) != REGISTRY_SUCCESS || values[0] != values[1])
+                    {
+                        torn.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    reads.fetch_add(1, std::memory_order_relaxed);
+                }
+            });
+        }
+        uint64_t retriesBefore = reader.Retries();
+        uint32_t publishes = 0;
+        auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(durationMs);
+        while (std::chrono::steady_clock::now() < end)
+        {
+            ++publishes;
+            std::vector<RegistryChange> batch = {
+                {RegistryChange::SET_VALUE, "Pair", "A", RegistryValue::DWord(publishes)},
+                {RegistryChange::SET_VALUE, "Pair", "B", RegistryValue::DWord(publishes)},
+            };
+            backend->ApplyChanges(batch, failedIndex);
+            service.Refresh(error);
+        }
+        stop = true;
+        for (auto& thread : readers)
+        {
+            thread.join();
+        }
+        if (torn > 0)
+        {
+            std::cerr << "shm: " << torn << " of " << reads << " reads saw Pair\\A and Pair\\B apart\n";
+            ++failures;
+        }
+        printf("pair reads %llu during %u publishes, %llu retried\n", static_cast<unsigned long long>(reads.load()),
+               publishes, static_cast<unsigned long long>(reader.Retries() - retriesBefore));
+    }
+
+    // A tree too big for the slot is refused and readers keep the last generation
+    {
+        auto small = std::make_shared<MemoryRegistryBackend>();
+        small->CreateKey("App");
+        small->SetValue("App", "Name", RegistryValue::String("small"));
+        ConfigServiceOptions smallOptions;
+        smallOptions.segmentName = "RegistryBench-small-" + suffix;
+        smallOptions.slotSize = 64 * 1024;
+        smallOptions.pollInterval = std::chrono::hours(1);
+        ConfigService smallService(small, smallOptions);
+        SharedConfigReader smallReader;
+        RegistryValue value;
+        bool started = smallService.Start(error) && smallReader.Open(smallOptions.segmentName, error);
+        small->SetValue("App", "Blob", RegistryValue{VALUE_BINARY, std::string(100 * 1024, 'x')});
+        RegistryError overflow;
+        if (!started || smallService.Refresh(overflow) || overflow.operation != RegistryOperation::PublishSharedConfig ||
+            smallReader.Generation() != 1 || smallReader.QueryValue("App", "Name", value) != REGISTRY_SUCCESS ||
+            smallReader.QueryValue("App", "Blob", value) != REGISTRY_NOT_FOUND)
+        {
+            std::cerr << "shm: an oversized tree was not refused cleanly\n";
+            ++failures;
+        }
+    }
+
+#ifndef _WIN32
+    // Another process maps the same segment and finds the same values
+    {
+        fflush(stdout);
+        pid_t child = fork();
+        if (child == 0)
+        {
+            SharedConfigReader childReader;
+            RegistryError childError;
+            RegistryValue value;
+            bool ok = childReader.Open(options.segmentName, childError) &&
+                      childReader.QueryValue("Fleet\\Host7", "Value3", value) == REGISTRY_SUCCESS &&
+                      value == RegistryValue::String("changed");
+            _exit(ok ? 0 : 1);
+        }
+        int status = 0;
+        if (child < 0 || waitpid(child, &status, 0) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            std::cerr << "shm: a reader in another process did not see the segment\n";
+            ++failures;
+        }
+    }
+#endif
+
+    // Stopping reaches mapped readers and subscribers; the name is gone for new ones
+    service.Stop();
+    while (subscription.WaitForChange(1000, change))
+    {
+        // Events of the pair publishes, then the end of the stream
+    }
+    SharedConfigReader late;
+    RegistryError lateError;
+    if (reader.Live() || subscription.IsConnected() ||
+        late.Open(options.segmentName, lateError))
+    {
+        std::cerr << "shm: stopping the service was not seen\n";
+        ++failures;
+    }
+    return failures;
+}
+
+int main(int argc, char** argv)
+{
+    std::string section = "all";
+    int iterations = 3;
+    int probeNs = 1500;
+    int installs = 2000;
+    int threads = 4;
+    int values = 20000;
+    int durationMs = 300;
+    int fleetValues = 1000000;
+    int fuzzCases = 100000;
+    std::string traceFile;
+    std::string metricsFile;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--iterations") && i + 1 < argc) iterations = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--section") && i + 1 < argc) section = argv[++i];
+        else if (!strcmp(argv[i], "--probe-ns") && i + 1 < argc) probeNs = std::max(0, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--installs") && i + 1 < argc) installs = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc) threads = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--values") && i + 1 < argc) values = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--duration-ms") && i + 1 < argc) durationMs = std::max(10, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--fleet-values") && i + 1 < argc) fleetValues = std::max(1000, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--fuzz-cases") && i + 1 < argc) fuzzCases = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--trace") && i + 1 < argc) traceFile = argv[++i];
+        else if (!strcmp(argv[i], "--metrics") && i + 1 < argc) metricsFile = argv[++i];
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--section exists|txn|store|mvcc|diff|snapshot|search|bundle|text|trace|metrics|shm|all] [--iterations <n>] [--probe-ns <n>]"
+                      << " [--installs <n>] [--threads <n>] [--values <n>] [--duration-ms <n>] [--fleet-values <n>]"
+                      << " [--fuzz-cases <n>] [--trace <file>] [--metrics <file>]\n";
+            return 2;
+        }
+    }
+
+    Trace::SetEnabled(!traceFile.empty());
+    int failures = 0;
+    if (section == "exists" || section == "all")
+    {
+        failures += RunExistsBench(iterations, probeNs);
+    }
+    if (section == "txn" || section == "all")
+    {
+        failures += RunTransactionBench(iterations, installs, threads);
+    }
+    if (section == "store" || section == "all")
+    {
+        failures += RunStoreBench(iterations, values, threads);
+    }
+    if (section == "mvcc" || section == "all")
+    {
+        failures += RunMvccBench(durationMs);
+    }
+    if (section == "diff" || section == "all")
+    {
+        failures += RunDiffBench(fleetValues);
+    }
+    if (section == "snapshot" || section == "all")
+    {
+        failures += RunSnapshotBench(iterations, fleetValues);
+    }
+    if (section == "search" || section == "all")
+    {
+        failures += RunSearchBench(fleetValues);
+    }
+    if (section == "bundle" || section == "all")
+    {
+        failures += RunBundleBench(iterations, fleetValues);
+    }
+    if (section == "text" || section == "all")
+    {
+        failures += RunTextBench(iterations, fuzzCases);
+    }
+    if (!traceFile.empty() && !Trace::WriteChromeTrace(traceFile))
+    {
+        std::cerr << "Failed to write trace file " << traceFile << "\n";
+        ++failures;
+    }
+    if (section == "trace" || section == "all")
+    {
+        failures += RunTraceBench(iterations);
+    }
+    if (section == "metrics" || section == "all")
+    {
+        failures += RunMetricsBench();
+    }
+    if (section == "shm" || section == "all")
+    {
+        failures += RunShmBench(durationMs);
+    }
+    if (!metricsFile.empty() && !Metrics::WritePrometheusFile(metricsFile))
+    {
+        std::cerr << "Failed to write metrics file " << metricsFile << "\n";
+        ++failures;
+    }
+    return failures > 0 ? 1 : 0;
+}
@@ -5,6 +5,7 @@
 #include <map>
 #include <sstream>
 #include <fstream>
+#include "Common/Utf.h"
 
 #pragma comment(lib, "gdiplus.lib")
 #pragma comment(lib, "user32.lib")
@@ -164,16 +165,19 @@ void LoadRegistryData()
     HKEY hKey;
 
     // Load primary rectangles
-    if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, REG_PATH_RECTS.c_str(), 0, KEY_READ, &hKey) == ERROR_SUCCESS)
+    // Registry names are UTF-16; they are kept as UTF-8 and widened again for GDI+
+    std::wstring rectsPath = Widen(REG_PATH_RECTS);
+    if (RegOpenKeyExW(HKEY_LOCAL_MACHINE, rectsPath.c_str(), 0, KEY_READ, &hKey) == ERROR_SUCCESS)
     {
         DWORD index = 0;
-        char subKeyName[256];
-        DWORD nameLen = sizeof(subKeyName) / sizeof(char);
-        while (RegEnumKeyExA(hKey, index, subKeyName, &nameLen, nullptr, nullptr, nullptr, nullptr) == ERROR_SUCCESS)
+        wchar_t wideName[256];
+        DWORD nameLen = static_cast<DWORD>(std::size(wideName));
+        while (RegEnumKeyExW(hKey, index, wideName, &nameLen, nullptr, nullptr, nullptr, nullptr) == ERROR_SUCCESS)
         {
             HKEY hSubKey;
-            std::string path = std::string(REG_PATH_RECTS) + "\\" + subKeyName;
-            if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, path.c_str(), 0, KEY_READ, &hSubKey) == ERROR_SUCCESS)
+            std::string subKeyName = Narrow(std::wstring_view(wideName, nameLen));
+            std::wstring path = rectsPath + L"\\" + wideName;
+            if (RegOpenKeyExW(HKEY_LOCAL_MACHINE, path.c_str(), 0, KEY_READ, &hSubKey) == ERROR_SUCCESS)
             {
                 MyRect rect;
                 rect.name = subKeyName;
@@ -182,7 +186,7 @@ void LoadRegistryData()
                 bool valid = true;
                 std::stringstream error;
 
-                if (RegQueryValueEx(hSubKey, "Top", nullptr, nullptr, (LPBYTE)&data, &dataSize) != ERROR_SUCCESS || data > 100)
+                if (RegQueryValueExW(hSubKey, L"Top", nullptr, nullptr, (LPBYTE)&data, &dataSize) != ERROR_SUCCESS || data > 100)
                 {
                     error << "Invalid or missing 'Top' for " << subKeyName;
                     valid = false;
@@ -191,7 +195,7 @@ void LoadRegistryData()
                 {
                     rect.top = data;
                 }
-                if (RegQueryValueEx(hSubKey, "Left", nullptr, nullptr, (LPBYTE)&data, &dataSize) != ERROR_SUCCESS || data > 100)
+                if (RegQueryValueExW(hSubKey, L"Left", nullptr, nullptr, (LPBYTE)&data, &dataSize) != ERROR_SUCCESS || data > 100)
                 {
                     error << "Invalid or missing 'Left' for " << subKeyName;
                     valid = false;
@@ -200,7 +204,7 @@ void LoadRegistryData()
                 {
                     rect.left = data;
                 }
-                if (RegQueryValueEx(hSubKey, "Right", nullptr, nullptr, (LPBYTE)&data, &dataSize) != ERROR_SUCCESS || data > 100)
+                if (RegQueryValueExW(hSubKey, L"Right", nullptr, nullptr, (LPBYTE)&data, &dataSize) != ERROR_SUCCESS || data > 100)
                 {
                     error << "Invalid or missing 'Right' for " << subKeyName;
                     valid = false;
@@ -209,7 +213,7 @@ void LoadRegistryData()
                 {
                     rect.right = data;
                 }
-                if (RegQueryValueEx(hSubKey, "Bottom", nullptr, nullptr, (LPBYTE)&data, &dataSize) != ERROR_SUCCESS || data > 100)
+                if (RegQueryValueExW(hSubKey, L"Bottom", nullptr, nullptr, (LPBYTE)&data, &dataSize) != ERROR_SUCCESS || data > 100)
                 {
                     error << "Invalid or missing 'Bottom' for " << subKeyName;
                     valid = false;
@@ -232,7 +236,7 @@ void LoadRegistryData()
                 }
                 RegCloseKey(hSubKey);
             }
-            nameLen = sizeof(subKeyName) / sizeof(wchar_t);
+            nameLen = static_cast<DWORD>(std::size(wideName));
             index++;
         }
         RegCloseKey(hKey);
@@ -249,19 +253,22 @@ void LoadRegistryData()
     {
         REG_PATH_ALT_NAMES = pathFromFile;
     }
-    if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, REG_PATH_ALT_NAMES.c_str(), 0, KEY_READ, &hKey) == ERROR_SUCCESS)
+    if (RegOpenKeyExW(HKEY_LOCAL_MACHINE, Widen(REG_PATH_ALT_NAMES).c_str(), 0, KEY_READ, &hKey) == ERROR_SUCCESS)
     {
         DWORD index = 0;
-        char valueName[256] {};
-        DWORD nameLen = sizeof(valueName) / sizeof(char);
-        char valueData[256] {};
+        wchar_t valueName[256] {};
+        DWORD nameLen = static_cast<DWORD>(std::size(valueName));
+        wchar_t valueData[256] {};
         DWORD dataLen = sizeof(valueData);
-        while (RegEnumValueA(hKey, index, valueName, &nameLen, nullptr, nullptr, (LPBYTE)valueData, &dataLen) == ERROR_SUCCESS)
+        while (RegEnumValueW(hKey, index, valueName, &nameLen, nullptr, nullptr, (LPBYTE)valueData, &dataLen) == ERROR_SUCCESS)
         {
-            char simplifyName[255] {};
-            strcpy_s(simplifyName, 255, valueName + strlen(valueName) - 2);
-            g_altNames[simplifyName] = valueData;
-            nameLen = sizeof(valueName) / sizeof(wchar_t);
+            std::wstring_view target(valueData, dataLen / sizeof(wchar_t));
+            target = target.substr(0, target.find(L'\0'));
+            if (nameLen >= 2)
+            {
+                g_altNames[Narrow(std::wstring_view(valueName + nameLen - 2, 2))] = Narrow(target);
+            }
+            nameLen = static_cast<DWORD>(std::size(valueName));
             dataLen = sizeof(valueData);
             index++;
         }
@@ -316,16 +323,6 @@ void ShowContextMenu(HWND hwnd)
     DestroyMenu(hMenu);
 }
 
-std::wstring stringToWstringStream(const std::string& str)
-{
-    // This method is generally for simple conversions where the characters
-    // in string and wstring are byte-compatible or handled by a basic locale.
-    // It's not robust for complex encoding conversions like UTF-8 to UTF-16.
-    std::wstringstream wss;
-    wss << str.c_str(); // This might not correctly convert multi-byte characters
-    return wss.str();
-}
-
 // Draw rectangles and labels
 void DrawRectangles(HDC hdc)
 {
@@ -354,6 +351,6 @@ void DrawRectangles(HDC hdc)
         format.SetAlignment(Gdiplus::StringAlignmentCenter);
         format.SetLineAlignment(Gdiplus::StringAlignmentCenter);
         Gdiplus::RectF textRect((float)left, (float)top, (float)(right - left), (float)(bottom - top));
-        graphics.DrawString(stringToWstringStream(rect.name.c_str()).c_str(), -1, &font, textRect, &format, &brush);
+        graphics.DrawString(Widen(rect.name).c_str(), -1, &font, textRect, &format, &brush);
     }
 }
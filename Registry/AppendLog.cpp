@@ -0,0 +1,346 @@
+#include "AppendLog.h"
+#include <cerrno>
+#include "../Common/Checksum.h"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+AppendLog::AppendLog()
+{}
+
+AppendLog::~AppendLog()
+{
+    Close();
+}
+
+bool AppendLog::SyncFile(FILE* file)
+{
+    if (fflush(file) != 0)
+    {
+        return false;
+    }
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+int32_t AppendLog::Open(const std::string& fileName, bool truncate)
+{
+    Close();
+    FILE* file = fopen(fileName.c_str(), truncate ? "wb" : "ab");
+    if (!file)
+    {
+        return errno;
+    }
+    if (truncate && !SyncFile(file))
+    {
+        int32_t result = errno;
+        fclose(file);
+        return result;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_file = file;
+    m_fileName = fileName;
+    fseek(file, 0, SEEK_END);
+    m_size = static_cast<uint64_t>(ftell(file));
+    m_error = 0;
+    m_syncs = 0;
+    return 0;
+}
+
+void AppendLog::Close()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_flushed.wait(lock, [this] { return !m_flushing; });
+    if (m_file)
+    {
+        fclose(m_file);
+        m_file = nullptr;
+    }
+    m_pending.clear();
+    m_durableSeq = m_queuedSeq;
+}
+
+bool AppendLog::IsOpen() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_file != nullptr;
+}
+
+void AppendLog::Frame(const std::string& payload, std::string& out)
+{
+    PutU32(out, static_cast<uint32_t>(payload.size()));
+    PutU32(out, Crc32(payload.data(), payload.size()));
+    out += payload;
+}
+
+uint64_t AppendLog::Enqueue(const std::string& payload)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Frame(payload, m_pending);
+    return ++m_queuedSeq;
+}
+
+int32_t AppendLog::WaitDurable(uint64_t seq)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return FlushLocked(lock, seq);
+}
+
+int32_t AppendLog::Append(const std::string& payload)
+{
+    return WaitDurable(Enqueue(payload));
+}
+
+int32_t AppendLog::FlushLocked(std::unique_lock<std::mutex>& lock, uint64_t seq)
+{
+    while (m_durableSeq < seq && m_error == 0)
+    {
+        if (m_flushing)
+        {
+            m_flushed.wait(lock);
+            continue;
+        }
+        if (!m_file)
+        {
+            return EBADF;
+        }
+
+        // Become the leader for everything queued so far
+        m_flushing = true;
+        std::string batch;
+        batch.swap(m_pending);
+        uint64_t target = m_queuedSeq;
+        FILE* file = m_file;
+        lock.unlock();
+
+        errno = 0;
+        int32_t result = 0;
+        if (fwrite(batch.data(), 1, batch.size(), file) != batch.size() || !SyncFile(file))
+        {
+            result = errno ? errno : EIO;
+        }
+
+        lock.lock();
+        m_flushing = false;
+        m_durableSeq = target;
+        m_error = result;
+        m_size += batch.size();
+        ++m_syncs;
+        m_flushed.notify_all();
+    }
+    return m_error;
+}
+
+int32_t AppendLog::Rotate(const std::string& fileName)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    int32_t result = FlushLocked(lock, m_queuedSeq);
+    m_flushed.wait(lock, [this] { return !m_flushing; });
+    if (result != 0)
+    {
+        return result;
+    }
+
+    FILE* file = fopen(fileName.c_str(), "wb");
+    if (!file || !SyncFile(file))
+    {
+        result = errno ? errno : EIO;
+        if (file)
+        {
+            fclose(file);
+        }
+        return result;
+    }
+    if (m_file)
+    {
+        fclose(m_file);
+    }
+    m_file = file;
+    m_fileName = fileName;
+    m_size = 0;
+    return 0;
+}
+
+int32_t AppendLog::Truncate()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_flushed.wait(lock, [this] { return !m_flushing; });
+    if (!m_file)
+    {
+        return EBADF;
+    }
+    FILE* file = freopen(m_fileName.c_str(), "wb", m_file);
+    m_file = file;
+    if (!file)
+    {
+        m_error = errno ? errno : EIO;
+        return m_error;
+    }
+    m_size = 0;
+    return 0;
+}
+
+uint64_t AppendLog::Size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_size;
+}
+
+uint64_t AppendLog::Syncs() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_syncs;
+}
+
+size_t AppendLog::ReadRecords(const std::string& contents, const std::function<bool(const char*, size_t)>& onRecord)
+{
+    size_t offset = 0;
+    while (contents.size() - offset >= 8)
+    {
+        RecordReader header{contents.data() + offset, 8};
+        uint32_t size, crc;
+        header.GetU32(size);
+        header.GetU32(crc);
+        if (contents.size() - offset - 8 < size)
+        {
+            break; // Torn tail: the crash happened while this record was written
+        }
+        const char* payload = contents.data() + offset + 8;
+        if (Crc32(payload, size) != crc || !onRecord(payload, size))
+        {
+            break;
+        }
+        offset += 8 + size;
+    }
+    return offset;
+}
+
+bool AppendLog::ReadFile(const std::string& fileName, std::string& contents)
+{
+    contents.clear();
+    FILE* file = fopen(fileName.c_str(), "rb");
+    if (!file)
+    {
+        return false;
+    }
+    char buffer[65536];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        contents.append(buffer, count);
+    }
+    fclose(file);
+    return true;
+}
+
+void PutU32(std::string& out, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        out.push_back(static_cast<char>((value >> (i * 8)) & 0xFF));
+    }
+}
+
+void PutU64(std::string& out, uint64_t value)
+{
+    PutU32(out, static_cast<uint32_t>(value));
+    PutU32(out, static_cast<uint32_t>(value >> 32));
+}
+
+void PutString(std::string& out, const std::string& text)
+{
+    PutU32(out, static_cast<uint32_t>(text.size()));
+    out += text;
+}
+
+// u32 count, then per change: u8 kind, path, name, u32 value type, data
+void PutChanges(std::string& out, const std::vector<RegistryChange>& changes)
+{
+    PutU32(out, static_cast<uint32_t>(changes.size()));
+    for (const RegistryChange& change : changes)
+    {
+        out.push_back(static_cast<char>(change.kind));
+        PutString(out, change.path);
+        PutString(out, change.name);
+        PutU32(out, change.value.type);
+        PutString(out, change.value.data);
+    }
+}
+
+bool RecordReader::GetU8(uint8_t& value)
+{
+    if (offset >= size)
+    {
+        return false;
+    }
+    value = static_cast<uint8_t>(data[offset++]);
+    return true;
+}
+
+bool RecordReader::GetU32(uint32_t& value)
+{
+    if (size - offset < 4)
+    {
+        return false;
+    }
+    value = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        value |= static_cast<uint32_t>(static_cast<uint8_t>(data[offset + i])) << (i * 8);
+    }
+    offset += 4;
+    return true;
+}
+
+bool RecordReader::GetU64(uint64_t& value)
+{
+    uint32_t low, high;
+    if (!GetU32(low) || !GetU32(high))
+    {
+        return false;
+    }
+    value = low | (static_cast<uint64_t>(high) << 32);
+    return true;
+}
+
+bool RecordReader::GetString(std::string& text)
+{
+    uint32_t length;
+    if (!GetU32(length) || size - offset < length)
+    {
+        return false;
+    }
+    text.assign(data + offset, length);
+    offset += length;
+    return true;
+}
+
+bool RecordReader::GetChanges(std::vector<RegistryChange>& changes)
+{
+    uint32_t count;
+    if (!GetU32(count))
+    {
+        return false;
+    }
+    changes.clear();
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        RegistryChange change;
+        uint8_t kind;
+        if (!GetU8(kind) || kind > RegistryChange::DELETE_VALUE || !GetString(change.path) || !GetString(change.name) ||
+            !GetU32(change.value.type) || !GetString(change.value.data))
+        {
+            return false;
+        }
+        change.kind = static_cast<RegistryChange::Kind>(kind);
+        changes.push_back(std::move(change));
+    }
+    return true;
+}
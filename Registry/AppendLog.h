@@ -0,0 +1,82 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "RegistryBackend.h"
+
+// Append-only file of CRC-framed records with group commit.
+// Each record is u32 payload size, u32 CRC-32 of the payload, payload.
+// Concurrent appenders share syncs: whoever finds no flush running writes
+// everything queued so far with one fsync, and the others wait for it.
+class AppendLog
+{
+public:
+    AppendLog();
+    ~AppendLog();
+
+    // Returns 0 or an errno-style code
+    int32_t Open(const std::string& fileName, bool truncate);
+    void Close();
+    bool IsOpen() const;
+
+    // Enqueue + WaitDurable; returns 0 once the record is on disk
+    int32_t Append(const std::string& payload);
+
+    // Split form: enqueue under the caller's own lock to fix record order,
+    // then wait outside it so other writers can join the same sync
+    uint64_t Enqueue(const std::string& payload);
+    int32_t WaitDurable(uint64_t seq);
+
+    // Flushes what is queued and continues in a new file
+    int32_t Rotate(const std::string& fileName);
+    // Empties the file; only safe when nobody is appending
+    int32_t Truncate();
+
+    uint64_t Size() const;   // Bytes written to the current file
+    uint64_t Syncs() const;
+
+    // Calls onRecord for each intact record in order, stopping at a torn or
+    // corrupt tail or when onRecord returns false. Returns the bytes consumed.
+    static size_t ReadRecords(const std::string& contents, const std::function<bool(const char*, size_t)>& onRecord);
+    static bool ReadFile(const std::string& fileName, std::string& contents);
+    static void Frame(const std::string& payload, std::string& out);
+    static bool SyncFile(FILE* file);
+
+private:
+    int32_t FlushLocked(std::unique_lock<std::mutex>& lock, uint64_t seq);
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_flushed;
+    FILE* m_file = nullptr;
+    std::string m_fileName;
+    std::string m_pending;     // Framed records queued for the next flush
+    uint64_t m_queuedSeq = 0;  // Last record queued
+    uint64_t m_durableSeq = 0; // Last record known to be on disk
+    bool m_flushing = false;
+    int32_t m_error = 0;       // Sticky: once a flush fails nothing later is trusted
+    uint64_t m_size = 0;
+    uint64_t m_syncs = 0;
+};
+
+// Little-endian payload encoding shared by the journal and the log store
+void PutU32(std::string& out, uint32_t value);
+void PutU64(std::string& out, uint64_t value);
+void PutString(std::string& out, const std::string& text);
+void PutChanges(std::string& out, const std::vector<RegistryChange>& changes);
+
+struct RecordReader
+{
+    const char* data;
+    size_t size;
+    size_t offset = 0;
+
+    bool GetU8(uint8_t& value);
+    bool GetU32(uint32_t& value);
+    bool GetU64(uint64_t& value);
+    bool GetString(std::string& text);
+    bool GetChanges(std::vector<RegistryChange>& changes);
+};
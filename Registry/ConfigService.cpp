@@ -0,0 +1,451 @@
+#include "ConfigService.h"
+#include <algorithm>
+#include <cstring>
+#include "MemoryBackend.h"
+#include "RegistryDiff.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <afunix.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// Subscribers are picked up this often while the service waits to poll
+static const std::chrono::milliseconds ACCEPT_INTERVAL(20);
+
+#ifdef _WIN32
+using SocketHandle = SOCKET;
+
+static bool StartSockets()
+{
+    static const bool started = []
+    {
+        WSADATA data;
+        return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+    }();
+    return started;
+}
+
+static int32_t LastSocketError() { return WSAGetLastError(); }
+static bool Interrupted() { return false; }
+static void CloseSocket(intptr_t handle) { closesocket(static_cast<SocketHandle>(handle)); }
+static void RemoveSocketFile(const std::string& path) { DeleteFileA(path.c_str()); }
+
+static bool SetNonBlocking(SocketHandle socket)
+{
+    u_long enabled = 1;
+    return ioctlsocket(socket, FIONBIO, &enabled) == 0;
+}
+
+static int WaitReadable(SocketHandle socket, int timeoutMs)
+{
+    WSAPOLLFD ready = { socket, POLLRDNORM, 0 };
+    return WSAPoll(&ready, 1, timeoutMs);
+}
+
+static const int SEND_FLAGS = 0;
+#else
+using SocketHandle = int;
+
+static bool StartSockets() { return true; }
+static int32_t LastSocketError() { return errno; }
+static bool Interrupted() { return errno == EINTR; }
+static void CloseSocket(intptr_t handle) { close(static_cast<SocketHandle>(handle)); }
+static void RemoveSocketFile(const std::string& path) { unlink(path.c_str()); }
+
+static bool SetNonBlocking(SocketHandle socket)
+{
+    int flags = fcntl(socket, F_GETFL, 0);
+    return flags >= 0 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static int WaitReadable(SocketHandle socket, int timeoutMs)
+{
+    pollfd ready = { socket, POLLIN, 0 };
+    return poll(&ready, 1, timeoutMs);
+}
+
+#ifdef MSG_NOSIGNAL
+static const int SEND_FLAGS = MSG_NOSIGNAL; // A subscriber that went away must not kill the service
+#else
+static const int SEND_FLAGS = 0;
+#endif
+#endif
+
+static bool SocketAddress(const std::string& path, sockaddr_un& address)
+{
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path))
+    {
+        return false;
+    }
+    memcpy(address.sun_path, path.data(), path.size());
+    return true;
+}
+
+// Event frame: uint32 size of the rest, uint64 generation, uint32 key count,
+// then each key as uint32 length and bytes; little-endian
+static void AppendNumber(std::string& out, uint64_t number, size_t bytes)
+{
+    for (size_t i = 0; i < bytes; ++i)
+    {
+        out += static_cast<char>((number >> (i * 8)) & 0xFF);
+    }
+}
+
+static uint64_t ReadNumber(const char* in, size_t bytes)
+{
+    uint64_t number = 0;
+    for (size_t i = 0; i < bytes; ++i)
+    {
+        number |= uint64_t(static_cast<unsigned char>(in[i])) << (i * 8);
+    }
+    return number;
+}
+
+static std::string EncodeChange(const ConfigChange& change)
+{
+    std::string body;
+    AppendNumber(body, change.generation, 8);
+    AppendNumber(body, change.keys.size(), 4);
+    for (const std::string& key : change.keys)
+    {
+        AppendNumber(body, key.size(), 4);
+        body += key;
+    }
+    std::string frame;
+    AppendNumber(frame, body.size(), 4);
+    return frame + body;
+}
+
+// Whole or not at all; the sockets are non-blocking
+static bool SendFrame(intptr_t subscriber, const std::string& frame)
+{
+    auto sent = send(static_cast<SocketHandle>(subscriber), frame.data(), static_cast<int>(frame.size()), SEND_FLAGS);
+    return sent == static_cast<decltype(sent)>(frame.size());
+}
+
+ConfigService::ConfigService(std::shared_ptr<RegistryBackend> backend, ConfigServiceOptions options)
+    : m_backend(std::move(backend)), m_options(std::move(options))
+{}
+
+ConfigService::~ConfigService()
+{
+    Stop();
+}
+
+bool ConfigService::Start(RegistryError& error)
+{
+    Stop();
+    if (!m_writer.Create(m_options.segmentName, m_options.slotSize, error))
+    {
+        return false;
+    }
+    m_published = RegistryTree();
+    if (!Refresh(error))
+    {
+        m_writer.Close();
+        return false;
+    }
+
+    if (!m_options.socketPath.empty())
+    {
+        sockaddr_un address;
+        if (!StartSockets() || !SocketAddress(m_options.socketPath, address))
+        {
+            error = RegistryError(RegistryOperation::OpenConfigSocket, REGISTRY_INVALID_PARAMETER, m_options.socketPath);
+            m_writer.Close();
+            return false;
+        }
+        RemoveSocketFile(m_options.socketPath); // Left by a service that crashed
+        SocketHandle listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener == static_cast<SocketHandle>(-1) ||
+            bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+            listen(listener, 16) != 0 || !SetNonBlocking(listener))
+        {
+            error = RegistryError(RegistryOperation::OpenConfigSocket, SystemError::Native(LastSocketError()), m_options.socketPath);
+            if (listener != static_cast<SocketHandle>(-1))
+            {
+                CloseSocket(static_cast<intptr_t>(listener));
+            }
+            m_writer.Close();
+            return false;
+        }
+        m_listener = static_cast<intptr_t>(listener);
+    }
+
+    m_stop = false;
+    m_thread = std::thread(&ConfigService::Run, this);
+    return true;
+}
+
+void ConfigService::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (intptr_t subscriber : m_subscribers)
+    {
+        CloseSocket(subscriber);
+    }
+    m_subscribers.clear();
+    if (m_listener != -1)
+    {
+        CloseSocket(m_listener);
+        RemoveSocketFile(m_options.socketPath);
+        m_listener = -1;
+    }
+    m_writer.Close();
+}
+
+size_t ConfigService::SubscriberCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_subscribers.size();
+}
+
+// The in-memory backend gives a consistent capture; others are read key by
+// key, and a write caught half-way is completed by the next poll
+bool ConfigService::Capture(RegistryTree& tree, RegistryError& error)
+{
+    if (auto* memory = dynamic_cast<MemoryRegistryBackend*>(m_backend.get()))
+    {
+        return CaptureTree(memory->TakeSnapshot(), m_options.rootPath, tree, error);
+    }
+    return CaptureTree(*m_backend, m_options.rootPath, tree, error);
+}
+
+bool ConfigService::Refresh(RegistryError& error)
+{
+    // Held across the capture so two refreshes cannot publish out of order
+    std::lock_guard<std::mutex> lock(m_mutex);
+    RegistryTree tree;
+    if (!Capture(tree, error))
+    {
+        return false;
+    }
+    if (m_writer.Generation() > 0 && tree.RootHash() == m_published.RootHash())
+    {
+        return true;
+    }
+    std::vector<RegistryDelta> delta;
+    DiffTrees(m_published, tree, delta);
+    if (!m_writer.Publish(tree, error))
+    {
+        return false;
+    }
+
+    ConfigChange change;
+    change.generation = m_writer.Generation();
+    for (const RegistryDelta& entry : delta)
+    {
+        change.keys.push_back(entry.path);
+    }
+    std::sort(change.keys.begin(), change.keys.end(), LessNoCase());
+    change.keys.erase(std::unique(change.keys.begin(), change.keys.end(),
+                                  [](const std::string& a, const std::string& b) { return EqualsNoCase(a, b); }),
+                      change.keys.end());
+    m_published = std::move(tree);
+    Notify(change);
+    return true;
+}
+
+// Called with m_mutex held. Sends never block: a subscriber that lets its
+// socket buffer fill up is dropped rather than stalling everyone else.
+void ConfigService::Notify(const ConfigChange& change)
+{
+    if (m_subscribers.empty())
+    {
+        return;
+    }
+    std::string frame = EncodeChange(change);
+    m_subscribers.erase(std::remove_if(m_subscribers.begin(), m_subscribers.end(), [&](intptr_t subscriber)
+    {
+        if (SendFrame(subscriber, frame))
+        {
+            return false;
+        }
+        CloseSocket(subscriber);
+        return true;
+    }), m_subscribers.end());
+}
+
+// Called with m_mutex held
+void ConfigService::AcceptSubscribers()
+{
+    if (m_listener == -1)
+    {
+        return;
+    }
+    while (true)
+    {
+        SocketHandle subscriber = accept(static_cast<SocketHandle>(m_listener), nullptr, nullptr);
+        if (subscriber == static_cast<SocketHandle>(-1))
+        {
+            return;
+        }
+        if (!SetNonBlocking(subscriber))
+        {
+            CloseSocket(static_cast<intptr_t>(subscriber));
+            continue;
+        }
+
+        // Where the subscriber starts, so it knows it has missed nothing after this
+        ConfigChange current;
+        current.generation = m_writer.Generation();
+        if (!SendFrame(static_cast<intptr_t>(subscriber), EncodeChange(current)))
+        {
+            CloseSocket(static_cast<intptr_t>(subscriber));
+            continue;
+        }
+        m_subscribers.push_back(static_cast<intptr_t>(subscriber));
+    }
+}
+
+void ConfigService::Run()
+{
+    auto nextPoll = std::chrono::steady_clock::now() + m_options.pollInterval;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stop)
+    {
+        m_wake.wait_for(lock, ACCEPT_INTERVAL, [this] { return m_stop; });
+        if (m_stop)
+        {
+            break;
+        }
+        AcceptSubscribers();
+        if (std::chrono::steady_clock::now() >= nextPoll)
+        {
+            lock.unlock();
+            RegistryError error;
+            Refresh(error); // A failed capture keeps the last good generation published
+            nextPoll = std::chrono::steady_clock::now() + m_options.pollInterval;
+            lock.lock();
+        }
+    }
+}
+
+ConfigSubscription::~ConfigSubscription()
+{
+    Close();
+}
+
+bool ConfigSubscription::Connect(const std::string& socketPath, RegistryError& error)
+{
+    Close();
+    sockaddr_un address;
+    if (!StartSockets() || !SocketAddress(socketPath, address))
+    {
+        error = RegistryError(RegistryOperation::OpenConfigSocket, REGISTRY_INVALID_PARAMETER, socketPath);
+        return false;
+    }
+    SocketHandle handle = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (handle == static_cast<SocketHandle>(-1) ||
+        connect(handle, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        error = RegistryError(RegistryOperation::OpenConfigSocket, SystemError::Native(LastSocketError()), socketPath);
+        if (handle != static_cast<SocketHandle>(-1))
+        {
+            CloseSocket(static_cast<intptr_t>(handle));
+        }
+        return false;
+    }
+    m_socket = static_cast<intptr_t>(handle);
+    return true;
+}
+
+void ConfigSubscription::Close()
+{
+    if (m_socket != -1)
+    {
+        CloseSocket(m_socket);
+        m_socket = -1;
+    }
+    m_buffer.clear();
+}
+
+bool ConfigSubscription::TakeEvent(ConfigChange& change)
+{
+    if (m_buffer.size() < 4)
+    {
+        return false;
+    }
+    size_t size = static_cast<size_t>(ReadNumber(m_buffer.data(), 4));
+    if (m_buffer.size() < 4 + size)
+    {
+        return false;
+    }
+    const char* p = m_buffer.data() + 4;
+    const char* end = p + size;
+    change.generation = ReadNumber(p, 8);
+    size_t count = static_cast<size_t>(ReadNumber(p + 8, 4));
+    p += 12;
+    change.keys.clear();
+    for (size_t i = 0; i < count && end - p >= 4; ++i)
+    {
+        size_t length = static_cast<size_t>(ReadNumber(p, 4));
+        p += 4;
+        length = (std::min)(length, static_cast<size_t>(end - p));
+        change.keys.emplace_back(p, length);
+        p += length;
+    }
+    m_buffer.erase(0, 4 + size);
+    return true;
+}
+
+bool ConfigSubscription::WaitForChange(int timeoutMs, ConfigChange& change)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (m_socket != -1)
+    {
+        if (TakeEvent(change))
+        {
+            return true;
+        }
+        int wait = -1;
+        if (timeoutMs >= 0)
+        {
+            auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+            wait = static_cast<int>((std::max)(left, decltype(left)(0)));
+        }
+        int ready = WaitReadable(static_cast<SocketHandle>(m_socket), wait);
+        if (ready == 0)
+        {
+            return false;
+        }
+        if (ready < 0 && Interrupted())
+        {
+            continue;
+        }
+        if (ready < 0)
+        {
+            Close();
+            return false;
+        }
+        char buffer[4096];
+        auto received = recv(static_cast<SocketHandle>(m_socket), buffer, static_cast<int>(sizeof(buffer)), 0);
+        if (received <= 0)
+        {
+            Close(); // The service stopped
+            return false;
+        }
+        m_buffer.append(buffer, static_cast<size_t>(received));
+    }
+    return false;
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "RegistryBackend.h"
+#include "RegistryError.h"
+#include "RegistryTree.h"
+#include "SharedConfig.h"
+
+// The local configuration service: one process owns a registry subtree and
+// publishes it with SharedConfigWriter, so every other process reads it from
+// shared memory instead of the registry. The backend is polled; a capture
+// whose Merkle root hash is unchanged costs no publish. Each publish is sent
+// as a change event to every subscriber on a Unix domain socket (AF_UNIX,
+// which Windows has had since version 1803).
+
+struct ConfigServiceOptions
+{
+    std::string rootPath;   // Subtree of the backend to publish, "" for all of it
+    std::string segmentName = "learn-win32api-config";
+    std::string socketPath; // Empty: no change events
+    size_t slotSize = 4u << 20;
+    std::chrono::milliseconds pollInterval{250};
+};
+
+struct ConfigChange
+{
+    uint64_t generation = 0;
+    std::vector<std::string> keys; // Relative to the root; a removed key stands for its subtree
+};
+
+class ConfigService
+{
+public:
+    ConfigService(std::shared_ptr<RegistryBackend> backend, ConfigServiceOptions options);
+    ~ConfigService();
+    ConfigService(const ConfigService&) = delete;
+    ConfigService& operator=(const ConfigService&) = delete;
+
+    // Publishes the first generation, opens the socket and starts polling
+    bool Start(RegistryError& error);
+
+    // Closes the segment and the socket; readers see Live() turn false
+    void Stop();
+
+    // Captures the subtree and publishes it if it changed. The polling thread
+    // calls this; an owner that has just written can call it to skip the wait.
+    bool Refresh(RegistryError& error);
+
+    uint64_t Generation() const { return m_writer.Generation(); }
+    size_t SubscriberCount() const;
+
+private:
+    void Run();
+    void AcceptSubscribers();
+    void Notify(const ConfigChange& change);
+    bool Capture(RegistryTree& tree, RegistryError& error);
+
+    std::shared_ptr<RegistryBackend> m_backend;
+    ConfigServiceOptions m_options;
+    SharedConfigWriter m_writer;
+    RegistryTree m_published;
+
+    mutable std::mutex m_mutex; // Publishing and the subscriber list
+    std::condition_variable m_wake;
+    bool m_stop = false;
+    std::thread m_thread;
+
+    intptr_t m_listener = -1; // Socket handle, -1 when none
+    std::vector<intptr_t> m_subscribers;
+};
+
+// Change events from a ConfigService, for processes that read through
+// SharedConfigReader and want to react instead of polling Generation()
+class ConfigSubscription
+{
+public:
+    ~ConfigSubscription();
+
+    bool Connect(const std::string& socketPath, RegistryError& error);
+    void Close();
+    bool IsConnected() const { return m_socket != -1; }
+
+    // Waits up to timeoutMs (negative: no limit) for the next event. The first
+    // one after Connect carries the generation current then, with no keys.
+    // False on timeout, and when the service has gone away (IsConnected turns false).
+    bool WaitForChange(int timeoutMs, ConfigChange& change);
+
+private:
+    bool TakeEvent(ConfigChange& change);
+
+    intptr_t m_socket = -1;
+    std::string m_buffer; // Received bytes not yet returned as an event
+};
@@ -0,0 +1,187 @@
+#include "KeyExistenceCache.h"
+#include <algorithm>
+#include <mutex>
+
+static inline char LowerAscii(char ch)
+{
+    return (ch >= 'A' && ch <= 'Z') ? static_cast<char>(ch - 'A' + 'a') : ch;
+}
+
+static std::string LowerPath(std::string_view path)
+{
+    std::string lower(path);
+    for (char& ch : lower)
+    {
+        ch = LowerAscii(ch);
+    }
+    return lower;
+}
+
+// Only ASCII is folded before hashing, but the registry folds all of Unicode:
+// a non-ASCII name spelled in another case than the snapshot's would hash
+// elsewhere and be rejected although it exists
+static bool IsAsciiPath(std::string_view path)
+{
+    return std::all_of(path.begin(), path.end(), [](char ch) { return static_cast<unsigned char>(ch) < 0x80; });
+}
+
+std::string_view CanonicalKeyPath(std::string_view path, std::string& buffer)
+{
+    bool canonical = path.empty() || (path.front() != '\\' && path.back() != '\\' &&
+                                      path.find("\\\\") == std::string_view::npos);
+    if (canonical)
+    {
+        return path;
+    }
+
+    buffer.clear();
+    for (size_t i = 0; i < path.size(); ++i)
+    {
+        if (path[i] != '\\')
+        {
+            buffer += path[i];
+        }
+        else if (!buffer.empty() && buffer.back() != '\\')
+        {
+            buffer += '\\';
+        }
+    }
+    if (!buffer.empty() && buffer.back() == '\\')
+    {
+        buffer.pop_back();
+    }
+    return buffer;
+}
+
+uint64_t KeyBloomFilter::HashPath(std::string_view path)
+{
+    // FNV-1a over the lower-cased bytes, then a final mix so both halves are usable
+    uint64_t hash = 14695981039346656037ull;
+    for (char ch : path)
+    {
+        hash ^= static_cast<unsigned char>(LowerAscii(ch));
+        hash *= 1099511628211ull;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+void KeyBloomFilter::Build(const std::vector<std::string>& paths, int bitsPerKey)
+{
+    m_bitCount = std::max<uint64_t>(64, static_cast<uint64_t>(paths.size()) * bitsPerKey);
+    m_bits.assign(static_cast<size_t>((m_bitCount + 63) / 64), 0);
+    m_probes = std::max(1, std::min(16, static_cast<int>(bitsPerKey * 69 / 100))); // ln 2 * bits per key
+
+    for (const auto& path : paths)
+    {
+        uint64_t hash = HashPath(path);
+        uint64_t delta = (hash >> 32) | 1;
+        for (int i = 0; i < m_probes; ++i, hash += delta)
+        {
+            uint64_t bit = hash % m_bitCount;
+            m_bits[bit / 64] |= 1ull << (bit % 64);
+        }
+    }
+}
+
+void KeyBloomFilter::Clear()
+{
+    m_bits.clear();
+    m_bitCount = 0;
+}
+
+bool KeyBloomFilter::MayContain(std::string_view path) const
+{
+    uint64_t hash = HashPath(path);
+    uint64_t delta = (hash >> 32) | 1;
+    for (int i = 0; i < m_probes; ++i, hash += delta)
+    {
+        uint64_t bit = hash % m_bitCount;
+        if (!(m_bits[bit / 64] & (1ull << (bit % 64))))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+KeyExistenceCache::KeyExistenceCache(Clock::duration ttl, size_t maxEntries)
+    : m_ttl(ttl), m_maxEntries(maxEntries)
+{}
+
+void KeyExistenceCache::LoadSnapshot(const std::vector<std::string>& existingPaths)
+{
+    KeyBloomFilter bloom;
+    std::vector<std::string> canonicalPaths;
+    canonicalPaths.reserve(existingPaths.size());
+    std::string buffer;
+    for (const std::string& path : existingPaths)
+    {
+        canonicalPaths.emplace_back(CanonicalKeyPath(path, buffer));
+    }
+    bloom.Build(canonicalPaths);
+
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    m_bloom = std::move(bloom);
+    m_entries.clear();
+    ++m_generation;
+}
+
+void KeyExistenceCache::Invalidate()
+{
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    m_bloom.Clear();
+    m_entries.clear();
+    ++m_generation;
+}
+
+bool KeyExistenceCache::Exists(std::string_view path, const Probe& probe)
+{
+    std::string buffer;
+    path = CanonicalKeyPath(path, buffer);
+    std::string key;
+    Clock::time_point now;
+    uint64_t generation;
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        if (!m_bloom.Empty() && IsAsciiPath(path) && !m_bloom.MayContain(path))
+        {
+            m_bloomRejects.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        key = LowerPath(path);
+        now = Clock::now();
+        generation = m_generation;
+
+        auto it = m_entries.find(key);
+        if (it != m_entries.end() && it->second.expires > now)
+        {
+            m_cacheHits.fetch_add(1, std::memory_order_relaxed);
+            return it->second.exists;
+        }
+    }
+
+    // Probe without holding the lock; the registry call is the slow part
+    m_probes.fetch_add(1, std::memory_order_relaxed);
+    bool exists = probe(path);
+
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    if (generation != m_generation)
+    {
+        return exists; // Invalidated while probing, the answer may already be stale
+    }
+    if (m_entries.size() >= m_maxEntries)
+    {
+        m_entries.clear(); // Entries live for seconds, refilling is cheap
+    }
+    m_entries[std::move(key)] = {exists, now + m_ttl};
+    return exists;
+}
+
+KeyExistenceCache::Stats KeyExistenceCache::GetStats() const
+{
+    return {m_bloomRejects.load(), m_cacheHits.load(), m_probes.load()};
+}
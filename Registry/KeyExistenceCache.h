@@ -0,0 +1,89 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Drops leading and trailing '\' and collapses repeated ones, so "A\\B\" and
+// "A\B" are the same key. Returns path itself when it is already canonical,
+// otherwise a view of buffer.
+std::string_view CanonicalKeyPath(std::string_view path, std::string& buffer);
+
+// Bloom filter over registry key paths. Paths are hashed case-insensitively,
+// like the registry compares them.
+class KeyBloomFilter
+{
+public:
+    // bitsPerKey 10 with 7 probes gives about 1% false positives
+    void Build(const std::vector<std::string>& paths, int bitsPerKey = 10);
+    void Clear();
+
+    bool Empty() const { return m_bits.empty(); }
+    bool MayContain(std::string_view path) const;
+    size_t SizeInBytes() const { return m_bits.size() * sizeof(uint64_t); }
+
+    static uint64_t HashPath(std::string_view path);
+
+private:
+    std::vector<uint64_t> m_bits;
+    uint64_t m_bitCount = 0;
+    int m_probes = 0;
+};
+
+// Answers "does this key exist" for paths under one subtree without touching
+// the registry for most misses:
+// 1. a Bloom filter built from a snapshot of the subtree rejects keys that
+//    did not exist when the snapshot was taken (ASCII paths only, since it
+//    folds case like the registry for those alone);
+// 2. a short-TTL cache remembers recent answers, positive and negative;
+// 3. everything else goes to the probe (RegOpenKeyEx on Windows).
+// A change notification calls Invalidate(), which drops both until the next
+// snapshot is loaded, so a key created after the snapshot is never hidden.
+class KeyExistenceCache
+{
+public:
+    using Probe = std::function<bool(std::string_view path)>;
+    using Clock = std::chrono::steady_clock;
+
+    explicit KeyExistenceCache(Clock::duration ttl = std::chrono::seconds(2), size_t maxEntries = 65536);
+
+    // Snapshot paths are relative to the subtree root, like the queried paths.
+    // Both are passed through CanonicalKeyPath, and the probe gets the
+    // canonical form.
+    void LoadSnapshot(const std::vector<std::string>& existingPaths);
+    void Invalidate();
+
+    bool Exists(std::string_view path, const Probe& probe);
+
+    struct Stats
+    {
+        uint64_t bloomRejects;
+        uint64_t cacheHits;
+        uint64_t probes;
+    };
+    Stats GetStats() const;
+
+private:
+    struct Entry
+    {
+        bool exists;
+        Clock::time_point expires;
+    };
+
+    Clock::duration m_ttl;
+    size_t m_maxEntries;
+
+    mutable std::shared_mutex m_mutex;
+    KeyBloomFilter m_bloom; // Empty while no valid snapshot is loaded
+    std::unordered_map<std::string, Entry> m_entries; // Keyed by ASCII-lower-cased path
+    uint64_t m_generation = 0; // Bumped by every snapshot and invalidation
+
+    std::atomic<uint64_t> m_bloomRejects{0};
+    std::atomic<uint64_t> m_cacheHits{0};
+    std::atomic<uint64_t> m_probes{0};
+};
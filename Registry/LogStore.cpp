@@ -0,0 +1,405 @@
+#include "LogStore.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <optional>
+#include "../Common/Logger.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// Checkpoint file: a header record (magic, number of the first log it does
+// not cover), then records of changes that rebuild the tree
+static const uint32_t CHECKPOINT_MAGIC = 0x4B435252; // "RRCK"
+static const size_t CHECKPOINT_CHUNK = 1024;         // Changes per checkpoint record
+
+// Makes a rename inside the directory durable
+static void SyncDirectory(const std::string& directory)
+{
+#ifndef _WIN32
+    int fd = open(directory.c_str(), O_RDONLY);
+    if (fd >= 0)
+    {
+        fsync(fd);
+        close(fd);
+    }
+#else
+    (void)directory; // NTFS journals the rename itself
+#endif
+}
+
+// Numbers of the log.<hex> files in the directory, ascending
+static std::vector<uint64_t> ListLogs(const std::string& directory)
+{
+    std::vector<uint64_t> numbers;
+    std::error_code ec;
+    for (const fs::directory_entry& entry : fs::directory_iterator(directory, ec))
+    {
+        std::string name = entry.path().filename().string();
+        if (name.size() == 20 && name.compare(0, 4, "log.") == 0 &&
+            name.find_first_not_of("0123456789abcdef", 4) == std::string::npos)
+        {
+            numbers.push_back(std::stoull(name.substr(4), nullptr, 16));
+        }
+    }
+    std::sort(numbers.begin(), numbers.end());
+    return numbers;
+}
+
+LogStoreBackend::LogStoreBackend()
+{}
+
+LogStoreBackend::~LogStoreBackend()
+{
+    Close();
+}
+
+std::string LogStoreBackend::LogFileName(uint64_t number) const
+{
+    char name[24];
+    snprintf(name, sizeof(name), "log.%016llx", static_cast<unsigned long long>(number));
+    return (fs::path(m_directory) / name).string();
+}
+
+bool LogStoreBackend::Open(const std::string& directory, const Options& options, RegistryError& error)
+{
+    Close();
+    auto start = std::chrono::steady_clock::now();
+    m_directory = directory;
+    m_options = options;
+    if (!Recover(error))
+    {
+        return false;
+    }
+
+    int32_t result = m_log.Open(LogFileName(m_logNumber), false);
+    if (result != 0)
+    {
+        error = RegistryError(RegistryOperation::OpenStore, SystemError::Errno(result), LogFileName(m_logNumber));
+        return false;
+    }
+    m_recoveryMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    if (m_options.backgroundCompaction)
+    {
+        m_stopping = false;
+        m_compactRequested = false;
+        m_compactor = std::thread(&LogStoreBackend::CompactionLoop, this);
+    }
+    return true;
+}
+
+bool LogStoreBackend::Recover(RegistryError& error)
+{
+    std::error_code ec;
+    fs::create_directories(m_directory, ec);
+    if (ec)
+    {
+        error = RegistryError(RegistryOperation::OpenStore, SystemError::From(ec), m_directory);
+        return false;
+    }
+    m_state.Clear();
+    m_replayedRecords = 0;
+    m_checkpointBytes = 0;
+
+    // Checkpoints are renamed into place, so a damaged one is real damage
+    uint64_t firstLog = 0;
+    std::string checkpoint = (fs::path(m_directory) / "checkpoint").string();
+    std::string contents;
+    if (AppendLog::ReadFile(checkpoint, contents))
+    {
+        bool header = false;
+        bool applied = true;
+        size_t used = AppendLog::ReadRecords(contents, [&](const char* data, size_t size) {
+            RecordReader reader{data, size};
+            if (!header)
+            {
+                uint32_t magic;
+                header = reader.GetU32(magic) && magic == CHECKPOINT_MAGIC && reader.GetU64(firstLog);
+                return header;
+            }
+            std::vector<RegistryChange> changes;
+            size_t failedIndex;
+            applied = reader.GetChanges(changes) && m_state.ApplyChanges(changes, failedIndex) == REGISTRY_SUCCESS;
+            return applied;
+        });
+        if (!header || !applied || used != contents.size())
+        {
+            error = RegistryError(RegistryOperation::OpenStore, REGISTRY_CORRUPT, checkpoint);
+            return false;
+        }
+        m_checkpointBytes = contents.size();
+    }
+    fs::remove(fs::path(m_directory) / "checkpoint.tmp", ec);
+
+    std::vector<uint64_t> logs = ListLogs(m_directory);
+    m_logNumber = firstLog;
+    m_oldLogBytes = 0;
+    for (size_t i = 0; i < logs.size(); ++i)
+    {
+        std::string fileName = LogFileName(logs[i]);
+        if (logs[i] < firstLog)
+        {
+            fs::remove(fileName, ec); // Left behind by a compaction cut short
+            continue;
+        }
+
+        AppendLog::ReadFile(fileName, contents);
+        bool applied = true;
+        size_t used = AppendLog::ReadRecords(contents, [&](const char* data, size_t size) {
+            RecordReader reader{data, size};
+            std::vector<RegistryChange> changes;
+            size_t failedIndex;
+            applied = reader.GetChanges(changes) && m_state.ApplyChanges(changes, failedIndex) == REGISTRY_SUCCESS;
+            m_replayedRecords += applied;
+            return applied;
+        });
+        if (used != contents.size())
+        {
+            // Only the log being written when the process died can end in a torn record
+            if (!applied || i + 1 != logs.size())
+            {
+                error = RegistryError(RegistryOperation::OpenStore, REGISTRY_CORRUPT, fileName);
+                return false;
+            }
+            fs::resize_file(fileName, used, ec);
+        }
+        m_logNumber = logs[i];
+        if (i + 1 != logs.size())
+        {
+            m_oldLogBytes += used;
+        }
+    }
+    return true;
+}
+
+void LogStoreBackend::Close()
+{
+    if (m_compactor.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_threadMutex);
+            m_stopping = true;
+        }
+        m_compactWake.notify_all();
+        m_compactor.join();
+    }
+    m_log.Close();
+}
+
+int32_t LogStoreBackend::CreateKey(std::string_view path)
+{
+    return Write({RegistryChange::CREATE_KEY, std::string(path), {}, {}});
+}
+
+int32_t LogStoreBackend::DeleteKey(std::string_view path)
+{
+    return Write({RegistryChange::DELETE_KEY, std::string(path), {}, {}});
+}
+
+int32_t LogStoreBackend::KeyExists(std::string_view path)
+{
+    return m_state.KeyExists(path);
+}
+
+int32_t LogStoreBackend::SetValue(std::string_view path, std::string_view name, const RegistryValue& value)
+{
+    return Write({RegistryChange::SET_VALUE, std::string(path), std::string(name), value});
+}
+
+int32_t LogStoreBackend::QueryValue(std::string_view path, std::string_view name, RegistryValue& value)
+{
+    return m_state.QueryValue(path, name, value);
+}
+
+int32_t LogStoreBackend::DeleteValue(std::string_view path, std::string_view name)
+{
+    return Write({RegistryChange::DELETE_VALUE, std::string(path), std::string(name), {}});
+}
+
+int32_t LogStoreBackend::EnumSubkeys(std::string_view path, std::vector<std::string>& names)
+{
+    return m_state.EnumSubkeys(path, names);
+}
+
+int32_t LogStoreBackend::EnumValues(std::string_view path, std::vector<std::pair<std::string, RegistryValue>>& values)
+{
+    return m_state.EnumValues(path, values);
+}
+
+int32_t LogStoreBackend::Write(RegistryChange change)
+{
+    std::vector<RegistryChange> changes;
+    changes.push_back(std::move(change));
+    size_t failedIndex;
+    return ApplyChanges(changes, failedIndex);
+}
+
+int32_t LogStoreBackend::ApplyChanges(const std::vector<RegistryChange>& changes, size_t& failedIndex)
+{
+    std::unique_lock<std::mutex> lock(m_writeMutex);
+    if (!m_log.IsOpen())
+    {
+        failedIndex = 0;
+        return REGISTRY_IO_ERROR;
+    }
+    int32_t result = m_state.ApplyChanges(changes, failedIndex);
+    if (result != REGISTRY_SUCCESS)
+    {
+        return result;
+    }
+
+    std::string payload;
+    PutChanges(payload, changes);
+    uint64_t seq = m_log.Enqueue(payload);
+    bool compact = m_options.backgroundCompaction && ShouldCompact();
+    lock.unlock();
+
+    if (compact)
+    {
+        {
+            std::lock_guard<std::mutex> threadLock(m_threadMutex);
+            m_compactRequested = true;
+        }
+        m_compactWake.notify_one();
+    }
+
+    // Already visible to readers; an I/O error here also fails every later write
+    if (m_log.WaitDurable(seq) != 0)
+    {
+        failedIndex = changes.size();
+        return REGISTRY_IO_ERROR;
+    }
+    return REGISTRY_SUCCESS;
+}
+
+bool LogStoreBackend::ShouldCompact() const
+{
+    uint64_t logBytes = m_oldLogBytes + m_log.Size();
+    double limit = m_options.compactGrowth * static_cast<double>(m_checkpointBytes.load());
+    return logBytes >= m_options.compactMinBytes && static_cast<double>(logBytes) > limit;
+}
+
+bool LogStoreBackend::Compact(RegistryError& error)
+{
+    std::lock_guard<std::mutex> compacting(m_compactMutex);
+
+    // Rotate and take the snapshot together, so it is exactly the state at the
+    // start of the new log; exporting it does not hold up writers
+    std::vector<RegistryChange> snapshot;
+    uint64_t next;
+    std::optional<MemoryRegistryBackend::Snapshot> version;
+    {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        if (!m_log.IsOpen())
+        {
+            error = RegistryError(RegistryOperation::WriteStore, REGISTRY_IO_ERROR, m_directory);
+            return false;
+        }
+        next = m_logNumber + 1;
+        int32_t result = m_log.Rotate(LogFileName(next));
+        if (result != 0)
+        {
+            error = RegistryError(RegistryOperation::WriteStore, SystemError::Errno(result), LogFileName(next));
+            return false;
+        }
+        std::error_code ec;
+        m_oldLogBytes += fs::file_size(LogFileName(m_logNumber), ec);
+        m_logNumber = next;
+        version.emplace(m_state.TakeSnapshot());
+    }
+    version->Export(snapshot);
+    version.reset();
+
+    std::string data;
+    std::string payload;
+    PutU32(payload, CHECKPOINT_MAGIC);
+    PutU64(payload, next);
+    AppendLog::Frame(payload, data);
+    for (size_t i = 0; i < snapshot.size(); i += CHECKPOINT_CHUNK)
+    {
+        std::vector<RegistryChange> chunk(snapshot.begin() + i,
+                                          snapshot.begin() + (std::min)(snapshot.size(), i + CHECKPOINT_CHUNK));
+        payload.clear();
+        PutChanges(payload, chunk);
+        AppendLog::Frame(payload, data);
+    }
+
+    std::string temporary = (fs::path(m_directory) / "checkpoint.tmp").string();
+    std::string checkpoint = (fs::path(m_directory) / "checkpoint").string();
+    FILE* file = fopen(temporary.c_str(), "wb");
+    bool written = file && fwrite(data.data(), 1, data.size(), file) == data.size() && AppendLog::SyncFile(file);
+    if (file)
+    {
+        fclose(file);
+    }
+    std::error_code ec;
+    if (written)
+    {
+        fs::rename(temporary, checkpoint, ec);
+    }
+    if (!written || ec)
+    {
+        error = RegistryError(RegistryOperation::WriteStore, SystemError::From(ec), checkpoint);
+        fs::remove(temporary, ec);
+        return false;
+    }
+    SyncDirectory(m_directory);
+
+    // The checkpoint covers everything before the new log now
+    for (uint64_t number : ListLogs(m_directory))
+    {
+        if (number < next)
+        {
+            fs::remove(LogFileName(number), ec);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        m_oldLogBytes = 0;
+    }
+    m_checkpointBytes = data.size();
+    ++m_compactions;
+    return true;
+}
+
+void LogStoreBackend::CompactionLoop()
+{
+    std::unique_lock<std::mutex> lock(m_threadMutex);
+    while (true)
+    {
+        m_compactWake.wait(lock, [this] { return m_compactRequested || m_stopping; });
+        if (m_stopping)
+        {
+            return;
+        }
+        m_compactRequested = false;
+        lock.unlock();
+
+        RegistryError error;
+        if (!Compact(error))
+        {
+            LY_WRN("Registry store compaction failed: %s", error.Message());
+        }
+        lock.lock();
+    }
+}
+
+LogStoreBackend::Stats LogStoreBackend::GetStats() const
+{
+    Stats stats{};
+    {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        stats.logBytes = m_oldLogBytes + m_log.Size();
+    }
+    stats.checkpointBytes = m_checkpointBytes;
+    stats.syncs = m_log.Syncs();
+    stats.compactions = m_compactions;
+    stats.replayedRecords = m_replayedRecords;
+    stats.recoveryMs = m_recoveryMs;
+    return stats;
+}
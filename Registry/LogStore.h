@@ -0,0 +1,91 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "AppendLog.h"
+#include "MemoryBackend.h"
+#include "RegistryError.h"
+
+// Durable portable registry: an in-memory tree backed by a directory holding
+// a checkpoint of the whole tree and append-only logs of the batches applied
+// since. Every ApplyChanges batch is one log record, synced with group commit
+// before the call returns. Open loads the checkpoint and replays the logs,
+// dropping a torn record at the end of the last one. Compaction rotates to a
+// new log, writes the live tree as the next checkpoint and deletes the logs it
+// covers, so overwritten and deleted values stop taking space.
+class LogStoreBackend : public RegistryBackend
+{
+public:
+    struct Options
+    {
+        uint64_t compactMinBytes = 1 << 20; // Smaller logs are never compacted
+        double compactGrowth = 1.0;         // Compact once the log outgrows the checkpoint by this factor
+        bool backgroundCompaction = true;
+    };
+
+    LogStoreBackend();
+    ~LogStoreBackend() override;
+
+    bool Open(const std::string& directory, const Options& options, RegistryError& error);
+    void Close();
+
+    int32_t CreateKey(std::string_view path) override;
+    int32_t DeleteKey(std::string_view path) override;
+    int32_t KeyExists(std::string_view path) override;
+
+    int32_t SetValue(std::string_view path, std::string_view name, const RegistryValue& value) override;
+    int32_t QueryValue(std::string_view path, std::string_view name, RegistryValue& value) override;
+    int32_t DeleteValue(std::string_view path, std::string_view name) override;
+
+    int32_t EnumSubkeys(std::string_view path, std::vector<std::string>& names) override;
+    int32_t EnumValues(std::string_view path, std::vector<std::pair<std::string, RegistryValue>>& values) override;
+
+    int32_t ApplyChanges(const std::vector<RegistryChange>& changes, size_t& failedIndex) override;
+    MemoryRegistryBackend::Snapshot TakeSnapshot() const { return m_state.TakeSnapshot(); }
+    bool AtomicBatches() const override { return true; }
+    bool DurableBatches() const override { return true; }
+
+    // Synchronous compaction; the background thread calls this too
+    bool Compact(RegistryError& error);
+
+    struct Stats
+    {
+        uint64_t logBytes;        // Logs not yet covered by a checkpoint
+        uint64_t checkpointBytes;
+        uint64_t syncs;
+        uint64_t compactions;
+        uint64_t replayedRecords; // Log records applied by the last Open
+        double recoveryMs;        // Time spent in the last Open
+    };
+    Stats GetStats() const;
+
+private:
+    int32_t Write(RegistryChange change);
+    bool Recover(RegistryError& error);
+    bool ShouldCompact() const;
+    void CompactionLoop();
+    std::string LogFileName(uint64_t number) const;
+
+    MemoryRegistryBackend m_state;
+    AppendLog m_log;
+    std::string m_directory;
+    Options m_options;
+
+    mutable std::mutex m_writeMutex; // Orders log records; held to apply and enqueue, not to sync
+    uint64_t m_logNumber = 0;   // Current log file
+    uint64_t m_oldLogBytes = 0; // Earlier logs a running compaction has not deleted yet
+
+    std::mutex m_compactMutex; // One compaction at a time
+    std::mutex m_threadMutex;
+    std::condition_variable m_compactWake;
+    std::thread m_compactor;
+    bool m_compactRequested = false;
+    bool m_stopping = false;
+
+    std::atomic<uint64_t> m_checkpointBytes{0};
+    std::atomic<uint64_t> m_compactions{0};
+    uint64_t m_replayedRecords = 0;
+    double m_recoveryMs = 0;
+};
@@ -0,0 +1,455 @@
+#include "MemoryBackend.h"
+#include <algorithm>
+
+// Values and nodes carry the id of the batch that created them: a batch may
+// change its own objects in place, anything older it has to copy
+struct MemoryRegistryBackend::Value
+{
+    std::string name;
+    uint64_t batch;
+    RegistryValue value;
+};
+
+struct MemoryRegistryBackend::Node
+{
+    std::string name;
+    uint64_t batch;
+    std::vector<Node*> subkeys; // Sorted by name, case-insensitive
+    std::vector<Value*> values; // Sorted by name, case-insensitive
+};
+
+template <class T>
+static typename std::vector<T*>::const_iterator FindNamed(const std::vector<T*>& items, std::string_view name)
+{
+    auto it = std::lower_bound(items.begin(), items.end(), name,
+                               [](const T* item, std::string_view key) { return LessNoCase()(item->name, key); });
+    return it != items.end() && EqualsNoCase((*it)->name, name) ? it : items.end();
+}
+
+template <class T>
+static typename std::vector<T*>::iterator InsertPosition(std::vector<T*>& items, std::string_view name)
+{
+    return std::lower_bound(items.begin(), items.end(), name,
+                            [](const T* item, std::string_view key) { return LessNoCase()(item->name, key); });
+}
+
+MemoryRegistryBackend::MemoryRegistryBackend() : m_root(new Node{{}, 0, {}, {}})
+{}
+
+MemoryRegistryBackend::~MemoryRegistryBackend()
+{
+    FreeTree(m_root.load());
+    for (Retired& retired : m_retired)
+    {
+        for (Node* node : retired.nodes)
+        {
+            delete node;
+        }
+        for (Value* value : retired.values)
+        {
+            delete value;
+        }
+    }
+}
+
+void MemoryRegistryBackend::FreeTree(Node* node)
+{
+    for (Node* child : node->subkeys)
+    {
+        FreeTree(child);
+    }
+    for (Value* value : node->values)
+    {
+        delete value;
+    }
+    delete node;
+}
+
+MemoryRegistryBackend::Snapshot MemoryRegistryBackend::TakeSnapshot() const
+{
+    Epoch::Guard guard; // Pin before loading the root
+    const Node* root = m_root.load();
+    return Snapshot(std::move(guard), root);
+}
+
+const MemoryRegistryBackend::Node* MemoryRegistryBackend::FindNode(const Node* root, std::string_view path)
+{
+    const Node* node = root;
+    for (std::string_view part : SplitKeyPath(path))
+    {
+        auto it = FindNamed(node->subkeys, part);
+        if (it == node->subkeys.end())
+        {
+            return nullptr;
+        }
+        node = *it;
+    }
+    return node;
+}
+
+int32_t MemoryRegistryBackend::Snapshot::KeyExists(std::string_view path) const
+{
+    return FindNode(m_root, path) ? REGISTRY_SUCCESS : REGISTRY_NOT_FOUND;
+}
+
+int32_t MemoryRegistryBackend::Snapshot::QueryValue(std::string_view path, std::string_view name, RegistryValue& value) const
+{
+    const Node* node = FindNode(m_root, path);
+    if (!node)
+    {
+        return REGISTRY_KEY_NOT_FOUND;
+    }
+    auto it = FindNamed(node->values, name);
+    if (it == node->values.end())
+    {
+        return REGISTRY_NOT_FOUND;
+    }
+    value = (*it)->value;
+    return REGISTRY_SUCCESS;
+}
+
+int32_t MemoryRegistryBackend::Snapshot::EnumSubkeys(std::string_view path, std::vector<std::string>& names) const
+{
+    const Node* node = FindNode(m_root, path);
+    if (!node)
+    {
+        return REGISTRY_NOT_FOUND;
+    }
+    names.clear();
+    for (const Node* child : node->subkeys)
+    {
+        names.push_back(child->name);
+    }
+    return REGISTRY_SUCCESS;
+}
+
+int32_t MemoryRegistryBackend::Snapshot::EnumValues(std::string_view path, std::vector<std::pair<std::string, RegistryValue>>& values) const
+{
+    const Node* node = FindNode(m_root, path);
+    if (!node)
+    {
+        return REGISTRY_NOT_FOUND;
+    }
+    values.clear();
+    for (const Value* value : node->values)
+    {
+        values.emplace_back(value->name, value->value);
+    }
+    return REGISTRY_SUCCESS;
+}
+
+int32_t MemoryRegistryBackend::KeyExists(std::string_view path)
+{
+    return TakeSnapshot().KeyExists(path);
+}
+
+int32_t MemoryRegistryBackend::QueryValue(std::string_view path, std::string_view name, RegistryValue& value)
+{
+    return TakeSnapshot().QueryValue(path, name, value);
+}
+
+int32_t MemoryRegistryBackend::EnumSubkeys(std::string_view path, std::vector<std::string>& names)
+{
+    return TakeSnapshot().EnumSubkeys(path, names);
+}
+
+int32_t MemoryRegistryBackend::EnumValues(std::string_view path, std::vector<std::pair<std::string, RegistryValue>>& values)
+{
+    return TakeSnapshot().EnumValues(path, values);
+}
+
+int32_t MemoryRegistryBackend::CreateKey(std::string_view path)
+{
+    size_t failedIndex;
+    return ApplyBatch({{RegistryChange::CREATE_KEY, std::string(path), {}, {}}}, failedIndex);
+}
+
+int32_t MemoryRegistryBackend::DeleteKey(std::string_view path)
+{
+    size_t failedIndex;
+    return ApplyBatch({{RegistryChange::DELETE_KEY, std::string(path), {}, {}}}, failedIndex);
+}
+
+int32_t MemoryRegistryBackend::SetValue(std::string_view path, std::string_view name, const RegistryValue& value)
+{
+    size_t failedIndex;
+    return ApplyBatch({{RegistryChange::SET_VALUE, std::string(path), std::string(name), value}}, failedIndex);
+}
+
+int32_t MemoryRegistryBackend::DeleteValue(std::string_view path, std::string_view name)
+{
+    size_t failedIndex;
+    return ApplyBatch({{RegistryChange::DELETE_VALUE, std::string(path), std::string(name), {}}}, failedIndex);
+}
+
+MemoryRegistryBackend::Node* MemoryRegistryBackend::Writable(Node* node, Batch& batch)
+{
+    if (node->batch == batch.id)
+    {
+        return node;
+    }
+    Node* copy = new Node(*node); // Shares children and values with the original
+    copy->batch = batch.id;
+    batch.createdNodes.push_back(copy);
+    batch.replacedNodes.push_back(node);
+    return copy;
+}
+
+// Copies the key and its ancestors into the batch, creating missing keys when asked
+MemoryRegistryBackend::Node* MemoryRegistryBackend::WritableKey(Batch& batch, std::string_view path, bool create)
+{
+    Node* node = batch.root = Writable(batch.root, batch);
+    for (std::string_view part : SplitKeyPath(path))
+    {
+        auto position = InsertPosition(node->subkeys, part);
+        if (position != node->subkeys.end() && EqualsNoCase((*position)->name, part))
+        {
+            *position = Writable(*position, batch);
+        }
+        else if (create)
+        {
+            Node* child = new Node{std::string(part), batch.id, {}, {}};
+            batch.createdNodes.push_back(child);
+            position = node->subkeys.insert(position, child);
+        }
+        else
+        {
+            return nullptr;
+        }
+        node = *position;
+    }
+    return node;
+}
+
+void MemoryRegistryBackend::Release(Value* value, Batch& batch)
+{
+    (value->batch == batch.id ? batch.droppedValues : batch.replacedValues).push_back(value);
+}
+
+int32_t MemoryRegistryBackend::Apply(Batch& batch, const RegistryChange& change)
+{
+    switch (change.kind)
+    {
+        case RegistryChange::CREATE_KEY:
+        {
+            // Creating a key that exists is common and should not copy anything
+            if (!FindNode(batch.root, change.path))
+            {
+                WritableKey(batch, change.path, true);
+            }
+            return REGISTRY_SUCCESS;
+        }
+        case RegistryChange::DELETE_KEY:
+        {
+            std::vector<std::string_view> parts = SplitKeyPath(change.path);
+            const Node* target = FindNode(batch.root, change.path);
+            if (parts.empty() || !target)
+            {
+                return parts.empty() ? REGISTRY_INVALID_PARAMETER : REGISTRY_NOT_FOUND;
+            }
+            if (!target->subkeys.empty())
+            {
+                return REGISTRY_KEY_HAS_CHILDREN;
+            }
+            std::string_view parentPath = change.path;
+            parentPath = parentPath.substr(0, parts.back().data() - change.path.data());
+            Node* parent = WritableKey(batch, parentPath, false);
+            auto position = InsertPosition(parent->subkeys, parts.back());
+            Node* child = *position;
+            parent->subkeys.erase(position);
+            for (Value* value : child->values)
+            {
+                Release(value, batch);
+            }
+            (child->batch == batch.id ? batch.droppedNodes : batch.replacedNodes).push_back(child);
+            return REGISTRY_SUCCESS;
+        }
+        case RegistryChange::SET_VALUE:
+        {
+            if (!FindNode(batch.root, change.path))
+            {
+                return REGISTRY_KEY_NOT_FOUND;
+            }
+            Node* node = WritableKey(batch, change.path, false);
+            auto position = InsertPosition(node->values, change.name);
+            if (position != node->values.end() && EqualsNoCase((*position)->name, change.name))
+            {
+                if ((*position)->batch == batch.id)
+                {
+                    (*position)->value = change.value;
+                    return REGISTRY_SUCCESS;
+                }
+                batch.replacedValues.push_back(*position);
+                *position = new Value{(*position)->name, batch.id, change.value};
+            }
+            else
+            {
+                position = node->values.insert(position, new Value{change.name, batch.id, change.value});
+            }
+            batch.createdValues.push_back(*position);
+            return REGISTRY_SUCCESS;
+        }
+        case RegistryChange::DELETE_VALUE:
+        {
+            const Node* existing = FindNode(batch.root, change.path);
+            if (!existing)
+            {
+                return REGISTRY_KEY_NOT_FOUND;
+            }
+            if (FindNamed(existing->values, change.name) == existing->values.end())
+            {
+                return REGISTRY_NOT_FOUND;
+            }
+            Node* node = WritableKey(batch, change.path, false);
+            auto position = InsertPosition(node->values, change.name);
+            Release(*position, batch);
+            node->values.erase(position);
+            return REGISTRY_SUCCESS;
+        }
+    }
+    return REGISTRY_INVALID_PARAMETER;
+}
+
+int32_t MemoryRegistryBackend::ApplyChanges(const std::vector<RegistryChange>& changes, size_t& failedIndex)
+{
+    return ApplyBatch(changes, failedIndex);
+}
+
+int32_t MemoryRegistryBackend::ApplyBatch(const std::vector<RegistryChange>& changes, size_t& failedIndex)
+{
+    std::lock_guard<std::mutex> lock(m_writeMutex);
+    Batch batch{};
+    batch.id = m_nextBatch++;
+    Node* published = m_root.load();
+    batch.root = published;
+
+    for (size_t i = 0; i < changes.size(); ++i)
+    {
+        int32_t result = Apply(batch, changes[i]);
+        if (result != REGISTRY_SUCCESS)
+        {
+            // Nothing was published; only the batch's own objects exist to be freed
+            for (Node* node : batch.createdNodes)
+            {
+                delete node;
+            }
+            for (Value* value : batch.createdValues)
+            {
+                delete value;
+            }
+            failedIndex = i;
+            return result;
+        }
+    }
+    for (Node* node : batch.droppedNodes)
+    {
+        delete node;
+    }
+    for (Value* value : batch.droppedValues)
+    {
+        delete value;
+    }
+    if (batch.root == published)
+    {
+        return REGISTRY_SUCCESS;
+    }
+
+    // Later batches have other ids, so from here on these objects are copied, never changed
+    m_root.store(batch.root);
+    ++m_versions;
+    Retired retired{Epoch::Retire(), std::move(batch.replacedNodes), std::move(batch.replacedValues)};
+    m_retiredPending += retired.nodes.size() + retired.values.size();
+    m_retired.push_back(std::move(retired));
+    Reclaim();
+    return REGISTRY_SUCCESS;
+}
+
+void MemoryRegistryBackend::Reclaim()
+{
+    uint64_t oldest = Epoch::OldestActive();
+    while (!m_retired.empty() && m_retired.front().epoch < oldest)
+    {
+        Retired& retired = m_retired.front();
+        for (Node* node : retired.nodes)
+        {
+            delete node;
+        }
+        for (Value* value : retired.values)
+        {
+            delete value;
+        }
+        size_t count = retired.nodes.size() + retired.values.size();
+        m_retiredPending -= count;
+        m_reclaimed += count;
+        m_retired.pop_front();
+    }
+}
+
+size_t MemoryRegistryBackend::KeyCount() const
+{
+    Snapshot snapshot = TakeSnapshot();
+    size_t count = 0;
+    std::vector<const Node*> pending{snapshot.m_root};
+    while (!pending.empty())
+    {
+        const Node* node = pending.back();
+        pending.pop_back();
+        count += node->subkeys.size();
+        pending.insert(pending.end(), node->subkeys.begin(), node->subkeys.end());
+    }
+    return count;
+}
+
+void MemoryRegistryBackend::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_writeMutex);
+    Node* old = m_root.exchange(new Node{{}, 0, {}, {}});
+    Retired retired{0, {}, {}};
+    std::vector<Node*> pending{old};
+    while (!pending.empty())
+    {
+        Node* node = pending.back();
+        pending.pop_back();
+        retired.nodes.push_back(node);
+        retired.values.insert(retired.values.end(), node->values.begin(), node->values.end());
+        pending.insert(pending.end(), node->subkeys.begin(), node->subkeys.end());
+    }
+    retired.epoch = Epoch::Retire();
+    ++m_versions;
+    m_retiredPending += retired.nodes.size() + retired.values.size();
+    m_retired.push_back(std::move(retired));
+    Reclaim();
+}
+
+void MemoryRegistryBackend::Export(std::vector<RegistryChange>& changes) const
+{
+    TakeSnapshot().Export(changes);
+}
+
+void MemoryRegistryBackend::Snapshot::Export(std::vector<RegistryChange>& changes) const
+{
+    std::vector<std::pair<std::string, const Node*>> pending{{std::string(), m_root}};
+    while (!pending.empty())
+    {
+        auto [path, node] = std::move(pending.back());
+        pending.pop_back();
+        if (!path.empty())
+        {
+            changes.push_back({RegistryChange::CREATE_KEY, path, {}, {}});
+        }
+        for (const Value* value : node->values)
+        {
+            changes.push_back({RegistryChange::SET_VALUE, path, value->name, value->value});
+        }
+        for (const Node* child : node->subkeys)
+        {
+            pending.emplace_back(path.empty() ? child->name : path + '\\' + child->name, child);
+        }
+    }
+}
+
+MemoryRegistryBackend::Stats MemoryRegistryBackend::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_writeMutex);
+    return {m_versions, m_retiredPending, m_reclaimed};
+}
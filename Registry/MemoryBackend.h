@@ -0,0 +1,113 @@
+#pragma once
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include "RegistryBackend.h"
+#include "../Common/Epoch.h"
+
+// Portable in-memory registry tree with multi-version concurrency control.
+// Published versions are immutable: a write batch copies the keys it changes
+// and their ancestors, shares everything else with the previous version and
+// publishes the new root with one atomic store. Readers never lock; they pin
+// an epoch, load the root and see that version whole. Replaced keys and values
+// are freed once no pinned reader can reach them. Writers are serialized.
+class MemoryRegistryBackend : public RegistryBackend
+{
+    struct Node;
+    struct Value;
+
+public:
+    // One consistent version of the tree, readable from any thread without
+    // locks. Holding it keeps replaced versions alive, so keep it short-lived.
+    class Snapshot
+    {
+    public:
+        int32_t KeyExists(std::string_view path) const;
+        int32_t QueryValue(std::string_view path, std::string_view name, RegistryValue& value) const;
+        int32_t EnumSubkeys(std::string_view path, std::vector<std::string>& names) const;
+        int32_t EnumValues(std::string_view path, std::vector<std::pair<std::string, RegistryValue>>& values) const;
+        void Export(std::vector<RegistryChange>& changes) const;
+
+    private:
+        friend class MemoryRegistryBackend;
+        Snapshot(Epoch::Guard guard, const Node* root) : m_guard(std::move(guard)), m_root(root)
+        {}
+
+        Epoch::Guard m_guard;
+        const Node* m_root;
+    };
+
+    MemoryRegistryBackend();
+    ~MemoryRegistryBackend() override; // No snapshot may outlive the backend
+
+    Snapshot TakeSnapshot() const;
+
+    int32_t CreateKey(std::string_view path) override;
+    int32_t DeleteKey(std::string_view path) override;
+    int32_t KeyExists(std::string_view path) override;
+
+    int32_t SetValue(std::string_view path, std::string_view name, const RegistryValue& value) override;
+    int32_t QueryValue(std::string_view path, std::string_view name, RegistryValue& value) override;
+    int32_t DeleteValue(std::string_view path, std::string_view name) override;
+
+    int32_t EnumSubkeys(std::string_view path, std::vector<std::string>& names) override;
+    int32_t EnumValues(std::string_view path, std::vector<std::pair<std::string, RegistryValue>>& values) override;
+
+    // All of a batch becomes visible at once; a failed batch is never published
+    int32_t ApplyChanges(const std::vector<RegistryChange>& changes, size_t& failedIndex) override;
+    bool AtomicBatches() const override { return true; }
+
+    size_t KeyCount() const;
+    void Clear();
+
+    // The whole tree as changes that rebuild it: every key, then its values
+    void Export(std::vector<RegistryChange>& changes) const;
+
+    struct Stats
+    {
+        uint64_t versions;       // Batches published
+        uint64_t retiredPending; // Replaced keys and values a reader may still see
+        uint64_t reclaimed;      // Replaced keys and values freed
+    };
+    Stats GetStats() const;
+
+private:
+    // Everything a write batch has touched, so it can be published or dropped
+    struct Batch
+    {
+        uint64_t id;
+        Node* root;
+        std::vector<Node*> createdNodes;    // Private to the batch until published
+        std::vector<Value*> createdValues;
+        std::vector<Node*> replacedNodes;   // Published, unreachable from the new root
+        std::vector<Value*> replacedValues;
+        std::vector<Node*> droppedNodes;    // Created by the batch, then removed again
+        std::vector<Value*> droppedValues;
+    };
+
+    struct Retired
+    {
+        uint64_t epoch;
+        std::vector<Node*> nodes;
+        std::vector<Value*> values;
+    };
+
+    // Not virtual, so subclasses overriding the single-change calls are not re-entered
+    int32_t ApplyBatch(const std::vector<RegistryChange>& changes, size_t& failedIndex);
+    static const Node* FindNode(const Node* root, std::string_view path);
+    static Node* Writable(Node* node, Batch& batch);
+    static Node* WritableKey(Batch& batch, std::string_view path, bool create);
+    static int32_t Apply(Batch& batch, const RegistryChange& change);
+    static void Release(Value* value, Batch& batch);
+    static void FreeTree(Node* node);
+    void Reclaim();
+
+    std::atomic<Node*> m_root;
+    mutable std::mutex m_writeMutex;
+    uint64_t m_nextBatch = 1;
+    std::deque<Retired> m_retired; // Oldest first
+    uint64_t m_versions = 0;
+    uint64_t m_retiredPending = 0;
+    uint64_t m_reclaimed = 0;
+};
@@ -0,0 +1,327 @@
+#include "RegFile.h"
+#include "AppendLog.h"
+#include "../Common/Utf.h"
+
+// UTF-16LE bytes to UTF-8; unpaired surrogates become U+FFFD
+static std::string Utf16LeToUtf8(const uint8_t* data, size_t units)
+{
+    std::u16string text(units, u'\0');
+    for (size_t i = 0; i < units; ++i)
+    {
+        text[i] = static_cast<char16_t>(data[i * 2] | (data[i * 2 + 1] << 8));
+    }
+    std::string out;
+    Utf16ToUtf8(text, out, InvalidText::Replace);
+    return out;
+}
+
+static std::string_view Trim(std::string_view text)
+{
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t'))
+    {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t' || text.back() == '\r'))
+    {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+static bool StartsWithNoCase(std::string_view text, std::string_view prefix)
+{
+    return text.size() >= prefix.size() && EqualsNoCase(text.substr(0, prefix.size()), prefix);
+}
+
+static std::string ExpandHive(std::string_view path)
+{
+    static const std::pair<const char*, const char*> SHORT_NAMES[] = {
+        {"HKCR", "HKEY_CLASSES_ROOT"},
+        {"HKCU", "HKEY_CURRENT_USER"},
+        {"HKLM", "HKEY_LOCAL_MACHINE"},
+        {"HKU", "HKEY_USERS"},
+        {"HKCC", "HKEY_CURRENT_CONFIG"},
+    };
+    size_t end = path.find('\\');
+    std::string_view hive = path.substr(0, end);
+    for (const auto& [shortName, longName] : SHORT_NAMES)
+    {
+        if (EqualsNoCase(hive, shortName))
+        {
+            return longName + std::string(end == std::string_view::npos ? std::string_view() : path.substr(end));
+        }
+    }
+    return std::string(path);
+}
+
+// A quoted string with \\ and \" escapes; text starts at the opening quote
+static bool ParseQuoted(std::string_view& text, std::string& out)
+{
+    out.clear();
+    for (size_t i = 1; i < text.size(); ++i)
+    {
+        if (text[i] == '\\' && i + 1 < text.size())
+        {
+            out += text[++i];
+        }
+        else if (text[i] == '"')
+        {
+            text.remove_prefix(i + 1);
+            return true;
+        }
+        else
+        {
+            out += text[i];
+        }
+    }
+    return false;
+}
+
+static int HexDigit(char ch)
+{
+    if (ch >= '0' && ch <= '9') return ch - '0';
+    if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+    return -1;
+}
+
+// Comma-separated bytes, as in hex:01,02 or hex(2):41,00,00,00
+static bool ParseHexBytes(std::string_view text, std::string& out)
+{
+    out.clear();
+    text = Trim(text);
+    while (!text.empty())
+    {
+        if (text.size() < 2 || HexDigit(text[0]) < 0 || HexDigit(text[1]) < 0)
+        {
+            return false;
+        }
+        out += static_cast<char>(HexDigit(text[0]) * 16 + HexDigit(text[1]));
+        text = Trim(text.substr(2));
+        if (!text.empty())
+        {
+            if (text[0] != ',')
+            {
+                return false;
+            }
+            text = Trim(text.substr(1));
+        }
+    }
+    return true;
+}
+
+static bool ParseValueData(std::string_view text, RegistryValue& value)
+{
+    if (!text.empty() && text[0] == '"')
+    {
+        value.type = VALUE_STRING;
+        return ParseQuoted(text, value.data) && Trim(text).empty();
+    }
+    if (StartsWithNoCase(text, "dword:"))
+    {
+        std::string_view digits = Trim(text.substr(6));
+        uint32_t number = 0;
+        if (digits.empty() || digits.size() > 8)
+        {
+            return false;
+        }
+        for (char ch : digits)
+        {
+            if (HexDigit(ch) < 0)
+            {
+                return false;
+            }
+            number = number * 16 + HexDigit(ch);
+        }
+        value = RegistryValue::DWord(number);
+        return true;
+    }
+    if (!StartsWithNoCase(text, "hex"))
+    {
+        return false;
+    }
+
+    text.remove_prefix(3);
+    value.type = VALUE_BINARY;
+    if (!text.empty() && text[0] == '(')
+    {
+        size_t close = text.find(')');
+        if (close == std::string_view::npos || close == 1)
+        {
+            return false;
+        }
+        value.type = 0;
+        for (char ch : text.substr(1, close - 1))
+        {
+            if (HexDigit(ch) < 0)
+            {
+                return false;
+            }
+            value.type = value.type * 16 + HexDigit(ch);
+        }
+        text.remove_prefix(close + 1);
+    }
+    if (text.empty() || text[0] != ':' || !ParseHexBytes(text.substr(1), value.data))
+    {
+        return false;
+    }
+
+    // String types are stored as UTF-16 with terminators, kept here as UTF-8 without them
+    if (value.type == VALUE_STRING || value.type == VALUE_EXPAND_STRING || value.type == VALUE_MULTI_STRING)
+    {
+        std::string text8 = Utf16LeToUtf8(reinterpret_cast<const uint8_t*>(value.data.data()), value.data.size() / 2);
+        while (!text8.empty() && text8.back() == '\0')
+        {
+            text8.pop_back();
+        }
+        value.data.swap(text8);
+    }
+    return true;
+}
+
+bool ParseRegFile(std::string_view text, std::string_view sourceName, std::vector<RegistryDelta>& entries,
+                  RegistryError& error)
+{
+    std::string converted;
+    if (text.size() >= 2 && static_cast<uint8_t>(text[0]) == 0xFF && static_cast<uint8_t>(text[1]) == 0xFE)
+    {
+        converted = Utf16LeToUtf8(reinterpret_cast<const uint8_t*>(text.data()) + 2, (text.size() - 2) / 2);
+        text = converted;
+    }
+    else if (text.size() >= 3 && text.substr(0, 3) == "\xEF\xBB\xBF")
+    {
+        text.remove_prefix(3);
+    }
+
+    size_t lineNumber = 0;
+    auto fail = [&](size_t line)
+    {
+        error = RegistryError(RegistryOperation::ParseRegFile, REGISTRY_INVALID_PARAMETER,
+                              std::string(sourceName) + ":" + std::to_string(line));
+        return false;
+    };
+
+    bool sawHeader = false;
+    std::string currentKey;
+    bool inKey = false;
+    std::string logical;
+    size_t position = 0;
+    while (position < text.size())
+    {
+        size_t end = text.find('\n', position);
+        if (end == std::string_view::npos)
+        {
+            end = text.size();
+        }
+        std::string_view line = Trim(text.substr(position, end - position));
+        position = end + 1;
+        ++lineNumber;
+        size_t firstLine = lineNumber;
+
+        // Long hex data continues on the next lines after a trailing backslash
+        if (!line.empty() && line.back() == '\\' && (line[0] == '"' || line[0] == '@'))
+        {
+            logical.assign(line.substr(0, line.size() - 1));
+            while (position < text.size())
+            {
+                end = text.find('\n', position);
+                if (end == std::string_view::npos)
+                {
+                    end = text.size();
+                }
+                std::string_view next = Trim(text.substr(position, end - position));
+                position = end + 1;
+                ++lineNumber;
+                bool more = !next.empty() && next.back() == '\\';
+                logical += more ? next.substr(0, next.size() - 1) : next;
+                if (!more)
+                {
+                    break;
+                }
+            }
+            line = logical;
+        }
+
+        if (line.empty() || line[0] == ';')
+        {
+            continue;
+        }
+        if (!sawHeader)
+        {
+            if (line != "Windows Registry Editor Version 5.00" && line != "REGEDIT4")
+            {
+                return fail(firstLine);
+            }
+            sawHeader = true;
+            continue;
+        }
+
+        if (line[0] == '[')
+        {
+            size_t close = line.rfind(']');
+            if (close == std::string_view::npos || close < 2)
+            {
+                return fail(firstLine);
+            }
+            bool remove = line[1] == '-';
+            std::string path = ExpandHive(line.substr(remove ? 2 : 1, close - (remove ? 2 : 1)));
+            if (path.empty())
+            {
+                return fail(firstLine);
+            }
+            entries.push_back({remove ? RegistryDelta::KEY_REMOVED : RegistryDelta::KEY_ADDED, path, {}, {}, {}});
+            currentKey = std::move(path);
+            inKey = !remove; // Values after a removed key have nowhere to go
+            continue;
+        }
+
+        if (!inKey)
+        {
+            return fail(firstLine);
+        }
+        std::string name;
+        std::string_view rest = line;
+        if (rest[0] == '@')
+        {
+            rest.remove_prefix(1);
+        }
+        else if (rest[0] != '"' || !ParseQuoted(rest, name))
+        {
+            return fail(firstLine);
+        }
+        rest = Trim(rest);
+        if (rest.empty() || rest[0] != '=')
+        {
+            return fail(firstLine);
+        }
+        rest = Trim(rest.substr(1));
+        if (rest == "-")
+        {
+            entries.push_back({RegistryDelta::VALUE_REMOVED, currentKey, std::move(name), {}, {}});
+            continue;
+        }
+        RegistryValue value;
+        if (!ParseValueData(rest, value))
+        {
+            return fail(firstLine);
+        }
+        entries.push_back({RegistryDelta::VALUE_ADDED, currentKey, std::move(name), {}, std::move(value)});
+    }
+
+    if (!sawHeader)
+    {
+        return fail(lineNumber ? lineNumber : 1);
+    }
+    return true;
+}
+
+bool ReadRegFile(const std::string& fileName, std::vector<RegistryDelta>& entries, RegistryError& error)
+{
+    std::string contents;
+    if (!AppendLog::ReadFile(fileName, contents))
+    {
+        error = RegistryError(RegistryOperation::ParseRegFile, REGISTRY_NOT_FOUND, fileName);
+        return false;
+    }
+    return ParseRegFile(contents, fileName, entries, error);
+}
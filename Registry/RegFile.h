@@ -0,0 +1,16 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include "RegistryDiff.h"
+#include "RegistryError.h"
+
+// Reads .reg files as written by regedit and FormatRegPatch: REGEDIT4 or
+// version 5.00, ANSI/UTF-8 or UTF-16LE with a byte order mark. Each entry
+// is one line of the file, in order: [key] gives KEY_ADDED, [-key]
+// KEY_REMOVED, "name"=data VALUE_ADDED and "name"=- VALUE_REMOVED. Paths
+// keep their hive, with HKCR, HKCU, HKLM, HKU and HKCC spelled out.
+// Errors name the source and line, e.g. "context-menus.reg:12".
+bool ParseRegFile(std::string_view text, std::string_view sourceName, std::vector<RegistryDelta>& entries,
+                  RegistryError& error);
+bool ReadRegFile(const std::string& fileName, std::vector<RegistryDelta>& entries, RegistryError& error);
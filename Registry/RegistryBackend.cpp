@@ -0,0 +1,97 @@
+#include "RegistryBackend.h"
+
+RegistryValue RegistryValue::String(std::string_view text)
+{
+    return {VALUE_STRING, std::string(text)};
+}
+
+RegistryValue RegistryValue::DWord(uint32_t number)
+{
+    RegistryValue value{VALUE_DWORD, std::string(sizeof(number), '\0')};
+    for (size_t i = 0; i < sizeof(number); ++i)
+    {
+        value.data[i] = static_cast<char>((number >> (i * 8)) & 0xFF);
+    }
+    return value;
+}
+
+int32_t ApplyChange(RegistryBackend& backend, const RegistryChange& change)
+{
+    switch (change.kind)
+    {
+        case RegistryChange::CREATE_KEY: return backend.CreateKey(change.path);
+        case RegistryChange::DELETE_KEY: return backend.DeleteKey(change.path);
+        case RegistryChange::SET_VALUE: return backend.SetValue(change.path, change.name, change.value);
+        case RegistryChange::DELETE_VALUE: return backend.DeleteValue(change.path, change.name);
+    }
+    return REGISTRY_INVALID_PARAMETER;
+}
+
+int32_t RegistryBackend::ApplyChanges(const std::vector<RegistryChange>& changes, size_t& failedIndex)
+{
+    for (size_t i = 0; i < changes.size(); ++i)
+    {
+        int32_t result = ApplyChange(*this, changes[i]);
+        if (result != REGISTRY_SUCCESS)
+        {
+            failedIndex = i;
+            return result;
+        }
+    }
+    return REGISTRY_SUCCESS;
+}
+
+std::vector<std::string_view> SplitKeyPath(std::string_view path)
+{
+    std::vector<std::string_view> parts;
+    size_t start = 0;
+    while (start <= path.size())
+    {
+        size_t end = path.find('\\', start);
+        if (end == std::string_view::npos)
+        {
+            end = path.size();
+        }
+        if (end > start)
+        {
+            parts.push_back(path.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    return parts;
+}
+
+static inline unsigned char FoldCase(char ch)
+{
+    return (ch >= 'A' && ch <= 'Z') ? static_cast<unsigned char>(ch - 'A' + 'a') : static_cast<unsigned char>(ch);
+}
+
+bool EqualsNoCase(std::string_view a, std::string_view b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        if (FoldCase(a[i]) != FoldCase(b[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool LessNoCase::operator()(std::string_view a, std::string_view b) const
+{
+    size_t count = a.size() < b.size() ? a.size() : b.size();
+    for (size_t i = 0; i < count; ++i)
+    {
+        unsigned char x = FoldCase(a[i]), y = FoldCase(b[i]);
+        if (x != y)
+        {
+            return x < y;
+        }
+    }
+    return a.size() < b.size();
+}
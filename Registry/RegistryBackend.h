@@ -0,0 +1,107 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Result codes use the Win32 numbering, so the Win32 backend can return its
+// own codes unchanged. RegistryCodeText gives their text; they are not errno
+// values and must not go to strerror.
+constexpr int32_t REGISTRY_SUCCESS = 0;
+constexpr int32_t REGISTRY_NOT_FOUND = 2;
+constexpr int32_t REGISTRY_KEY_NOT_FOUND = 3; // ERROR_PATH_NOT_FOUND
+constexpr int32_t REGISTRY_ACCESS_DENIED = 5;
+constexpr int32_t REGISTRY_INVALID_PARAMETER = 87;
+constexpr int32_t REGISTRY_KEY_HAS_CHILDREN = 1020;
+constexpr int32_t REGISTRY_IO_ERROR = 1117;
+constexpr int32_t REGISTRY_CORRUPT = 1392;
+constexpr int32_t REGISTRY_TYPE_MISMATCH = 1804; // ERROR_INVALID_DATATYPE
+
+// Same values as REG_SZ, REG_DWORD, ...
+enum RegistryValueType : uint32_t
+{
+    VALUE_NONE = 0,
+    VALUE_STRING = 1,
+    VALUE_EXPAND_STRING = 2,
+    VALUE_BINARY = 3,
+    VALUE_DWORD = 4,
+    VALUE_MULTI_STRING = 7,
+    VALUE_QWORD = 11,
+};
+
+// Strings are stored without their terminator; DWORDs as 4 little-endian bytes
+struct RegistryValue
+{
+    uint32_t type = VALUE_NONE;
+    std::string data;
+
+    static RegistryValue String(std::string_view text);
+    static RegistryValue DWord(uint32_t number);
+    bool operator==(const RegistryValue& other) const { return type == other.type && data == other.data; }
+    bool operator!=(const RegistryValue& other) const { return !(*this == other); }
+};
+
+// One buffered change, as collected by a transaction
+struct RegistryChange
+{
+    enum Kind : uint8_t
+    {
+        CREATE_KEY,
+        DELETE_KEY,
+        SET_VALUE,
+        DELETE_VALUE,
+    };
+
+    Kind kind;
+    std::string path;
+    std::string name;
+    RegistryValue value;
+};
+
+// Storage behind RegistryManager: the Win32 registry on Windows, the portable
+// stand-ins everywhere. Paths are relative to the backend root and use '\' as
+// separator; key and value names compare case-insensitively.
+class RegistryBackend
+{
+public:
+    virtual ~RegistryBackend() = default;
+
+    virtual int32_t CreateKey(std::string_view path) = 0; // Creates missing parents too
+    virtual int32_t DeleteKey(std::string_view path) = 0; // Fails if the key has subkeys
+    virtual int32_t KeyExists(std::string_view path) = 0;
+
+    // Value calls return REGISTRY_KEY_NOT_FOUND when the key itself is missing
+    // and REGISTRY_NOT_FOUND when only the value is
+    virtual int32_t SetValue(std::string_view path, std::string_view name, const RegistryValue& value) = 0;
+    virtual int32_t QueryValue(std::string_view path, std::string_view name, RegistryValue& value) = 0;
+    virtual int32_t DeleteValue(std::string_view path, std::string_view name) = 0;
+
+    virtual int32_t EnumSubkeys(std::string_view path, std::vector<std::string>& names) = 0;
+    virtual int32_t EnumValues(std::string_view path, std::vector<std::pair<std::string, RegistryValue>>& values) = 0;
+
+    // Applies changes in order and stops at the first failure, reporting its
+    // index. The default runs them one by one; backends override this to open
+    // each key once or to make the batch atomic.
+    virtual int32_t ApplyChanges(const std::vector<RegistryChange>& changes, size_t& failedIndex);
+
+    // True when a failed ApplyChanges leaves no partial effects behind
+    virtual bool AtomicBatches() const { return false; }
+
+    // True when a batch also survives a crash all-or-nothing, so transactions
+    // need no undo journal
+    virtual bool DurableBatches() const { return false; }
+};
+
+// Applies one change through the single-operation calls
+int32_t ApplyChange(RegistryBackend& backend, const RegistryChange& change);
+
+// Path helpers shared by the backends
+std::vector<std::string_view> SplitKeyPath(std::string_view path);
+bool EqualsNoCase(std::string_view a, std::string_view b);
+
+struct LessNoCase
+{
+    using is_transparent = void;
+    bool operator()(std::string_view a, std::string_view b) const;
+};
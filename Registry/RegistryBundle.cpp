@@ -0,0 +1,552 @@
+#include "RegistryBundle.h"
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <set>
+#include "AppendLog.h"
+#include "RegistryTransaction.h"
+#include "../Common/Checksum.h"
+#include "../Common/Compression.h"
+
+// File layout: two AppendLog records
+//   header  u32 magic, u32 version, u32 keyCount, u32 codec, u64 body size
+//   body    raw or LZ-compressed; per key: u32 bytes shared with the previous
+//           path, string rest of the path, u8 flags, u32 valueCount, then per
+//           value: string name, u8 remove, u32 type, string data, u64 hash
+static const uint32_t BUNDLE_MAGIC = 0x444E4252; // "RBND"
+static const uint32_t BUNDLE_VERSION = 1;
+static const uint32_t CODEC_NONE = 0;
+static const uint32_t CODEC_LZ = 1;
+static const uint8_t KEY_REMOVE_FIRST = 1;
+static const uint8_t KEY_CREATE = 2;
+
+static uint64_t ValueHash(const RegistryValue& value)
+{
+    return Hash64(value.data.data(), value.data.size(), value.type);
+}
+
+// True when path is root or one of its subkeys
+static bool IsAtOrBelow(std::string_view path, std::string_view root)
+{
+    return path.size() >= root.size() && EqualsNoCase(path.substr(0, root.size()), root) &&
+           (path.size() == root.size() || root.empty() || path[root.size()] == '\\');
+}
+
+size_t RegistryBundle::OperationCount() const
+{
+    size_t count = 0;
+    for (const Key& key : keys)
+    {
+        count += (key.removeFirst ? 1 : 0) + (key.create ? 1 : 0) + key.values.size();
+    }
+    return count;
+}
+
+void CompileBundle(const std::vector<RegistryDelta>& entries, RegistryBundle& bundle)
+{
+    struct PlannedKey
+    {
+        bool removeFirst = false;
+        bool create = false;
+        std::map<std::string, RegistryBundle::Value, LessNoCase> values;
+    };
+    std::map<std::string, PlannedKey, LessNoCase> plan;
+
+    for (const RegistryDelta& entry : entries)
+    {
+        switch (entry.kind)
+        {
+            case RegistryDelta::KEY_ADDED:
+                plan[entry.path].create = true;
+                break;
+            case RegistryDelta::KEY_REMOVED:
+            {
+                // Everything planned below is gone again; paths sharing the
+                // prefix are contiguous, subkeys are those with a separator next
+                auto it = plan.lower_bound(entry.path);
+                while (it != plan.end() && it->first.size() >= entry.path.size() &&
+                       EqualsNoCase(std::string_view(it->first).substr(0, entry.path.size()), entry.path))
+                {
+                    it = IsAtOrBelow(it->first, entry.path) ? plan.erase(it) : std::next(it);
+                }
+
+                // A removed ancestor already takes this key with it
+                bool covered = false;
+                for (size_t end = entry.path.rfind('\\'); end != std::string::npos && !covered;
+                     end = end ? entry.path.rfind('\\', end - 1) : std::string::npos)
+                {
+                    auto parent = plan.find(std::string_view(entry.path).substr(0, end));
+                    covered = parent != plan.end() && parent->second.removeFirst;
+                }
+                if (!covered)
+                {
+                    plan[entry.path].removeFirst = true;
+                }
+                break;
+            }
+            case RegistryDelta::VALUE_ADDED:
+            case RegistryDelta::VALUE_CHANGED:
+            {
+                PlannedKey& key = plan[entry.path];
+                key.create = true;
+                key.values[entry.name] = {entry.name, false, entry.newValue, ValueHash(entry.newValue)};
+                break;
+            }
+            case RegistryDelta::VALUE_REMOVED:
+            {
+                PlannedKey& key = plan[entry.path];
+                key.create = true;
+                key.values[entry.name] = {entry.name, true, {}, 0};
+                break;
+            }
+        }
+    }
+
+    bundle.keys.clear();
+    bundle.keys.reserve(plan.size());
+    for (auto& [path, planned] : plan)
+    {
+        RegistryBundle::Key key{path, planned.removeFirst, planned.create, {}};
+        key.values.reserve(planned.values.size());
+        for (auto& [name, value] : planned.values)
+        {
+            key.values.push_back(std::move(value));
+        }
+        bundle.keys.push_back(std::move(key));
+    }
+}
+
+bool SaveBundle(const RegistryBundle& bundle, const std::string& fileName, RegistryError& error)
+{
+    std::string body;
+    std::string_view previous;
+    for (const RegistryBundle::Key& key : bundle.keys)
+    {
+        size_t shared = 0;
+        while (shared < previous.size() && shared < key.path.size() && previous[shared] == key.path[shared])
+        {
+            ++shared;
+        }
+        PutU32(body, static_cast<uint32_t>(shared));
+        PutString(body, key.path.substr(shared));
+        body.push_back(static_cast<char>((key.removeFirst ? KEY_REMOVE_FIRST : 0) | (key.create ? KEY_CREATE : 0)));
+        PutU32(body, static_cast<uint32_t>(key.values.size()));
+        for (const RegistryBundle::Value& value : key.values)
+        {
+            PutString(body, value.name);
+            body.push_back(static_cast<char>(value.remove ? 1 : 0));
+            PutU32(body, value.value.type);
+            PutString(body, value.value.data);
+            PutU64(body, value.hash);
+        }
+        previous = key.path;
+    }
+
+    // Generated bundles repeat names and data a lot; keep the body compressed when that pays
+    std::string stored;
+    uint32_t codec = CODEC_LZ;
+    if (LzCompress(body.data(), body.size(), stored) >= body.size() - body.size() / 8)
+    {
+        codec = CODEC_NONE;
+        stored.swap(body);
+    }
+
+    std::string header;
+    PutU32(header, BUNDLE_MAGIC);
+    PutU32(header, BUNDLE_VERSION);
+    PutU32(header, static_cast<uint32_t>(bundle.keys.size()));
+    PutU32(header, codec);
+    PutU64(header, body.size());
+    std::string out;
+    AppendLog::Frame(header, out);
+    AppendLog::Frame(stored, out);
+
+    std::string temporary = fileName + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    bool written = file && fwrite(out.data(), 1, out.size(), file) == out.size() && AppendLog::SyncFile(file);
+    if (file)
+    {
+        fclose(file);
+    }
+    std::error_code ec;
+    if (written)
+    {
+        std::filesystem::rename(temporary, fileName, ec);
+    }
+    if (!written || ec)
+    {
+        error = RegistryError(RegistryOperation::WriteBundle, SystemError::From(ec), fileName);
+        std::filesystem::remove(temporary, ec);
+        return false;
+    }
+    return true;
+}
+
+static bool ReadBundleBody(RecordReader& reader, uint32_t keyCount, RegistryBundle& bundle)
+{
+    std::string previous;
+    for (uint32_t k = 0; k < keyCount; ++k)
+    {
+        RegistryBundle::Key key;
+        uint32_t shared = 0;
+        uint8_t flags = 0;
+        uint32_t valueCount = 0;
+        std::string rest;
+        if (!reader.GetU32(shared) || shared > previous.size() || !reader.GetString(rest) || !reader.GetU8(flags) ||
+            !reader.GetU32(valueCount))
+        {
+            return false;
+        }
+        for (uint32_t i = 0; i < valueCount; ++i)
+        {
+            RegistryBundle::Value value;
+            uint8_t remove = 0;
+            if (!reader.GetString(value.name) || !reader.GetU8(remove) || !reader.GetU32(value.value.type) ||
+                !reader.GetString(value.value.data) || !reader.GetU64(value.hash))
+            {
+                return false;
+            }
+            value.remove = remove != 0;
+            if (!value.remove && value.hash != ValueHash(value.value))
+            {
+                return false;
+            }
+            key.values.push_back(std::move(value));
+        }
+        key.path = previous.substr(0, shared) + rest;
+        key.removeFirst = (flags & KEY_REMOVE_FIRST) != 0;
+        key.create = (flags & KEY_CREATE) != 0;
+        previous = key.path;
+        bundle.keys.push_back(std::move(key));
+    }
+    return reader.offset == reader.size;
+}
+
+bool LoadBundle(const std::string& fileName, RegistryBundle& bundle, RegistryError& error)
+{
+    std::string contents;
+    if (!AppendLog::ReadFile(fileName, contents))
+    {
+        error = RegistryError(RegistryOperation::ReadBundle, REGISTRY_NOT_FOUND, fileName);
+        return false;
+    }
+
+    std::vector<std::string> records;
+    size_t consumed = AppendLog::ReadRecords(contents, [&](const char* data, size_t size)
+    {
+        records.emplace_back(data, size);
+        return true;
+    });
+
+    bundle.keys.clear();
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint32_t keyCount = 0;
+    uint32_t codec = 0;
+    uint64_t rawSize = 0;
+    bool valid = records.size() == 2 && consumed == contents.size();
+    if (valid)
+    {
+        RecordReader header{records[0].data(), records[0].size()};
+        valid = header.GetU32(magic) && header.GetU32(version) && header.GetU32(keyCount) && header.GetU32(codec) &&
+                header.GetU64(rawSize) && magic == BUNDLE_MAGIC && version == BUNDLE_VERSION &&
+                (codec == CODEC_NONE || codec == CODEC_LZ);
+    }
+    std::string body;
+    if (valid && codec == CODEC_LZ)
+    {
+        // LZ4-format data expands at most 255 times
+        valid = rawSize <= records[1].size() * 255;
+    }
+    if (valid && codec == CODEC_LZ)
+    {
+        body.resize(rawSize);
+        valid = LzDecompress(records[1].data(), records[1].size(), &body[0], body.size());
+    }
+    else if (valid)
+    {
+        body.swap(records[1]);
+    }
+    RecordReader reader{body.data(), body.size()};
+    if (!valid || !ReadBundleBody(reader, keyCount, bundle))
+    {
+        bundle.keys.clear();
+        error = RegistryError(RegistryOperation::ReadBundle, REGISTRY_CORRUPT, fileName);
+        return false;
+    }
+    return true;
+}
+
+// Applies a bundle against what the backend holds, queuing only differences
+class BundleApplier
+{
+public:
+    BundleApplier(RegistryTransaction& transaction, BundleApplyStats& stats)
+        : m_transaction(transaction), m_backend(transaction.Backend()), m_stats(stats)
+    {}
+
+    std::map<std::string, const RegistryBundle::Key*, LessNoCase> planned; // Backend path to key
+    std::string failedPath;
+
+    // Deletes what exists at or below a removed key unless the bundle puts it back
+    int32_t Replace(const std::string& path)
+    {
+        int32_t result = m_backend.KeyExists(path);
+        if (result != REGISTRY_SUCCESS)
+        {
+            return result == REGISTRY_NOT_FOUND ? REGISTRY_SUCCESS : Fail(result, path);
+        }
+        return Survives(path) ? Prune(path) : DeleteSubtree(path);
+    }
+
+    int32_t ApplyKey(const std::string& path, const RegistryBundle::Key& key, bool replaced)
+    {
+        bool writesValues = false;
+        for (const RegistryBundle::Value& value : key.values)
+        {
+            writesValues = writesValues || !value.remove;
+        }
+        if (!key.create && !writesValues)
+        {
+            return REGISTRY_SUCCESS;
+        }
+
+        int32_t result = m_backend.KeyExists(path);
+        if (result != REGISTRY_SUCCESS && result != REGISTRY_NOT_FOUND)
+        {
+            return Fail(result, path);
+        }
+        bool exists = result == REGISTRY_SUCCESS;
+        if (exists && key.create)
+        {
+            ++m_stats.skipped;
+        }
+        else if (!exists)
+        {
+            m_transaction.CreateKey(path);
+            ++m_stats.keysCreated;
+        }
+
+        // One read of the key's values; a replaced key keeps only the values the bundle names
+        std::map<std::string, uint64_t, LessNoCase> current;
+        if (exists)
+        {
+            m_values.clear();
+            result = m_backend.EnumValues(path, m_values);
+            if (result != REGISTRY_SUCCESS)
+            {
+                return Fail(result, path);
+            }
+            for (const auto& [name, value] : m_values)
+            {
+                current.emplace(name, ValueHash(value));
+            }
+        }
+
+        for (const RegistryBundle::Value& value : key.values)
+        {
+            auto found = current.find(value.name);
+            if (value.remove)
+            {
+                if (found == current.end())
+                {
+                    ++m_stats.skipped;
+                }
+                else
+                {
+                    m_transaction.DeleteValue(path, value.name);
+                    ++m_stats.valuesDeleted;
+                }
+            }
+            else if (found != current.end() && found->second == value.hash)
+            {
+                ++m_stats.skipped;
+            }
+            else
+            {
+                m_transaction.WriteValue(path, value.name, value.value);
+                ++m_stats.valuesWritten;
+            }
+            if (found != current.end())
+            {
+                current.erase(found);
+            }
+        }
+        if (replaced)
+        {
+            for (const auto& [name, hash] : current)
+            {
+                m_transaction.DeleteValue(path, name);
+                ++m_stats.valuesDeleted;
+            }
+        }
+        return REGISTRY_SUCCESS;
+    }
+
+private:
+    static bool HasContent(const RegistryBundle::Key& key)
+    {
+        for (const RegistryBundle::Value& value : key.values)
+        {
+            if (!value.remove)
+            {
+                return true;
+            }
+        }
+        return key.create;
+    }
+
+    // The bundle creates this key or something below it; paths sharing the prefix are contiguous
+    bool Survives(const std::string& path) const
+    {
+        for (auto it = planned.lower_bound(path); it != planned.end() && it->first.size() >= path.size() &&
+                                                  EqualsNoCase(std::string_view(it->first).substr(0, path.size()), path);
+             ++it)
+        {
+            if (IsAtOrBelow(it->first, path) && HasContent(*it->second))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int32_t Prune(const std::string& path)
+    {
+        std::vector<std::string> names;
+        int32_t result = m_backend.EnumSubkeys(path, names);
+        if (result != REGISTRY_SUCCESS)
+        {
+            return Fail(result, path);
+        }
+        for (const std::string& name : names)
+        {
+            std::string child = path + "\\" + name;
+            result = Survives(child) ? Prune(child) : DeleteSubtree(child);
+            if (result != REGISTRY_SUCCESS)
+            {
+                return result;
+            }
+        }
+
+        // Keys the bundle writes have their values settled by ApplyKey; keys
+        // kept only as parents are emptied here
+        auto it = planned.find(path);
+        if (it == planned.end() || !HasContent(*it->second))
+        {
+            m_values.clear();
+            result = m_backend.EnumValues(path, m_values);
+            if (result != REGISTRY_SUCCESS)
+            {
+                return Fail(result, path);
+            }
+            for (const auto& [name, value] : m_values)
+            {
+                m_transaction.DeleteValue(path, name);
+                ++m_stats.valuesDeleted;
+            }
+        }
+        return REGISTRY_SUCCESS;
+    }
+
+    // Subkeys first, deepest first, then the key
+    int32_t DeleteSubtree(const std::string& path)
+    {
+        std::vector<std::string> names;
+        int32_t result = m_backend.EnumSubkeys(path, names);
+        if (result != REGISTRY_SUCCESS)
+        {
+            return Fail(result, path);
+        }
+        for (const std::string& name : names)
+        {
+            result = DeleteSubtree(path + "\\" + name);
+            if (result != REGISTRY_SUCCESS)
+            {
+                return result;
+            }
+        }
+        m_transaction.DeleteKey(path);
+        ++m_stats.keysDeleted;
+        return REGISTRY_SUCCESS;
+    }
+
+    int32_t Fail(int32_t result, const std::string& path)
+    {
+        failedPath = path;
+        return result;
+    }
+
+    RegistryTransaction& m_transaction;
+    RegistryBackend& m_backend;
+    BundleApplyStats& m_stats;
+    std::vector<std::pair<std::string, RegistryValue>> m_values;
+};
+
+bool ApplyBundle(RegistryTransaction& transaction, const RegistryBundle& bundle, std::string_view hive,
+                 BundleApplyStats& stats, RegistryError& error)
+{
+    stats = {};
+    BundleApplier applier(transaction, stats);
+    for (const RegistryBundle::Key& key : bundle.keys)
+    {
+        if (!IsAtOrBelow(key.path, hive))
+        {
+            ++stats.keysIgnored;
+            continue;
+        }
+        size_t skip = hive.empty() || key.path.size() == hive.size() ? hive.size() : hive.size() + 1;
+        applier.planned.emplace(key.path.substr(skip), &key);
+    }
+
+    // Removals first, then every key in order with whether a removal covers it
+    auto fail = [&](RegistryOperation operation, int32_t result, const std::string& path)
+    {
+        transaction.Rollback();
+        error = RegistryError(operation, result, path);
+        return false;
+    };
+    std::set<std::string, LessNoCase> replaced;
+    for (const auto& [path, key] : applier.planned)
+    {
+        if (!key->removeFirst)
+        {
+            continue;
+        }
+        if (path.empty())
+        {
+            return fail(RegistryOperation::DeleteKey, REGISTRY_INVALID_PARAMETER, key->path);
+        }
+        size_t queued = transaction.Size();
+        int32_t result = applier.Replace(path);
+        if (result != REGISTRY_SUCCESS)
+        {
+            return fail(RegistryOperation::OpenKeyForReading, result, applier.failedPath);
+        }
+        if (transaction.Size() == queued)
+        {
+            ++stats.skipped;
+        }
+        replaced.insert(path);
+    }
+    for (const auto& [path, key] : applier.planned)
+    {
+        bool covered = false;
+        for (std::string_view parent = path; !covered;)
+        {
+            covered = replaced.count(parent) != 0;
+            size_t end = parent.rfind('\\');
+            if (end == std::string_view::npos)
+            {
+                break;
+            }
+            parent = parent.substr(0, end);
+        }
+        int32_t result = applier.ApplyKey(path, *key, covered);
+        if (result != REGISTRY_SUCCESS)
+        {
+            return fail(RegistryOperation::OpenKeyForReading, result, applier.failedPath);
+        }
+    }
+    return transaction.Commit(error);
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "RegistryBackend.h"
+#include "RegistryDiff.h"
+#include "RegistryError.h"
+
+class RegistryTransaction;
+
+// The net effect of one or more .reg files, grouped by key so that applying
+// it opens every key once. Keys are sorted by path and values by name; every
+// value carries the hash of its type and data.
+struct RegistryBundle
+{
+    struct Value
+    {
+        std::string name;
+        bool remove;          // "name"=-
+        RegistryValue value;  // Empty when removed
+        uint64_t hash;
+    };
+
+    struct Key
+    {
+        std::string path;
+        bool removeFirst;     // [-path]: what exists at or below it goes unless the bundle recreates it
+        bool create;
+        std::vector<Value> values;
+    };
+
+    std::vector<Key> keys;
+
+    size_t OperationCount() const;
+};
+
+// Replays the entries in order, as regedit would import them, and keeps what
+// is left: a value set twice keeps the last data, and a removed key drops
+// everything planned at or below it before that point.
+void CompileBundle(const std::vector<RegistryDelta>& entries, RegistryBundle& bundle);
+
+// A CRC-checked file; paths are prefix-compressed against the previous key
+// and the body is LZ-compressed when that makes it at least 1/8 smaller
+bool SaveBundle(const RegistryBundle& bundle, const std::string& fileName, RegistryError& error);
+bool LoadBundle(const std::string& fileName, RegistryBundle& bundle, RegistryError& error);
+
+struct BundleApplyStats
+{
+    uint64_t keysCreated;
+    uint64_t keysDeleted;  // Including the subkeys of removed keys
+    uint64_t valuesWritten;
+    uint64_t valuesDeleted;
+    uint64_t skipped;      // Operations whose outcome was already in place
+    uint64_t keysIgnored;  // Keys outside the hive
+};
+
+// Applies the keys below hive (e.g. "HKEY_CURRENT_USER") with the prefix
+// stripped; an empty hive takes paths as they are. Each key's values are read
+// once and only those whose hash differs are written. A removed key that the
+// bundle recreates is pruned rather than deleted, so applying the same bundle
+// twice writes nothing the second time. Commits as one transaction.
+bool ApplyBundle(RegistryTransaction& transaction, const RegistryBundle& bundle, std::string_view hive,
+                 BundleApplyStats& stats, RegistryError& error);
@@ -0,0 +1,381 @@
+#include "RegistryDiff.h"
+#include <cstdio>
+#include "RegistryTransaction.h"
+#include "../Common/Utf.h"
+
+static inline unsigned char FoldCase(char ch)
+{
+    return (ch >= 'A' && ch <= 'Z') ? static_cast<unsigned char>(ch - 'A' + 'a') : static_cast<unsigned char>(ch);
+}
+
+// Same order as LessNoCase, three-way so each merge step compares once
+static int CompareNoCase(std::string_view a, std::string_view b)
+{
+    size_t count = a.size() < b.size() ? a.size() : b.size();
+    for (size_t i = 0; i < count; ++i)
+    {
+        unsigned char x = FoldCase(a[i]), y = FoldCase(b[i]);
+        if (x != y)
+        {
+            return x < y ? -1 : 1;
+        }
+    }
+    return a.size() == b.size() ? 0 : (a.size() < b.size() ? -1 : 1);
+}
+
+static std::string JoinPath(std::string_view parent, std::string_view name)
+{
+    std::string path(parent);
+    if (!path.empty() && !name.empty())
+    {
+        path += '\\';
+    }
+    path += name;
+    return path;
+}
+
+class TreeDiffer
+{
+public:
+    TreeDiffer(const RegistryTree& before, const RegistryTree& after, std::vector<RegistryDelta>& delta)
+        : m_before(before), m_after(after), m_delta(delta)
+    {}
+
+    void Compare(uint32_t a, uint32_t b, std::string& path)
+    {
+        const RegistryTree::Key& keyA = m_before.keys[a];
+        const RegistryTree::Key& keyB = m_after.keys[b];
+        if (keyA.hash == keyB.hash)
+        {
+            ++m_stats.subtreesSkipped;
+            return;
+        }
+        ++m_stats.keysCompared;
+
+        // Values: merge the two sorted runs
+        uint32_t i = keyA.firstValue, endA = keyA.firstValue + keyA.valueCount;
+        uint32_t j = keyB.firstValue, endB = keyB.firstValue + keyB.valueCount;
+        while (i < endA || j < endB)
+        {
+            int order = i == endA ? 1 : j == endB ? -1 : CompareNoCase(m_before.values[i].name, m_after.values[j].name);
+            if (order < 0)
+            {
+                const RegistryTree::Value& value = m_before.values[i++];
+                Emit(RegistryDelta::VALUE_REMOVED, path, value.name, &value.value, nullptr);
+            }
+            else if (order > 0)
+            {
+                const RegistryTree::Value& value = m_after.values[j++];
+                Emit(RegistryDelta::VALUE_ADDED, path, value.name, nullptr, &value.value);
+            }
+            else
+            {
+                const RegistryTree::Value& oldValue = m_before.values[i++];
+                const RegistryTree::Value& newValue = m_after.values[j++];
+                if (oldValue.hash != newValue.hash || oldValue.value != newValue.value)
+                {
+                    Emit(RegistryDelta::VALUE_CHANGED, path, newValue.name, &oldValue.value, &newValue.value);
+                }
+            }
+        }
+
+        // Subkeys: the same merge, recursing into keys on both sides
+        i = keyA.firstChild, endA = keyA.firstChild + keyA.childCount;
+        j = keyB.firstChild, endB = keyB.firstChild + keyB.childCount;
+        while (i < endA || j < endB)
+        {
+            int order = i == endA ? 1 : j == endB ? -1 : CompareNoCase(m_before.keys[i].name, m_after.keys[j].name);
+            size_t length = path.size();
+            if (order < 0)
+            {
+                Emit(RegistryDelta::KEY_REMOVED, JoinPath(path, m_before.keys[i++].name), std::string(), nullptr, nullptr);
+                continue;
+            }
+            if (order > 0)
+            {
+                AppendName(path, m_after.keys[j].name);
+                Added(j++, path);
+            }
+            else
+            {
+                AppendName(path, m_after.keys[j].name);
+                Compare(i++, j++, path);
+            }
+            path.resize(length);
+        }
+    }
+
+    DiffStats Stats() const { return m_stats; }
+
+private:
+    // Built as a named entry and moved in: brace-initialising the values in
+    // place trips -Wmaybe-uninitialized in optimised GCC builds
+    void Emit(RegistryDelta::Kind kind, const std::string& path, const std::string& name,
+              const RegistryValue* oldValue, const RegistryValue* newValue)
+    {
+        RegistryDelta delta;
+        delta.kind = kind;
+        delta.path = path;
+        delta.name = name;
+        if (oldValue)
+        {
+            delta.oldValue = *oldValue;
+        }
+        if (newValue)
+        {
+            delta.newValue = *newValue;
+        }
+        m_delta.push_back(std::move(delta));
+    }
+
+    static void AppendName(std::string& path, const std::string& name)
+    {
+        if (!path.empty())
+        {
+            path += '\\';
+        }
+        path += name;
+    }
+
+    // A key only in after: it and everything below it are new
+    void Added(uint32_t b, std::string& path)
+    {
+        const RegistryTree::Key& key = m_after.keys[b];
+        Emit(RegistryDelta::KEY_ADDED, path, std::string(), nullptr, nullptr);
+        for (uint32_t v = key.firstValue; v < key.firstValue + key.valueCount; ++v)
+        {
+            const RegistryTree::Value& value = m_after.values[v];
+            Emit(RegistryDelta::VALUE_ADDED, path, value.name, nullptr, &value.value);
+        }
+        for (uint32_t c = key.firstChild; c < key.firstChild + key.childCount; ++c)
+        {
+            size_t length = path.size();
+            AppendName(path, m_after.keys[c].name);
+            Added(c, path);
+            path.resize(length);
+        }
+    }
+
+    const RegistryTree& m_before;
+    const RegistryTree& m_after;
+    std::vector<RegistryDelta>& m_delta;
+    DiffStats m_stats = {};
+};
+
+DiffStats DiffTrees(const RegistryTree& before, const RegistryTree& after, std::vector<RegistryDelta>& delta)
+{
+    if (before.keys.empty() || after.keys.empty())
+    {
+        return {};
+    }
+    TreeDiffer differ(before, after, delta);
+    std::string path;
+    differ.Compare(0, 0, path);
+    return differ.Stats();
+}
+
+static void AppendQuoted(std::string& out, std::string_view text)
+{
+    out += '"';
+    for (char ch : text)
+    {
+        if (ch == '\\' || ch == '"')
+        {
+            out += '\\';
+        }
+        out += ch;
+    }
+    out += '"';
+}
+
+// regedit continues long hex lists on the next line after a backslash
+static void AppendHex(std::string& out, size_t lineStart, std::string_view bytes)
+{
+    for (size_t i = 0; i < bytes.size(); ++i)
+    {
+        char hex[4];
+        snprintf(hex, sizeof(hex), "%02x", static_cast<unsigned char>(bytes[i]));
+        out += hex;
+        if (i + 1 < bytes.size())
+        {
+            out += ',';
+            if (out.size() - lineStart > 76)
+            {
+                out += "\\\r\n  ";
+                lineStart = out.size() - 2;
+            }
+        }
+    }
+}
+
+// String types are written as they are stored: UTF-16LE with their terminators
+static void AppendUtf16Hex(std::string& out, size_t lineStart, std::string_view text, size_t terminators)
+{
+    std::u16string units;
+    Utf8ToUtf16(text, units, InvalidText::Replace);
+    units.append(terminators, u'\0');
+    std::string bytes;
+    bytes.reserve(units.size() * 2);
+    for (char16_t unit : units)
+    {
+        bytes += static_cast<char>(unit & 0xFF);
+        bytes += static_cast<char>(unit >> 8);
+    }
+    AppendHex(out, lineStart, bytes);
+}
+
+static void AppendValue(std::string& out, size_t lineStart, const RegistryValue& value)
+{
+    const std::string& data = value.data;
+    switch (value.type)
+    {
+        case VALUE_STRING:
+        {
+            bool printable = true;
+            for (char ch : data)
+            {
+                printable = printable && static_cast<unsigned char>(ch) >= 0x20;
+            }
+            if (printable)
+            {
+                AppendQuoted(out, data);
+                return;
+            }
+            out += "hex(1):";
+            AppendUtf16Hex(out, lineStart, data, 1);
+            return;
+        }
+        case VALUE_DWORD:
+            if (data.size() == 4)
+            {
+                uint32_t number = 0;
+                for (int i = 3; i >= 0; --i)
+                {
+                    number = (number << 8) | static_cast<unsigned char>(data[i]);
+                }
+                char text[16];
+                snprintf(text, sizeof(text), "dword:%08x", number);
+                out += text;
+                return;
+            }
+            break;
+        case VALUE_BINARY:
+            out += "hex:";
+            AppendHex(out, lineStart, data);
+            return;
+        case VALUE_EXPAND_STRING:
+            out += "hex(2):";
+            AppendUtf16Hex(out, lineStart, data, 1);
+            return;
+        case VALUE_MULTI_STRING:
+            out += "hex(7):";
+            AppendUtf16Hex(out, lineStart, data, 2);
+            return;
+    }
+    char prefix[16];
+    snprintf(prefix, sizeof(prefix), "hex(%x):", value.type);
+    out += prefix;
+    AppendHex(out, lineStart, data);
+}
+
+std::string FormatRegPatch(const std::vector<RegistryDelta>& delta, std::string_view rootPath)
+{
+    std::string out = "Windows Registry Editor Version 5.00\r\n";
+    const std::string* header = nullptr; // Key the following values belong to
+    for (const RegistryDelta& entry : delta)
+    {
+        if (entry.kind == RegistryDelta::KEY_REMOVED)
+        {
+            out += "\r\n[-" + JoinPath(rootPath, entry.path) + "]\r\n";
+            header = nullptr;
+            continue;
+        }
+        if (!header || *header != entry.path)
+        {
+            out += "\r\n[" + JoinPath(rootPath, entry.path) + "]\r\n";
+            header = &entry.path;
+        }
+        if (entry.kind == RegistryDelta::KEY_ADDED)
+        {
+            continue;
+        }
+
+        size_t lineStart = out.size();
+        if (entry.name.empty())
+        {
+            out += '@';
+        }
+        else
+        {
+            AppendQuoted(out, entry.name);
+        }
+        out += '=';
+        if (entry.kind == RegistryDelta::VALUE_REMOVED)
+        {
+            out += '-';
+        }
+        else
+        {
+            AppendValue(out, lineStart, entry.newValue);
+        }
+        out += "\r\n";
+    }
+    return out;
+}
+
+// Children first, so every key is empty by the time it is deleted
+static int32_t QueueSubtreeDelete(RegistryTransaction& transaction, const std::string& path, std::string& failedPath)
+{
+    std::vector<std::string> names;
+    int32_t result = transaction.Backend().EnumSubkeys(path, names);
+    if (result != REGISTRY_SUCCESS)
+    {
+        failedPath = path;
+        return result;
+    }
+    for (const std::string& name : names)
+    {
+        result = QueueSubtreeDelete(transaction, JoinPath(path, name), failedPath);
+        if (result != REGISTRY_SUCCESS)
+        {
+            return result;
+        }
+    }
+    transaction.DeleteKey(path);
+    return REGISTRY_SUCCESS;
+}
+
+bool ApplyDelta(RegistryTransaction& transaction, std::string_view rootPath, const std::vector<RegistryDelta>& delta,
+                RegistryError& error)
+{
+    for (const RegistryDelta& entry : delta)
+    {
+        std::string path = JoinPath(rootPath, entry.path);
+        switch (entry.kind)
+        {
+            case RegistryDelta::KEY_ADDED:
+                transaction.CreateKey(path);
+                break;
+            case RegistryDelta::KEY_REMOVED:
+            {
+                std::string failedPath;
+                int32_t result = QueueSubtreeDelete(transaction, path, failedPath);
+                if (result != REGISTRY_SUCCESS)
+                {
+                    transaction.Rollback();
+                    error = RegistryError(RegistryOperation::OpenKeyForReading, result, failedPath);
+                    return false;
+                }
+                break;
+            }
+            case RegistryDelta::VALUE_ADDED:
+            case RegistryDelta::VALUE_CHANGED:
+                transaction.WriteValue(path, entry.name, entry.newValue);
+                break;
+            case RegistryDelta::VALUE_REMOVED:
+                transaction.DeleteValue(path, entry.name);
+                break;
+        }
+    }
+    return transaction.Commit(error);
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "RegistryBackend.h"
+#include "RegistryError.h"
+#include "RegistryTree.h"
+
+class RegistryTransaction;
+
+// One difference between two captured trees. Paths are relative to the tree
+// roots; an empty value name is the key's default value.
+struct RegistryDelta
+{
+    enum Kind : uint8_t
+    {
+        KEY_ADDED,
+        KEY_REMOVED,    // Covers the whole subtree; nothing below it is listed
+        VALUE_ADDED,
+        VALUE_REMOVED,
+        VALUE_CHANGED,
+    };
+
+    Kind kind;
+    std::string path;
+    std::string name;
+    RegistryValue oldValue;
+    RegistryValue newValue;
+};
+
+struct DiffStats
+{
+    uint64_t keysCompared;    // Keys present on both sides whose hashes differed
+    uint64_t subtreesSkipped; // Keys present on both sides with equal hashes
+};
+
+// Appends what it takes to turn before into after. A key comes before its
+// values and its values before its subkeys, so the delta applies in order.
+DiffStats DiffTrees(const RegistryTree& before, const RegistryTree& after, std::vector<RegistryDelta>& delta);
+
+// The delta as a .reg file that regedit can import. rootPath is prepended to
+// every key, e.g. "HKEY_CURRENT_USER\\Software\\MyTestApp".
+std::string FormatRegPatch(const std::vector<RegistryDelta>& delta, std::string_view rootPath);
+
+// Queues the delta below rootPath on the transaction and commits it. Removed
+// keys are deleted with everything the backend currently has below them.
+bool ApplyDelta(RegistryTransaction& transaction, std::string_view rootPath, const std::vector<RegistryDelta>& delta,
+                RegistryError& error);
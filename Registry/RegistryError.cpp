@@ -0,0 +1,184 @@
+#include "RegistryError.h"
+#include <cerrno>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include "RegistryBackend.h"
+
+RegistryError::RegistryError(RegistryOperation operation, int32_t code, std::string_view keyPath)
+    : code(code), operation(operation), keyPathId(InternKeyPath(keyPath))
+{}
+
+RegistryError::RegistryError(RegistryOperation operation, SystemError system, std::string_view keyPath)
+    : code(RegistryCodeOf(system)), operation(operation), keyPathId(InternKeyPath(keyPath)), system(system)
+{}
+
+std::string RegistryError::Message() const
+{
+    if (!Failed())
+    {
+        return "";
+    }
+
+    std::string message = OperationText(operation);
+    message += ": ";
+    message += RegistryCodeText(code);
+    if (system)
+    {
+        message += " (";
+        message += system.Message();
+        message += ")";
+    }
+    if (keyPathId != 0)
+    {
+        message += " [";
+        message += KeyPathOf(keyPathId);
+        message += "]";
+    }
+    return message;
+}
+
+const char* OperationText(RegistryOperation operation)
+{
+    switch (operation)
+    {
+        case RegistryOperation::None: return "No error";
+        case RegistryOperation::CreateKey: return "Failed to create/open key";
+        case RegistryOperation::DeleteKey: return "Failed to delete key";
+        case RegistryOperation::OpenKeyForWriting: return "Failed to open key for writing";
+        case RegistryOperation::WriteString: return "Failed to write string value";
+        case RegistryOperation::WriteDWORD: return "Failed to write DWORD value";
+        case RegistryOperation::OpenKeyForReading: return "Failed to open key for reading";
+        case RegistryOperation::QueryString: return "Failed to query string value";
+        case RegistryOperation::ReadString: return "Failed to read string value";
+        case RegistryOperation::ReadDWORD: return "Failed to read DWORD value";
+        case RegistryOperation::OpenKeyForDeletingValue: return "Failed to open key for deleting value";
+        case RegistryOperation::DeleteValue: return "Failed to delete value";
+        case RegistryOperation::CommitTransaction: return "Failed to commit transaction";
+        case RegistryOperation::OpenJournal: return "Failed to open transaction journal";
+        case RegistryOperation::WriteJournal: return "Failed to write transaction journal";
+        case RegistryOperation::OpenStore: return "Failed to open registry store";
+        case RegistryOperation::WriteStore: return "Failed to write registry store";
+        case RegistryOperation::OpenSnapshot: return "Failed to open registry snapshot";
+        case RegistryOperation::WriteSnapshot: return "Failed to write registry snapshot";
+        case RegistryOperation::ParseRegFile: return "Failed to parse .reg file";
+        case RegistryOperation::ReadBundle: return "Failed to read registry bundle";
+        case RegistryOperation::WriteBundle: return "Failed to write registry bundle";
+        case RegistryOperation::OpenSharedConfig: return "Failed to open shared configuration";
+        case RegistryOperation::PublishSharedConfig: return "Failed to publish shared configuration";
+        case RegistryOperation::OpenConfigSocket: return "Failed to open configuration event socket";
+    }
+    return "Registry operation failed";
+}
+
+const std::string& RegistryCodeText(int32_t code)
+{
+    // Kept here rather than looked up as OS codes: strerror gives the Win32
+    // numbers unrelated meanings
+    static const std::string texts[] = {
+        "The operation completed successfully",
+        "The entry was not found",
+        "The key was not found",
+        "Access is denied",
+        "The parameter is incorrect",
+        "The key has subkeys",
+        "An I/O error occurred",
+        "The registry data is corrupt",
+        "The value has a different type",
+    };
+    switch (code)
+    {
+        case REGISTRY_SUCCESS: return texts[0];
+        case REGISTRY_NOT_FOUND: return texts[1];
+        case REGISTRY_KEY_NOT_FOUND: return texts[2];
+        case REGISTRY_ACCESS_DENIED: return texts[3];
+        case REGISTRY_INVALID_PARAMETER: return texts[4];
+        case REGISTRY_KEY_HAS_CHILDREN: return texts[5];
+        case REGISTRY_IO_ERROR: return texts[6];
+        case REGISTRY_CORRUPT: return texts[7];
+        case REGISTRY_TYPE_MISMATCH: return texts[8];
+    }
+#ifdef _WIN32
+    return SystemMessage(code);
+#else
+    static const std::string unknown = "Unknown registry error";
+    return unknown;
+#endif
+}
+
+int32_t RegistryCodeOf(SystemError system)
+{
+    if (!system)
+    {
+        return REGISTRY_IO_ERROR;
+    }
+#ifdef _WIN32
+    if (system.domain == SystemError::NATIVE)
+    {
+        switch (system.code)
+        {
+            case 2: // ERROR_FILE_NOT_FOUND
+            case 3: // ERROR_PATH_NOT_FOUND
+                return REGISTRY_NOT_FOUND;
+            case 5: // ERROR_ACCESS_DENIED
+                return REGISTRY_ACCESS_DENIED;
+            case 87: // ERROR_INVALID_PARAMETER
+                return REGISTRY_INVALID_PARAMETER;
+        }
+        return REGISTRY_IO_ERROR;
+    }
+#endif
+    switch (system.code)
+    {
+        case ENOENT: return REGISTRY_NOT_FOUND;
+        case EACCES:
+        case EPERM:
+        case EROFS: return REGISTRY_ACCESS_DENIED;
+        case EINVAL: return REGISTRY_INVALID_PARAMETER;
+    }
+    return REGISTRY_IO_ERROR;
+}
+
+// Read-mostly: the same few paths fail over and over
+static std::shared_mutex g_keyPathMutex;
+static std::deque<std::string> g_keyPaths; // Deque so views into it stay valid
+static std::unordered_map<std::string_view, uint32_t> g_keyPathIds;
+
+uint32_t InternKeyPath(std::string_view keyPath)
+{
+    if (keyPath.empty())
+    {
+        return 0;
+    }
+
+    {
+        std::shared_lock<std::shared_mutex> lock(g_keyPathMutex);
+        auto it = g_keyPathIds.find(keyPath);
+        if (it != g_keyPathIds.end())
+        {
+            return it->second;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(g_keyPathMutex);
+    auto it = g_keyPathIds.find(keyPath);
+    if (it != g_keyPathIds.end())
+    {
+        return it->second;
+    }
+    g_keyPaths.emplace_back(keyPath);
+    uint32_t id = static_cast<uint32_t>(g_keyPaths.size());
+    g_keyPathIds.emplace(g_keyPaths.back(), id);
+    return id;
+}
+
+std::string_view KeyPathOf(uint32_t id)
+{
+    std::shared_lock<std::shared_mutex> lock(g_keyPathMutex);
+    if (id == 0 || id > g_keyPaths.size())
+    {
+        return {};
+    }
+    return g_keyPaths[id - 1];
+}
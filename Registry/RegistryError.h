@@ -0,0 +1,67 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "../Common/SystemMessages.h"
+
+enum class RegistryOperation : uint8_t
+{
+    None,
+    CreateKey,
+    DeleteKey,
+    OpenKeyForWriting,
+    WriteString,
+    WriteDWORD,
+    OpenKeyForReading,
+    QueryString,
+    ReadString,
+    ReadDWORD,
+    OpenKeyForDeletingValue,
+    DeleteValue,
+    CommitTransaction,
+    OpenJournal,
+    WriteJournal,
+    OpenStore,
+    WriteStore,
+    OpenSnapshot,
+    WriteSnapshot,
+    ParseRegFile,
+    ReadBundle,
+    WriteBundle,
+    OpenSharedConfig,
+    PublishSharedConfig,
+    OpenConfigSocket,
+};
+
+// What failed, with which code, on which key. Filling one in costs a few
+// stores and a key path lookup; the text is only built when Message() is called.
+// code is always a REGISTRY_* code (or a Win32 code from the Win32 backend);
+// a failing file or socket call keeps its OS code in system.
+struct RegistryError
+{
+    int32_t code = 0;
+    RegistryOperation operation = RegistryOperation::None;
+    uint32_t keyPathId = 0; // From InternKeyPath, 0 when unknown
+    SystemError system;
+
+    RegistryError() = default;
+    RegistryError(RegistryOperation operation, int32_t code, std::string_view keyPath);
+    // code is derived from the OS error
+    RegistryError(RegistryOperation operation, SystemError system, std::string_view keyPath);
+
+    bool Failed() const { return operation != RegistryOperation::None; }
+    std::string Message() const;
+};
+
+const char* OperationText(RegistryOperation operation);
+
+// Text for a REGISTRY_* code. Other codes are Win32 codes from the Win32
+// backend and go to FormatMessage; elsewhere they are reported by number.
+const std::string& RegistryCodeText(int32_t code);
+
+// The REGISTRY_* code that best describes an OS error
+int32_t RegistryCodeOf(SystemError system);
+
+// Process-wide table of key paths seen in errors; ids stay valid for the process lifetime
+uint32_t InternKeyPath(std::string_view keyPath);
+std::string_view KeyPathOf(uint32_t id);
@@ -0,0 +1,509 @@
+#include "RegistryIndex.h"
+#include <algorithm>
+#include <mutex>
+
+// Rebuilding costs about as much as the dead entries it drops, so wait for enough of them
+static const uint64_t REBUILD_MIN_DEAD = 4096;
+
+static std::string Fold(std::string_view text)
+{
+    std::string folded(text);
+    for (char& ch : folded)
+    {
+        if (ch >= 'A' && ch <= 'Z')
+        {
+            ch = static_cast<char>(ch - 'A' + 'a');
+        }
+        else if (ch == '\0')
+        {
+            ch = '\n'; // Separates the strings of a multi-string
+        }
+    }
+    return folded;
+}
+
+static inline uint32_t PostingKey(RegistrySearchHit::Field field, const char* text)
+{
+    return (static_cast<uint32_t>(field) << 24) | (static_cast<uint8_t>(text[0]) << 16) |
+           (static_cast<uint8_t>(text[1]) << 8) | static_cast<uint8_t>(text[2]);
+}
+
+static bool IsText(uint32_t type)
+{
+    return type == VALUE_STRING || type == VALUE_EXPAND_STRING || type == VALUE_MULTI_STRING;
+}
+
+// Joins the parts again, so "A\\B\" and "A\B" name the same key
+static std::string NormalizePath(std::string_view path)
+{
+    std::string normalized;
+    for (std::string_view part : SplitKeyPath(path))
+    {
+        if (!normalized.empty())
+        {
+            normalized += '\\';
+        }
+        normalized += part;
+    }
+    return normalized;
+}
+
+RegistryIndex::RegistryIndex()
+{
+    Clear();
+}
+
+void RegistryIndex::Clear()
+{
+    m_keys.clear();
+    m_values.clear();
+    m_entries.clear();
+    m_paths.clear();
+    m_postings.clear();
+    m_numbers.clear();
+    m_liveEntries = 0;
+    m_deadEntries = 0;
+    m_postingCount = 0;
+
+    // The root has no name to index but holds values like any key
+    m_keys.push_back({std::string(), NONE, {}});
+    m_paths.emplace(std::string(), 0);
+}
+
+void RegistryIndex::Build(const RegistryTree& tree)
+{
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    Clear();
+    if (tree.keys.empty())
+    {
+        return;
+    }
+
+    std::vector<uint32_t> slots(tree.keys.size());
+    slots[0] = 0;
+    for (size_t i = 0; i < tree.keys.size(); ++i)
+    {
+        const RegistryTree::Key& key = tree.keys[i];
+        for (uint32_t v = key.firstValue; v < key.firstValue + key.valueCount; ++v)
+        {
+            SetValue(slots[i], tree.values[v].name, tree.values[v].value);
+        }
+        for (uint32_t c = key.firstChild; c < key.firstChild + key.childCount; ++c)
+        {
+            const std::string& parent = m_keys[slots[i]].path;
+            std::string path = parent.empty() ? tree.keys[c].name : parent + '\\' + tree.keys[c].name;
+            slots[c] = static_cast<uint32_t>(m_keys.size());
+            m_keys.push_back({path, AddEntry(slots[c], RegistrySearchHit::KEY_NAME, Fold(tree.keys[c].name)), {}});
+            m_paths.emplace(std::move(path), slots[c]);
+        }
+    }
+}
+
+void RegistryIndex::Apply(const std::vector<RegistryDelta>& delta)
+{
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    for (const RegistryDelta& entry : delta)
+    {
+        switch (entry.kind)
+        {
+            case RegistryDelta::KEY_ADDED:
+                AddKey(entry.path);
+                break;
+            case RegistryDelta::KEY_REMOVED:
+            {
+                uint32_t key = FindKey(entry.path);
+                if (key != NONE)
+                {
+                    RemoveKey(key);
+                }
+                break;
+            }
+            case RegistryDelta::VALUE_ADDED:
+            case RegistryDelta::VALUE_CHANGED:
+                SetValue(AddKey(entry.path), entry.name, entry.newValue);
+                break;
+            case RegistryDelta::VALUE_REMOVED:
+            {
+                uint32_t key = FindKey(entry.path);
+                if (key != NONE)
+                {
+                    RemoveValue(key, entry.name);
+                }
+                break;
+            }
+        }
+    }
+    RebuildIfSparse();
+}
+
+void RegistryIndex::Apply(const std::vector<RegistryChange>& changes)
+{
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    for (const RegistryChange& change : changes)
+    {
+        switch (change.kind)
+        {
+            case RegistryChange::CREATE_KEY:
+                AddKey(change.path);
+                break;
+            case RegistryChange::DELETE_KEY:
+            {
+                uint32_t key = FindKey(change.path);
+                if (key != NONE)
+                {
+                    RemoveKey(key);
+                }
+                break;
+            }
+            case RegistryChange::SET_VALUE:
+                SetValue(AddKey(change.path), change.name, change.value);
+                break;
+            case RegistryChange::DELETE_VALUE:
+            {
+                uint32_t key = FindKey(change.path);
+                if (key != NONE)
+                {
+                    RemoveValue(key, change.name);
+                }
+                break;
+            }
+        }
+    }
+    RebuildIfSparse();
+}
+
+uint32_t RegistryIndex::FindKey(std::string_view path) const
+{
+    auto it = m_paths.find(NormalizePath(path));
+    return it == m_paths.end() ? NONE : it->second;
+}
+
+uint32_t RegistryIndex::AddKey(std::string_view path)
+{
+    uint32_t key = 0;
+    std::string prefix;
+    for (std::string_view part : SplitKeyPath(path))
+    {
+        if (!prefix.empty())
+        {
+            prefix += '\\';
+        }
+        prefix += part;
+        auto it = m_paths.find(prefix);
+        if (it != m_paths.end())
+        {
+            key = it->second;
+            continue;
+        }
+        key = static_cast<uint32_t>(m_keys.size());
+        m_keys.push_back({prefix, AddEntry(key, RegistrySearchHit::KEY_NAME, Fold(part)), {}});
+        m_paths.emplace(prefix, key);
+    }
+    return key;
+}
+
+void RegistryIndex::RemoveKey(uint32_t key)
+{
+    // Subkey paths all start with "path\", so they sit together in the map
+    std::vector<uint32_t> doomed;
+    const std::string path = m_keys[key].path;
+    std::string prefix = path.empty() ? path : path + '\\';
+    for (auto it = m_paths.lower_bound(prefix); it != m_paths.end(); ++it)
+    {
+        if (it->first.size() < prefix.size() || !EqualsNoCase(std::string_view(it->first).substr(0, prefix.size()), prefix))
+        {
+            break;
+        }
+        if (it->second != 0)
+        {
+            doomed.push_back(it->second);
+        }
+    }
+    if (key != 0)
+    {
+        doomed.push_back(key);
+    }
+
+    for (uint32_t slot : doomed)
+    {
+        KeySlot& dead = m_keys[slot];
+        while (!dead.values.empty())
+        {
+            RemoveValue(slot, dead.values.begin()->first);
+        }
+        KillEntry(dead.entry);
+        m_paths.erase(dead.path);
+        std::string().swap(dead.path);
+    }
+    if (key == 0)
+    {
+        while (!m_keys[0].values.empty())
+        {
+            RemoveValue(0, m_keys[0].values.begin()->first);
+        }
+    }
+}
+
+void RegistryIndex::SetValue(uint32_t key, std::string_view name, const RegistryValue& value)
+{
+    RemoveValue(key, name);
+
+    uint32_t slot = static_cast<uint32_t>(m_values.size());
+    ValueSlot added = {key, std::string(name), NONE, NONE, false, 0};
+    added.nameEntry = AddEntry(slot, RegistrySearchHit::VALUE_NAME, Fold(name));
+    if (IsText(value.type))
+    {
+        added.dataEntry = AddEntry(slot, RegistrySearchHit::VALUE_DATA, Fold(value.data));
+    }
+    else if ((value.type == VALUE_DWORD && value.data.size() == 4) || (value.type == VALUE_QWORD && value.data.size() == 8))
+    {
+        for (size_t i = value.data.size(); i-- > 0;)
+        {
+            added.number = (added.number << 8) | static_cast<uint8_t>(value.data[i]);
+        }
+        added.numeric = true;
+        m_numbers.emplace(added.number, slot);
+    }
+    m_values.push_back(std::move(added));
+    m_keys[key].values.emplace(std::string(name), slot);
+}
+
+void RegistryIndex::RemoveValue(uint32_t key, std::string_view name)
+{
+    auto& values = m_keys[key].values;
+    auto it = values.find(name);
+    if (it == values.end())
+    {
+        return;
+    }
+    ValueSlot& dead = m_values[it->second];
+    KillEntry(dead.nameEntry);
+    KillEntry(dead.dataEntry);
+    if (dead.numeric)
+    {
+        m_numbers.erase({dead.number, it->second});
+    }
+    std::string().swap(dead.name);
+    values.erase(it);
+}
+
+uint32_t RegistryIndex::AddEntry(uint32_t owner, RegistrySearchHit::Field field, std::string text)
+{
+    uint32_t entry = static_cast<uint32_t>(m_entries.size());
+    for (size_t i = 0; i + 3 <= text.size(); ++i)
+    {
+        // Entries only ever get larger numbers, so appending keeps lists sorted
+        std::vector<uint32_t>& list = m_postings[PostingKey(field, text.data() + i)];
+        if (list.empty() || list.back() != entry)
+        {
+            list.push_back(entry);
+            ++m_postingCount;
+        }
+    }
+    m_entries.push_back({owner, field, true, std::move(text)});
+    ++m_liveEntries;
+    return entry;
+}
+
+void RegistryIndex::KillEntry(uint32_t entry)
+{
+    if (entry == NONE || !m_entries[entry].live)
+    {
+        return;
+    }
+    m_entries[entry].live = false;
+    std::string().swap(m_entries[entry].text);
+    --m_liveEntries;
+    ++m_deadEntries;
+}
+
+// Re-indexes the live keys and values into fresh slots, entries and postings
+void RegistryIndex::RebuildIfSparse()
+{
+    if (m_deadEntries < REBUILD_MIN_DEAD || m_deadEntries < m_liveEntries)
+    {
+        return;
+    }
+
+    std::vector<KeySlot> keys;
+    std::vector<ValueSlot> values;
+    std::vector<Entry> entries;
+    keys.swap(m_keys);
+    values.swap(m_values);
+    entries.swap(m_entries);
+    m_postings.clear();
+    m_numbers.clear();
+    m_liveEntries = 0;
+    m_deadEntries = 0;
+    m_postingCount = 0;
+
+    for (auto& [path, slot] : m_paths)
+    {
+        KeySlot& key = keys[slot];
+        uint32_t newKey = static_cast<uint32_t>(m_keys.size());
+        uint32_t entry = key.entry == NONE ? NONE : AddEntry(newKey, RegistrySearchHit::KEY_NAME, std::move(entries[key.entry].text));
+        m_keys.push_back({std::move(key.path), entry, {}});
+        for (auto& [name, valueSlot] : key.values)
+        {
+            ValueSlot& value = values[valueSlot];
+            uint32_t newValue = static_cast<uint32_t>(m_values.size());
+            value.key = newKey;
+            value.nameEntry = AddEntry(newValue, RegistrySearchHit::VALUE_NAME, std::move(entries[value.nameEntry].text));
+            if (value.dataEntry != NONE)
+            {
+                value.dataEntry = AddEntry(newValue, RegistrySearchHit::VALUE_DATA, std::move(entries[value.dataEntry].text));
+            }
+            if (value.numeric)
+            {
+                m_numbers.emplace(value.number, newValue);
+            }
+            m_values.push_back(std::move(value));
+            valueSlot = newValue;
+        }
+        m_keys.back().values = std::move(key.values);
+        slot = newKey;
+    }
+    ++m_rebuilds;
+}
+
+RegistrySearchHit RegistryIndex::HitOf(const Entry& entry) const
+{
+    if (entry.field == RegistrySearchHit::KEY_NAME)
+    {
+        return {entry.field, m_keys[entry.owner].path, std::string()};
+    }
+    const ValueSlot& value = m_values[entry.owner];
+    return {entry.field, m_keys[value.key].path, value.name};
+}
+
+std::vector<RegistrySearchHit> RegistryIndex::Find(std::string_view text, uint32_t fields, size_t limit, Match match) const
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    std::vector<RegistrySearchHit> hits;
+    const std::string pattern = Fold(text);
+    auto matches = [&](const Entry& entry)
+    {
+        if (!entry.live)
+        {
+            return false;
+        }
+        return match == Match::Prefix ? entry.text.compare(0, pattern.size(), pattern) == 0
+                                      : entry.text.find(pattern) != std::string::npos;
+    };
+
+    for (RegistrySearchHit::Field field : {RegistrySearchHit::KEY_NAME, RegistrySearchHit::VALUE_NAME, RegistrySearchHit::VALUE_DATA})
+    {
+        if (!(fields & field))
+        {
+            continue;
+        }
+
+        // Too short for a trigram: check every entry of the field
+        if (pattern.size() < 3)
+        {
+            for (const Entry& entry : m_entries)
+            {
+                if (hits.size() == limit)
+                {
+                    return hits;
+                }
+                if (entry.field == field && matches(entry))
+                {
+                    hits.push_back(HitOf(entry));
+                }
+            }
+            continue;
+        }
+
+        std::vector<const std::vector<uint32_t>*> lists;
+        bool missing = false;
+        for (size_t i = 0; i + 3 <= pattern.size() && !missing; ++i)
+        {
+            auto it = m_postings.find(PostingKey(field, pattern.data() + i));
+            missing = it == m_postings.end();
+            if (!missing)
+            {
+                lists.push_back(&it->second);
+            }
+        }
+        if (missing)
+        {
+            continue;
+        }
+
+        // Shortest list first; every other list can only remove candidates
+        std::sort(lists.begin(), lists.end(), [](auto* a, auto* b) { return a->size() < b->size(); });
+        std::vector<uint32_t> candidates = *lists[0];
+        for (size_t l = 1; l < lists.size() && !candidates.empty(); ++l)
+        {
+            const std::vector<uint32_t>& list = *lists[l];
+            auto from = list.begin();
+            size_t kept = 0;
+            for (uint32_t candidate : candidates)
+            {
+                // Gallop: candidates ascend, so the next one is usually close by
+                size_t step = 1;
+                while (step < static_cast<size_t>(list.end() - from) && from[step] < candidate)
+                {
+                    step *= 2;
+                }
+                auto until = step < static_cast<size_t>(list.end() - from) ? from + step + 1 : list.end();
+                from = std::lower_bound(from, until, candidate);
+                if (from == list.end())
+                {
+                    break;
+                }
+                if (*from == candidate)
+                {
+                    candidates[kept++] = candidate;
+                }
+            }
+            candidates.resize(kept);
+        }
+        for (uint32_t candidate : candidates)
+        {
+            if (hits.size() == limit)
+            {
+                return hits;
+            }
+            if (matches(m_entries[candidate]))
+            {
+                hits.push_back(HitOf(m_entries[candidate]));
+            }
+        }
+    }
+    return hits;
+}
+
+std::vector<RegistrySearchHit> RegistryIndex::FindSubstring(std::string_view text, uint32_t fields, size_t limit) const
+{
+    return Find(text, fields, limit, Match::Substring);
+}
+
+std::vector<RegistrySearchHit> RegistryIndex::FindPrefix(std::string_view text, uint32_t fields, size_t limit) const
+{
+    return Find(text, fields, limit, Match::Prefix);
+}
+
+std::vector<RegistrySearchHit> RegistryIndex::FindNumberRange(uint64_t low, uint64_t high, size_t limit) const
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    std::vector<RegistrySearchHit> hits;
+    for (auto it = m_numbers.lower_bound({low, 0}); it != m_numbers.end() && it->first <= high && hits.size() < limit; ++it)
+    {
+        const ValueSlot& value = m_values[it->second];
+        hits.push_back({RegistrySearchHit::VALUE_DATA, m_keys[value.key].path, value.name});
+    }
+    return hits;
+}
+
+RegistryIndex::Stats RegistryIndex::GetStats() const
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    uint64_t values = 0;
+    for (const auto& [path, slot] : m_paths)
+    {
+        values += m_keys[slot].values.size();
+    }
+    return {m_paths.size() - 1, values, m_liveEntries, m_deadEntries, m_postingCount, m_rebuilds};
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "RegistryBackend.h"
+#include "RegistryDiff.h"
+#include "RegistryTree.h"
+
+struct RegistrySearchHit
+{
+    enum Field : uint8_t
+    {
+        KEY_NAME = 1,
+        VALUE_NAME = 2,
+        VALUE_DATA = 4, // String, expandable string and multi-string data
+        ALL = KEY_NAME | VALUE_NAME | VALUE_DATA,
+    };
+
+    Field field;
+    std::string path;
+    std::string name; // The value name; empty for key name hits
+};
+
+// Search index over a registry subtree: a trigram index over key names,
+// value names and string data, and an ordered index of DWORD and QWORD data.
+// Text queries are case-insensitive. A substring query intersects the
+// posting lists of the pattern's trigrams and checks the survivors, so its
+// cost follows the rarest trigram rather than the tree size.
+// Updates append new entries and mark the old ones dead; once dead entries
+// outnumber live ones the postings are rebuilt. Queries may run from several
+// threads while one thread updates.
+class RegistryIndex
+{
+public:
+    RegistryIndex();
+
+    // Replaces the contents with the captured tree; paths are relative to its root
+    void Build(const RegistryTree& tree);
+
+    // Incremental updates, as produced by DiffTrees or applied to a backend
+    void Apply(const std::vector<RegistryDelta>& delta);
+    void Apply(const std::vector<RegistryChange>& changes);
+
+    // fields is a mask of RegistrySearchHit::Field. Hits come in no particular order.
+    std::vector<RegistrySearchHit> FindSubstring(std::string_view text, uint32_t fields = RegistrySearchHit::ALL,
+                                                 size_t limit = SIZE_MAX) const;
+    std::vector<RegistrySearchHit> FindPrefix(std::string_view text, uint32_t fields = RegistrySearchHit::ALL,
+                                              size_t limit = SIZE_MAX) const;
+
+    // DWORD and QWORD values with low <= data <= high
+    std::vector<RegistrySearchHit> FindNumberRange(uint64_t low, uint64_t high, size_t limit = SIZE_MAX) const;
+
+    struct Stats
+    {
+        uint64_t keys;
+        uint64_t values;
+        uint64_t liveEntries; // Indexed texts
+        uint64_t deadEntries; // Replaced texts still in the postings
+        uint64_t postings;    // Trigram occurrences stored
+        uint64_t rebuilds;
+    };
+    Stats GetStats() const;
+
+private:
+    static const uint32_t NONE = UINT32_MAX;
+
+    struct KeySlot
+    {
+        std::string path;
+        uint32_t entry;
+        std::map<std::string, uint32_t, LessNoCase> values; // Name to value slot
+    };
+
+    struct ValueSlot
+    {
+        uint32_t key;
+        std::string name;
+        uint32_t nameEntry;
+        uint32_t dataEntry; // NONE unless the data is text
+        bool numeric;
+        uint64_t number;
+    };
+
+    // One indexed text, folded to lower case
+    struct Entry
+    {
+        uint32_t owner; // Key slot for key names, value slot otherwise
+        RegistrySearchHit::Field field;
+        bool live;
+        std::string text;
+    };
+
+    enum class Match
+    {
+        Substring,
+        Prefix,
+    };
+
+    std::vector<RegistrySearchHit> Find(std::string_view text, uint32_t fields, size_t limit, Match match) const;
+    RegistrySearchHit HitOf(const Entry& entry) const;
+
+    void Clear();
+    uint32_t AddKey(std::string_view path); // Adds missing parents too
+    void RemoveKey(uint32_t key);           // With its subkeys and values
+    void SetValue(uint32_t key, std::string_view name, const RegistryValue& value);
+    void RemoveValue(uint32_t key, std::string_view name);
+    uint32_t FindKey(std::string_view path) const;
+    uint32_t AddEntry(uint32_t owner, RegistrySearchHit::Field field, std::string text);
+    void KillEntry(uint32_t entry);
+    void RebuildIfSparse();
+
+    mutable std::shared_mutex m_mutex;
+    std::vector<KeySlot> m_keys;
+    std::vector<ValueSlot> m_values;
+    std::vector<Entry> m_entries;
+    std::map<std::string, uint32_t, LessNoCase> m_paths;             // Live key paths to key slots
+    std::unordered_map<uint32_t, std::vector<uint32_t>> m_postings; // Field and trigram to ascending entries
+    std::set<std::pair<uint64_t, uint32_t>> m_numbers;               // Number and value slot
+    uint64_t m_liveEntries = 0;
+    uint64_t m_deadEntries = 0;
+    uint64_t m_postingCount = 0;
+    uint64_t m_rebuilds = 0;
+};
@@ -0,0 +1,172 @@
+#include "RegistryManager.h"
+#include "TransactionJournal.h"
+#include "../Common/Metrics.h"
+#include "../Common/Trace.h"
+
+#ifdef _WIN32
+#include "Win32Backend.h"
+
+RegistryManager::RegistryManager(HKEY rootKey) : m_backend(std::make_shared<Win32RegistryBackend>(rootKey))
+{}
+#endif
+
+RegistryManager::RegistryManager(std::shared_ptr<RegistryBackend> backend) : m_backend(std::move(backend))
+{}
+
+RegistryManager::~RegistryManager()
+{}
+
+bool RegistryManager::CreateKey(const std::string& subKey, RegistryError& error)
+{
+    LY_TRACE_FUNCTION("registry");
+    static Metrics::Operation metrics("registry_op", "CreateKey");
+    Metrics::OperationTimer timer(metrics);
+    int32_t result = m_backend->CreateKey(subKey);
+    if (result != REGISTRY_SUCCESS)
+    {
+        error = RegistryError(RegistryOperation::CreateKey, result, subKey);
+        timer.Fail();
+        return false;
+    }
+    return true;
+}
+
+bool RegistryManager::DeleteKey(const std::string& subKey, RegistryError& error)
+{
+    LY_TRACE_FUNCTION("registry");
+    static Metrics::Operation metrics("registry_op", "DeleteKey");
+    Metrics::OperationTimer timer(metrics);
+    int32_t result = m_backend->DeleteKey(subKey);
+    if (result != REGISTRY_SUCCESS)
+    {
+        error = RegistryError(RegistryOperation::DeleteKey, result, subKey);
+        timer.Fail();
+        return false;
+    }
+    return true;
+}
+
+// Value calls tell a missing key apart from a failed value operation by code
+static RegistryOperation FailedStep(int32_t result, RegistryOperation openStep, RegistryOperation valueStep)
+{
+    return result == REGISTRY_KEY_NOT_FOUND ? openStep : valueStep;
+}
+
+bool RegistryManager::WriteStringValue(const std::string& subKey, const std::string& valueName, const std::string& data, RegistryError& error)
+{
+    LY_TRACE_FUNCTION("registry");
+    static Metrics::Operation metrics("registry_op", "WriteStringValue");
+    Metrics::OperationTimer timer(metrics);
+    int32_t result = m_backend->SetValue(subKey, valueName, RegistryValue::String(data));
+    if (result != REGISTRY_SUCCESS)
+    {
+        error = RegistryError(FailedStep(result, RegistryOperation::OpenKeyForWriting, RegistryOperation::WriteString),
+                              result, subKey);
+        timer.Fail();
+        return false;
+    }
+    return true;
+}
+
+bool RegistryManager::WriteDWORDValue(const std::string& subKey, const std::string& valueName, uint32_t data, RegistryError& error)
+{
+    LY_TRACE_FUNCTION("registry");
+    static Metrics::Operation metrics("registry_op", "WriteDWORDValue");
+    Metrics::OperationTimer timer(metrics);
+    int32_t result = m_backend->SetValue(subKey, valueName, RegistryValue::DWord(data));
+    if (result != REGISTRY_SUCCESS)
+    {
+        error = RegistryError(FailedStep(result, RegistryOperation::OpenKeyForWriting, RegistryOperation::WriteDWORD),
+                              result, subKey);
+        timer.Fail();
+        return false;
+    }
+    return true;
+}
+
+bool RegistryManager::ReadStringValue(const std::string& subKey, const std::string& valueName, std::string& dataOut, RegistryError& error)
+{
+    LY_TRACE_FUNCTION("registry");
+    static Metrics::Operation metrics("registry_op", "ReadStringValue");
+    Metrics::OperationTimer timer(metrics);
+    RegistryValue value;
+    int32_t result = m_backend->QueryValue(subKey, valueName, value);
+    if (result != REGISTRY_SUCCESS)
+    {
+        error = RegistryError(FailedStep(result, RegistryOperation::OpenKeyForReading, RegistryOperation::QueryString),
+                              result, subKey);
+        timer.Fail();
+        return false;
+    }
+    if (value.type != VALUE_STRING)
+    {
+        error = RegistryError(RegistryOperation::QueryString, REGISTRY_TYPE_MISMATCH, subKey);
+        timer.Fail();
+        return false;
+    }
+
+    dataOut = std::move(value.data);
+    return true;
+}
+
+bool RegistryManager::ReadDWORDValue(const std::string& subKey, const std::string& valueName, uint32_t& dataOut, RegistryError& error)
+{
+    LY_TRACE_FUNCTION("registry");
+    static Metrics::Operation metrics("registry_op", "ReadDWORDValue");
+    Metrics::OperationTimer timer(metrics);
+    RegistryValue value;
+    int32_t result = m_backend->QueryValue(subKey, valueName, value);
+    if (result != REGISTRY_SUCCESS)
+    {
+        error = RegistryError(FailedStep(result, RegistryOperation::OpenKeyForReading, RegistryOperation::ReadDWORD),
+                              result, subKey);
+        timer.Fail();
+        return false;
+    }
+    if (value.type != VALUE_DWORD || value.data.size() != sizeof(uint32_t))
+    {
+        error = RegistryError(RegistryOperation::ReadDWORD, REGISTRY_TYPE_MISMATCH, subKey);
+        timer.Fail();
+        return false;
+    }
+
+    dataOut = 0;
+    for (size_t i = 0; i < sizeof(uint32_t); ++i)
+    {
+        dataOut |= static_cast<uint32_t>(static_cast<uint8_t>(value.data[i])) << (i * 8);
+    }
+    return true;
+}
+
+bool RegistryManager::DeleteValue(const std::string& subKey, const std::string& valueName, RegistryError& error)
+{
+    LY_TRACE_FUNCTION("registry");
+    static Metrics::Operation metrics("registry_op", "DeleteValue");
+    Metrics::OperationTimer timer(metrics);
+    int32_t result = m_backend->DeleteValue(subKey, valueName);
+    if (result != REGISTRY_SUCCESS)
+    {
+        error = RegistryError(FailedStep(result, RegistryOperation::OpenKeyForDeletingValue, RegistryOperation::DeleteValue),
+                              result, subKey);
+        timer.Fail();
+        return false;
+    }
+    return true;
+}
+
+RegistryManager::Transaction RegistryManager::BeginTransaction()
+{
+    return Transaction(m_backend, m_journal);
+}
+
+bool RegistryManager::EnableJournal(const std::string& fileName, RegistryError& error)
+{
+    LY_TRACE_FUNCTION("registry");
+    auto journal = std::make_shared<TransactionJournal>();
+    if (!journal->Open(fileName, *m_backend, error))
+    {
+        return false;
+    }
+    m_journal = std::move(journal);
+    return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <memory>
+#include <string>
+#include "RegistryBackend.h"
+#include "RegistryError.h"
+#include "RegistryTransaction.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+class TransactionJournal;
+
+// Safe to share between threads once set up (EnableJournal is setup only):
+// every backend here takes concurrent calls. Transactions are per thread.
+class RegistryManager
+{
+public:
+#ifdef _WIN32
+    RegistryManager(HKEY rootKey);
+#endif
+    explicit RegistryManager(std::shared_ptr<RegistryBackend> backend);
+    ~RegistryManager();
+
+    bool CreateKey(const std::string& subKey, RegistryError& error);
+    bool DeleteKey(const std::string& subKey, RegistryError& error);
+
+    bool WriteStringValue(const std::string& subKey, const std::string& valueName, const std::string& data, RegistryError& error);
+    bool WriteDWORDValue(const std::string& subKey, const std::string& valueName, uint32_t data, RegistryError& error);
+
+    bool ReadStringValue(const std::string& subKey, const std::string& valueName, std::string& dataOut, RegistryError& error);
+    bool ReadDWORDValue(const std::string& subKey, const std::string& valueName, uint32_t& dataOut, RegistryError& error);
+
+    bool DeleteValue(const std::string& subKey, const std::string& valueName, RegistryError& error);
+
+    // Multi-key updates that land all together or not at all
+    using Transaction = RegistryTransaction;
+    Transaction BeginTransaction();
+
+    // Journals transactions to fileName, first rolling back any left
+    // unfinished by a crash. Not needed with a KTM-transacted backend.
+    bool EnableJournal(const std::string& fileName, RegistryError& error);
+
+    RegistryBackend& Backend() { return *m_backend; }
+    std::shared_ptr<TransactionJournal> Journal() const { return m_journal; }
+
+private:
+    std::shared_ptr<RegistryBackend> m_backend;
+    std::shared_ptr<TransactionJournal> m_journal;
+};
@@ -0,0 +1,187 @@
+#include "RegistryTransaction.h"
+#include <algorithm>
+#include <set>
+#include "TransactionJournal.h"
+#include "../Common/Trace.h"
+
+RegistryTransaction::RegistryTransaction(std::shared_ptr<RegistryBackend> backend, std::shared_ptr<TransactionJournal> journal)
+    : m_backend(std::move(backend)), m_journal(std::move(journal))
+{}
+
+void RegistryTransaction::CreateKey(const std::string& subKey)
+{
+    m_changes.push_back({RegistryChange::CREATE_KEY, subKey, {}, {}});
+}
+
+void RegistryTransaction::DeleteKey(const std::string& subKey)
+{
+    m_changes.push_back({RegistryChange::DELETE_KEY, subKey, {}, {}});
+}
+
+void RegistryTransaction::WriteStringValue(const std::string& subKey, const std::string& valueName, const std::string& data)
+{
+    m_changes.push_back({RegistryChange::SET_VALUE, subKey, valueName, RegistryValue::String(data)});
+}
+
+void RegistryTransaction::WriteDWORDValue(const std::string& subKey, const std::string& valueName, uint32_t data)
+{
+    m_changes.push_back({RegistryChange::SET_VALUE, subKey, valueName, RegistryValue::DWord(data)});
+}
+
+void RegistryTransaction::WriteValue(const std::string& subKey, const std::string& valueName, const RegistryValue& value)
+{
+    m_changes.push_back({RegistryChange::SET_VALUE, subKey, valueName, value});
+}
+
+void RegistryTransaction::DeleteValue(const std::string& subKey, const std::string& valueName)
+{
+    m_changes.push_back({RegistryChange::DELETE_VALUE, subKey, valueName, {}});
+}
+
+void RegistryTransaction::Rollback()
+{
+    m_changes.clear();
+}
+
+// Reads the state the buffered changes will overwrite and returns the changes
+// that put it back, in the order they must be applied
+static std::vector<RegistryChange> CaptureUndo(RegistryBackend& backend, const std::vector<RegistryChange>& changes)
+{
+    std::vector<RegistryChange> undo;      // Built backwards, reversed at the end
+    // Kept apart: a CREATE_KEY only records whether a key existed, so a later
+    // DELETE_KEY of the same key must still capture its values
+    std::set<std::string, LessNoCase> keysSeen;   // Keys whose existence is captured
+    std::set<std::string, LessNoCase> valuesSeen; // Keys whose values, and "key\nvalue", are captured
+    for (const RegistryChange& change : changes)
+    {
+        switch (change.kind)
+        {
+            case RegistryChange::CREATE_KEY:
+            {
+                // Every missing key on the path gets created, parents first
+                std::string prefix;
+                for (std::string_view part : SplitKeyPath(change.path))
+                {
+                    if (!prefix.empty())
+                    {
+                        prefix += '\\';
+                    }
+                    prefix += part;
+                    if (keysSeen.insert(prefix).second && backend.KeyExists(prefix) != REGISTRY_SUCCESS)
+                    {
+                        undo.push_back({RegistryChange::DELETE_KEY, prefix, {}, {}});
+                    }
+                }
+                break;
+            }
+            case RegistryChange::DELETE_KEY:
+            {
+                std::vector<std::pair<std::string, RegistryValue>> values;
+                // A key found missing by an earlier CREATE_KEY fails EnumValues
+                // here; its undo already deletes it
+                keysSeen.insert(change.path);
+                if (valuesSeen.insert(change.path).second && backend.EnumValues(change.path, values) == REGISTRY_SUCCESS)
+                {
+                    for (auto& [name, value] : values)
+                    {
+                        valuesSeen.insert(change.path + '\n' + name);
+                        undo.push_back({RegistryChange::SET_VALUE, change.path, name, std::move(value)});
+                    }
+                    undo.push_back({RegistryChange::CREATE_KEY, change.path, {}, {}});
+                }
+                break;
+            }
+            case RegistryChange::SET_VALUE:
+            case RegistryChange::DELETE_VALUE:
+            {
+                if (!valuesSeen.insert(change.path + '\n' + change.name).second)
+                {
+                    break;
+                }
+                RegistryValue previous;
+                if (backend.QueryValue(change.path, change.name, previous) == REGISTRY_SUCCESS)
+                {
+                    undo.push_back({RegistryChange::SET_VALUE, change.path, change.name, std::move(previous)});
+                }
+                else
+                {
+                    undo.push_back({RegistryChange::DELETE_VALUE, change.path, change.name, {}});
+                }
+                break;
+            }
+        }
+    }
+    std::reverse(undo.begin(), undo.end());
+    return undo;
+}
+
+static RegistryOperation OperationOf(const RegistryChange& change)
+{
+    switch (change.kind)
+    {
+        case RegistryChange::CREATE_KEY: return RegistryOperation::CreateKey;
+        case RegistryChange::DELETE_KEY: return RegistryOperation::DeleteKey;
+        case RegistryChange::SET_VALUE:
+            return change.value.type == VALUE_DWORD ? RegistryOperation::WriteDWORD : RegistryOperation::WriteString;
+        case RegistryChange::DELETE_VALUE: return RegistryOperation::DeleteValue;
+    }
+    return RegistryOperation::CommitTransaction;
+}
+
+bool RegistryTransaction::Commit(RegistryError& error)
+{
+    LY_TRACE_FUNCTION("registry");
+    std::vector<RegistryChange> changes;
+    changes.swap(m_changes);
+    if (changes.empty())
+    {
+        return true;
+    }
+
+    bool journaled = m_journal && m_journal->IsOpen() && !m_backend->DurableBatches();
+    std::vector<RegistryChange> undo;
+    if (journaled || !m_backend->AtomicBatches())
+    {
+        undo = CaptureUndo(*m_backend, changes);
+    }
+
+    uint64_t id = 0;
+    if (journaled && !m_journal->Begin(undo, id, error))
+    {
+        return false;
+    }
+
+    size_t failedIndex = 0;
+    int32_t result = m_backend->ApplyChanges(changes, failedIndex);
+    if (result != REGISTRY_SUCCESS && !m_backend->AtomicBatches())
+    {
+        for (const RegistryChange& change : undo)
+        {
+            ApplyChange(*m_backend, change);
+        }
+    }
+
+    // The end record is written for rolled back transactions too: there is nothing left to undo
+    RegistryError journalError;
+    bool ended = !journaled || m_journal->End(id, journalError);
+
+    if (result != REGISTRY_SUCCESS)
+    {
+        if (failedIndex < changes.size())
+        {
+            error = RegistryError(OperationOf(changes[failedIndex]), result, changes[failedIndex].path);
+        }
+        else
+        {
+            error = RegistryError(RegistryOperation::CommitTransaction, result, {});
+        }
+        return false;
+    }
+    if (!ended)
+    {
+        // Applied, but the next Open of the journal will roll it back
+        error = journalError;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "RegistryBackend.h"
+#include "RegistryError.h"
+
+class TransactionJournal;
+
+// Buffers registry changes and commits them as one group: every key is opened
+// once, and either all changes land or none do. When the backend cannot make
+// that promise across a crash by itself, the undo journal does.
+// Not thread-safe; use one transaction per thread.
+class RegistryTransaction
+{
+public:
+    RegistryTransaction(std::shared_ptr<RegistryBackend> backend, std::shared_ptr<TransactionJournal> journal);
+
+    void CreateKey(const std::string& subKey);
+    void DeleteKey(const std::string& subKey);
+
+    void WriteStringValue(const std::string& subKey, const std::string& valueName, const std::string& data);
+    void WriteDWORDValue(const std::string& subKey, const std::string& valueName, uint32_t data);
+    void WriteValue(const std::string& subKey, const std::string& valueName, const RegistryValue& value);
+
+    void DeleteValue(const std::string& subKey, const std::string& valueName);
+
+    // The buffer is empty afterwards, whether or not the commit succeeded
+    bool Commit(RegistryError& error);
+    void Rollback();
+
+    size_t Size() const { return m_changes.size(); }
+    RegistryBackend& Backend() const { return *m_backend; }
+
+private:
+    std::shared_ptr<RegistryBackend> m_backend;
+    std::shared_ptr<TransactionJournal> m_journal;
+    std::vector<RegistryChange> m_changes;
+};
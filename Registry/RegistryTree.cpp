@@ -0,0 +1,112 @@
+#include "RegistryTree.h"
+#include <algorithm>
+#include <utility>
+#include "../Common/Checksum.h"
+
+// Names compare case-insensitively, so they are hashed folded
+static uint64_t NameHash(std::string_view name, std::string& scratch)
+{
+    scratch.assign(name.begin(), name.end());
+    for (char& ch : scratch)
+    {
+        if (ch >= 'A' && ch <= 'Z')
+        {
+            ch = static_cast<char>(ch - 'A' + 'a');
+        }
+    }
+    return Hash64(scratch.data(), scratch.size());
+}
+
+void HashTree(RegistryTree& tree)
+{
+    std::string scratch;
+    std::vector<uint64_t> lanes;
+    for (RegistryTree::Value& value : tree.values)
+    {
+        value.hash = Hash64(value.value.data.data(), value.value.data.size(), value.value.type);
+    }
+
+    // Subkeys always come after their parent, so walking backwards hashes
+    // every child before the key that includes it
+    for (size_t i = tree.keys.size(); i-- > 0;)
+    {
+        RegistryTree::Key& key = tree.keys[i];
+        lanes.clear();
+        lanes.push_back(key.valueCount);
+        for (uint32_t v = key.firstValue; v < key.firstValue + key.valueCount; ++v)
+        {
+            lanes.push_back(NameHash(tree.values[v].name, scratch));
+            lanes.push_back(tree.values[v].hash);
+        }
+        lanes.push_back(key.childCount);
+        for (uint32_t c = key.firstChild; c < key.firstChild + key.childCount; ++c)
+        {
+            lanes.push_back(NameHash(tree.keys[c].name, scratch));
+            lanes.push_back(tree.keys[c].hash);
+        }
+        key.hash = Hash64(lanes.data(), lanes.size() * sizeof(uint64_t));
+    }
+}
+
+template <class Reader>
+static bool Capture(Reader& reader, std::string_view path, RegistryTree& tree, RegistryError& error)
+{
+    tree.keys.clear();
+    tree.values.clear();
+    tree.keys.push_back({ std::string(), 0, 0, 0, 0, 0 });
+
+    // Full paths of the keys still to be read, in the same breadth-first order
+    std::vector<std::string> paths{ std::string(path) };
+    std::vector<std::string> names;
+    std::vector<std::pair<std::string, RegistryValue>> values;
+
+    for (size_t i = 0; i < tree.keys.size(); ++i)
+    {
+        const std::string keyPath = std::move(paths[i]);
+        names.clear();
+        values.clear();
+        int32_t result = reader.EnumSubkeys(keyPath, names);
+        if (result == REGISTRY_SUCCESS)
+        {
+            result = reader.EnumValues(keyPath, values);
+        }
+        if (result != REGISTRY_SUCCESS)
+        {
+            error = RegistryError(RegistryOperation::OpenKeyForReading, result, keyPath);
+            return false;
+        }
+
+        std::sort(names.begin(), names.end(), LessNoCase());
+        std::sort(values.begin(), values.end(), [](const auto& a, const auto& b) {
+            return LessNoCase()(a.first, b.first);
+        });
+
+        tree.keys[i].firstChild = static_cast<uint32_t>(tree.keys.size());
+        tree.keys[i].childCount = static_cast<uint32_t>(names.size());
+        tree.keys[i].firstValue = static_cast<uint32_t>(tree.values.size());
+        tree.keys[i].valueCount = static_cast<uint32_t>(values.size());
+        for (std::string& name : names)
+        {
+            paths.push_back(keyPath.empty() ? name : keyPath + '\\' + name);
+            tree.keys.push_back({ std::move(name), 0, 0, 0, 0, 0 });
+        }
+        for (auto& value : values)
+        {
+            tree.values.push_back({ std::move(value.first), std::move(value.second), 0 });
+        }
+    }
+
+    HashTree(tree);
+    return true;
+}
+
+bool CaptureTree(RegistryBackend& backend, std::string_view path, RegistryTree& tree, RegistryError& error)
+{
+    return Capture(backend, path, tree, error);
+}
+
+bool CaptureTree(const MemoryRegistryBackend::Snapshot& snapshot, std::string_view path, RegistryTree& tree,
+                 RegistryError& error)
+{
+    return Capture(snapshot, path, tree, error);
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "MemoryBackend.h"
+#include "RegistryBackend.h"
+#include "RegistryError.h"
+
+// A registry subtree captured into flat arrays, with a Merkle hash on every
+// key: the hash covers the key's values and, through their hashes, all of its
+// subkeys. Two keys with equal hashes hold the same content, so a diff can
+// skip the whole branch without looking inside.
+// Keys are laid out breadth-first; the subkeys of a key are contiguous and
+// sorted case-insensitively, and so are its values. keys[0] is the root.
+struct RegistryTree
+{
+    struct Key
+    {
+        std::string name;
+        uint64_t hash;
+        uint32_t firstChild;
+        uint32_t childCount;
+        uint32_t firstValue;
+        uint32_t valueCount;
+    };
+
+    struct Value
+    {
+        std::string name;
+        RegistryValue value;
+        uint64_t hash; // Of type and data only; names are compared directly
+    };
+
+    std::vector<Key> keys;
+    std::vector<Value> values;
+
+    uint64_t RootHash() const { return keys.empty() ? 0 : keys[0].hash; }
+};
+
+// Capture everything below path. The backend overload reads key by key and
+// sees concurrent writers mid-way; the snapshot overload is consistent.
+bool CaptureTree(RegistryBackend& backend, std::string_view path, RegistryTree& tree, RegistryError& error);
+bool CaptureTree(const MemoryRegistryBackend::Snapshot& snapshot, std::string_view path, RegistryTree& tree,
+                 RegistryError& error);
+
+// Recomputes every key hash; CaptureTree already does this
+void HashTree(RegistryTree& tree);
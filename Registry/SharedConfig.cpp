@@ -0,0 +1,446 @@
+#include "SharedConfig.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <thread>
+
+static const uint32_t SEGMENT_MAGIC = 0x4353594C; // "LYSC"
+static const uint32_t SEGMENT_VERSION = 1;
+
+struct SegmentHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t slotSize; // Including its SlotHeader
+    std::atomic<uint64_t> generation;
+    std::atomic<uint32_t> live;
+};
+
+// Odd sequence: the writer is filling the slot
+struct SlotHeader
+{
+    std::atomic<uint64_t> sequence;
+    uint64_t generation;
+    uint32_t entryCount;
+    uint32_t used;        // Bytes of entries, buckets and text after the header
+    uint32_t bucketCount; // Power of two; each bucket is 0 or an entry index + 1
+};
+
+// Entries are sorted by key, which is the path, a '\0' and the value name, so
+// a key's values are adjacent for EnumValues. The hash buckets after them
+// find a single value with one probe instead of a binary search.
+struct SlotEntry
+{
+    uint32_t keyOffset;
+    uint32_t keyLength;
+    uint32_t pathLength;
+    uint32_t type;
+    uint32_t dataOffset;
+    uint32_t dataLength;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the segment needs address-free 64-bit atomics");
+
+static const size_t HEADER_SIZE = 64;
+static const size_t SLOT_HEADER_SIZE = 64;
+
+static inline unsigned char FoldCase(char ch)
+{
+    return (ch >= 'A' && ch <= 'Z') ? static_cast<unsigned char>(ch - 'A' + 'a') : static_cast<unsigned char>(ch);
+}
+
+static int CompareFolded(const char* a, const char* b, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        unsigned char x = FoldCase(a[i]), y = FoldCase(b[i]);
+        if (x != y)
+        {
+            return x < y ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+// Orders a stored key against path + '\0' + name without building the latter
+static int CompareKey(std::string_view key, std::string_view path, std::string_view name)
+{
+    if (int order = CompareFolded(key.data(), path.data(), (std::min)(key.size(), path.size())))
+    {
+        return order;
+    }
+    if (key.size() <= path.size())
+    {
+        return -1;
+    }
+    if (key[path.size()] != '\0')
+    {
+        return 1;
+    }
+    std::string_view rest = key.substr(path.size() + 1);
+    if (int order = CompareFolded(rest.data(), name.data(), (std::min)(rest.size(), name.size())))
+    {
+        return order;
+    }
+    return rest.size() < name.size() ? -1 : (rest.size() > name.size() ? 1 : 0);
+}
+
+// FNV-1a of the case-folded key; the writer hashes the stored key, the
+// reader the path and name it was given, to the same number
+static uint32_t HashFolded(uint32_t hash, std::string_view text)
+{
+    for (char ch : text)
+    {
+        hash = (hash ^ FoldCase(ch)) * 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t HashKey(std::string_view path, std::string_view name)
+{
+    uint32_t hash = HashFolded(2166136261u, path);
+    hash = (hash ^ 0u) * 16777619u;
+    return HashFolded(hash, name);
+}
+
+SharedConfigWriter::~SharedConfigWriter()
+{
+    Close();
+}
+
+bool SharedConfigWriter::Create(const std::string& segmentName, size_t slotSize, RegistryError& error)
+{
+    Close();
+    slotSize = (std::max)(slotSize, SLOT_HEADER_SIZE + 64);
+    slotSize = (slotSize + 63) & ~size_t(63);
+    int32_t result = m_memory.Create(segmentName, HEADER_SIZE + 2 * slotSize);
+    if (result != 0)
+    {
+        error = RegistryError(RegistryOperation::OpenSharedConfig, SystemError::Native(result), segmentName);
+        return false;
+    }
+    SegmentHeader* header = new (m_memory.Data()) SegmentHeader{SEGMENT_MAGIC, SEGMENT_VERSION, slotSize, {0}, {0}};
+    for (int slot = 0; slot < 2; ++slot)
+    {
+        new (m_memory.Data() + HEADER_SIZE + slot * slotSize) SlotHeader{{0}, 0, 0, 0, 0};
+    }
+    header->live.store(1, std::memory_order_release);
+    m_segmentName = segmentName;
+    m_slotSize = slotSize;
+    m_generation = 0;
+    return true;
+}
+
+void SharedConfigWriter::Close()
+{
+    if (m_memory.IsOpen())
+    {
+        reinterpret_cast<SegmentHeader*>(m_memory.Data())->live.store(0, std::memory_order_release);
+    }
+    m_memory.Close();
+}
+
+bool SharedConfigWriter::Publish(const RegistryTree& tree, RegistryError& error)
+{
+    if (!m_memory.IsOpen())
+    {
+        error = RegistryError(RegistryOperation::PublishSharedConfig, REGISTRY_INVALID_PARAMETER, m_segmentName);
+        return false;
+    }
+
+    // Keys are breadth-first, so every parent has its path before its children
+    std::vector<std::string> paths(tree.keys.size());
+    struct Record
+    {
+        std::string key;
+        uint32_t pathLength;
+        const RegistryValue* value;
+    };
+    std::vector<Record> records;
+    records.reserve(tree.values.size());
+    size_t textBytes = 0;
+    for (size_t i = 0; i < tree.keys.size(); ++i)
+    {
+        const RegistryTree::Key& key = tree.keys[i];
+        for (uint32_t c = key.firstChild; c < key.firstChild + key.childCount; ++c)
+        {
+            paths[c] = paths[i].empty() ? tree.keys[c].name : paths[i] + "\\" + tree.keys[c].name;
+        }
+        for (uint32_t v = key.firstValue; v < key.firstValue + key.valueCount; ++v)
+        {
+            const RegistryTree::Value& value = tree.values[v];
+            records.push_back({paths[i] + '\0' + value.name, static_cast<uint32_t>(paths[i].size()), &value.value});
+            textBytes += records.back().key.size() + value.value.data.size();
+        }
+    }
+    std::sort(records.begin(), records.end(), [](const Record& a, const Record& b) { return LessNoCase()(a.key, b.key); });
+
+    // Load factor at most one half keeps probe chains short
+    uint32_t bucketCount = 1;
+    while (bucketCount < records.size() * 2 && bucketCount < (1u << 30))
+    {
+        bucketCount <<= 1;
+    }
+    size_t needed = records.size() * sizeof(SlotEntry) + bucketCount * sizeof(uint32_t) + textBytes;
+    if (needed > m_slotSize - SLOT_HEADER_SIZE || needed > UINT32_MAX)
+    {
+        error = RegistryError(RegistryOperation::PublishSharedConfig, REGISTRY_INVALID_PARAMETER, m_segmentName);
+        return false;
+    }
+
+    uint64_t next = m_generation + 1;
+    uint8_t* base = m_memory.Data() + HEADER_SIZE + (next & 1) * m_slotSize;
+    SlotHeader* slot = reinterpret_cast<SlotHeader*>(base);
+    uint8_t* body = base + SLOT_HEADER_SIZE;
+    uint64_t sequence = slot->sequence.load(std::memory_order_relaxed);
+    slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    uint8_t* buckets = body + records.size() * sizeof(SlotEntry);
+    memset(buckets, 0, bucketCount * sizeof(uint32_t));
+    uint32_t text = static_cast<uint32_t>(records.size() * sizeof(SlotEntry) + bucketCount * sizeof(uint32_t));
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        const Record& record = records[i];
+        SlotEntry entry;
+        entry.keyOffset = text;
+        entry.keyLength = static_cast<uint32_t>(record.key.size());
+        entry.pathLength = record.pathLength;
+        entry.type = record.value->type;
+        memcpy(body + text, record.key.data(), record.key.size());
+        text += entry.keyLength;
+        entry.dataOffset = text;
+        entry.dataLength = static_cast<uint32_t>(record.value->data.size());
+        memcpy(body + text, record.value->data.data(), record.value->data.size());
+        text += entry.dataLength;
+        memcpy(body + i * sizeof(SlotEntry), &entry, sizeof(entry));
+
+        std::string_view key = record.key;
+        uint32_t bucket = HashKey(key.substr(0, record.pathLength), key.substr(record.pathLength + 1)) & (bucketCount - 1);
+        uint32_t occupant;
+        for (memcpy(&occupant, buckets + bucket * 4, 4); occupant != 0; memcpy(&occupant, buckets + bucket * 4, 4))
+        {
+            bucket = (bucket + 1) & (bucketCount - 1);
+        }
+        uint32_t index = static_cast<uint32_t>(i + 1);
+        memcpy(buckets + bucket * 4, &index, 4);
+    }
+    slot->generation = next;
+    slot->entryCount = static_cast<uint32_t>(records.size());
+    slot->used = text;
+    slot->bucketCount = bucketCount;
+
+    slot->sequence.store(sequence + 2, std::memory_order_release);
+    reinterpret_cast<SegmentHeader*>(m_memory.Data())->generation.store(next, std::memory_order_release);
+    m_generation = next;
+    return true;
+}
+
+// One slot as a reader sees it. The writer may be rewriting it underneath,
+// so every offset is checked before use; whatever a torn read returns is
+// thrown away when the sequence number turns out to have moved.
+struct SharedConfigReader::SlotView
+{
+    const uint8_t* body;
+    size_t capacity;
+    uint32_t count;
+    uint32_t bucketCount; // 0 when torn
+
+    bool Entry(uint32_t index, SlotEntry& entry, std::string_view& key) const
+    {
+        memcpy(&entry, body + static_cast<size_t>(index) * sizeof(SlotEntry), sizeof(entry));
+        if (uint64_t(entry.keyOffset) + entry.keyLength > capacity || uint64_t(entry.dataOffset) + entry.dataLength > capacity ||
+            entry.pathLength > entry.keyLength)
+        {
+            return false;
+        }
+        key = std::string_view(reinterpret_cast<const char*>(body) + entry.keyOffset, entry.keyLength);
+        return true;
+    }
+
+    // First entry not ordered before path + '\0' + name
+    uint32_t LowerBound(std::string_view path, std::string_view name) const
+    {
+        uint32_t low = 0, high = count;
+        while (low < high)
+        {
+            uint32_t middle = low + (high - low) / 2;
+            SlotEntry entry;
+            std::string_view key;
+            if (!Entry(middle, entry, key))
+            {
+                return count; // Torn; the caller retries
+            }
+            if (CompareKey(key, path, name) < 0)
+            {
+                low = middle + 1;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+        return low;
+    }
+
+    bool Find(std::string_view path, std::string_view name, RegistryValue& value) const
+    {
+        const uint8_t* buckets = body + static_cast<size_t>(count) * sizeof(SlotEntry);
+        uint32_t bucket = HashKey(path, name);
+        SlotEntry entry;
+        std::string_view key;
+        for (uint32_t probe = 0;; ++probe, ++bucket)
+        {
+            uint32_t index;
+            if (probe >= bucketCount)
+            {
+                return false;
+            }
+            memcpy(&index, buckets + (bucket & (bucketCount - 1)) * 4, 4);
+            if (index == 0 || index > count || !Entry(index - 1, entry, key))
+            {
+                return false;
+            }
+            if (entry.pathLength == path.size() && entry.keyLength == path.size() + 1 + name.size() &&
+                CompareKey(key, path, name) == 0)
+            {
+                break;
+            }
+        }
+        value.type = entry.type;
+        value.data.assign(reinterpret_cast<const char*>(body) + entry.dataOffset, entry.dataLength);
+        return true;
+    }
+};
+
+bool SharedConfigReader::Open(const std::string& segmentName, RegistryError& error)
+{
+    Close();
+    int32_t result = m_memory.Open(segmentName);
+    if (result != 0)
+    {
+        error = RegistryError(RegistryOperation::OpenSharedConfig, SystemError::Native(result), segmentName);
+        return false;
+    }
+    const SegmentHeader* header = reinterpret_cast<const SegmentHeader*>(m_memory.Data());
+    if (m_memory.Size() < HEADER_SIZE || header->magic != SEGMENT_MAGIC || header->version != SEGMENT_VERSION ||
+        header->slotSize < SLOT_HEADER_SIZE || header->slotSize > (m_memory.Size() - HEADER_SIZE) / 2)
+    {
+        m_memory.Close();
+        error = RegistryError(RegistryOperation::OpenSharedConfig, REGISTRY_CORRUPT, segmentName);
+        return false;
+    }
+    m_slotSize = static_cast<size_t>(header->slotSize);
+    return true;
+}
+
+void SharedConfigReader::Close()
+{
+    m_memory.Close();
+    m_slotSize = 0;
+}
+
+bool SharedConfigReader::Live() const
+{
+    return m_memory.IsOpen() &&
+           reinterpret_cast<const SegmentHeader*>(m_memory.Data())->live.load(std::memory_order_acquire) != 0;
+}
+
+uint64_t SharedConfigReader::Generation() const
+{
+    if (!m_memory.IsOpen())
+    {
+        return 0;
+    }
+    return reinterpret_cast<const SegmentHeader*>(m_memory.Data())->generation.load(std::memory_order_acquire);
+}
+
+template <typename Fn>
+int32_t SharedConfigReader::ReadStable(Fn&& read) const
+{
+    if (!m_memory.IsOpen())
+    {
+        return REGISTRY_INVALID_PARAMETER;
+    }
+    const SegmentHeader* header = reinterpret_cast<const SegmentHeader*>(m_memory.Data());
+    for (int attempt = 0;; ++attempt)
+    {
+        uint64_t generation = header->generation.load(std::memory_order_acquire);
+        if (generation == 0)
+        {
+            return REGISTRY_NOT_FOUND;
+        }
+        const uint8_t* base = m_memory.Data() + HEADER_SIZE + (generation & 1) * m_slotSize;
+        const SlotHeader* slot = reinterpret_cast<const SlotHeader*>(base);
+        uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+        if ((sequence & 1) == 0)
+        {
+            size_t capacity = m_slotSize - SLOT_HEADER_SIZE;
+            uint32_t count = slot->entryCount;
+            uint32_t bucketCount = slot->bucketCount;
+            bool fits = (bucketCount & (bucketCount - 1)) == 0 &&
+                        uint64_t(count) * sizeof(SlotEntry) + uint64_t(bucketCount) * sizeof(uint32_t) <= capacity;
+            SlotView view{base + SLOT_HEADER_SIZE, capacity, fits ? count : 0, fits ? bucketCount : 0};
+            int32_t result = read(view);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot->sequence.load(std::memory_order_relaxed) == sequence)
+            {
+                return result;
+            }
+        }
+        m_retries.fetch_add(1, std::memory_order_relaxed);
+        if (attempt >= 16)
+        {
+            std::this_thread::yield(); // The writer is mid-publish; let it finish
+        }
+    }
+}
+
+int32_t SharedConfigReader::QueryValue(std::string_view path, std::string_view name, RegistryValue& value) const
+{
+    return ReadStable([&](const SlotView& view)
+    {
+        return view.Find(path, name, value) ? REGISTRY_SUCCESS : REGISTRY_NOT_FOUND;
+    });
+}
+
+int32_t SharedConfigReader::QueryValues(std::string_view path, const std::vector<std::string>& names,
+                                        std::vector<RegistryValue>& values) const
+{
+    return ReadStable([&](const SlotView& view)
+    {
+        values.assign(names.size(), RegistryValue());
+        int32_t result = REGISTRY_SUCCESS;
+        for (size_t i = 0; i < names.size(); ++i)
+        {
+            if (!view.Find(path, names[i], values[i]))
+            {
+                values[i] = RegistryValue();
+                result = REGISTRY_NOT_FOUND;
+            }
+        }
+        return result;
+    });
+}
+
+int32_t SharedConfigReader::EnumValues(std::string_view path, std::vector<std::pair<std::string, RegistryValue>>& values) const
+{
+    return ReadStable([&](const SlotView& view)
+    {
+        values.clear();
+        for (uint32_t index = view.LowerBound(path, {}); index < view.count; ++index)
+        {
+            SlotEntry entry;
+            std::string_view key;
+            if (!view.Entry(index, entry, key) || entry.pathLength != path.size() ||
+                CompareKey(key.substr(0, entry.pathLength + 1), path, {}) != 0)
+            {
+                break;
+            }
+            RegistryValue value{entry.type, std::string(reinterpret_cast<const char*>(view.body) + entry.dataOffset,
+                                                        entry.dataLength)};
+            values.emplace_back(std::string(key.substr(entry.pathLength + 1)), std::move(value));
+        }
+        return values.empty() ? REGISTRY_NOT_FOUND : REGISTRY_SUCCESS;
+    });
+}
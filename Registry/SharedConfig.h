@@ -0,0 +1,87 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "RegistryBackend.h"
+#include "RegistryError.h"
+#include "RegistryTree.h"
+#include "../Common/SharedMemory.h"
+
+// A registry subtree published into shared memory for many readers.
+// The segment holds two slots. The writer fills the one readers are not
+// using, under a sequence number that is odd while it writes (a seqlock),
+// then bumps the published generation to point at it. A reader picks the
+// slot of the current generation, finds the value through a case-insensitive
+// hash index (a key's values are also kept sorted together for EnumValues),
+// and retries only if the writer lapped it and started on that slot again. After Open nothing a reader
+// does enters the kernel. Only values are published, so a key without
+// values cannot be told from a missing one.
+
+// Publishes from one thread of the owning process
+class SharedConfigWriter
+{
+public:
+    ~SharedConfigWriter();
+
+    // slotSize bounds one published snapshot: 24 to 32 bytes per value plus
+    // its path, name and data
+    bool Create(const std::string& segmentName, size_t slotSize, RegistryError& error);
+
+    // Marks the segment closed for readers that still have it mapped
+    void Close();
+
+    // Makes the tree the next generation; fails when it does not fit the slot
+    bool Publish(const RegistryTree& tree, RegistryError& error);
+
+    uint64_t Generation() const { return m_generation; }
+
+private:
+    SharedMemory m_memory;
+    std::string m_segmentName;
+    size_t m_slotSize = 0;
+    uint64_t m_generation = 0;
+};
+
+// Safe to share between threads
+class SharedConfigReader
+{
+public:
+    bool Open(const std::string& segmentName, RegistryError& error);
+    void Close();
+
+    bool IsOpen() const { return m_memory.IsOpen(); }
+
+    // False once the writer has closed the segment; reopen to follow a restarted service
+    bool Live() const;
+
+    // Changes with every publish, 0 before the first; one load, cheap enough to poll
+    uint64_t Generation() const;
+
+    // Paths are relative to the published root, as in RegistryBackend.
+    // REGISTRY_NOT_FOUND also before the first publish.
+    int32_t QueryValue(std::string_view path, std::string_view name, RegistryValue& value) const;
+
+    // All from the same generation; REGISTRY_NOT_FOUND if any is missing,
+    // which is then left as VALUE_NONE
+    int32_t QueryValues(std::string_view path, const std::vector<std::string>& names,
+                        std::vector<RegistryValue>& values) const;
+
+    // The values of one key, default value first then by name
+    int32_t EnumValues(std::string_view path, std::vector<std::pair<std::string, RegistryValue>>& values) const;
+
+    // Reads that had to start over because the writer reused their slot
+    uint64_t Retries() const { return m_retries.load(std::memory_order_relaxed); }
+
+private:
+    struct SlotView;
+
+    template <typename Fn>
+    int32_t ReadStable(Fn&& read) const;
+
+    SharedMemory m_memory;
+    size_t m_slotSize = 0;
+    mutable std::atomic<uint64_t> m_retries{0};
+};
@@ -0,0 +1,696 @@
+#include "SnapshotFile.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <unordered_map>
+#include "AppendLog.h"
+#include "../Common/Checksum.h"
+#include "../Common/Compression.h"
+
+// File layout, little-endian, every section 8-byte aligned:
+//   Header
+//   KeyRecord[keyCount]      breadth-first; subkeys of a key are contiguous and sorted
+//   ValueRecord[valueCount]  values of a key are contiguous and sorted
+//   uint32_t[stringCount + 1] offsets into the string bytes, then the bytes;
+//                            every distinct key and value name is stored once
+//   BlockRecord[blockCount]
+//   value data blocks; each value starts 8-byte aligned inside its block
+// Records are read in place from the mapping, so their layout is the format.
+static const uint32_t SNAPSHOT_MAGIC = 0x504E5352; // "RSNP"
+static const uint16_t SNAPSHOT_VERSION = 1;
+static const uint32_t CODEC_NONE = 0;
+static const uint32_t CODEC_LZ = 1;
+
+struct SnapshotFileBackend::Header
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t flags;
+    uint32_t keyCount;
+    uint32_t valueCount;
+    uint32_t stringCount;
+    uint32_t blockCount;
+    uint64_t keysOffset;
+    uint64_t valuesOffset;
+    uint64_t stringsOffset;
+    uint64_t blocksOffset;
+    uint64_t rootHash;
+    uint32_t tablesCrc; // From keysOffset to the end of the block table
+    uint32_t headerCrc; // Of the header with this field zero
+};
+
+struct SnapshotFileBackend::KeyRecord
+{
+    uint32_t name;
+    uint32_t firstChild;
+    uint32_t childCount;
+    uint32_t firstValue;
+    uint32_t valueCount;
+    uint32_t reserved;
+    uint64_t hash;
+};
+
+struct SnapshotFileBackend::ValueRecord
+{
+    uint32_t name;
+    uint32_t type;
+    uint32_t block;
+    uint32_t size;
+    uint64_t offset; // Inside the inflated block
+};
+
+struct SnapshotFileBackend::BlockRecord
+{
+    uint64_t offset; // In the file
+    uint32_t storedSize;
+    uint32_t rawSize;
+    uint32_t codec;
+    uint32_t crc; // Of the stored bytes
+};
+
+static size_t AlignUp(size_t size)
+{
+    return (size + 7) & ~static_cast<size_t>(7);
+}
+
+template <class T>
+static void Append(std::string& out, const T& record)
+{
+    out.append(reinterpret_cast<const char*>(&record), sizeof(T));
+}
+
+bool WriteSnapshotFile(const RegistryTree& tree, const std::string& fileName, const SnapshotWriteOptions& options,
+                       RegistryError& error)
+{
+    using Header = SnapshotFileBackend::Header;
+    using KeyRecord = SnapshotFileBackend::KeyRecord;
+    using ValueRecord = SnapshotFileBackend::ValueRecord;
+    using BlockRecord = SnapshotFileBackend::BlockRecord;
+    static_assert(sizeof(Header) == 72 && sizeof(KeyRecord) == 32 && sizeof(ValueRecord) == 24 &&
+                  sizeof(BlockRecord) == 24, "snapshot record layout changed");
+
+    if (tree.keys.empty())
+    {
+        error = RegistryError(RegistryOperation::WriteSnapshot, REGISTRY_INVALID_PARAMETER, fileName);
+        return false;
+    }
+
+    std::vector<std::string_view> strings;
+    std::unordered_map<std::string_view, uint32_t> stringIds;
+    auto intern = [&](const std::string& text)
+    {
+        auto inserted = stringIds.emplace(text, static_cast<uint32_t>(strings.size()));
+        if (inserted.second)
+        {
+            strings.push_back(text);
+        }
+        return inserted.first->second;
+    };
+
+    std::vector<KeyRecord> keys;
+    keys.reserve(tree.keys.size());
+    for (const RegistryTree::Key& key : tree.keys)
+    {
+        keys.push_back({intern(key.name), key.firstChild, key.childCount, key.firstValue, key.valueCount, 0, key.hash});
+    }
+
+    // Value data packed into blocks; identical data is stored once
+    std::vector<std::string> blocks(1);
+    std::unordered_map<uint64_t, std::vector<uint32_t>> dataByHash; // Value indices with that data hash
+    std::vector<ValueRecord> values;
+    values.reserve(tree.values.size());
+    for (const RegistryTree::Value& value : tree.values)
+    {
+        const std::string& data = value.value.data;
+        ValueRecord record = {intern(value.name), value.value.type, 0, static_cast<uint32_t>(data.size()), 0};
+        if (data.empty())
+        {
+            values.push_back(record);
+            continue;
+        }
+
+        std::vector<uint32_t>& same = dataByHash[Hash64(data.data(), data.size())];
+        bool shared = false;
+        for (uint32_t index : same)
+        {
+            const ValueRecord& other = values[index];
+            if (other.size == data.size() && !blocks[other.block].compare(other.offset, other.size, data))
+            {
+                record.block = other.block;
+                record.offset = other.offset;
+                shared = true;
+                break;
+            }
+        }
+        if (!shared)
+        {
+            if (!blocks.back().empty() && AlignUp(blocks.back().size()) + data.size() > options.blockSize)
+            {
+                blocks.emplace_back();
+            }
+            std::string& block = blocks.back();
+            block.resize(AlignUp(block.size()), '\0');
+            record.block = static_cast<uint32_t>(blocks.size() - 1);
+            record.offset = block.size();
+            block += data;
+            same.push_back(static_cast<uint32_t>(values.size()));
+        }
+        values.push_back(record);
+    }
+
+    Header header = {};
+    header.magic = SNAPSHOT_MAGIC;
+    header.version = SNAPSHOT_VERSION;
+    header.keyCount = static_cast<uint32_t>(keys.size());
+    header.valueCount = static_cast<uint32_t>(values.size());
+    header.stringCount = static_cast<uint32_t>(strings.size());
+    header.blockCount = static_cast<uint32_t>(blocks.size());
+    header.rootHash = tree.RootHash();
+
+    std::string out(sizeof(Header), '\0');
+    header.keysOffset = out.size();
+    out.append(reinterpret_cast<const char*>(keys.data()), keys.size() * sizeof(KeyRecord));
+    header.valuesOffset = out.size();
+    out.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(ValueRecord));
+    out.resize(AlignUp(out.size()), '\0');
+    header.stringsOffset = out.size();
+    uint32_t stringOffset = 0;
+    for (std::string_view text : strings)
+    {
+        Append(out, stringOffset);
+        stringOffset += static_cast<uint32_t>(text.size());
+    }
+    Append(out, stringOffset);
+    for (std::string_view text : strings)
+    {
+        out += text;
+    }
+    out.resize(AlignUp(out.size()), '\0');
+
+    // Block payloads come after the table, which needs their offsets
+    std::vector<BlockRecord> blockRecords(blocks.size());
+    std::vector<std::string> stored(blocks.size());
+    header.blocksOffset = out.size();
+    size_t payloadOffset = AlignUp(out.size() + blocks.size() * sizeof(BlockRecord));
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+        BlockRecord& record = blockRecords[i];
+        record.codec = CODEC_NONE;
+        if (options.compress && !blocks[i].empty())
+        {
+            LzCompress(blocks[i].data(), blocks[i].size(), stored[i]);
+            if (stored[i].size() <= blocks[i].size() - blocks[i].size() / 8)
+            {
+                record.codec = CODEC_LZ;
+            }
+        }
+        if (record.codec == CODEC_NONE)
+        {
+            stored[i].swap(blocks[i]);
+        }
+        record.offset = payloadOffset;
+        record.storedSize = static_cast<uint32_t>(stored[i].size());
+        record.rawSize = static_cast<uint32_t>(record.codec == CODEC_NONE ? stored[i].size() : blocks[i].size());
+        record.crc = Crc32(stored[i].data(), stored[i].size());
+        payloadOffset = AlignUp(payloadOffset + stored[i].size());
+    }
+    out.append(reinterpret_cast<const char*>(blockRecords.data()), blockRecords.size() * sizeof(BlockRecord));
+    header.tablesCrc = Crc32(out.data() + header.keysOffset, out.size() - header.keysOffset);
+    for (const std::string& block : stored)
+    {
+        out.resize(AlignUp(out.size()), '\0');
+        out += block;
+    }
+    header.headerCrc = Crc32(&header, sizeof(header));
+    memcpy(&out[0], &header, sizeof(header));
+
+    std::string temporary = fileName + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    bool written = file && fwrite(out.data(), 1, out.size(), file) == out.size() && AppendLog::SyncFile(file);
+    if (file)
+    {
+        fclose(file);
+    }
+    std::error_code ec;
+    if (written)
+    {
+        std::filesystem::rename(temporary, fileName, ec);
+    }
+    if (!written || ec)
+    {
+        error = RegistryError(RegistryOperation::WriteSnapshot, SystemError::From(ec), fileName);
+        std::filesystem::remove(temporary, ec);
+        return false;
+    }
+    return true;
+}
+
+SnapshotFileBackend::SnapshotFileBackend()
+{}
+
+SnapshotFileBackend::~SnapshotFileBackend()
+{
+    Close();
+}
+
+// A section of count records at offset must lie inside the file and be aligned
+static bool SectionFits(size_t fileSize, uint64_t offset, uint64_t count, size_t recordSize)
+{
+    return offset % 8 == 0 && offset <= fileSize && count <= (fileSize - offset) / recordSize;
+}
+
+bool SnapshotFileBackend::Open(const std::string& fileName, RegistryError& error)
+{
+    Close();
+    int32_t result = m_file.Open(fileName);
+    if (result != 0)
+    {
+        error = RegistryError(RegistryOperation::OpenSnapshot, SystemError::Native(result), fileName);
+        return false;
+    }
+
+    const uint8_t* data = m_file.Data();
+    size_t size = m_file.Size();
+    Header header;
+    bool valid = size >= sizeof(Header);
+    if (valid)
+    {
+        memcpy(&header, data, sizeof(header));
+        uint32_t headerCrc = header.headerCrc;
+        header.headerCrc = 0;
+        valid = header.magic == SNAPSHOT_MAGIC && header.version == SNAPSHOT_VERSION &&
+                Crc32(&header, sizeof(header)) == headerCrc && header.keyCount > 0 &&
+                SectionFits(size, header.keysOffset, header.keyCount, sizeof(KeyRecord)) &&
+                SectionFits(size, header.valuesOffset, header.valueCount, sizeof(ValueRecord)) &&
+                SectionFits(size, header.stringsOffset, header.stringCount + 1ull, sizeof(uint32_t)) &&
+                SectionFits(size, header.blocksOffset, header.blockCount, sizeof(BlockRecord));
+    }
+    if (valid)
+    {
+        const uint32_t* offsets = reinterpret_cast<const uint32_t*>(data + header.stringsOffset);
+        size_t bytesOffset = header.stringsOffset + (header.stringCount + 1ull) * sizeof(uint32_t);
+        valid = offsets[header.stringCount] <= size - bytesOffset;
+        m_stringBytes = reinterpret_cast<const char*>(data + bytesOffset);
+        m_stringBytesSize = offsets[header.stringCount];
+    }
+    if (!valid)
+    {
+        Close();
+        error = RegistryError(RegistryOperation::OpenSnapshot, REGISTRY_CORRUPT, fileName);
+        return false;
+    }
+
+    m_fileName = fileName;
+    m_header = reinterpret_cast<const Header*>(data);
+    m_keys = reinterpret_cast<const KeyRecord*>(data + header.keysOffset);
+    m_values = reinterpret_cast<const ValueRecord*>(data + header.valuesOffset);
+    m_stringOffsets = reinterpret_cast<const uint32_t*>(data + header.stringsOffset);
+    m_blocks = reinterpret_cast<const BlockRecord*>(data + header.blocksOffset);
+    m_inflated.reset(new std::atomic<const std::string*>[header.blockCount]());
+    return true;
+}
+
+void SnapshotFileBackend::Close()
+{
+    if (m_header)
+    {
+        for (uint32_t i = 0; i < m_header->blockCount; ++i)
+        {
+            delete m_inflated[i].load();
+        }
+    }
+    m_inflated.reset();
+    m_blocksInflated = 0;
+    m_header = nullptr;
+    m_keys = nullptr;
+    m_values = nullptr;
+    m_stringOffsets = nullptr;
+    m_stringBytes = nullptr;
+    m_stringBytesSize = 0;
+    m_blocks = nullptr;
+    m_fileName.clear();
+    m_file.Close();
+}
+
+bool SnapshotFileBackend::Verify(RegistryError& error) const
+{
+    if (!m_header)
+    {
+        error = RegistryError(RegistryOperation::OpenSnapshot, REGISTRY_INVALID_PARAMETER, {});
+        return false;
+    }
+
+    const uint8_t* data = m_file.Data();
+    size_t tablesEnd = m_header->blocksOffset + m_header->blockCount * sizeof(BlockRecord);
+    bool valid = Crc32(data + m_header->keysOffset, tablesEnd - m_header->keysOffset) == m_header->tablesCrc;
+    for (uint32_t i = 0; valid && i < m_header->blockCount; ++i)
+    {
+        const BlockRecord& block = m_blocks[i];
+        valid = block.offset <= m_file.Size() && block.storedSize <= m_file.Size() - block.offset &&
+                Crc32(data + block.offset, block.storedSize) == block.crc &&
+                (block.codec == CODEC_LZ || (block.codec == CODEC_NONE && block.rawSize == block.storedSize)) &&
+                (block.codec != CODEC_LZ || InflateBlock(i));
+    }
+
+    // Every index must stay in range, so lookups can trust the tables
+    for (uint32_t i = 0; valid && i < m_header->keyCount; ++i)
+    {
+        const KeyRecord& key = m_keys[i];
+        valid = key.name < m_header->stringCount && key.firstChild <= m_header->keyCount &&
+                key.childCount <= m_header->keyCount - key.firstChild && key.firstValue <= m_header->valueCount &&
+                key.valueCount <= m_header->valueCount - key.firstValue && (key.childCount == 0 || key.firstChild > i);
+    }
+    for (uint32_t i = 0; valid && i < m_header->valueCount; ++i)
+    {
+        const ValueRecord& value = m_values[i];
+        valid = value.name < m_header->stringCount &&
+                (value.size == 0 || (value.block < m_header->blockCount && value.offset <= m_blocks[value.block].rawSize &&
+                                     value.size <= m_blocks[value.block].rawSize - value.offset));
+    }
+    if (!valid)
+    {
+        error = RegistryError(RegistryOperation::OpenSnapshot, REGISTRY_CORRUPT, m_fileName);
+    }
+    return valid;
+}
+
+std::string_view SnapshotFileBackend::String(uint32_t id) const
+{
+    if (id >= m_header->stringCount)
+    {
+        return {};
+    }
+    uint32_t begin = m_stringOffsets[id], end = m_stringOffsets[id + 1];
+    if (begin > end || end > m_stringBytesSize)
+    {
+        return {};
+    }
+    return std::string_view(m_stringBytes + begin, end - begin);
+}
+
+const SnapshotFileBackend::KeyRecord* SnapshotFileBackend::FindKey(std::string_view path) const
+{
+    if (!m_header)
+    {
+        return nullptr;
+    }
+    const KeyRecord* key = m_keys;
+    LessNoCase less;
+    size_t start = 0;
+    while (start < path.size())
+    {
+        size_t end = path.find('\\', start);
+        if (end == std::string_view::npos)
+        {
+            end = path.size();
+        }
+        std::string_view part = path.substr(start, end - start);
+        start = end + 1;
+        if (part.empty())
+        {
+            continue;
+        }
+
+        uint32_t low = key->firstChild, high = key->firstChild + key->childCount;
+        if (high > m_header->keyCount || high < low)
+        {
+            return nullptr;
+        }
+        while (low < high)
+        {
+            uint32_t middle = low + (high - low) / 2;
+            if (less(String(m_keys[middle].name), part))
+            {
+                low = middle + 1;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+        if (low == key->firstChild + key->childCount || !EqualsNoCase(String(m_keys[low].name), part))
+        {
+            return nullptr;
+        }
+        key = m_keys + low;
+    }
+    return key;
+}
+
+const SnapshotFileBackend::ValueRecord* SnapshotFileBackend::FindValueRecord(const KeyRecord& key, std::string_view name) const
+{
+    uint32_t low = key.firstValue, high = key.firstValue + key.valueCount;
+    if (high > m_header->valueCount || high < low)
+    {
+        return nullptr;
+    }
+    LessNoCase less;
+    while (low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        if (less(String(m_values[middle].name), name))
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    if (low == key.firstValue + key.valueCount || !EqualsNoCase(String(m_values[low].name), name))
+    {
+        return nullptr;
+    }
+    return m_values + low;
+}
+
+const std::string* SnapshotFileBackend::InflateBlock(uint32_t index) const
+{
+    std::atomic<const std::string*>& slot = m_inflated[index];
+    if (const std::string* inflated = slot.load(std::memory_order_acquire))
+    {
+        return inflated;
+    }
+
+    const BlockRecord& block = m_blocks[index];
+    const uint8_t* stored = m_file.Data() + block.offset;
+    if (block.offset > m_file.Size() || block.storedSize > m_file.Size() - block.offset ||
+        Crc32(stored, block.storedSize) != block.crc)
+    {
+        return nullptr;
+    }
+    auto inflated = std::make_unique<std::string>(block.rawSize, '\0');
+    if (!LzDecompress(stored, block.storedSize, &(*inflated)[0], block.rawSize))
+    {
+        return nullptr;
+    }
+
+    // Two readers may race to inflate the same block; the loser frees its copy
+    const std::string* expected = nullptr;
+    if (slot.compare_exchange_strong(expected, inflated.get(), std::memory_order_acq_rel))
+    {
+        ++m_blocksInflated;
+        return inflated.release();
+    }
+    return expected;
+}
+
+int32_t SnapshotFileBackend::ValueData(const ValueRecord& value, std::string_view& data) const
+{
+    if (value.size == 0)
+    {
+        data = {};
+        return REGISTRY_SUCCESS;
+    }
+    if (value.block >= m_header->blockCount)
+    {
+        return REGISTRY_CORRUPT;
+    }
+
+    const BlockRecord& block = m_blocks[value.block];
+    const char* base;
+    if (block.codec == CODEC_NONE)
+    {
+        if (block.offset > m_file.Size() || block.rawSize > m_file.Size() - block.offset)
+        {
+            return REGISTRY_CORRUPT;
+        }
+        base = reinterpret_cast<const char*>(m_file.Data() + block.offset);
+    }
+    else
+    {
+        const std::string* inflated = block.codec == CODEC_LZ ? InflateBlock(value.block) : nullptr;
+        if (!inflated)
+        {
+            return REGISTRY_CORRUPT;
+        }
+        base = inflated->data();
+    }
+    if (value.offset > block.rawSize || value.size > block.rawSize - value.offset)
+    {
+        return REGISTRY_CORRUPT;
+    }
+    data = std::string_view(base + value.offset, value.size);
+    return REGISTRY_SUCCESS;
+}
+
+int32_t SnapshotFileBackend::CreateKey(std::string_view)
+{
+    return REGISTRY_ACCESS_DENIED;
+}
+
+int32_t SnapshotFileBackend::DeleteKey(std::string_view)
+{
+    return REGISTRY_ACCESS_DENIED;
+}
+
+int32_t SnapshotFileBackend::KeyExists(std::string_view path)
+{
+    return FindKey(path) ? REGISTRY_SUCCESS : REGISTRY_NOT_FOUND;
+}
+
+int32_t SnapshotFileBackend::SetValue(std::string_view, std::string_view, const RegistryValue&)
+{
+    return REGISTRY_ACCESS_DENIED;
+}
+
+int32_t SnapshotFileBackend::FindValue(std::string_view path, std::string_view name, uint32_t& type,
+                                       std::string_view& data) const
+{
+    const KeyRecord* key = FindKey(path);
+    if (!key)
+    {
+        return REGISTRY_KEY_NOT_FOUND;
+    }
+    const ValueRecord* value = FindValueRecord(*key, name);
+    if (!value)
+    {
+        return REGISTRY_NOT_FOUND;
+    }
+    type = value->type;
+    return ValueData(*value, data);
+}
+
+int32_t SnapshotFileBackend::QueryValue(std::string_view path, std::string_view name, RegistryValue& value)
+{
+    std::string_view data;
+    int32_t result = FindValue(path, name, value.type, data);
+    if (result == REGISTRY_SUCCESS)
+    {
+        value.data.assign(data.data(), data.size());
+    }
+    return result;
+}
+
+int32_t SnapshotFileBackend::DeleteValue(std::string_view, std::string_view)
+{
+    return REGISTRY_ACCESS_DENIED;
+}
+
+int32_t SnapshotFileBackend::EnumSubkeys(std::string_view path, std::vector<std::string>& names)
+{
+    const KeyRecord* key = FindKey(path);
+    if (!key)
+    {
+        return REGISTRY_NOT_FOUND;
+    }
+    names.clear();
+    for (uint32_t i = key->firstChild; i < key->firstChild + key->childCount && i < m_header->keyCount; ++i)
+    {
+        names.emplace_back(String(m_keys[i].name));
+    }
+    return REGISTRY_SUCCESS;
+}
+
+int32_t SnapshotFileBackend::EnumValues(std::string_view path, std::vector<std::pair<std::string, RegistryValue>>& values)
+{
+    const KeyRecord* key = FindKey(path);
+    if (!key)
+    {
+        return REGISTRY_NOT_FOUND;
+    }
+    values.clear();
+    for (uint32_t i = key->firstValue; i < key->firstValue + key->valueCount && i < m_header->valueCount; ++i)
+    {
+        std::string_view data;
+        int32_t result = ValueData(m_values[i], data);
+        if (result != REGISTRY_SUCCESS)
+        {
+            return result;
+        }
+        values.emplace_back(std::string(String(m_values[i].name)), RegistryValue{m_values[i].type, std::string(data)});
+    }
+    return REGISTRY_SUCCESS;
+}
+
+int32_t SnapshotFileBackend::ApplyChanges(const std::vector<RegistryChange>& changes, size_t& failedIndex)
+{
+    if (changes.empty())
+    {
+        return REGISTRY_SUCCESS;
+    }
+    failedIndex = 0;
+    return REGISTRY_ACCESS_DENIED;
+}
+
+void SnapshotFileBackend::Export(std::vector<RegistryChange>& changes) const
+{
+    if (!m_header)
+    {
+        return;
+    }
+    // Breadth-first like the file, so each parent is created before its subkeys
+    std::vector<std::string> paths(m_header->keyCount);
+    for (uint32_t i = 0; i < m_header->keyCount; ++i)
+    {
+        const KeyRecord& key = m_keys[i];
+        if (i > 0)
+        {
+            changes.push_back({RegistryChange::CREATE_KEY, paths[i], {}, {}});
+        }
+        for (uint32_t v = key.firstValue; v < key.firstValue + key.valueCount && v < m_header->valueCount; ++v)
+        {
+            std::string_view data;
+            if (ValueData(m_values[v], data) == REGISTRY_SUCCESS)
+            {
+                changes.push_back({RegistryChange::SET_VALUE, paths[i], std::string(String(m_values[v].name)),
+                                   RegistryValue{m_values[v].type, std::string(data)}});
+            }
+        }
+        for (uint32_t c = key.firstChild; c < key.firstChild + key.childCount && c < m_header->keyCount; ++c)
+        {
+            std::string_view name = String(m_keys[c].name);
+            paths[c] = paths[i].empty() ? std::string(name) : paths[i] + '\\' + std::string(name);
+        }
+        std::string().swap(paths[i]);
+    }
+}
+
+uint64_t SnapshotFileBackend::RootHash() const
+{
+    return m_header ? m_header->rootHash : 0;
+}
+
+size_t SnapshotFileBackend::KeyCount() const
+{
+    return m_header ? m_header->keyCount : 0;
+}
+
+size_t SnapshotFileBackend::ValueCount() const
+{
+    return m_header ? m_header->valueCount : 0;
+}
+
+SnapshotFileBackend::Stats SnapshotFileBackend::GetStats() const
+{
+    Stats stats = {m_file.Size(), 0, 0, m_blocksInflated.load()};
+    if (m_header)
+    {
+        stats.blocks = m_header->blockCount;
+        for (uint32_t i = 0; i < m_header->blockCount; ++i)
+        {
+            stats.compressedBlocks += m_blocks[i].codec == CODEC_LZ;
+        }
+    }
+    return stats;
+}
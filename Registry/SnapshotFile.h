@@ -0,0 +1,104 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "RegistryBackend.h"
+#include "RegistryError.h"
+#include "RegistryTree.h"
+#include "../Common/MappedFile.h"
+
+struct SnapshotWriteOptions
+{
+    bool compress = false;         // LZ-compress value data blocks that shrink by at least 1/8
+    uint32_t blockSize = 64 * 1024; // Value data per block; larger values get a block of their own
+};
+
+// Saves a captured tree as a binary snapshot file, written to a temporary
+// name and renamed into place
+bool WriteSnapshotFile(const RegistryTree& tree, const std::string& fileName, const SnapshotWriteOptions& options,
+                       RegistryError& error);
+
+// Read-only backend over a memory-mapped snapshot file. Open maps the file
+// and checks the header, so it takes the same time for any size; lookups
+// binary-search the sorted subkey and value tables in place. Uncompressed
+// value data is read straight from the mapping; a compressed block is
+// inflated on first use and kept. All writes fail with access denied.
+// Reads may run from any thread; Open and Close may not overlap them.
+class SnapshotFileBackend : public RegistryBackend
+{
+public:
+    SnapshotFileBackend();
+    ~SnapshotFileBackend() override;
+
+    bool Open(const std::string& fileName, RegistryError& error);
+    void Close();
+
+    // Checks every table and block checksum: a full read of the file. Open
+    // trusts the body, so run this on files that come from elsewhere.
+    bool Verify(RegistryError& error) const;
+
+    int32_t CreateKey(std::string_view path) override;
+    int32_t DeleteKey(std::string_view path) override;
+    int32_t KeyExists(std::string_view path) override;
+
+    int32_t SetValue(std::string_view path, std::string_view name, const RegistryValue& value) override;
+    int32_t QueryValue(std::string_view path, std::string_view name, RegistryValue& value) override;
+    int32_t DeleteValue(std::string_view path, std::string_view name) override;
+
+    int32_t EnumSubkeys(std::string_view path, std::vector<std::string>& names) override;
+    int32_t EnumValues(std::string_view path, std::vector<std::pair<std::string, RegistryValue>>& values) override;
+
+    int32_t ApplyChanges(const std::vector<RegistryChange>& changes, size_t& failedIndex) override;
+
+    // Without copying: data points into the mapping or the block cache and
+    // stays valid until Close
+    int32_t FindValue(std::string_view path, std::string_view name, uint32_t& type, std::string_view& data) const;
+
+    // The whole tree as changes that rebuild it, to seed a writable backend
+    void Export(std::vector<RegistryChange>& changes) const;
+
+    uint64_t RootHash() const; // Merkle hash of the captured tree
+    size_t KeyCount() const;
+    size_t ValueCount() const;
+
+    struct Stats
+    {
+        uint64_t fileBytes;
+        uint64_t blocks;
+        uint64_t compressedBlocks;
+        uint64_t blocksInflated; // Compressed blocks decoded so far
+    };
+    Stats GetStats() const;
+
+private:
+    friend bool WriteSnapshotFile(const RegistryTree& tree, const std::string& fileName,
+                                  const SnapshotWriteOptions& options, RegistryError& error);
+
+    // On-disk records, read in place from the mapping
+    struct Header;
+    struct KeyRecord;
+    struct ValueRecord;
+    struct BlockRecord;
+
+    const KeyRecord* FindKey(std::string_view path) const;
+    const ValueRecord* FindValueRecord(const KeyRecord& key, std::string_view name) const;
+    std::string_view String(uint32_t id) const;
+    int32_t ValueData(const ValueRecord& value, std::string_view& data) const;
+    const std::string* InflateBlock(uint32_t index) const;
+
+    MappedFile m_file;
+    std::string m_fileName;
+    const Header* m_header = nullptr;
+    const KeyRecord* m_keys = nullptr;
+    const ValueRecord* m_values = nullptr;
+    const uint32_t* m_stringOffsets = nullptr;
+    const char* m_stringBytes = nullptr;
+    size_t m_stringBytesSize = 0;
+    const BlockRecord* m_blocks = nullptr;
+
+    // Inflated compressed blocks, installed once by whichever reader gets there first
+    std::unique_ptr<std::atomic<const std::string*>[]> m_inflated;
+    mutable std::atomic<uint64_t> m_blocksInflated{0};
+};
@@ -0,0 +1,136 @@
+#include "TransactionJournal.h"
+#include <map>
+
+// Payload: u8 type, u64 transaction id, and for undo records the changes
+static const uint8_t RECORD_UNDO = 1;
+static const uint8_t RECORD_END = 2;
+
+// Emptied once no transaction is open and the file has grown past this
+static const uint64_t TRUNCATE_SIZE = 1 << 20;
+
+TransactionJournal::TransactionJournal()
+{}
+
+TransactionJournal::~TransactionJournal()
+{
+    Close();
+}
+
+bool TransactionJournal::Open(const std::string& fileName, RegistryBackend& backend, RegistryError& error)
+{
+    Close();
+
+    std::string contents;
+    AppendLog::ReadFile(fileName, contents);
+    size_t recovered = Recover(contents, backend);
+
+    // Everything in the old file is settled now
+    int32_t result = m_log.Open(fileName, true);
+    if (result != 0)
+    {
+        error = RegistryError(RegistryOperation::OpenJournal, SystemError::Errno(result), fileName);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_fileName = fileName;
+    m_active = 0;
+    m_stats = {};
+    m_stats.recovered = recovered;
+    return true;
+}
+
+void TransactionJournal::Close()
+{
+    m_log.Close();
+}
+
+bool TransactionJournal::IsOpen() const
+{
+    return m_log.IsOpen();
+}
+
+bool TransactionJournal::Begin(const std::vector<RegistryChange>& undo, uint64_t& id, RegistryError& error)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        id = m_nextId++;
+        ++m_active;
+        ++m_stats.records;
+    }
+    std::string payload;
+    payload.push_back(static_cast<char>(RECORD_UNDO));
+    PutU64(payload, id);
+    PutChanges(payload, undo);
+    int32_t result = m_log.Append(payload);
+    if (result != 0)
+    {
+        error = RegistryError(RegistryOperation::WriteJournal, SystemError::Errno(result), m_fileName);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        --m_active;
+        return false;
+    }
+    return true;
+}
+
+bool TransactionJournal::End(uint64_t id, RegistryError& error)
+{
+    std::string payload;
+    payload.push_back(static_cast<char>(RECORD_END));
+    PutU64(payload, id);
+    int32_t result = m_log.Append(payload);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_stats.records;
+    --m_active;
+    // Begin counts itself in under this lock before appending, so with no
+    // transaction active nothing in the file is needed any more
+    if (result == 0 && m_active == 0 && m_log.Size() > TRUNCATE_SIZE)
+    {
+        result = m_log.Truncate();
+    }
+    if (result != 0)
+    {
+        error = RegistryError(RegistryOperation::WriteJournal, SystemError::Errno(result), m_fileName);
+        return false;
+    }
+    return true;
+}
+
+size_t TransactionJournal::Recover(const std::string& contents, RegistryBackend& backend) const
+{
+    std::map<uint64_t, std::vector<RegistryChange>> unfinished;
+    AppendLog::ReadRecords(contents, [&](const char* data, size_t size) {
+        RecordReader reader{data, size};
+        uint8_t type;
+        uint64_t id;
+        if (!reader.GetU8(type) || !reader.GetU64(id))
+        {
+            return false;
+        }
+        if (type == RECORD_END)
+        {
+            unfinished.erase(id);
+            return true;
+        }
+        return type == RECORD_UNDO && reader.GetChanges(unfinished[id]);
+    });
+
+    // Newest first, so older transactions see the state they left behind
+    for (auto it = unfinished.rbegin(); it != unfinished.rend(); ++it)
+    {
+        for (const RegistryChange& change : it->second)
+        {
+            ApplyChange(backend, change); // Steps that were never applied fail harmlessly
+        }
+    }
+    return unfinished.size();
+}
+
+TransactionJournal::Stats TransactionJournal::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats stats = m_stats;
+    stats.syncs = m_log.Syncs();
+    return stats;
+}
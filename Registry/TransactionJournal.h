@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "AppendLog.h"
+#include "RegistryBackend.h"
+#include "RegistryError.h"
+
+// Append-only undo journal for registry transactions.
+// Before a transaction touches the backend, the changes that would undo it are
+// appended and synced; once it has finished an end record is appended and
+// synced. On Open, any transaction with an undo record but no end record was
+// cut short by a crash and is rolled back. Concurrent committers share syncs
+// through AppendLog's group commit.
+class TransactionJournal
+{
+public:
+    TransactionJournal();
+    ~TransactionJournal();
+
+    // Rolls back unfinished transactions found in the file, then starts it empty
+    bool Open(const std::string& fileName, RegistryBackend& backend, RegistryError& error);
+    void Close();
+    bool IsOpen() const;
+
+    // Both return once the record is on disk
+    bool Begin(const std::vector<RegistryChange>& undo, uint64_t& id, RegistryError& error);
+    bool End(uint64_t id, RegistryError& error);
+
+    struct Stats
+    {
+        uint64_t records;
+        uint64_t syncs;
+        uint64_t recovered; // Transactions rolled back by Open
+    };
+    Stats GetStats() const;
+
+private:
+    size_t Recover(const std::string& contents, RegistryBackend& backend) const;
+
+    mutable std::mutex m_mutex;
+    AppendLog m_log;
+    std::string m_fileName;
+    uint64_t m_nextId = 1;
+    size_t m_active = 0; // Transactions between Begin and End
+    Stats m_stats{};
+};
@@ -0,0 +1,307 @@
+#ifdef _WIN32
+#include "Win32Backend.h"
+#include <ktmw32.h>
+#include <map>
+#include "../Common/Utf.h"
+
+#pragma comment(lib, "ktmw32.lib")
+
+static bool IsText(uint32_t type)
+{
+    return type == VALUE_STRING || type == VALUE_EXPAND_STRING || type == VALUE_MULTI_STRING;
+}
+
+// RegOpenKeyExW reports a missing key as ERROR_FILE_NOT_FOUND, the same code as
+// a missing value; value calls hand it on as ERROR_PATH_NOT_FOUND instead
+static LONG KeyOpenResult(LONG result)
+{
+    return result == ERROR_FILE_NOT_FOUND ? ERROR_PATH_NOT_FOUND : result;
+}
+
+static LONG SetValueOn(HKEY key, const std::wstring& name, const RegistryValue& value)
+{
+    if (!IsText(value.type))
+    {
+        return RegSetValueExW(key, name.c_str(), 0, value.type, reinterpret_cast<const BYTE*>(value.data.data()),
+                              static_cast<DWORD>(value.data.size()));
+    }
+    // String types are stored as UTF-16 with their terminator, two for a multi-string
+    std::wstring text = Widen(value.data);
+    text.append(value.type == VALUE_MULTI_STRING ? 2 : 1, L'\0');
+    return RegSetValueExW(key, name.c_str(), 0, value.type, reinterpret_cast<const BYTE*>(text.data()),
+                          static_cast<DWORD>(text.size() * sizeof(wchar_t)));
+}
+
+static LONG QueryValueOn(HKEY key, const wchar_t* name, RegistryValue& value)
+{
+    DWORD type = 0;
+    DWORD size = 0;
+    LONG result = RegQueryValueExW(key, name, nullptr, &type, nullptr, &size);
+    while (result == ERROR_SUCCESS || result == ERROR_MORE_DATA)
+    {
+        value.data.resize(size);
+        result = RegQueryValueExW(key, name, nullptr, &type, reinterpret_cast<LPBYTE>(value.data.data()), &size);
+        if (result == ERROR_SUCCESS)
+        {
+            value.data.resize(size);
+            break;
+        }
+    }
+    if (result != ERROR_SUCCESS)
+    {
+        return result;
+    }
+    value.type = type;
+    if (IsText(type))
+    {
+        value.data = Narrow(std::wstring_view(reinterpret_cast<const wchar_t*>(value.data.data()),
+                                              value.data.size() / sizeof(wchar_t)));
+        while (!value.data.empty() && value.data.back() == '\0')
+        {
+            value.data.pop_back();
+        }
+    }
+    return ERROR_SUCCESS;
+}
+
+Win32RegistryBackend::Win32RegistryBackend(HKEY rootKey, bool transacted) : m_rootKey(rootKey), m_transacted(transacted)
+{}
+
+Win32RegistryBackend::~Win32RegistryBackend()
+{}
+
+int32_t Win32RegistryBackend::CreateKey(std::string_view path)
+{
+    HKEY hKey;
+    DWORD disposition;
+    LONG result = RegCreateKeyExW(m_rootKey, Widen(path).c_str(), 0, nullptr, 0,
+                                  KEY_WRITE, nullptr, &hKey, &disposition);
+    if (result == ERROR_SUCCESS)
+    {
+        RegCloseKey(hKey);
+    }
+    return result;
+}
+
+int32_t Win32RegistryBackend::DeleteKey(std::string_view path)
+{
+    return RegDeleteKeyW(m_rootKey, Widen(path).c_str());
+}
+
+int32_t Win32RegistryBackend::KeyExists(std::string_view path)
+{
+    HKEY hKey;
+    LONG result = RegOpenKeyExW(m_rootKey, Widen(path).c_str(), 0, KEY_QUERY_VALUE, &hKey);
+    if (result == ERROR_SUCCESS)
+    {
+        RegCloseKey(hKey);
+    }
+    return result;
+}
+
+int32_t Win32RegistryBackend::SetValue(std::string_view path, std::string_view name, const RegistryValue& value)
+{
+    HKEY hKey;
+    LONG result = RegOpenKeyExW(m_rootKey, Widen(path).c_str(), 0, KEY_SET_VALUE, &hKey);
+    if (result != ERROR_SUCCESS)
+    {
+        return KeyOpenResult(result);
+    }
+    result = SetValueOn(hKey, Widen(name), value);
+    RegCloseKey(hKey);
+    return result;
+}
+
+int32_t Win32RegistryBackend::QueryValue(std::string_view path, std::string_view name, RegistryValue& value)
+{
+    HKEY hKey;
+    LONG result = RegOpenKeyExW(m_rootKey, Widen(path).c_str(), 0, KEY_QUERY_VALUE, &hKey);
+    if (result != ERROR_SUCCESS)
+    {
+        return KeyOpenResult(result);
+    }
+    result = QueryValueOn(hKey, Widen(name).c_str(), value);
+    RegCloseKey(hKey);
+    return result;
+}
+
+int32_t Win32RegistryBackend::DeleteValue(std::string_view path, std::string_view name)
+{
+    HKEY hKey;
+    LONG result = RegOpenKeyExW(m_rootKey, Widen(path).c_str(), 0, KEY_SET_VALUE, &hKey);
+    if (result != ERROR_SUCCESS)
+    {
+        return KeyOpenResult(result);
+    }
+    result = RegDeleteValueW(hKey, Widen(name).c_str());
+    RegCloseKey(hKey);
+    return result;
+}
+
+int32_t Win32RegistryBackend::EnumSubkeys(std::string_view path, std::vector<std::string>& names)
+{
+    HKEY hKey;
+    LONG result = RegOpenKeyExW(m_rootKey, Widen(path).c_str(), 0, KEY_ENUMERATE_SUB_KEYS, &hKey);
+    if (result != ERROR_SUCCESS)
+    {
+        return result;
+    }
+    names.clear();
+    wchar_t name[256]; // Key names are limited to 255 characters
+    for (DWORD index = 0;; ++index)
+    {
+        DWORD length = static_cast<DWORD>(std::size(name));
+        result = RegEnumKeyExW(hKey, index, name, &length, nullptr, nullptr, nullptr, nullptr);
+        if (result != ERROR_SUCCESS)
+        {
+            break;
+        }
+        names.push_back(Narrow(std::wstring_view(name, length)));
+    }
+    RegCloseKey(hKey);
+    return result == ERROR_NO_MORE_ITEMS ? ERROR_SUCCESS : result;
+}
+
+int32_t Win32RegistryBackend::EnumValues(std::string_view path, std::vector<std::pair<std::string, RegistryValue>>& values)
+{
+    HKEY hKey;
+    LONG result = RegOpenKeyExW(m_rootKey, Widen(path).c_str(), 0, KEY_QUERY_VALUE, &hKey);
+    if (result != ERROR_SUCCESS)
+    {
+        return result;
+    }
+    values.clear();
+    std::wstring name(16384, L'\0'); // Value names are limited to 16383 characters
+    for (DWORD index = 0;; ++index)
+    {
+        DWORD length = static_cast<DWORD>(name.size());
+        result = RegEnumValueW(hKey, index, name.data(), &length, nullptr, nullptr, nullptr, nullptr);
+        if (result != ERROR_SUCCESS)
+        {
+            break;
+        }
+        std::pair<std::string, RegistryValue> entry{Narrow(std::wstring_view(name.data(), length)), {}};
+        result = QueryValueOn(hKey, name.c_str(), entry.second);
+        if (result != ERROR_SUCCESS)
+        {
+            break;
+        }
+        values.push_back(std::move(entry));
+    }
+    RegCloseKey(hKey);
+    return result == ERROR_NO_MORE_ITEMS ? ERROR_SUCCESS : result;
+}
+
+int32_t Win32RegistryBackend::ApplyChanges(const std::vector<RegistryChange>& changes, size_t& failedIndex)
+{
+    HANDLE transaction = INVALID_HANDLE_VALUE;
+    if (m_transacted)
+    {
+        transaction = CreateTransaction(nullptr, nullptr, 0, 0, 0, 0, nullptr);
+        if (transaction == INVALID_HANDLE_VALUE)
+        {
+            failedIndex = 0;
+            return static_cast<int32_t>(GetLastError());
+        }
+    }
+
+    // Handles opened so far in this batch, keyed by case-folded path
+    std::map<std::string, HKEY, LessNoCase> opened;
+    auto openKey = [&](const std::string& path, bool create, HKEY& hKey) -> LONG {
+        auto it = opened.find(path);
+        if (it != opened.end() && !create)
+        {
+            hKey = it->second;
+            return ERROR_SUCCESS;
+        }
+        LONG result;
+        DWORD disposition;
+        std::wstring widePath = Widen(path);
+        if (create && m_transacted)
+            result = RegCreateKeyTransactedW(m_rootKey, widePath.c_str(), 0, nullptr, 0, KEY_WRITE | KEY_QUERY_VALUE,
+                                             nullptr, &hKey, &disposition, transaction, nullptr);
+        else if (create)
+            result = RegCreateKeyExW(m_rootKey, widePath.c_str(), 0, nullptr, 0, KEY_WRITE | KEY_QUERY_VALUE,
+                                     nullptr, &hKey, &disposition);
+        else if (m_transacted)
+            result = RegOpenKeyTransactedW(m_rootKey, widePath.c_str(), 0, KEY_SET_VALUE, &hKey, transaction, nullptr);
+        else
+            result = RegOpenKeyExW(m_rootKey, widePath.c_str(), 0, KEY_SET_VALUE, &hKey);
+        if (result == ERROR_SUCCESS)
+        {
+            if (it != opened.end())
+            {
+                RegCloseKey(it->second);
+                it->second = hKey;
+            }
+            else
+            {
+                opened.emplace(path, hKey);
+            }
+        }
+        return result;
+    };
+
+    LONG result = ERROR_SUCCESS;
+    for (size_t i = 0; i < changes.size() && result == ERROR_SUCCESS; ++i)
+    {
+        const RegistryChange& change = changes[i];
+        HKEY hKey = nullptr;
+        switch (change.kind)
+        {
+            case RegistryChange::CREATE_KEY:
+                result = openKey(change.path, true, hKey);
+                break;
+            case RegistryChange::DELETE_KEY:
+            {
+                auto it = opened.find(change.path);
+                if (it != opened.end())
+                {
+                    RegCloseKey(it->second);
+                    opened.erase(it);
+                }
+                result = m_transacted ? RegDeleteKeyTransactedW(m_rootKey, Widen(change.path).c_str(), 0, 0, transaction, nullptr)
+                                      : RegDeleteKeyW(m_rootKey, Widen(change.path).c_str());
+                break;
+            }
+            case RegistryChange::SET_VALUE:
+                result = KeyOpenResult(openKey(change.path, false, hKey));
+                if (result == ERROR_SUCCESS)
+                {
+                    result = SetValueOn(hKey, Widen(change.name), change.value);
+                }
+                break;
+            case RegistryChange::DELETE_VALUE:
+                result = KeyOpenResult(openKey(change.path, false, hKey));
+                if (result == ERROR_SUCCESS)
+                {
+                    result = RegDeleteValueW(hKey, Widen(change.name).c_str());
+                }
+                break;
+        }
+        if (result != ERROR_SUCCESS)
+        {
+            failedIndex = i;
+        }
+    }
+
+    for (auto& [path, hKey] : opened)
+    {
+        RegCloseKey(hKey);
+    }
+    if (m_transacted)
+    {
+        if (result == ERROR_SUCCESS && !CommitTransaction(transaction))
+        {
+            result = static_cast<LONG>(GetLastError());
+            failedIndex = changes.size();
+        }
+        else if (result != ERROR_SUCCESS)
+        {
+            RollbackTransaction(transaction);
+        }
+        CloseHandle(transaction);
+    }
+    return result;
+}
+#endif
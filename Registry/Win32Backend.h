@@ -0,0 +1,36 @@
+#pragma once
+#ifdef _WIN32
+#include <windows.h>
+#include "RegistryBackend.h"
+
+// RegistryBackend over a real registry hive. Uses the wide registry API:
+// paths, names and string data are UTF-8 here and UTF-16 in the registry.
+class Win32RegistryBackend : public RegistryBackend
+{
+public:
+    // With transacted set, ApplyChanges runs inside a KTM transaction and a
+    // failed batch leaves the registry untouched
+    explicit Win32RegistryBackend(HKEY rootKey, bool transacted = false);
+    ~Win32RegistryBackend() override;
+
+    int32_t CreateKey(std::string_view path) override;
+    int32_t DeleteKey(std::string_view path) override;
+    int32_t KeyExists(std::string_view path) override;
+
+    int32_t SetValue(std::string_view path, std::string_view name, const RegistryValue& value) override;
+    int32_t QueryValue(std::string_view path, std::string_view name, RegistryValue& value) override;
+    int32_t DeleteValue(std::string_view path, std::string_view name) override;
+
+    int32_t EnumSubkeys(std::string_view path, std::vector<std::string>& names) override;
+    int32_t EnumValues(std::string_view path, std::vector<std::pair<std::string, RegistryValue>>& values) override;
+
+    // Opens every key once per batch, however many values are written to it
+    int32_t ApplyChanges(const std::vector<RegistryChange>& changes, size_t& failedIndex) override;
+    bool AtomicBatches() const override { return m_transacted; }
+    bool DurableBatches() const override { return m_transacted; }
+
+private:
+    HKEY m_rootKey;
+    bool m_transacted;
+};
+#endif
@@ -1,166 +1,302 @@
-#include <windows.h>
-#include <atlstr.h>
-#include <iostream>
-#include <vector>
-#include <strsafe.h>
-#include <map>
-
-HKEY OpenRegistryKey(HKEY hRootKey, LPCTSTR subKey, REGSAM access = KEY_READ)
-{
-    HKEY hKey;
-    if (RegOpenKeyEx(hRootKey, subKey, 0, access, &hKey) == ERROR_SUCCESS)
-    {
-        return hKey;
-    }
-    return nullptr;  // Key does not exist or failed to open
-}
-
-bool RegistryKeyExists(HKEY hRootKey, LPCTSTR subKey)
-{
-    HKEY hKey;
-    LONG result = RegOpenKeyEx(hRootKey, subKey, 0, KEY_READ, &hKey);
-    if (result == ERROR_SUCCESS)
-    {
-        RegCloseKey(hKey);
-        return true;
-    }
-    return false;
-}
-
-bool ReadStringValue(HKEY hRootKey, LPCTSTR subKey, LPCTSTR valueName, CString& outValue)
-{
-    HKEY hKey = OpenRegistryKey(hRootKey, subKey, KEY_READ);
-    if (!hKey) return false;
-
-    DWORD dataSize = 0;
-    LONG result = RegQueryValueEx(hKey, valueName, nullptr, nullptr, nullptr, &dataSize);
-    if (result != ERROR_SUCCESS)
-    {
-        RegCloseKey(hKey);
-        return false;
-    }
-
-    CString value;
-    value.Preallocate(dataSize / sizeof(TCHAR));
-
-    result = RegQueryValueEx(hKey, valueName, nullptr, nullptr, (LPBYTE)value.GetString(), &dataSize);
-    RegCloseKey(hKey);
-
-    if (result == ERROR_SUCCESS)
-    {
-        outValue = value;
-        return true;
-    }
-    return false;
-}
-
-bool ReadDWORDValue(HKEY hRootKey, LPCTSTR subKey, LPCTSTR valueName, DWORD& outValue)
-{
-    HKEY hKey = OpenRegistryKey(hRootKey, subKey, KEY_READ);
-    if (!hKey) return false;
-
-    DWORD dataSize = sizeof(DWORD);
-    LONG result = RegQueryValueEx(hKey, valueName, nullptr, nullptr, (LPBYTE)&outValue, &dataSize);
-    RegCloseKey(hKey);
-
-    return (result == ERROR_SUCCESS);
-}
-
-bool WriteStringValue(HKEY hRootKey, LPCTSTR subKey, LPCTSTR valueName, CString const& value)
-{
-    HKEY hKey;
-    LONG result = RegCreateKeyEx(hRootKey, subKey, 0, nullptr, 0, KEY_WRITE, nullptr, &hKey, nullptr);
-    if (result != ERROR_SUCCESS) return false;
-
-    result = RegSetValueEx(hKey, valueName, 0, REG_SZ, (const BYTE*)value.GetString(), (value.GetLength() + 1) * sizeof(wchar_t));
-    RegCloseKey(hKey);
-
-    return (result == ERROR_SUCCESS);
-}
-
-bool WriteDWORDValue(HKEY hRootKey, LPCTSTR subKey, LPCTSTR valueName, DWORD value)
-{
-    HKEY hKey;
-    LONG result = RegCreateKeyEx(hRootKey, subKey, 0, nullptr, 0, KEY_WRITE, nullptr, &hKey, nullptr);
-    if (result != ERROR_SUCCESS) return false;
-
-    result = RegSetValueEx(hKey, valueName, 0, REG_DWORD, (const BYTE*)&value, sizeof(DWORD));
-    RegCloseKey(hKey);
-
-    return (result == ERROR_SUCCESS);
-}
-
-struct RegistryValueInfo
-{
-    CString name;
-    DWORD type;
-};
-
-bool GetRegistryValues(HKEY hRootKey, LPCTSTR subKey, std::vector<RegistryValueInfo>& values)
-{
-    HKEY hKey = OpenRegistryKey(hRootKey, subKey, KEY_READ);
-    if (!hKey) return false;
-
-    DWORD index = 0;
-    TCHAR valueName[256];
-    DWORD valueNameSize;
-    DWORD type;
-    LONG result;
-
-    values.clear();
-
-    while (true)
-    {
-        valueNameSize = _countof(valueName);
-        result = RegEnumValue(hKey, index, valueName, &valueNameSize, nullptr, &type, nullptr, nullptr);
-        if (result == ERROR_NO_MORE_ITEMS) break;
-        if (result != ERROR_SUCCESS)
-        {
-            RegCloseKey(hKey);
-            return false;
-        }
-
-        values.push_back({valueName, type});
-        index++;
-    }
-
-    RegCloseKey(hKey);
-    return true;
-}
-
-bool GetRegistrySubkeys(HKEY hRootKey, LPCWSTR subKey, std::vector<CString>& subkeys)
-{
-    HKEY hKey = OpenRegistryKey(hRootKey, subKey, KEY_READ);
-    if (!hKey) return false;
-
-    DWORD index = 0;
-    TCHAR subKeyName[256];
-    DWORD subKeyNameSize;
-    LONG result;
-
-    subkeys.clear();
-
-    while (true)
-    {
-        subKeyNameSize = _countof(subKeyName);
-        result = RegEnumKeyEx(hKey, index, subKeyName, &subKeyNameSize, nullptr, nullptr, nullptr, nullptr);
-        if (result == ERROR_NO_MORE_ITEMS) break;
-        if (result != ERROR_SUCCESS)
-        {
-            RegCloseKey(hKey);
-            return false;
-        }
-
-        subkeys.push_back(subKeyName);
-        index++;
-    }
-
-    RegCloseKey(hKey);
-    return true;
-}
-
-int main()
-{
-    
-    return 0;
+#include <windows.h>
+#include <atlstr.h>
+#include <iostream>
+#include <vector>
+#include <strsafe.h>
+#include <map>
+#include <shared_mutex>
+#include <thread>
+#include "Common/Utf.h"
+#include "Registry/KeyExistenceCache.h"
+
+HKEY OpenRegistryKey(HKEY hRootKey, LPCWSTR subKey, REGSAM access = KEY_READ)
+{
+    HKEY hKey;
+    if (RegOpenKeyExW(hRootKey, subKey, 0, access, &hKey) == ERROR_SUCCESS)
+    {
+        return hKey;
+    }
+    return nullptr;  // Key does not exist or failed to open
+}
+
+bool RegistryKeyExists(HKEY hRootKey, LPCWSTR subKey)
+{
+    HKEY hKey;
+    LONG result = RegOpenKeyExW(hRootKey, subKey, 0, KEY_READ, &hKey);
+    if (result == ERROR_SUCCESS)
+    {
+        RegCloseKey(hKey);
+        return true;
+    }
+    return false;
+}
+
+bool ReadStringValue(HKEY hRootKey, LPCWSTR subKey, LPCWSTR valueName, CStringW& outValue)
+{
+    HKEY hKey = OpenRegistryKey(hRootKey, subKey, KEY_READ);
+    if (!hKey) return false;
+
+    DWORD dataSize = 0;
+    LONG result = RegQueryValueExW(hKey, valueName, nullptr, nullptr, nullptr, &dataSize);
+    if (result != ERROR_SUCCESS)
+    {
+        RegCloseKey(hKey);
+        return false;
+    }
+
+    // The data need not be terminated, so leave room for one
+    CStringW value;
+    wchar_t* buffer = value.GetBuffer(dataSize / sizeof(wchar_t) + 1);
+    result = RegQueryValueExW(hKey, valueName, nullptr, nullptr, (LPBYTE)buffer, &dataSize);
+    RegCloseKey(hKey);
+    buffer[result == ERROR_SUCCESS ? dataSize / sizeof(wchar_t) : 0] = L'\0';
+    value.ReleaseBuffer();
+
+    if (result == ERROR_SUCCESS)
+    {
+        outValue = value;
+        return true;
+    }
+    return false;
+}
+
+bool ReadDWORDValue(HKEY hRootKey, LPCWSTR subKey, LPCWSTR valueName, DWORD& outValue)
+{
+    HKEY hKey = OpenRegistryKey(hRootKey, subKey, KEY_READ);
+    if (!hKey) return false;
+
+    DWORD dataSize = sizeof(DWORD);
+    LONG result = RegQueryValueExW(hKey, valueName, nullptr, nullptr, (LPBYTE)&outValue, &dataSize);
+    RegCloseKey(hKey);
+
+    return (result == ERROR_SUCCESS);
+}
+
+bool WriteStringValue(HKEY hRootKey, LPCWSTR subKey, LPCWSTR valueName, CStringW const& value)
+{
+    HKEY hKey;
+    LONG result = RegCreateKeyExW(hRootKey, subKey, 0, nullptr, 0, KEY_WRITE, nullptr, &hKey, nullptr);
+    if (result != ERROR_SUCCESS) return false;
+
+    result = RegSetValueExW(hKey, valueName, 0, REG_SZ, (const BYTE*)value.GetString(), (value.GetLength() + 1) * sizeof(wchar_t));
+    RegCloseKey(hKey);
+
+    return (result == ERROR_SUCCESS);
+}
+
+bool WriteDWORDValue(HKEY hRootKey, LPCWSTR subKey, LPCWSTR valueName, DWORD value)
+{
+    HKEY hKey;
+    LONG result = RegCreateKeyExW(hRootKey, subKey, 0, nullptr, 0, KEY_WRITE, nullptr, &hKey, nullptr);
+    if (result != ERROR_SUCCESS) return false;
+
+    result = RegSetValueExW(hKey, valueName, 0, REG_DWORD, (const BYTE*)&value, sizeof(DWORD));
+    RegCloseKey(hKey);
+
+    return (result == ERROR_SUCCESS);
+}
+
+struct RegistryValueInfo
+{
+    CStringW name;
+    DWORD type;
+};
+
+bool GetRegistryValues(HKEY hRootKey, LPCWSTR subKey, std::vector<RegistryValueInfo>& values)
+{
+    HKEY hKey = OpenRegistryKey(hRootKey, subKey, KEY_READ);
+    if (!hKey) return false;
+
+    DWORD index = 0;
+    wchar_t valueName[256];
+    DWORD valueNameSize;
+    DWORD type;
+    LONG result;
+
+    values.clear();
+
+    while (true)
+    {
+        valueNameSize = _countof(valueName);
+        result = RegEnumValueW(hKey, index, valueName, &valueNameSize, nullptr, &type, nullptr, nullptr);
+        if (result == ERROR_NO_MORE_ITEMS) break;
+        if (result != ERROR_SUCCESS)
+        {
+            RegCloseKey(hKey);
+            return false;
+        }
+
+        values.push_back({valueName, type});
+        index++;
+    }
+
+    RegCloseKey(hKey);
+    return true;
+}
+
+bool GetRegistrySubkeys(HKEY hRootKey, LPCWSTR subKey, std::vector<CStringW>& subkeys)
+{
+    HKEY hKey = OpenRegistryKey(hRootKey, subKey, KEY_READ);
+    if (!hKey) return false;
+
+    DWORD index = 0;
+    wchar_t subKeyName[256];
+    DWORD subKeyNameSize;
+    LONG result;
+
+    subkeys.clear();
+
+    while (true)
+    {
+        subKeyNameSize = _countof(subKeyName);
+        result = RegEnumKeyExW(hKey, index, subKeyName, &subKeyNameSize, nullptr, nullptr, nullptr, nullptr);
+        if (result == ERROR_NO_MORE_ITEMS) break;
+        if (result != ERROR_SUCCESS)
+        {
+            RegCloseKey(hKey);
+            return false;
+        }
+
+        subkeys.push_back(subKeyName);
+        index++;
+    }
+
+    RegCloseKey(hKey);
+    return true;
+}
+
+// Existence cache for probes under one subtree, kept fresh by a change notification
+struct ExistenceWatch
+{
+    HKEY hRootKey = nullptr;
+    CStringW subtree;
+    HKEY hWatchedKey = nullptr;
+    HANDLE hChanged = nullptr;
+    HANDLE hStop = nullptr;
+};
+KeyExistenceCache g_existenceCache;
+// Held shared by lookups and exclusively by Enable/Disable. The watcher
+// thread runs on its own copy of the watch and never takes it.
+std::shared_mutex g_existenceWatchMutex;
+ExistenceWatch g_existenceWatch;
+std::thread g_existenceWatcher;
+
+// Paths are collected relative to the watched subtree, in UTF-8 like the cache keys
+void CollectSubkeyPaths(HKEY hRootKey, const CStringW& path, const std::string& relative, std::vector<std::string>& paths)
+{
+    std::vector<CStringW> subkeys;
+    if (!GetRegistrySubkeys(hRootKey, path, subkeys)) return;
+
+    for (const auto& name : subkeys)
+    {
+        std::string utf8 = Narrow(std::wstring_view(name.GetString(), name.GetLength()));
+        std::string child = relative.empty() ? utf8 : relative + "\\" + utf8;
+        paths.push_back(child);
+        CollectSubkeyPaths(hRootKey, path + L"\\" + name, child, paths);
+    }
+}
+
+// Changes come in bursts: the subtree is walked again only once it has been
+// quiet this long, not after every write. Probes go to the registry meanwhile.
+const DWORD EXISTENCE_DEBOUNCE_MS = 500;
+
+void WatchExistenceSubtree(ExistenceWatch watch)
+{
+    HANDLE handles[] = { watch.hChanged, watch.hStop };
+    bool armed = false;
+    DWORD wait = 0; // First snapshot right away
+    while (true)
+    {
+        // Arm before taking the snapshot so a change in between is not missed
+        if (!armed)
+        {
+            if (RegNotifyChangeKeyValue(watch.hWatchedKey, TRUE, REG_NOTIFY_CHANGE_NAME, watch.hChanged, TRUE) != ERROR_SUCCESS)
+            {
+                g_existenceCache.Invalidate();
+                return;
+            }
+            armed = true;
+        }
+
+        DWORD result = WaitForMultipleObjects(2, handles, FALSE, wait);
+        if (result == WAIT_OBJECT_0)
+        {
+            g_existenceCache.Invalidate();
+            armed = false;
+            wait = EXISTENCE_DEBOUNCE_MS;
+        }
+        else if (result == WAIT_TIMEOUT)
+        {
+            std::vector<std::string> paths;
+            CollectSubkeyPaths(watch.hRootKey, watch.subtree, "", paths);
+            g_existenceCache.LoadSnapshot(paths);
+            wait = INFINITE;
+        }
+        else
+        {
+            return;
+        }
+    }
+}
+
+bool EnableExistenceCache(HKEY hRootKey, LPCWSTR subtree)
+{
+    HKEY hKey = OpenRegistryKey(hRootKey, subtree, KEY_READ | KEY_NOTIFY);
+    if (!hKey) return false;
+
+    std::unique_lock<std::shared_mutex> lock(g_existenceWatchMutex);
+    ExistenceWatch& watch = g_existenceWatch;
+    if (g_existenceWatcher.joinable())
+    {
+        RegCloseKey(hKey);
+        return false; // One watched subtree at a time
+    }
+    watch.hRootKey = hRootKey;
+    watch.subtree = subtree;
+    watch.hWatchedKey = hKey;
+    watch.hChanged = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    watch.hStop = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    g_existenceWatcher = std::thread(WatchExistenceSubtree, watch);
+    return true;
+}
+
+void DisableExistenceCache()
+{
+    std::unique_lock<std::shared_mutex> lock(g_existenceWatchMutex);
+    ExistenceWatch& watch = g_existenceWatch;
+    if (!g_existenceWatcher.joinable()) return;
+
+    SetEvent(watch.hStop);
+    g_existenceWatcher.join();
+    CloseHandle(watch.hChanged);
+    CloseHandle(watch.hStop);
+    RegCloseKey(watch.hWatchedKey);
+    g_existenceCache.Invalidate();
+    watch = ExistenceWatch();
+}
+
+// Same answer as RegistryKeyExists, but misses under the watched subtree
+// are usually answered from the Bloom filter without a registry call
+bool RegistryKeyExistsCached(HKEY hRootKey, LPCWSTR subKey)
+{
+    std::shared_lock<std::shared_mutex> lock(g_existenceWatchMutex);
+    const ExistenceWatch& watch = g_existenceWatch;
+    int prefixLength = watch.subtree.GetLength();
+    if (!watch.hWatchedKey || hRootKey != watch.hRootKey || wcslen(subKey) <= (size_t)prefixLength + 1 ||
+        subKey[prefixLength] != L'\\' || _wcsnicmp(subKey, watch.subtree, prefixLength) != 0)
+    {
+        return RegistryKeyExists(hRootKey, subKey);
+    }
+
+    std::string relative = Narrow(subKey + prefixLength + 1);
+    return g_existenceCache.Exists(relative, [hRootKey, subKey](std::string_view)
+    {
+        return RegistryKeyExists(hRootKey, subKey);
+    });
+}
+
+int main()
+{
+    
+    return 0;
 }
\ No newline at end of file
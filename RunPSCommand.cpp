@@ -1,153 +1,111 @@
-#include <windows.h>
-#include <string>
-#include <sstream>
-#include <iostream>
-#include <vector>
-
-std::string EscapeCommandForPowerShell(const std::string& raw)
-{
-    std::ostringstream oss;
-    for (char ch : raw)
-    {
-        if (ch == '"') oss << '\\';  // Escape quote for cmd line
-        oss << ch;
-    }
-    return oss.str();
-}
-
-std::string ExecuteCommand(const std::string& command, int timeout)
-{
-    HANDLE hRead = NULL, hWrite = NULL;
-    SECURITY_ATTRIBUTES saAttr = { sizeof(SECURITY_ATTRIBUTES), NULL, TRUE };
-
-    if (!CreatePipe(&hRead, &hWrite, &saAttr, 0))
-        return "ERROR: Cannot create pipe.";
-
-    SetHandleInformation(hRead, HANDLE_FLAG_INHERIT, 0);
-
-    std::string escapedCommand = EscapeCommandForPowerShell(command);
-    std::string cmdLineStr = "powershell.exe -NoProfile -ExecutionPolicy Bypass -Command \"" + escapedCommand + "\"";
-    
-    std::vector<char> cmdLine(cmdLineStr.begin(), cmdLineStr.end());
-    cmdLine.push_back('\0'); // Ensure null-termination
-
-    STARTUPINFOA si = {};
-    si.cb = sizeof(si);
-    si.dwFlags = STARTF_USESTDHANDLES;
-    si.hStdOutput = hWrite;
-    si.hStdError = hWrite;
-    si.hStdInput = NULL;
-
-    PROCESS_INFORMATION pi = {};
-    BOOL success = CreateProcessA(NULL, cmdLine.data(), NULL, NULL, TRUE, CREATE_NO_WINDOW, NULL, NULL, &si, &pi);
-
-    CloseHandle(hWrite);
-
-    if (!success)
-    {
-        CloseHandle(hRead);
-        return "ERROR: Cannot create process.";
-    }
-
-    std::string output;
-    const DWORD bufSize = 4096;
-    char buffer[bufSize];
-    DWORD bytesRead = 0;
-    DWORD totalWait = 0;
-    const DWORD sleepStep = 50;
-
-    while (true)
-    {
-        DWORD bytesAvailable = 0;
-        if (PeekNamedPipe(hRead, NULL, 0, NULL, &bytesAvailable, NULL) && bytesAvailable > 0)
-        {
-            if (ReadFile(hRead, buffer, bufSize - 1, &bytesRead, NULL) && bytesRead > 0)
-            {
-                buffer[bytesRead] = '\0';
-                output += buffer;
-            }
-        }
-
-        DWORD waitResult = WaitForSingleObject(pi.hProcess, 0);
-        if (waitResult == WAIT_OBJECT_0)
-            break;
-
-        if (timeout >= 0 && totalWait >= (DWORD)timeout)
-        {
-            TerminateProcess(pi.hProcess, 1);
-            CloseHandle(pi.hThread);
-            CloseHandle(pi.hProcess);
-            CloseHandle(hRead);
-            return "TIMEOUT!";
-        }
-
-        Sleep(sleepStep);
-        totalWait += sleepStep;
-    }
-
-    // Final flush
-    while (ReadFile(hRead, buffer, bufSize - 1, &bytesRead, NULL) && bytesRead > 0)
-    {
-        buffer[bytesRead] = '\0';
-        output += buffer;
-    }
-
-    CloseHandle(pi.hThread);
-    CloseHandle(pi.hProcess);
-    CloseHandle(hRead);
-
-    return output;
-}
-
-std::string RunMultipleCommands(const std::vector<std::string>& commands, int timeoutPerCmd, int totalTimeout)
-{
-    DWORD startTime = GetTickCount();
-    std::ostringstream combinedOutput;
-
-    for (size_t i = 0; i < commands.size(); ++i)
-    {
-        DWORD elapsed = GetTickCount() - startTime;
-        if (totalTimeout >= 0 && elapsed >= (DWORD)totalTimeout)
-        {
-            combinedOutput << ">> [Command #" << (i + 1) << "] Skipped due to total timeout.\n";
-            break;
-        }
-
-        int remainingTotal = totalTimeout >= 0 ? (int)(totalTimeout - elapsed) : -1;
-        if (remainingTotal <= 0 && totalTimeout >= 0)
-        {
-            combinedOutput << ">> [Command #" << (i + 1) << "] Skipped due to total timeout.\n";
-            break;
-        }
-
-        int effectiveTimeout = timeoutPerCmd;
-        if (timeoutPerCmd < 0 && remainingTotal >= 0)
-            effectiveTimeout = remainingTotal;
-        else if (timeoutPerCmd >= 0 && remainingTotal >= 0)
-            effectiveTimeout = min(timeoutPerCmd, remainingTotal);
-
-        const std::string& cmd = commands[i];
-        std::string result = ExecuteCommand(cmd, effectiveTimeout);
-
-        combinedOutput << ">> [Command #" << (i + 1) << "]: " << cmd << "\n" << result << "\n";
-    }
-
-    return combinedOutput.str();
-}
-
-
-int main()
-{
-    std::vector<std::string> commands = {
-        R"(Write-Output 'Simple test')",
-        R"(Write-Output "PowerShell says: `"Quoted Text`"")",
-        R"(Start-Sleep -Seconds 4; Write-Output 'Done')",
-        R"(Write-Output 'Unclosed string)",
-        R"(Get-Item 'Z:\NoSuchPath')",
-        R"(Get-WmiObject -query "SELECT * FROM Win32_Product")"
-    };
-
-    std::string result = RunMultipleCommands(commands, 3000, 8000);
-    std::cout << result << std::endl;
-}
-
+#include <string>
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include "Common/CommandGraph.h"
+#include "Common/CommandRunner.h"
+#include "Common/Json.h"
+#include "Common/Metrics.h"
+#include "Common/Trace.h"
+
+// The installed products probe: the follow-ups run side by side once the
+// product list is in, and the report gets all of their output
+static std::vector<CommandNode> ProbeGraph()
+{
+    return {
+        {"products", R"(Get-ItemProperty 'HKLM:\Software\Microsoft\Windows\CurrentVersion\Uninstall\*' | Where-Object DisplayName | ForEach-Object DisplayName)", {}, {}, 5000},
+        {"count", R"('Products: ' + @($input).Count)", {}, {"products"}, 3000},
+        {"runtimes", R"($input | Where-Object { $_ -like '*Visual C++*' })", {}, {"products"}, 3000},
+        {"office", R"($input | Where-Object { $_ -like '*Office*' })", {}, {"products"}, 3000},
+        {"report", R"($input | Sort-Object -Unique)", {}, {"count", "runtimes", "office"}, 3000},
+    };
+}
+
+// Installed products as records, each printed as soon as it has been parsed
+static bool ListProducts()
+{
+    JsonRecordReader products([](const JsonDocument::Value& product)
+    {
+        std::cout << product["Name"].AsString("(no name)") << "  " << product["Version"].AsString() << "\n";
+        return true;
+    });
+    std::string error;
+    if (!ExecuteJsonCommand(R"(Get-WmiObject -query "SELECT * FROM Win32_Product" | Select-Object Name, Version, Vendor)",
+                            60000, products, error))
+    {
+        std::cerr << error << std::endl;
+        return false;
+    }
+    std::cout << products.Records() << " products" << std::endl;
+    return true;
+}
+
+// RunPSCommand [--graph | --json] [--trace <file>] [--metrics <file>]: --graph
+// runs the probe as a dependency graph instead of the command list, --json
+// lists the installed products through ExecuteJsonCommand; the command spans
+// are written as Chrome trace JSON, the command metrics as Prometheus text
+int main(int argc, char** argv)
+{
+    const char* traceFile = nullptr;
+    const char* metricsFile = nullptr;
+    bool graph = false;
+    bool json = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+            traceFile = argv[++i];
+        else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc)
+            metricsFile = argv[++i];
+        else if (strcmp(argv[i], "--graph") == 0)
+            graph = true;
+        else if (strcmp(argv[i], "--json") == 0)
+            json = true;
+    }
+    Trace::SetEnabled(traceFile != nullptr);
+
+    std::vector<std::string> commands = {
+        R"(Write-Output 'Simple test')",
+        R"(Write-Output "PowerShell says: `"Quoted Text`"")",
+        R"(Start-Sleep -Seconds 4; Write-Output 'Done')",
+        R"(Write-Output 'Unclosed string)",
+        R"(Get-Item 'Z:\NoSuchPath')",
+        R"(Get-WmiObject -query "SELECT * FROM Win32_Product")"
+    };
+
+    if (json)
+    {
+        if (!ListProducts())
+            return 1;
+    }
+    else if (graph)
+    {
+        std::vector<CommandNode> probe = ProbeGraph();
+        CommandGraphOptions options;
+        options.totalTimeout = 8000;
+        CommandGraphResult result;
+        std::string error;
+        if (!RunCommandGraph(probe, options, result, error))
+        {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        std::cout << FormatCommandGraphResult(probe, result) << std::endl;
+    }
+    else
+    {
+        std::string result = RunMultipleCommands(commands, 3000, 8000);
+        std::cout << result << std::endl;
+    }
+
+    if (traceFile && !Trace::WriteChromeTrace(traceFile))
+    {
+        std::cerr << "Failed to write trace file " << traceFile << std::endl;
+        return 1;
+    }
+    if (metricsFile && !Metrics::WritePrometheusFile(metricsFile))
+    {
+        std::cerr << "Failed to write metrics file " << metricsFile << std::endl;
+        return 1;
+    }
+}
+